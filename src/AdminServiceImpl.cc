@@ -0,0 +1,99 @@
+#include "AdminServiceImpl.h"
+
+#include "utils/HeapProfiler.h"
+#include "utils/Metrics.h"
+
+#include <absl/log/log.h>
+#include <grpcpp/server_context.h>
+#include <grpcpp/support/server_callback.h>
+
+#include <format>
+#include <string>
+
+namespace
+{
+
+// Checks whether the peer address, e.g. "ipv4:127.0.0.1:50000", belongs to the same host
+bool isLocalPeer(const std::string& peer)
+{
+   return peer.starts_with("ipv4:127.") || peer.starts_with("ipv6:[::1]") || peer.starts_with("unix:");
+}
+
+}  // namespace
+
+namespace geo
+{
+
+AdminServiceImpl::AdminServiceImpl(bool heapProfilingEnabled)
+   : m_heapProfilingEnabled(heapProfilingEnabled)
+{
+}
+
+grpc::ServerUnaryReactor* AdminServiceImpl::GetMetrics(
+   grpc::CallbackServerContext* context, const geoproto::MetricsRequest* request, geoproto::MetricsResponse* response)
+{
+   response->set_text(Metrics::Instance().Format());
+
+   auto* reactor = context->DefaultReactor();
+   reactor->Finish(grpc::Status::OK);
+   return reactor;
+}
+
+grpc::ServerUnaryReactor* AdminServiceImpl::SetHeapProfiling(grpc::CallbackServerContext* context,
+   const geoproto::HeapProfilingRequest* request, geoproto::HeapProfilingResponse* response)
+{
+   auto* reactor = context->DefaultReactor();
+   if (auto status = checkHeapProfilingAllowed(*context); !status.ok())
+   {
+      reactor->Finish(status);
+      return reactor;
+   }
+
+   auto& profiler = HeapProfiler::Instance();
+   if (request->enable())
+      profiler.Start(request->sample_period_bytes());
+   else
+      profiler.Stop();
+
+   response->set_enabled(profiler.IsEnabled());
+   response->set_sample_period_bytes(profiler.GetSamplePeriod());
+   reactor->Finish(grpc::Status::OK);
+   return reactor;
+}
+
+grpc::ServerUnaryReactor* AdminServiceImpl::GetHeapProfile(grpc::CallbackServerContext* context,
+   const geoproto::HeapProfileRequest* request, geoproto::HeapProfileResponse* response)
+{
+   auto* reactor = context->DefaultReactor();
+   if (auto status = checkHeapProfilingAllowed(*context); !status.ok())
+   {
+      reactor->Finish(status);
+      return reactor;
+   }
+
+   auto& profiler = HeapProfiler::Instance();
+   if (!profiler.IsEnabled())
+   {
+      reactor->Finish(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Heap profiling is not started"));
+      return reactor;
+   }
+
+   response->set_profile(profiler.FormatProfile());
+   reactor->Finish(grpc::Status::OK);
+   return reactor;
+}
+
+grpc::Status AdminServiceImpl::checkHeapProfilingAllowed(const grpc::CallbackServerContext& context) const
+{
+   if (!m_heapProfilingEnabled)
+      return grpc::Status{grpc::StatusCode::PERMISSION_DENIED, "Heap profiling is disabled by the configuration"};
+
+   if (const std::string peer = context.peer(); !isLocalPeer(peer))
+   {
+      LOG(ERROR) << std::format("Heap profiling is denied to a remote client, peer={}", peer);
+      return grpc::Status{grpc::StatusCode::PERMISSION_DENIED, "Heap profiling is available to local clients only"};
+   }
+   return grpc::Status::OK;
+}
+
+}  // namespace geo
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "geo.grpc.pb.h"
+#include "geo.pb.h"
+
+#include <grpcpp/support/status.h>
+
+namespace grpc
+{
+class CallbackServerContext;
+class ServerUnaryReactor;
+}  // namespace grpc
+
+namespace geo
+{
+
+// AdminServiceImpl implements the GeoAdmin gRPC service defined in Geo.proto.
+// It exposes operational information about the service, such as metrics and heap profiles.
+// The service shares the port of GeoService, which has no authentication, while heap profiles contain the memory map
+// of the process and profiling slows allocations down. So heap profiling RPCs are enabled by the configuration only,
+// and even then they are answered to clients on the same host only.
+class AdminServiceImpl final : public geoproto::GeoAdmin::CallbackService
+{
+public:
+   // @param heapProfilingEnabled: Whether SetHeapProfiling and GetHeapProfile are served, see sz_adminHeapProfilingKey.
+   explicit AdminServiceImpl(bool heapProfilingEnabled);
+
+   // gRPC method to retrieve current values of service metrics in Prometheus text format.
+   grpc::ServerUnaryReactor* GetMetrics(grpc::CallbackServerContext* context, const geoproto::MetricsRequest* request,
+      geoproto::MetricsResponse* response) override;
+
+   // gRPC method to start or stop sampling of heap allocations.
+   grpc::ServerUnaryReactor* SetHeapProfiling(grpc::CallbackServerContext* context,
+      const geoproto::HeapProfilingRequest* request, geoproto::HeapProfilingResponse* response) override;
+
+   // gRPC method to retrieve sampled heap allocations in the heap profile format of pprof.
+   grpc::ServerUnaryReactor* GetHeapProfile(grpc::CallbackServerContext* context,
+      const geoproto::HeapProfileRequest* request, geoproto::HeapProfileResponse* response) override;
+
+private:
+   // Checks whether the client may use heap profiling RPCs
+   // @return PERMISSION_DENIED if heap profiling is disabled or the client is not local, OK otherwise
+   grpc::Status checkHeapProfilingAllowed(const grpc::CallbackServerContext& context) const;
+
+private:
+   const bool m_heapProfilingEnabled;  // Heap profiling RPCs are served
+};
+
+}  // namespace geo
@@ -1,16 +1,43 @@
 #include "DebugHelpers.h"
 
 #include "ProtoTypes.h"
+#include "cache/LruCache.h"
+#include "cache/RelationTable.h"
+#include "search/OpenMeteoApiUtils.h"
 #include "search/SearchEngine.h"
 #include "search/SearchEngineItf.h"
+#include "search/WeatherArchive.h"
+#include "utils/AsyncQueue.h"
 #include "utils/ConfigConstants.h"
 #include "utils/Configuration.h"
+#include "utils/Executor.h"
+#include "utils/StringInterner.h"
+#include "utils/Task.h"
 #include "utils/WebClient.h"
+#include "utils/WorkStealingDeque.h"
 
 #include <absl/log/log.h>
+#include <malloc.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <format>
+#include <fstream>
+#include <functional>
+#include <latch>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace geo::debug
 {
@@ -35,6 +62,211 @@ void printDetails(const GeoProtoPlaces& places)
    }
 }
 
+// Layout of relation information before it was made compact
+struct PlainRelationInfo
+{
+   std::int64_t osmId = 0;
+   std::string name;
+   std::string country;
+   double latitude = 0;
+   double longitude = 0;
+};
+
+// Returns the number of bytes taken by relation information
+std::size_t EstimateMemoryUsage(const PlainRelationInfo& info)
+{
+   return sizeof(info) - 2 * sizeof(std::string) + geo::EstimateMemoryUsage(info.name) +
+          geo::EstimateMemoryUsage(info.country);
+}
+
+// Returns the number of bytes allocated on the heap
+std::size_t getAllocatedBytes()
+{
+   return mallinfo2().uordblks;
+}
+
+// Measures lookups of the given ids
+// @return Millions of lookups per second
+template <typename TFind>
+double measureLookups(const std::vector<nominatim::OsmId>& ids, TFind find)
+{
+   std::size_t found = 0;
+   const auto started = std::chrono::steady_clock::now();
+   for (const auto id : ids)
+      found += find(id) ? 1 : 0;
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+   if (found != ids.size())
+      LOG(ERROR) << std::format("Only {} of {} relations are found", found, ids.size());
+   return ids.size() / elapsed.count() / 1e6;
+}
+
+// Measures lookups of the given ids by several threads at once, every thread looks all the ids up
+// @return Millions of lookups per second by all the threads
+template <typename TFind>
+double measureConcurrentLookups(std::size_t numThreads, const std::vector<nominatim::OsmId>& ids, TFind find)
+{
+   std::atomic<std::size_t> found = 0;
+   std::latch start(numThreads + 1);
+   std::vector<std::thread> threads;
+   for (std::size_t i = 0; i < numThreads; ++i)
+   {
+      threads.emplace_back(
+         [&]
+         {
+            std::size_t threadFound = 0;
+            start.arrive_and_wait();
+            for (const auto id : ids)
+               threadFound += find(id) ? 1 : 0;
+            found += threadFound;
+         });
+   }
+
+   start.arrive_and_wait();
+   const auto started = std::chrono::steady_clock::now();
+   for (auto& thread : threads)
+      thread.join();
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+   if (found != numThreads * ids.size())
+      LOG(ERROR) << std::format("Only {} of {} relations are found", found.load(), numThreads * ids.size());
+   return numThreads * ids.size() / elapsed.count() / 1e6;
+}
+
+// Thread pool with a single queue guarded by a mutex, the baseline for the executor benchmark
+class MutexQueuePool
+{
+public:
+   explicit MutexQueuePool(std::size_t numThreads)
+   {
+      for (std::size_t i = 0; i < numThreads; ++i)
+      {
+         m_threads.emplace_back(
+            [this]
+            {
+               run();
+            });
+      }
+   }
+
+   ~MutexQueuePool()
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         m_stopping = true;
+      }
+      m_condition.notify_all();
+   }
+
+   void Post(std::function<void()> job)
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         m_jobs.push_back(std::move(job));
+      }
+      m_condition.notify_one();
+   }
+
+private:
+   void run()
+   {
+      for (;;)
+      {
+         std::unique_lock lock(m_mutex);
+         m_condition.wait(lock,
+            [this]
+            {
+               return m_stopping || !m_jobs.empty();
+            });
+         if (m_jobs.empty())
+            return;
+
+         auto job = std::move(m_jobs.front());
+         m_jobs.pop_front();
+         lock.unlock();
+         job();
+      }
+   }
+
+   std::mutex m_mutex;
+   std::condition_variable m_condition;
+   std::deque<std::function<void()>> m_jobs;
+   bool m_stopping = false;
+   std::vector<std::jthread> m_threads;  // Destroyed first, so threads are joined before other members
+};
+
+// Takes from a fraction of a microsecond to a few microseconds, so that jobs are small and uneven
+void runUnevenJob(std::size_t index)
+{
+   volatile std::uint64_t value = index;
+   for (std::size_t i = 0; i < 32 * (1 + index % 16); ++i)
+      value = value * 6364136223846793005ULL + 1;
+}
+
+// Measures jobs posted by the benchmark thread, or, with fan-out, posted by a few jobs running on the pool
+// like continuations of coroutines which spawn jobs for tiles or years
+// @return Millions of jobs per second
+template <typename TPost>
+double measureJobs(std::size_t numJobs, bool fanOut, TPost post)
+{
+   constexpr std::size_t sc_numRoots = 16;
+
+   std::atomic<std::size_t> numFinished = 0;
+   const auto postJob = [&numFinished, numJobs, &post](std::size_t index)
+   {
+      post(
+         [&numFinished, numJobs, index]
+         {
+            runUnevenJob(index);
+            if (++numFinished == numJobs)
+               numFinished.notify_all();
+         });
+   };
+
+   const auto started = std::chrono::steady_clock::now();
+   if (!fanOut)
+   {
+      for (std::size_t i = 0; i < numJobs; ++i)
+         postJob(i);
+   }
+   else
+   {
+      for (std::size_t root = 0; root < sc_numRoots; ++root)
+      {
+         post(
+            [root, numJobs, &postJob]
+            {
+               for (std::size_t i = root; i < numJobs; i += sc_numRoots)
+                  postJob(i);
+            });
+      }
+   }
+
+   for (std::size_t finished = numFinished.load(); finished < numJobs; finished = numFinished.load())
+      numFinished.wait(finished);
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+   return numJobs / elapsed.count() / 1e6;
+}
+
+// Creates relations with distinct names spread over the globe
+nominatim::RelationInfos createRelations(std::size_t numRelations)
+{
+   constexpr std::size_t sc_numCountries = 200;
+
+   nominatim::RelationInfos relations(numRelations);
+   for (std::size_t i = 0; i < numRelations; ++i)
+   {
+      auto& r = relations[i];
+      r.osmId = 1'000'000 + static_cast<nominatim::OsmId>(i) * 7;
+      r.name = std::format("Administrative region {}", i);
+      r.country = StringInterner::Instance().Intern(std::format("Country {}", i % sc_numCountries));
+      r.addressType = StringInterner::Instance().Intern("state");
+      r.latitude = -90 + 180.0 * i / numRelations;
+      r.longitude = -180 + 360.0 * i / numRelations;
+   }
+   return relations;
+}
+
 void printDetails(const WeatherInfoVector& weather)
 {
    for (const auto& entry : weather)
@@ -44,6 +276,45 @@ void printDetails(const WeatherInfoVector& weather)
    }
 }
 
+using QueueItem = std::pair<std::size_t, std::size_t>;  // Producer of an item and the index of the item
+
+// Pushes items of the producer from a worker, the last producer to finish closes the queue
+Task<std::size_t> produceItems(AsyncQueue<QueueItem>& queue, Executor& executor, std::size_t producer,
+   std::size_t numItems, std::atomic<std::size_t>& numRunning)
+{
+   co_await executor.Schedule();
+   std::size_t numPushed = 0;
+   while (numPushed < numItems)
+   {
+      if (!co_await queue.Push({producer, numPushed}))
+         break;
+      ++numPushed;
+   }
+   if (numRunning.fetch_sub(1) == 1)
+      queue.Close();
+   co_return numPushed;
+}
+
+// Pops items from a worker until the queue is closed and empty
+Task<std::vector<QueueItem>> consumeItems(AsyncQueue<QueueItem>& queue, Executor& executor)
+{
+   co_await executor.Schedule();
+   std::vector<QueueItem> items;
+   while (auto item = co_await queue.Pop())
+      items.push_back(*item);
+   co_return items;
+}
+
+Task<bool> pushItem(AsyncQueue<QueueItem>& queue, QueueItem item)
+{
+   co_return co_await queue.Push(item);
+}
+
+Task<std::optional<QueueItem>> popItem(AsyncQueue<QueueItem>& queue)
+{
+   co_return co_await queue.Pop();
+}
+
 }  // namespace
 
 void Search(const std::string& name, const std::string& configFilePath)
@@ -51,8 +322,9 @@ void Search(const std::string& name, const std::string& configFilePath)
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
-   auto cities = engine.FindCitiesByName(name, true);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(overpassApiClient, nominatimApiClient, openMeteoApiClient);
+   auto cities = engine.FindCitiesByName(name, true, nullptr);
    printDetails(cities);
 }
 
@@ -61,8 +333,9 @@ void Search(double latitude, double longitude, const std::string& configFilePath
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
-   auto cities = engine.FindCitiesByPosition(latitude, longitude, true);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(overpassApiClient, nominatimApiClient, openMeteoApiClient);
+   auto cities = engine.FindCitiesByPosition(latitude, longitude, true, nullptr);
    printDetails(cities);
 }
 
@@ -76,7 +349,8 @@ void Search(
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(overpassApiClient, nominatimApiClient, openMeteoApiClient);
    auto handler = engine.StartFindRegions();
 
    GeoProtoPlaces regions;
@@ -90,16 +364,445 @@ void Search(
    printDetails(regions);
 }
 
+void BenchmarkRelationCache(std::size_t numRelations)
+{
+   constexpr std::size_t sc_numLookups = 10'000'000;
+   constexpr double sc_bytesPerGb = 1024.0 * 1024 * 1024;
+
+   const nominatim::RelationInfos relations = createRelations(numRelations);
+
+   std::mt19937_64 random(42);
+   std::vector<nominatim::OsmId> lookupIds(sc_numLookups);
+   for (auto& id : lookupIds)
+      id = relations[random() % numRelations].osmId;
+
+   {
+      const std::size_t before = getAllocatedBytes();
+      LruCache<nominatim::OsmId, PlainRelationInfo> cache(numRelations);
+      for (const auto& r : relations)
+         cache.Insert(r.osmId, {r.osmId, r.name, std::string(r.country.View()), r.latitude, r.longitude});
+      const std::size_t bytes = getAllocatedBytes() - before;
+
+      const double lookupsPerSecond = measureLookups(lookupIds,
+         [&cache](auto id)
+         {
+            return cache.Find(id);
+         });
+      LOG(INFO) << std::format(
+         "LruCache<PlainRelationInfo>: {} bytes per entry, {:.0f} entries per GB, {:.2f}M lookups/s",
+         bytes / numRelations, numRelations / (bytes / sc_bytesPerGb), lookupsPerSecond);
+   }
+
+   {
+      const std::size_t before = getAllocatedBytes();
+      RelationTable table(numRelations);
+      for (const auto& r : relations)
+         table.Insert(r);
+      const std::size_t bytes = getAllocatedBytes() - before;
+
+      const double lookupsPerSecond = measureLookups(lookupIds,
+         [&table](auto id)
+         {
+            return table.Find(id);
+         });
+      LOG(INFO) << std::format("RelationTable: {} bytes per entry, {:.0f} entries per GB, {:.2f}M lookups/s",
+         bytes / numRelations, numRelations / (bytes / sc_bytesPerGb), lookupsPerSecond);
+   }
+}
+
+void BenchmarkCacheContention(std::size_t maxThreads)
+{
+   constexpr std::size_t sc_numRelations = 10'000;
+   constexpr std::size_t sc_numHotRelations = 16;  // E.g. capital cities
+   constexpr std::size_t sc_hotPercent = 90;       // Share of lookups of hot relations
+   constexpr std::size_t sc_numLookups = 1'000'000;
+
+   const nominatim::RelationInfos relations = createRelations(sc_numRelations);
+
+   std::mt19937_64 random(42);
+   std::vector<nominatim::OsmId> lookupIds(sc_numLookups);
+   for (auto& id : lookupIds)
+   {
+      const bool isHot = random() % 100 < sc_hotPercent;
+      id = relations[random() % (isHot ? sc_numHotRelations : sc_numRelations)].osmId;
+   }
+
+   LruCache<nominatim::OsmId, nominatim::RelationInfo> sharedCache(sc_numRelations);
+   RelationTable table(sc_numRelations);
+   for (const auto& r : relations)
+   {
+      sharedCache.Insert(r.osmId, r);
+      table.Insert(r);
+   }
+
+   for (std::size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+   {
+      const double sharedLookupsPerSecond = measureConcurrentLookups(numThreads, lookupIds,
+         [&sharedCache](auto id)
+         {
+            return sharedCache.Find(id);
+         });
+      const double tableLookupsPerSecond = measureConcurrentLookups(numThreads, lookupIds,
+         [&table](auto id)
+         {
+            return table.Find(id);
+         });
+      LOG(INFO) << std::format("{} threads: LruCache {:.2f}M lookups/s, RelationTable {:.2f}M lookups/s", numThreads,
+         sharedLookupsPerSecond, tableLookupsPerSecond);
+   }
+}
+
 void RequestWeather(double latitude, double longitude, const std::string& fromDate, const std::string& toDate,
    const std::string& configFilePath)
 {
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   SearchEngineSettings settings;
+   settings.weatherArchivePath = configuration.GetString(sz_weatherArchivePathKey);
+   geo::SearchEngine engine(overpassApiClient, nominatimApiClient, openMeteoApiClient, settings);
 
    const auto weather = engine.GetWeather(latitude, longitude, {StringToDate(fromDate), StringToDate(toDate)});
    printDetails(weather);
 }
 
+void IngestWeatherArchive(const std::string& csvPath, const std::string& archivePath, double cellSizeDegrees)
+{
+   const auto startTime = std::chrono::steady_clock::now();
+   const auto numDays = WeatherArchive::Ingest(csvPath, archivePath, cellSizeDegrees);
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+   if (numDays)
+      LOG(INFO) << std::format("Ingested {} days in {:.1f} seconds", *numDays, elapsed.count());
+}
+
+void BenchmarkExecutor(std::size_t maxThreads)
+{
+   constexpr std::size_t sc_numJobs = 1'000'000;
+
+   for (std::size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+   {
+      for (const bool fanOut : {false, true})
+      {
+         double mutexJobsPerSecond = 0;
+         {
+            MutexQueuePool pool(numThreads);
+            mutexJobsPerSecond = measureJobs(sc_numJobs, fanOut,
+               [&pool](std::function<void()> job)
+               {
+                  pool.Post(std::move(job));
+               });
+         }
+
+         double stealingJobsPerSecond = 0;
+         {
+            Executor executor(numThreads);
+            stealingJobsPerSecond = measureJobs(sc_numJobs, fanOut,
+               [&executor](std::function<void()> job)
+               {
+                  executor.Post(std::move(job));
+               });
+         }
+
+         LOG(INFO) << std::format("{} threads, {}: mutex queue {:.2f}M jobs/s, work stealing {:.2f}M jobs/s",
+            numThreads, fanOut ? "fan-out from workers" : "posted by one thread", mutexJobsPerSecond,
+            stealingJobsPerSecond);
+      }
+   }
+}
+
+void BenchmarkWeatherWindows(std::size_t numLocations)
+{
+   using namespace std::chrono_literals;
+
+   constexpr std::uint32_t sc_numYears = 30;
+   constexpr std::size_t sc_numRequests = 1'000;
+
+   // Every location gets its own cell with random temperatures of every day of the last 33 years.
+   const std::chrono::sys_days latestDay{2025y / std::chrono::January / 1};
+   const auto directory = std::filesystem::temp_directory_path();
+   const std::string csvPath = directory / "geo-weather-benchmark.csv";
+   const std::string archivePath = directory / "geo-weather-benchmark.bin";
+   std::mt19937_64 random(42);
+   std::vector<std::pair<double, double>> locations(numLocations);
+   {
+      std::ofstream csv(csvPath);
+      for (std::size_t i = 0; i < numLocations; ++i)
+      {
+         locations[i] = {-60.1 + static_cast<double>(i / 100), -170.1 + static_cast<double>(i % 100) * 3};
+         for (auto day = std::chrono::sys_days{1992y / std::chrono::January / 1}; day < latestDay; ++day)
+         {
+            const double temperatureMin = static_cast<double>(random() % 400) / 10 - 20;
+            const double temperatureMax = temperatureMin + static_cast<double>(random() % 150) / 10;
+            csv << std::format("{:%F},{},{},{:.1f},{:.1f}\n", Date{day}, locations[i].first, locations[i].second,
+               temperatureMin, temperatureMax);
+         }
+      }
+   }
+   if (!WeatherArchive::Ingest(csvPath, archivePath, 0.25))
+      return;
+
+   WeatherArchive archive;
+   if (!archive.Open(archivePath))
+      return;
+
+   // Returns microseconds per request, the sum of averages is accumulated so that nothing is optimized away
+   const auto measure = [&locations](const std::vector<std::vector<DateRange>>& requests, const auto& sumAverages)
+   {
+      double sum = 0;
+      const auto startTime = std::chrono::steady_clock::now();
+      for (const auto& ranges : requests)
+      {
+         for (const auto& [latitude, longitude] : locations)
+            sum += sumAverages(latitude, longitude, ranges);
+      }
+      const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - startTime;
+      LOG(INFO) << std::format("Sum of averages {:.1f}", sum);
+      return elapsed.count() / requests.size();
+   };
+
+   for (const std::chrono::days windowDays : {std::chrono::days{7}, std::chrono::days{30}, std::chrono::days{90}})
+   {
+      // Windows start at random days of a year.
+      std::vector<std::vector<DateRange>> requests(sc_numRequests);
+      for (auto& ranges : requests)
+      {
+         const std::chrono::sys_days firstDay = std::chrono::sys_days{2024y / std::chrono::January / 1} +
+            std::chrono::days{random() % 366};
+         ranges = openmeteo::CollectHistoricalRanges(
+            {Date{firstDay}, Date{firstDay + windowDays - std::chrono::days{1}}}, latestDay, sc_numYears);
+      }
+
+      const double dailyMicroseconds = measure(requests,
+         [&archive](double latitude, double longitude, const std::vector<DateRange>& ranges)
+         {
+            double sum = 0;
+            for (const auto& range : ranges)
+            {
+               for (const auto& day : archive.Find(latitude, longitude, range).value_or(WeatherInfoVector{}))
+                  sum += day.temperatureAverage;
+            }
+            return sum;
+         });
+      const double tableMicroseconds = measure(requests,
+         [&archive](double latitude, double longitude, const std::vector<DateRange>& ranges)
+         {
+            double sum = 0;
+            for (const auto& summary : archive.Summarize(latitude, longitude, ranges))
+               sum += summary.value_or(WeatherSummary{}).sumTemperatureAverage;
+            return sum;
+         });
+      LOG(INFO) << std::format("{} locations x {} years of {}-day windows: daily rows {:.1f} us per request, "
+                               "aggregation tables {:.1f} us per request",
+         numLocations, sc_numYears, windowDays.count(), dailyMicroseconds, tableMicroseconds);
+   }
+
+   std::filesystem::remove(csvPath);
+   std::filesystem::remove(archivePath);
+}
+
+void CheckAsyncQueue()
+{
+   constexpr std::size_t sc_numProducers = 4;
+   constexpr std::size_t sc_numConsumers = 3;
+   constexpr std::size_t sc_numItems = 10'000;
+   constexpr std::size_t sc_capacity = 2;
+
+   bool passed = true;
+   const auto check = [&passed](bool condition, const char* description)
+   {
+      if (!condition)
+      {
+         LOG(ERROR) << std::format("AsyncQueue check failed: {}", description);
+         passed = false;
+      }
+   };
+
+   // Closed queues fail pushes and drain queued items before failing pops.
+   {
+      AsyncQueue<QueueItem> queue(sc_capacity);
+      check(SyncWait(pushItem(queue, {0, 0})), "push into an open queue");
+      queue.Close();
+      check(!SyncWait(pushItem(queue, {0, 1})), "push into a closed queue");
+      check(SyncWait(popItem(queue)) == QueueItem{0, 0}, "pop of an item queued before closing");
+      check(!SyncWait(popItem(queue)), "pop from a closed empty queue");
+   }
+
+   // Producers and consumers on workers of an executor suspend each other on a small queue. Every item is taken
+   // once, and every consumer takes the items of a producer in the order they were pushed.
+   {
+      Executor executor(sc_numProducers + sc_numConsumers);
+      AsyncQueue<QueueItem> queue(sc_capacity);
+      std::atomic<std::size_t> numRunning = sc_numProducers;
+
+      std::vector<Task<std::size_t>> producers;
+      for (std::size_t producer = 0; producer < sc_numProducers; ++producer)
+         producers.push_back(produceItems(queue, executor, producer, sc_numItems, numRunning));
+      std::vector<Task<std::vector<QueueItem>>> consumers;
+      for (std::size_t consumer = 0; consumer < sc_numConsumers; ++consumer)
+         consumers.push_back(consumeItems(queue, executor));
+      auto consumed = StartEagerly(
+         [&consumers]
+         {
+            return WhenAll(std::move(consumers));
+         });
+
+      for (const auto numPushed : SyncWait(WhenAll(std::move(producers))))
+         check(numPushed == sc_numItems, "all the items are pushed");
+
+      std::vector<std::size_t> numTaken(sc_numProducers * sc_numItems);
+      for (const auto& items : SyncWait(std::move(consumed)))
+      {
+         std::vector<std::size_t> nextIndex(sc_numProducers);
+         for (const auto& [producer, index] : items)
+         {
+            check(index >= nextIndex[producer], "items of a producer are taken in order");
+            nextIndex[producer] = index + 1;
+            ++numTaken[producer * sc_numItems + index];
+         }
+      }
+      check(std::ranges::all_of(numTaken,
+               [](std::size_t count)
+               {
+                  return count == 1;
+               }),
+         "every item is taken once");
+   }
+
+   if (passed)
+      LOG(INFO) << "AsyncQueue check passed";
+}
+
+void CheckExecutor()
+{
+   constexpr std::size_t sc_numItems = 100'000;
+   constexpr std::size_t sc_numThieves = 3;
+   constexpr std::size_t sc_numThreads = 4;
+   constexpr std::size_t sc_numJobs = 10'000;
+   constexpr std::size_t sc_outerCount = 64;
+   constexpr std::size_t sc_innerCount = 100;
+
+   bool passed = true;
+   const auto check = [&passed](bool condition, const char* description)
+   {
+      if (!condition)
+      {
+         LOG(ERROR) << std::format("Executor check failed: {}", description);
+         passed = false;
+      }
+   };
+   const auto allOnce = [](const std::vector<std::atomic<std::size_t>>& counts)
+   {
+      return std::ranges::all_of(counts,
+         [](const std::atomic<std::size_t>& count)
+         {
+            return count.load() == 1;
+         });
+   };
+
+   // The owner pushes and pops items of a deque, which grows from a small capacity, while thieves steal them.
+   {
+      WorkStealingDeque<std::size_t> deque(4);
+      std::vector<std::atomic<std::size_t>> numTaken(sc_numItems);
+      std::atomic<bool> pushed = false;
+      {
+         std::vector<std::jthread> thieves;
+         for (std::size_t i = 0; i < sc_numThieves; ++i)
+         {
+            thieves.emplace_back(
+               [&deque, &numTaken, &pushed]
+               {
+                  for (;;)
+                  {
+                     if (const auto item = deque.Steal())
+                        ++numTaken[*item];
+                     else if (pushed && deque.IsEmpty())
+                        break;
+                  }
+               });
+         }
+
+         for (std::size_t i = 0; i < sc_numItems; ++i)
+         {
+            deque.Push(i);
+            if (i % 3 == 0)
+            {
+               if (const auto item = deque.Pop())
+                  ++numTaken[*item];
+            }
+         }
+         while (const auto item = deque.Pop())
+            ++numTaken[*item];
+         pushed = true;
+      }
+      check(allOnce(numTaken), "every item of the deque is taken once");
+   }
+
+   // Jobs posted by another thread and by workers run once each.
+   {
+      std::vector<std::atomic<std::size_t>> numRun(sc_numJobs);
+      std::atomic<std::size_t> numFinished = 0;
+      {
+         Executor executor(sc_numThreads);
+         for (std::size_t i = 0; i < sc_numJobs / 2; ++i)
+         {
+            executor.Post(
+               [&executor, &numRun, &numFinished, i]
+               {
+                  ++numRun[i];
+                  executor.Post(
+                     [&numRun, &numFinished, i]
+                     {
+                        ++numRun[sc_numJobs / 2 + i];
+                        ++numFinished;
+                     });
+               });
+         }
+      }
+      check(numFinished == sc_numJobs / 2, "jobs posted by jobs are run before the executor is destroyed");
+      check(allOnce(numRun), "every job is run once");
+   }
+
+   // Every worker calls ParallelFor() whose function calls it again, so workers wait for calls taken by each other.
+   // Exceptions of the function are passed to the caller once all the calls are finished.
+   {
+      Executor executor(sc_numThreads);
+      std::vector<std::atomic<std::size_t>> numCalls(sc_numThreads * sc_outerCount * sc_innerCount);
+      std::atomic<std::size_t> numFailed = 0;
+      std::latch done(sc_numThreads);
+      for (std::size_t root = 0; root < sc_numThreads; ++root)
+      {
+         executor.Post(
+            [&numCalls, &numFailed, &done, root]
+            {
+               try
+               {
+                  ParallelFor(sc_outerCount,
+                     [&numCalls, root](std::size_t outer)
+                     {
+                        ParallelFor(sc_innerCount,
+                           [&numCalls, root, outer](std::size_t inner)
+                           {
+                              ++numCalls[(root * sc_outerCount + outer) * sc_innerCount + inner];
+                              if (outer == 1 && inner == 2)
+                                 throw std::runtime_error("Failed call");
+                           });
+                     });
+               }
+               catch (const std::exception&)
+               {
+                  ++numFailed;
+               }
+               done.count_down();
+            });
+      }
+      done.wait();
+      check(allOnce(numCalls), "every index of nested ParallelFor() calls is called once");
+      check(numFailed == sc_numThreads, "exceptions are passed to the callers of ParallelFor()");
+   }
+
+   if (passed)
+      LOG(INFO) << "Executor check passed";
+}
+
 }  // namespace geo::debug
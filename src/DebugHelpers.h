@@ -20,4 +20,30 @@ void Search(double latitude, double longitude, std::uint32_t rangeMeters, std::u
 void RequestWeather(double latitude, double longitude, const std::string& fromDate, const std::string& toDate,
    const std::string& configFilePath);
 
+// Make a weather archive served by GetWeather from a CSV file of daily temperatures.
+void IngestWeatherArchive(const std::string& csvPath, const std::string& archivePath, double cellSizeDegrees);
+
+// Compare memory usage and lookup throughput of the relation cache with a cache of plain relation structs.
+void BenchmarkRelationCache(std::size_t numRelations);
+
+// Compare lookup throughput of a shared LRU cache and the relation cache with its per-thread cache
+// at 1 to maxThreads threads.
+void BenchmarkCacheContention(std::size_t maxThreads);
+
+// Compare job throughput of a thread pool with a mutex-guarded queue and the work-stealing executor
+// at 1 to maxThreads threads, for jobs posted by one thread and for jobs fanned out by jobs on the pool.
+void BenchmarkExecutor(std::size_t maxThreads);
+
+// Check that items of a work-stealing deque are taken once while other threads steal them, and that jobs and
+// nested ParallelFor() calls of the executor run every job and index once.
+void CheckExecutor();
+
+// Check that coroutines connected by an AsyncQueue on several threads pass every item once and in order,
+// and that closed queues fail pushes and drain queued items.
+void CheckAsyncQueue();
+
+// Compare aggregation of daily rows and of precomputed tables of the weather archive for GetWeather requests
+// of numLocations locations over 30 years.
+void BenchmarkWeatherWindows(std::size_t numLocations);
+
 }  // namespace geo::debug
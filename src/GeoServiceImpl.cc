@@ -1,32 +1,248 @@
 #include "GeoServiceImpl.h"
 
 #include "reactors/GetCitiesReactor.h"
+#include "reactors/GetNearestCitiesReactor.h"
 #include "reactors/GetRegionsReactor.h"
+#include "reactors/GetWeatherReactor.h"
 #include "search/SearchEngine.h"
 #include "utils/ConfigConstants.h"
 #include "utils/Configuration.h"
+#include "utils/ConfigurationStore.h"
+#include "utils/Executor.h"
+#include "utils/GeoUtils.h"
+#include "utils/HttpEventLoop.h"
+#include "utils/StringInterner.h"
+#include "utils/UpstreamDispatcher.h"
+
+#include <cstdint>
+#include <limits>
+
+namespace
+{
+
+using namespace geo;
+
+constexpr std::int64_t sc_maxExecutorThreads = 1024;         // Sanity limit of the number of executor workers
+constexpr std::int64_t sc_maxConcurrentRequests = 10'000;    // Sanity limit of concurrent requests to an upstream
+constexpr std::int64_t sc_maxBulkheadSize = 10'000;          // Sanity limit of running RPCs in a bulkhead
+constexpr std::int64_t sc_maxBulkheadQueueLength = 100'000;  // Sanity limit of queued RPCs in a bulkhead
+constexpr std::int64_t sc_maxBoxSideDegrees = 360;          // Sanity limit of maxBoxWidth and maxBoxHeight
+
+// Reads settings of the search engine caches from the configuration
+SearchEngineSettings loadSearchEngineSettings(const Configuration& configuration)
+{
+   SearchEngineSettings settings;
+   settings.tileCache.maxEntries = configuration.GetInt64(sz_overpassCacheMaxEntriesKey);
+   settings.tileCache.revalidateAfter =
+      std::chrono::seconds(configuration.GetInt64(sz_overpassCacheRevalidateSecondsKey));
+   settings.tileCache.maxAge = std::chrono::seconds(configuration.GetInt64(sz_overpassCacheMaxAgeSecondsKey));
+   settings.tileCache.revalidation = configuration.GetString(sz_overpassCacheRevalidationKey) == "refetch"
+                                        ? overpass::Revalidation::Refetch
+                                        : overpass::Revalidation::Timestamp;
+   settings.relationCacheMaxEntries = configuration.GetInt64(sz_relationCacheMaxEntriesKey);
+   settings.weatherCacheMaxEntries = configuration.GetInt64(sz_weatherCacheMaxEntriesKey);
+   settings.prefetchMaxPendingTiles = configuration.GetInt64(sz_prefetchMaxPendingTilesKey);
+   settings.maxStaleness = std::chrono::seconds(configuration.GetInt64(sz_fastRegionsMaxStalenessSecondsKey));
+   settings.citiesDatasetPath = configuration.GetString(sz_citiesDatasetPathKey);
+   settings.weatherArchivePath = configuration.GetString(sz_weatherArchivePathKey);
+   settings.scanOverpassConcurrency = configuration.GetInt64(sz_scanOverpassConcurrencyKey);
+   settings.scanNominatimConcurrency = configuration.GetInt64(sz_scanNominatimConcurrencyKey);
+   settings.scanQueueCapacity = configuration.GetInt64(sz_scanQueueCapacityKey);
+   return settings;
+}
+
+// Reads settings of the response version cache from the configuration
+ResponseVersionCacheSettings loadResponseVersionCacheSettings(const Configuration& configuration)
+{
+   ResponseVersionCacheSettings settings;
+   settings.maxEntries = configuration.GetInt64(sz_responseVersionCacheMaxEntriesKey);
+   settings.ttl = std::chrono::seconds(configuration.GetInt64(sz_responseVersionTtlSecondsKey));
+   return settings;
+}
+
+// Reads settings of the scan session cache from the configuration
+ScanSessionCacheSettings loadScanSessionCacheSettings(const Configuration& configuration)
+{
+   ScanSessionCacheSettings settings;
+   settings.maxEntries = configuration.GetInt64(sz_scanSessionsMaxEntriesKey);
+   settings.maxBytes = configuration.GetInt64(sz_scanSessionsMaxBytesKey);
+   settings.ttl = std::chrono::seconds(configuration.GetInt64(sz_scanSessionTtlSecondsKey));
+   return settings;
+}
+
+// Reads settings of the response cache from the configuration
+ResponseCacheSettings loadResponseCacheSettings(const Configuration& configuration)
+{
+   ResponseCacheSettings settings;
+   settings.maxEntries = configuration.GetInt64(sz_responseCacheMaxEntriesKey);
+   settings.maxResponseBytes = configuration.GetInt64(sz_responseCacheMaxResponseBytesKey);
+   settings.ttl = std::chrono::seconds(configuration.GetInt64(sz_responseCacheTtlSecondsKey));
+   return settings;
+}
+
+// Reads the memory budget of caches from the configuration, 0 disables the limit
+std::size_t loadMemoryBudget(const Configuration& configuration)
+{
+   return configuration.GetInt64(sz_memoryBudgetBytesKey, 0, std::numeric_limits<std::int64_t>::max());
+}
+
+// Reads a limit of concurrent requests to an upstream. With no requests allowed, requests of RPCs would wait
+// in the queue of the dispatcher until their deadlines.
+std::size_t loadMaxConcurrentRequests(const Configuration& configuration, const char* maxConcurrentRequestsKey)
+{
+   return configuration.GetInt64(maxConcurrentRequestsKey, 1, sc_maxConcurrentRequests);
+}
+
+// Creates a dispatcher which limits concurrency of requests to an upstream
+std::shared_ptr<UpstreamDispatcher> createDispatcher(
+   const Configuration& configuration, const char* maxConcurrentRequestsKey, std::string name)
+{
+   UpstreamDispatcher::Settings settings;
+   settings.name = std::move(name);
+   settings.maxConcurrentRequests = loadMaxConcurrentRequests(configuration, maxConcurrentRequestsKey);
+   return std::make_shared<UpstreamDispatcher>(std::move(settings));
+}
+
+// Reads the size of a bulkhead. With no running RPCs allowed, RPCs would wait in the queue until their deadlines.
+std::size_t loadBulkheadSize(const Configuration& configuration, const char* sizeKey)
+{
+   return configuration.GetInt64(sizeKey, 1, sc_maxBulkheadSize);
+}
+
+// Reads the limit of RPCs queued in a bulkhead, 0 rejects RPCs as soon as the bulkhead is full
+std::size_t loadBulkheadMaxQueueLength(const Configuration& configuration)
+{
+   return configuration.GetInt64(sz_bulkheadMaxQueueLengthKey, 0, sc_maxBulkheadQueueLength);
+}
+
+// Reads the largest grid tile of GetRegions searches, which fits into maxBoxWidth and maxBoxHeight
+double loadMaxTileSize(const Configuration& configuration)
+{
+   return GetMaxGridTileSize(configuration.GetInt64(sz_maxBoxWidthKey, 1, sc_maxBoxSideDegrees),
+      configuration.GetInt64(sz_maxBoxHeightKey, 1, sc_maxBoxSideDegrees));
+}
+
+// Reads settings of a bulkhead from the configuration
+Bulkhead::Settings loadBulkheadSettings(const Configuration& configuration, const char* sizeKey, std::string name)
+{
+   Bulkhead::Settings settings;
+   settings.name = std::move(name);
+   settings.maxRunningJobs = loadBulkheadSize(configuration, sizeKey);
+   settings.maxQueueLength = loadBulkheadMaxQueueLength(configuration);
+   return settings;
+}
+
+}  // namespace
 
 namespace geo
 {
 
-GeoServiceImpl::GeoServiceImpl(const Configuration& configuration)
-   : m_overpassApiClient(configuration.GetString(sz_overpassEndpointKey))    // Initialize Overpass API client
+GeoServiceImpl::GeoServiceImpl(const ConfigurationStore& configurationStore)
+   : GeoServiceImpl(configurationStore, *configurationStore.Current())
+{
+}
+
+GeoServiceImpl::GeoServiceImpl(const ConfigurationStore& configurationStore, const Configuration& configuration)
+   : m_configurationStore(configurationStore)
+   , m_overpassApiClient(configuration.GetString(sz_overpassEndpointKey))    // Initialize Overpass API client
    , m_nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey))  // Initialize Nominatim API client
-   , m_searchEngine(
-        std::make_unique<SearchEngine>(m_overpassApiClient, m_nominatimApiClient))  // Initialize search engine
+   , m_openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey))  // Initialize Open-Meteo API client
+   , m_overpassDispatcher(createDispatcher(configuration, sz_overpassMaxConcurrentRequestsKey, "overpass"))
+   , m_nominatimDispatcher(createDispatcher(configuration, sz_nominatimMaxConcurrentRequestsKey, "nominatim"))
+   , m_openMeteoDispatcher(createDispatcher(configuration, sz_maxOngoingWeatherRequestsKey, "openmeteo"))
+   , m_memoryAccountant(loadMemoryBudget(configuration))
+   , m_searchEngine(std::make_unique<SearchEngine>(m_overpassApiClient, m_nominatimApiClient, m_openMeteoApiClient,
+        loadSearchEngineSettings(configuration), &m_memoryAccountant))  // Initialize search engine
+   , m_versionCache(loadResponseVersionCacheSettings(configuration))
+   , m_responseCache(loadResponseCacheSettings(configuration))
+   , m_scanSessions(loadScanSessionCacheSettings(configuration))
+   , m_executor(std::make_shared<Executor>(configuration.GetInt64(sz_executorThreadsKey, 0, sc_maxExecutorThreads)))
+   , m_searchBulkhead(loadBulkheadSettings(configuration, sz_searchBulkheadSizeKey, "search"), m_executor)
+   , m_openMeteoBulkhead(loadBulkheadSettings(configuration, sz_openMeteoBulkheadSizeKey, "openmeteo"), m_executor)
+   , m_cacheBulkhead(loadBulkheadSettings(configuration, sz_cacheBulkheadSizeKey, "cache"), m_executor)
+{
+   m_overpassApiClient.SetDispatcher(m_overpassDispatcher);
+   m_nominatimApiClient.SetDispatcher(m_nominatimDispatcher);
+   m_openMeteoApiClient.SetDispatcher(m_openMeteoDispatcher);
+
+   // Transfers of all the upstreams share one loop thread.
+   const auto eventLoop = std::make_shared<HttpEventLoop>();
+   m_overpassApiClient.SetEventLoop(eventLoop);
+   m_nominatimApiClient.SetEventLoop(eventLoop);
+   m_openMeteoApiClient.SetEventLoop(eventLoop);
+
+   // Responses of all the upstreams are parsed by the workers which run the RPCs, rather than by the loop thread.
+   m_overpassApiClient.SetExecutor(m_executor);
+   m_nominatimApiClient.SetExecutor(m_executor);
+   m_openMeteoApiClient.SetExecutor(m_executor);
+
+   m_memoryRegistrations.push_back(m_memoryAccountant.RegisterCache("response_cache", m_responseCache));
+   m_memoryRegistrations.push_back(m_memoryAccountant.RegisterCache("response_version_cache", m_versionCache));
+   m_memoryRegistrations.push_back(m_memoryAccountant.RegisterCache("scan_sessions", m_scanSessions));
+
+   // Interned strings are never removed, so the interner is only accounted.
+   MemoryAccountant::Component interner;
+   interner.getMemoryUsage = []
+   {
+      return StringInterner::Instance().GetMemoryUsage();
+   };
+   m_memoryRegistrations.push_back(m_memoryAccountant.Register("string_interner", std::move(interner)));
+}
+
+GeoServiceImpl::ReloadableSettings GeoServiceImpl::LoadReloadableSettings(const Configuration& configuration)
 {
+   ReloadableSettings settings;
+   settings.overpassEndpoint = configuration.GetString(sz_overpassEndpointKey);
+   settings.nominatimEndpoint = configuration.GetString(sz_nominatimEndpointKey);
+   settings.openMeteoEndpoint = configuration.GetString(sz_openMeteoEndpointKey);
+   settings.overpassMaxConcurrentRequests =
+      loadMaxConcurrentRequests(configuration, sz_overpassMaxConcurrentRequestsKey);
+   settings.nominatimMaxConcurrentRequests =
+      loadMaxConcurrentRequests(configuration, sz_nominatimMaxConcurrentRequestsKey);
+   settings.openMeteoMaxConcurrentRequests = loadMaxConcurrentRequests(configuration, sz_maxOngoingWeatherRequestsKey);
+   settings.memoryBudgetBytes = loadMemoryBudget(configuration);
+   settings.searchBulkheadSize = loadBulkheadSize(configuration, sz_searchBulkheadSizeKey);
+   settings.openMeteoBulkheadSize = loadBulkheadSize(configuration, sz_openMeteoBulkheadSizeKey);
+   settings.cacheBulkheadSize = loadBulkheadSize(configuration, sz_cacheBulkheadSizeKey);
+   settings.bulkheadMaxQueueLength = loadBulkheadMaxQueueLength(configuration);
+   settings.maxTileSizeDegrees = loadMaxTileSize(configuration);
+   return settings;
+}
+
+void GeoServiceImpl::ApplyConfiguration(const Configuration& configuration)
+{
+   const ReloadableSettings settings = LoadReloadableSettings(configuration);
+
+   m_overpassApiClient.SetUrl(settings.overpassEndpoint);
+   m_nominatimApiClient.SetUrl(settings.nominatimEndpoint);
+   m_openMeteoApiClient.SetUrl(settings.openMeteoEndpoint);
+
+   m_overpassDispatcher->SetMaxConcurrentRequests(settings.overpassMaxConcurrentRequests);
+   m_nominatimDispatcher->SetMaxConcurrentRequests(settings.nominatimMaxConcurrentRequests);
+   m_openMeteoDispatcher->SetMaxConcurrentRequests(settings.openMeteoMaxConcurrentRequests);
+
+   m_searchBulkhead.SetLimits(settings.searchBulkheadSize, settings.bulkheadMaxQueueLength);
+   m_openMeteoBulkhead.SetLimits(settings.openMeteoBulkheadSize, settings.bulkheadMaxQueueLength);
+   m_cacheBulkhead.SetLimits(settings.cacheBulkheadSize, settings.bulkheadMaxQueueLength);
+
+   // Caches are shrunk to a lower budget by the accountant thread, rather than by the caller.
+   m_memoryAccountant.SetBudget(settings.memoryBudgetBytes);
 }
 
 grpc::ServerUnaryReactor* GeoServiceImpl::GetCities(
-   grpc::CallbackServerContext* context, const geoproto::CitiesRequest* request, geoproto::CitiesResponse* response)
+   grpc::CallbackServerContext* context, const grpc::ByteBuffer* request, grpc::ByteBuffer* response)
 {
-   return new GetCitiesReactor(context, *request, *response, *m_searchEngine);
+   return new GetCitiesReactor(
+      context, *request, *response, *m_searchEngine, m_versionCache, m_responseCache, m_searchBulkhead);
 }
 
 grpc::ServerUnaryReactor* GeoServiceImpl::GetRegions(
-   grpc::CallbackServerContext* context, const geoproto::RegionsRequest* request, geoproto::RegionsResponse* response)
+   grpc::CallbackServerContext* context, const grpc::ByteBuffer* request, grpc::ByteBuffer* response)
 {
-   return new GetRegionsReactor(context, *request, *response, *m_searchEngine);
+   // Limits of searches are read from the current snapshot on every RPC, so a reloaded file applies to the next one.
+   const double maxTileSizeDegrees = loadMaxTileSize(*m_configurationStore.Current());
+   return new GetRegionsReactor(context, *request, *response, *m_searchEngine, m_versionCache, m_responseCache,
+      m_scanSessions, m_searchBulkhead, m_cacheBulkhead, maxTileSizeDegrees);
 }
 
 grpc::ServerWriteReactor<geoproto::RegionsResponse>* GeoServiceImpl::GetRegionsStream(
@@ -38,7 +254,13 @@ grpc::ServerWriteReactor<geoproto::RegionsResponse>* GeoServiceImpl::GetRegionsS
 grpc::ServerUnaryReactor* GeoServiceImpl::GetWeather(
    grpc::CallbackServerContext* context, const geoproto::WeatherRequest* request, ::geoproto::WeatherResponse* response)
 {
-   return nullptr;  // gRPC sends grpc::StatusCode::UNIMPLEMENTED to Client
+   return new GetWeatherReactor(context, *request, *response, *m_searchEngine, m_openMeteoBulkhead, *m_executor);
+}
+
+grpc::ServerUnaryReactor* GeoServiceImpl::GetNearestCities(grpc::CallbackServerContext* context,
+   const geoproto::NearestCitiesRequest* request, geoproto::NearestCitiesResponse* response)
+{
+   return new GetNearestCitiesReactor(context, *request, *response, *m_searchEngine);
 }
 
 }  // namespace geo
@@ -1,11 +1,19 @@
 #pragma once
 
+#include "cache/MemoryAccountant.h"
+#include "cache/ResponseCache.h"
+#include "cache/ResponseVersionCache.h"
+#include "cache/ScanSessionCache.h"
 #include "geo.grpc.pb.h"
 #include "geo.pb.h"
 #include "search/SearchEngineItf.h"
+#include "utils/Bulkhead.h"
 #include "utils/WebClient.h"
 
+#include <cstddef>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace grpc
 {
@@ -18,28 +26,67 @@ namespace geo
 
 // Forward declaration of Configuration class. Configuration holds system-wide settings.
 class Configuration;
+class ConfigurationStore;
+class Executor;
+
+// Base class of GeoServiceImpl. GetCities and GetRegions are raw methods, which receive and send serialized messages,
+// so that cached responses can be sent without serialization.
+using GeoCallbackService = geoproto::Geo::WithRawCallbackMethod_GetCities<
+   geoproto::Geo::WithRawCallbackMethod_GetRegions<geoproto::Geo::CallbackService>>;
 
 // GeoServiceImpl implements the gRPC service defined in Geo.proto to handle geo-related queries.
 // It extends the CallbackService class to implement methods for city and region retrieval.
-class GeoServiceImpl final : public geoproto::Geo::CallbackService
+class GeoServiceImpl final : public GeoCallbackService
 {
 public:
-   // Constructor for GeoServiceImpl. Initializes with configuration settings.
+   // Constructor for GeoServiceImpl. Initializes with the current configuration settings.
    // The constructor sets up API clients and the search engine.
-   // @param configuration: Reference to the configuration object for settings.
-   explicit GeoServiceImpl(const Configuration& configuration);
+   // @param configurationStore: Store of configuration snapshots, read by RPCs. Must outlive the service.
+   explicit GeoServiceImpl(const ConfigurationStore& configurationStore);
+
+   // Settings which may be changed while the service is running
+   struct ReloadableSettings
+   {
+      std::string overpassEndpoint;                    // Base URL of Overpass API
+      std::string nominatimEndpoint;                   // Base URL of Nominatim API
+      std::string openMeteoEndpoint;                   // Base URL of Open-Meteo API
+      std::size_t overpassMaxConcurrentRequests = 1;   // Limit of concurrent requests to Overpass API
+      std::size_t nominatimMaxConcurrentRequests = 1;  // Limit of concurrent requests to Nominatim API
+      std::size_t openMeteoMaxConcurrentRequests = 1;  // Limit of concurrent requests to Open-Meteo API
+      std::size_t memoryBudgetBytes = 0;               // Memory budget of caches, 0 disables the limit
+      std::size_t searchBulkheadSize = 1;              // Limit of running RPCs waiting for Overpass and Nominatim
+      std::size_t openMeteoBulkheadSize = 1;           // Limit of running RPCs waiting for Open-Meteo API
+      std::size_t cacheBulkheadSize = 1;               // Limit of running RPCs answered from cached data
+      std::size_t bulkheadMaxQueueLength = 0;          // Limit of RPCs queued in every bulkhead
+      double maxTileSizeDegrees = 1;                   // Largest grid tile of GetRegions searches, read by every RPC
+   };
+
+   // Reads and checks the settings which may be changed while the service is running. Used to reject reloaded
+   // configurations before they are published, see ConfigurationStore.
+   // @param configuration: Configuration to read.
+   // @throw std::runtime_error if a setting is missing, has a wrong type or is out of range.
+   static ReloadableSettings LoadReloadableSettings(const Configuration& configuration);
+
+   // Applies settings which may be changed while the service is running: upstream endpoints, limits of concurrent
+   // upstream requests, sizes of bulkheads and the memory budget. Requests which are already running are not affected.
+   // All the settings are read and checked before any of them is applied, so a bad configuration changes nothing.
+   // @param configuration: Reloaded configuration.
+   // @throw std::runtime_error if the configuration is invalid, see LoadReloadableSettings().
+   void ApplyConfiguration(const Configuration& configuration);
 
    // gRPC method to retrieve a list of cities based on either geographic position or city name.
    // The method is called when a client sends a CitiesRequest.
    // If the request is valid, a new GetCitiesReactor is created to handle the query.
-   grpc::ServerUnaryReactor* GetCities(grpc::CallbackServerContext* context, const geoproto::CitiesRequest* request,
-      geoproto::CitiesResponse* response) override;
+   // Repeated requests are answered with cached serialized responses.
+   grpc::ServerUnaryReactor* GetCities(
+      grpc::CallbackServerContext* context, const grpc::ByteBuffer* request, grpc::ByteBuffer* response) override;
 
    // gRPC method to retrieve a list of regions in a single response (non-streaming version).
    // This method handles region queries based on geographic position and user preferences,
    // returning all results in one response rather than streaming them.
-   grpc::ServerUnaryReactor* GetRegions(grpc::CallbackServerContext* context, const geoproto::RegionsRequest* request,
-      geoproto::RegionsResponse* response) override;
+   // Repeated requests are answered with cached serialized responses.
+   grpc::ServerUnaryReactor* GetRegions(
+      grpc::CallbackServerContext* context, const grpc::ByteBuffer* request, grpc::ByteBuffer* response) override;
 
    // gRPC method to stream regions based on geographic position and user preferences.
    // This method streams responses, enabling clients to receive multiple region data.
@@ -53,13 +100,60 @@ public:
    grpc::ServerUnaryReactor* GetWeather(grpc::CallbackServerContext* context, const geoproto::WeatherRequest* request,
       ::geoproto::WeatherResponse* response) override;
 
+   // gRPC method to retrieve cities nearest to a point.
+   // The method is called when a client sends a NearestCitiesRequest.
+   // A new GetNearestCitiesReactor finds cities in the local city index and answers on the calling thread,
+   // without a bulkhead, as no upstream is asked.
+   grpc::ServerUnaryReactor* GetNearestCities(grpc::CallbackServerContext* context,
+      const geoproto::NearestCitiesRequest* request, geoproto::NearestCitiesResponse* response) override;
+
+private:
+   // Initializes with the given snapshot of the store
+   GeoServiceImpl(const ConfigurationStore& configurationStore, const Configuration& configuration);
+
 private:
-   // WebClient instances to interact with the Overpass API and Nominatim API for geographic data.
+   // Snapshots of the configuration, read by RPCs which use limits of the current one.
+   const ConfigurationStore& m_configurationStore;
+
+   // WebClient instances to interact with the Overpass API and Nominatim API for geographic data,
+   // and with the Open-Meteo API for historical weather.
    WebClient m_overpassApiClient;
    WebClient m_nominatimApiClient;
+   WebClient m_openMeteoApiClient;
 
-   // A search engine for handling location-based queries, uses Overpass and Nominatim APIs.
+   // Limit concurrency of requests to the upstreams above, changed by ApplyConfiguration().
+   std::shared_ptr<UpstreamDispatcher> m_overpassDispatcher;
+   std::shared_ptr<UpstreamDispatcher> m_nominatimDispatcher;
+   std::shared_ptr<UpstreamDispatcher> m_openMeteoDispatcher;
+
+   // Keeps the total memory taken by caches within the configured budget.
+   MemoryAccountant m_memoryAccountant;
+
+   // A search engine for handling location-based queries, uses Overpass, Nominatim and Open-Meteo APIs.
    std::unique_ptr<ISearchEngine> m_searchEngine;
+
+   // Versions of results sent to clients, used to answer conditional requests.
+   ResponseVersionCache m_versionCache;
+
+   // Serialized responses to repeated requests.
+   ResponseCache m_responseCache;
+
+   // Scan sessions which span several GetRegions requests.
+   ScanSessionCache m_scanSessions;
+
+   // Registrations of the caches above in the memory accountant, destroyed before the caches.
+   std::vector<MemoryAccountant::Registration> m_memoryRegistrations;
+
+   // Workers which run RPCs and parse upstream responses.
+   std::shared_ptr<Executor> m_executor;
+
+   // Limit RPCs in progress, separately for searches waiting for Overpass and Nominatim, for RPCs waiting for
+   // Open-Meteo and for RPCs answered from cached data, so that a slow upstream does not hold up the others.
+   // GetCities and GetRegions scans ask both Overpass and Nominatim, so these upstreams share a bulkhead.
+   // Destroyed first, as running RPCs use the members above.
+   Bulkhead m_searchBulkhead;
+   Bulkhead m_openMeteoBulkhead;
+   Bulkhead m_cacheBulkhead;
 };
 
 }  // namespace geo
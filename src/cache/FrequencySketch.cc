@@ -0,0 +1,77 @@
+#include "FrequencySketch.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+
+// Seeds of hash functions of sketch rows
+constexpr std::array<std::uint64_t, 4> sc_seeds = {
+   0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull};
+
+// Mixes bits of a hash value, so that the rows use independent bits (a step of SplitMix64)
+std::uint64_t mix(std::uint64_t value)
+{
+   value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+   value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+   return value ^ (value >> 31);
+}
+
+}  // namespace
+
+namespace geo
+{
+
+FrequencySketch::FrequencySketch(std::size_t capacity)
+{
+   const std::size_t rowSize = std::bit_ceil(std::max<std::size_t>(capacity, 16));
+   m_counters.resize(rowSize * sc_depth);
+   m_rowMask = rowSize - 1;
+   m_samplePeriod = 10 * std::max<std::size_t>(capacity, 1);
+}
+
+void FrequencySketch::Increment(std::size_t hash)
+{
+   const auto indices = getIndices(hash);
+   for (std::size_t row = 0; row < sc_depth; ++row)
+   {
+      auto& counter = m_counters[row * (m_rowMask + 1) + indices[row]];
+      if (counter < sc_maxCount)
+         ++counter;
+   }
+
+   if (++m_additions >= m_samplePeriod)
+      age();
+}
+
+std::uint32_t FrequencySketch::Estimate(std::size_t hash) const
+{
+   const auto indices = getIndices(hash);
+   std::uint32_t result = sc_maxCount;
+   for (std::size_t row = 0; row < sc_depth; ++row)
+      result = std::min<std::uint32_t>(result, m_counters[row * (m_rowMask + 1) + indices[row]]);
+   return result;
+}
+
+std::size_t FrequencySketch::GetMemoryUsage() const
+{
+   return m_counters.capacity();
+}
+
+std::array<std::size_t, FrequencySketch::sc_depth> FrequencySketch::getIndices(std::size_t hash) const
+{
+   std::array<std::size_t, sc_depth> result;
+   for (std::size_t row = 0; row < sc_depth; ++row)
+      result[row] = static_cast<std::size_t>(mix(hash + sc_seeds[row])) & m_rowMask;
+   return result;
+}
+
+void FrequencySketch::age()
+{
+   for (auto& counter : m_counters)
+      counter /= 2;
+   m_additions = 0;
+}
+
+}  // namespace geo
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace geo
+{
+
+// FrequencySketch estimates how often keys have been accessed recently, using a Count-Min sketch
+// with small saturating counters. All counters are halved periodically, so that old popularity fades away.
+// Estimates may be higher than real frequencies because of hash collisions, but never lower (until halving).
+// The class is not thread-safe, it is guarded by the owning cache.
+class FrequencySketch
+{
+public:
+   // @param capacity Number of entries in the cache, defines the size of the sketch and the halving period
+   explicit FrequencySketch(std::size_t capacity);
+
+   // Records an access to the key
+   // @param hash Hash of the key
+   void Increment(std::size_t hash);
+
+   // Returns the estimated number of recent accesses to the key, at most sc_maxCount
+   std::uint32_t Estimate(std::size_t hash) const;
+
+   // Returns the number of bytes taken by counters
+   std::size_t GetMemoryUsage() const;
+
+   static constexpr std::uint8_t sc_maxCount = 15;  // Counters saturate at this value
+
+private:
+   static constexpr std::size_t sc_depth = 4;  // Number of hash functions (rows of counters)
+
+   // Returns positions of the key's counters in every row
+   std::array<std::size_t, sc_depth> getIndices(std::size_t hash) const;
+
+   // Halves all the counters
+   void age();
+
+private:
+   std::vector<std::uint8_t> m_counters;  // sc_depth rows of counters, one after another
+   std::size_t m_rowMask;                 // Number of counters in a row minus one, the number is a power of two
+   std::size_t m_additions = 0;           // Number of increments since the last halving
+   std::size_t m_samplePeriod;            // Counters are halved after this number of increments
+};
+
+}  // namespace geo
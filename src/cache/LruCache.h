@@ -0,0 +1,151 @@
+#pragma once
+
+#include "../utils/MemoryUsage.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace geo
+{
+
+// Thread-safe cache with a fixed number of entries, which evicts the least recently used entry when full.
+// Memory taken by entries is tracked with EstimateMemoryUsage(), which must be defined for keys and values.
+template <typename TKey, typename TValue>
+class LruCache
+{
+public:
+   // @param capacity Maximum number of entries, 0 disables caching
+   explicit LruCache(std::size_t capacity)
+      : m_capacity(capacity)
+   {
+   }
+
+   // Returns a copy of the cached value and marks the entry as the most recently used one
+   std::optional<TValue> Find(const TKey& key)
+   {
+      std::lock_guard lock(m_mutex);
+      const auto it = m_index.find(key);
+      if (it == m_index.end())
+         return std::nullopt;
+
+      ++m_hits;
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return it->second->second;
+   }
+
+   // Checks whether the key is cached, without marking the entry as used
+   bool Contains(const TKey& key) const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_index.contains(key);
+   }
+
+   // Inserts or replaces the value, evicting the least recently used entry if the cache is full
+   // @return The evicted entry, if any. If caching is disabled, the passed entry is returned as evicted.
+   std::optional<std::pair<TKey, TValue>> Insert(const TKey& key, TValue value)
+   {
+      if (m_capacity == 0)
+         return std::make_pair(key, std::move(value));
+
+      std::lock_guard lock(m_mutex);
+      if (const auto it = m_index.find(key); it != m_index.end())
+      {
+         auto& entry = *it->second;
+         m_memoryUsage -= EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+         entry.second = std::move(value);
+         m_memoryUsage += EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+         m_entries.splice(m_entries.begin(), m_entries, it->second);
+         return std::nullopt;
+      }
+
+      std::optional<Entry> evicted;
+      if (m_entries.size() >= m_capacity)
+      {
+         evicted = popBack();
+      }
+
+      m_entries.emplace_front(key, std::move(value));
+      m_index.emplace(key, m_entries.begin());
+      m_memoryUsage += EstimateCacheEntryMemoryUsage(m_entries.front().first, m_entries.front().second);
+      return evicted;
+   }
+
+   // Modifies the cached value in place without changing its position
+   // @return true if the entry was found
+   template <typename TUpdater>
+   bool Update(const TKey& key, TUpdater updater)
+   {
+      std::lock_guard lock(m_mutex);
+      const auto it = m_index.find(key);
+      if (it == m_index.end())
+         return false;
+
+      auto& entry = *it->second;
+      m_memoryUsage -= EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+      updater(entry.second);
+      m_memoryUsage += EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+      return true;
+   }
+
+   // Returns the number of cached entries
+   std::size_t Size() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_entries.size();
+   }
+
+   // Returns the estimated number of bytes taken by cached entries
+   std::size_t GetMemoryUsage() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_memoryUsage;
+   }
+
+   // Returns the number of successful lookups since the cache was created
+   std::uint64_t GetHits() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_hits;
+   }
+
+   // Evicts the least recently used entries until the given number of bytes is freed or the cache is empty
+   // @return Number of freed bytes
+   std::size_t Evict(std::size_t bytes)
+   {
+      std::lock_guard lock(m_mutex);
+      const std::size_t before = m_memoryUsage;
+      while (!m_entries.empty() && before - m_memoryUsage < bytes)
+         popBack();
+      return before - m_memoryUsage;
+   }
+
+private:
+   using Entry = std::pair<TKey, TValue>;
+   using Entries = std::list<Entry>;
+
+   // Removes the least recently used entry. Must be called under the lock.
+   // @return The removed entry
+   Entry popBack()
+   {
+      Entry entry = std::move(m_entries.back());
+      m_entries.pop_back();
+      m_index.erase(entry.first);
+      m_memoryUsage -= EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+      return entry;
+   }
+
+private:
+   mutable std::mutex m_mutex;                                    // Guards all the members below
+   std::size_t m_capacity;                                        // Maximum number of entries
+   Entries m_entries;                                             // Entries ordered from the most recently used
+   std::unordered_map<TKey, typename Entries::iterator> m_index;  // Key to entry lookup
+   std::size_t m_memoryUsage = 0;                                 // Estimated bytes taken by entries
+   std::uint64_t m_hits = 0;                                      // Number of successful lookups
+};
+
+}  // namespace geo
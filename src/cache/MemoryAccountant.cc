@@ -0,0 +1,182 @@
+#include "MemoryAccountant.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace
+{
+
+// Once the budget is exceeded, caches are shrunk to this share of the budget, so that eviction does not
+// happen on every check while caches refill.
+constexpr double sc_lowWatermark = 0.9;
+
+}  // namespace
+
+namespace geo
+{
+
+MemoryAccountant::Registration::Registration(MemoryAccountant& accountant, std::uint64_t id, Metrics::Gauge gauge)
+   : m_accountant(&accountant)
+   , m_id(id)
+   , m_gauge(std::move(gauge))
+{
+}
+
+MemoryAccountant::Registration::Registration(Registration&& other) noexcept
+   : m_accountant(std::exchange(other.m_accountant, nullptr))
+   , m_id(other.m_id)
+   , m_gauge(std::move(other.m_gauge))
+{
+}
+
+MemoryAccountant::Registration& MemoryAccountant::Registration::operator=(Registration&& other) noexcept
+{
+   if (this != &other)
+   {
+      if (m_accountant)
+         m_accountant->unregister(m_id);
+      m_accountant = std::exchange(other.m_accountant, nullptr);
+      m_id = other.m_id;
+      m_gauge = std::move(other.m_gauge);
+   }
+   return *this;
+}
+
+MemoryAccountant::Registration::~Registration()
+{
+   if (m_accountant)
+      m_accountant->unregister(m_id);
+}
+
+MemoryAccountant::MemoryAccountant(std::size_t budgetBytes)
+   : m_budgetBytes(budgetBytes)
+{
+   auto& metrics = Metrics::Instance();
+   m_gauges.push_back(metrics.RegisterGauge("geo_memory_budget_bytes",
+      [this]
+      {
+         return static_cast<double>(m_budgetBytes);
+      }));
+   m_gauges.push_back(metrics.RegisterGauge("geo_memory_used_bytes",
+      [this]
+      {
+         return static_cast<double>(GetMemoryUsage());
+      }));
+
+   // The thread runs even without a budget, as one may be set later.
+   m_thread = std::jthread(
+      [this](std::stop_token stopToken)
+      {
+         run(std::move(stopToken));
+      });
+}
+
+MemoryAccountant::Registration MemoryAccountant::Register(const std::string& name, Component component)
+{
+   // Metrics are registered without the lock, because gauges are calculated under the registry lock
+   // and the total memory usage gauge takes the accountant lock.
+   auto& metrics = Metrics::Instance();
+   auto& evictedBytesCounter =
+      metrics.GetCounter(std::format("geo_memory_evicted_bytes_total{{component=\"{}\"}}", name));
+   auto gauge = metrics.RegisterGauge(std::format("geo_memory_bytes{{component=\"{}\"}}", name),
+      [getMemoryUsage = component.getMemoryUsage]
+      {
+         return static_cast<double>(getMemoryUsage());
+      });
+
+   std::lock_guard lock(m_mutex);
+   const std::uint64_t id = m_nextId++;
+   const std::uint64_t hits = component.getHits ? component.getHits() : 0;
+   m_components.emplace(id, ComponentState{name, std::move(component), evictedBytesCounter, hits});
+   return Registration(*this, id, std::move(gauge));
+}
+
+void MemoryAccountant::Enforce()
+{
+   struct Candidate
+   {
+      ComponentState* state;  // Cache to evict entries from
+      double hitsPerByte;     // Hits per cached byte since the previous check
+   };
+
+   std::lock_guard lock(m_mutex);
+   std::size_t totalBytes = 0;
+   std::vector<Candidate> candidates;
+   for (auto& [id, state] : m_components)
+   {
+      const std::size_t bytes = state.component.getMemoryUsage();
+      totalBytes += bytes;
+      if (!state.component.evict || !state.component.getHits)
+         continue;
+
+      // Hits are taken on every check, so that the value reflects recent requests only.
+      const std::uint64_t hits = state.component.getHits();
+      candidates.push_back({&state, static_cast<double>(hits - state.lastHits) / std::max<std::size_t>(bytes, 1)});
+      state.lastHits = hits;
+   }
+
+   const std::size_t budgetBytes = m_budgetBytes;
+   if (budgetBytes == 0 || totalBytes <= budgetBytes)
+      return;
+
+   std::ranges::sort(candidates, {}, &Candidate::hitsPerByte);
+   const auto targetBytes = static_cast<std::size_t>(budgetBytes * sc_lowWatermark);
+   std::size_t excessBytes = totalBytes - targetBytes;
+   for (const auto& candidate : candidates)
+   {
+      const std::size_t freedBytes = candidate.state->component.evict(excessBytes);
+      candidate.state->evictedBytesCounter += freedBytes;
+      LOG(INFO) << std::format("Memory budget of {} bytes is exceeded, {} bytes are evicted from {}", budgetBytes,
+         freedBytes, candidate.state->name);
+
+      excessBytes -= std::min(freedBytes, excessBytes);
+      if (excessBytes == 0)
+         return;
+   }
+
+   LOG(ERROR) << std::format(
+      "Caches cannot free {} more bytes to get memory usage below {} bytes", excessBytes, targetBytes);
+}
+
+std::size_t MemoryAccountant::GetMemoryUsage() const
+{
+   std::lock_guard lock(m_mutex);
+   std::size_t result = 0;
+   for (const auto& [id, state] : m_components)
+      result += state.component.getMemoryUsage();
+   return result;
+}
+
+void MemoryAccountant::SetBudget(std::size_t budgetBytes)
+{
+   if (m_budgetBytes.exchange(budgetBytes) != budgetBytes)
+      LOG(INFO) << std::format("Memory budget is changed to {} bytes", budgetBytes);
+}
+
+void MemoryAccountant::unregister(std::uint64_t id)
+{
+   std::lock_guard lock(m_mutex);
+   m_components.erase(id);
+}
+
+void MemoryAccountant::run(std::stop_token stopToken)
+{
+   // The wait is interrupted only when stop is requested, there is nothing else to wait for.
+   const auto neverReady = []
+   {
+      return false;
+   };
+
+   std::unique_lock lock(m_threadMutex);
+   while (!stopToken.stop_requested())
+   {
+      m_threadWakeup.wait_for(lock, stopToken, sc_checkPeriod, neverReady);
+      if (!stopToken.stop_requested())
+         Enforce();
+   }
+}
+
+}  // namespace geo
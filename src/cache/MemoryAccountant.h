@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../utils/Metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace geo
+{
+
+// MemoryAccountant keeps the total memory taken by caches and other components of the service within a global
+// budget. Every component reports its memory usage, caches also report hits and evict entries on request.
+// Once the budget is exceeded, entries are evicted from the caches with the lowest marginal hit value first,
+// which is estimated as the number of hits per cached byte since the previous check: freeing a byte of such a cache
+// costs the fewest hits. Memory usage of every component is exported as a gauge.
+// The class is thread-safe.
+class MemoryAccountant
+{
+public:
+   // Callbacks of a registered component, called under the accountant lock
+   struct Component
+   {
+      std::function<std::size_t()> getMemoryUsage;          // Returns the number of bytes taken by the component
+      std::function<std::uint64_t()> getHits;               // Returns the total number of hits, empty if not a cache
+      std::function<std::size_t(std::size_t bytes)> evict;  // Evicts entries to free the given number of bytes and
+                                                            // returns the number of freed bytes, empty if not a cache
+   };
+
+   // RAII handle of a registered component. The component is unregistered when the handle is destroyed.
+   class Registration
+   {
+   public:
+      Registration(Registration&& other) noexcept;
+      Registration& operator=(Registration&& other) noexcept;
+      ~Registration();
+
+   private:
+      friend class MemoryAccountant;
+      Registration(MemoryAccountant& accountant, std::uint64_t id, Metrics::Gauge gauge);
+
+      MemoryAccountant* m_accountant;  // Accountant the component is registered in, nullptr if moved out
+      std::uint64_t m_id;              // Identifier of the component
+      Metrics::Gauge m_gauge;          // Memory usage gauge of the component
+   };
+
+   // @param budgetBytes Maximum total memory usage of registered components, 0 disables eviction
+   explicit MemoryAccountant(std::size_t budgetBytes);
+
+   // Registers a component, which must stay alive until the registration is destroyed
+   // @param name Name of the component in metrics, e.g. "relation_cache"
+   // @param component Callbacks of the component
+   // @return Handle which unregisters the component on destruction
+   [[nodiscard]] Registration Register(const std::string& name, Component component);
+
+   // Registers a cache with GetMemoryUsage(), GetHits() and Evict(bytes) methods, see Register()
+   template <typename TCache>
+   [[nodiscard]] Registration RegisterCache(const std::string& name, TCache& cache)
+   {
+      return Register(name,
+         Component{
+            [&cache]
+            {
+               return cache.GetMemoryUsage();
+            },
+            [&cache]
+            {
+               return cache.GetHits();
+            },
+            [&cache](std::size_t bytes)
+            {
+               return cache.Evict(bytes);
+            },
+         });
+   }
+
+   // Evicts entries from caches if the total memory usage exceeds the budget.
+   // Called periodically by a background thread.
+   void Enforce();
+
+   // Returns the total memory usage of registered components
+   std::size_t GetMemoryUsage() const;
+
+   // Changes the budget, a lower one is enforced at the next check
+   // @param budgetBytes Maximum total memory usage of registered components, 0 disables eviction
+   void SetBudget(std::size_t budgetBytes);
+
+private:
+   struct ComponentState
+   {
+      std::string name;                       // Name of the component in metrics and logs
+      Component component;                    // Callbacks of the component
+      Metrics::Counter& evictedBytesCounter;  // Number of bytes evicted from the component
+      std::uint64_t lastHits = 0;             // Total number of hits at the previous check
+   };
+
+   // Removes a registered component
+   void unregister(std::uint64_t id);
+
+   // Calls Enforce() periodically until stop is requested
+   void run(std::stop_token stopToken);
+
+private:
+   static constexpr std::chrono::seconds sc_checkPeriod{1};  // How often the budget is checked
+
+   std::atomic<std::size_t> m_budgetBytes;  // Maximum total memory usage, 0 if not limited
+
+   mutable std::mutex m_mutex;                            // Guards all the members below
+   std::map<std::uint64_t, ComponentState> m_components;  // Registered components by identifier
+   std::uint64_t m_nextId = 0;                            // Identifier of the next registered component
+
+   std::vector<Metrics::Gauge> m_gauges;        // Total memory usage and budget
+   std::mutex m_threadMutex;                    // Used by the background thread to wait for the next check
+   std::condition_variable_any m_threadWakeup;  // Wakes the background thread up when stop is requested
+   std::jthread m_thread;                       // Background thread, destroyed first so that it stops before
+                                                // other members are destroyed
+};
+
+}  // namespace geo
@@ -0,0 +1,319 @@
+#include "RelationTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace
+{
+
+// Maximum share of non-empty slots, longer probe sequences make lookups slower
+constexpr double sc_maxLoadFactor = 0.75;
+
+// Names are compacted once removed names take this share of the arena
+constexpr double sc_maxGarbageShare = 0.5;
+
+// Returns the number of relations kept in the window, the table keeps at least one relation
+std::size_t getWindowSize(std::size_t maxEntries, std::size_t windowPercent)
+{
+   return maxEntries > 1 ? std::clamp<std::size_t>(maxEntries * windowPercent / 100, 1, maxEntries - 1) : 0;
+}
+
+// Returns the hash of the OSM id used for frequency estimation
+std::size_t hashOsmId(std::int64_t osmId)
+{
+   return std::hash<std::int64_t>{}(osmId);
+}
+
+// Returns the home slot of the OSM id. OSM ids are mostly sequential, so they are scrambled
+// with Fibonacci hashing to spread neighbouring ids over the table.
+std::size_t getHomeSlot(std::int64_t osmId, std::size_t numSlots)
+{
+   constexpr std::uint64_t sc_goldenRatio = 0x9E3779B97F4A7C15ull;
+   const int shift = 64 - std::countr_zero(numSlots);
+   return shift >= 64 ? 0 : static_cast<std::size_t>((static_cast<std::uint64_t>(osmId) * sc_goldenRatio) >> shift);
+}
+
+// Converts degrees to a fixed point number, unknown (NAN) coordinates become 0
+std::int32_t toFixedPoint(double degrees, double scale)
+{
+   return std::isfinite(degrees) ? static_cast<std::int32_t>(std::lround(degrees / scale)) : 0;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+RelationTable::RelationTable(std::size_t maxEntries)
+   : m_maxEntries(maxEntries - getWindowSize(maxEntries, sc_windowPercent))
+   , m_sketch(maxEntries)
+   , m_window(getWindowSize(maxEntries, sc_windowPercent))
+{
+}
+
+std::optional<nominatim::RelationInfo> RelationTable::Find(nominatim::OsmId osmId)
+{
+   if (auto info = m_threadCache.Find(osmId))
+   {
+      m_hits.fetch_add(1, std::memory_order_relaxed);
+      return info;
+   }
+
+   std::lock_guard lock(m_mutex);
+   const std::uint64_t generation = m_threadCache.GetGeneration();
+   m_sketch.Increment(hashOsmId(osmId));
+
+   auto info = m_window.Find(osmId);
+   if (!info && !m_slots.empty())
+   {
+      auto& record = m_slots[findSlot(osmId)];
+      if (record.osmId == osmId)
+      {
+         record.referenced = 1;
+         info = toRelationInfo(record);
+      }
+   }
+
+   if (info)
+   {
+      m_hits.fetch_add(1, std::memory_order_relaxed);
+      m_threadCache.Store(osmId, *info, generation);
+   }
+   return info;
+}
+
+bool RelationTable::Contains(nominatim::OsmId osmId) const
+{
+   std::lock_guard lock(m_mutex);
+   return m_window.Contains(osmId) || (!m_slots.empty() && m_slots[findSlot(osmId)].osmId == osmId);
+}
+
+void RelationTable::Insert(const nominatim::RelationInfo& info)
+{
+   if (info.osmId == 0)
+      return;
+
+   std::lock_guard lock(m_mutex);
+   if (!m_slots.empty())
+   {
+      // A relation which is already in the table is replaced in place.
+      const std::size_t slot = findSlot(info.osmId);
+      if (m_slots[slot].osmId == info.osmId)
+      {
+         erase(slot);
+         store(info);
+         m_threadCache.Invalidate();
+         return;
+      }
+   }
+
+   const auto replace = [&info](nominatim::RelationInfo& cached)
+   {
+      cached = info;
+   };
+   if (m_window.Update(info.osmId, replace))
+   {
+      m_threadCache.Invalidate();
+      return;
+   }
+
+   if (auto evicted = m_window.Insert(info.osmId, info))
+      admit(evicted->second);
+}
+
+std::size_t RelationTable::Size() const
+{
+   std::lock_guard lock(m_mutex);
+   return m_size + m_window.Size();
+}
+
+std::size_t RelationTable::GetMemoryUsage() const
+{
+   std::lock_guard lock(m_mutex);
+   return getMemoryUsage();
+}
+
+std::uint64_t RelationTable::GetHits() const
+{
+   return m_hits.load(std::memory_order_relaxed);
+}
+
+std::size_t RelationTable::Evict(std::size_t bytes)
+{
+   std::lock_guard lock(m_mutex);
+   const std::size_t before = getMemoryUsage();
+   const std::size_t target = before > bytes ? before - bytes : 0;
+
+   // Memory is freed only when the table is shrunk and names are compacted, so records are removed
+   // until the shrunk table fits the target.
+   const std::size_t otherBytes = m_sketch.GetMemoryUsage() + m_window.GetMemoryUsage();
+   while (m_size > 0 && getNumSlots(m_size) * sizeof(Record) + m_names.size() - m_garbageBytes + otherBytes > target)
+      erase(findVictim());
+
+   if (getNumSlots(m_size) < m_slots.size())
+      rehash(getNumSlots(m_size));
+   compactNames();
+
+   // Recently inserted relations are evicted last, when the table alone cannot free enough.
+   if (const std::size_t usage = getMemoryUsage(); usage > target)
+      m_window.Evict(usage - target);
+
+   const std::size_t after = getMemoryUsage();
+   return before > after ? before - after : 0;
+}
+
+std::size_t RelationTable::findSlot(nominatim::OsmId osmId) const
+{
+   const std::size_t mask = m_slots.size() - 1;
+   std::size_t slot = getHomeSlot(osmId, m_slots.size());
+   while (m_slots[slot].osmId != 0 && m_slots[slot].osmId != osmId)
+      slot = (slot + 1) & mask;
+   return slot;
+}
+
+void RelationTable::admit(const nominatim::RelationInfo& info)
+{
+   if (m_maxEntries == 0)
+      return;
+
+   if (m_size >= m_maxEntries)
+   {
+      // The candidate has to be more popular than the relation it would replace.
+      const std::size_t victim = findVictim();
+      if (m_sketch.Estimate(hashOsmId(info.osmId)) <= m_sketch.Estimate(hashOsmId(m_slots[victim].osmId)))
+         return;
+      erase(victim);
+   }
+   store(info);
+}
+
+void RelationTable::store(const nominatim::RelationInfo& info)
+{
+   if (m_slots.empty())
+      m_slots.resize(sc_minSlots);
+   else if (m_size + 1 > m_slots.size() * sc_maxLoadFactor)
+      rehash(m_slots.size() * 2);
+
+   const std::size_t slot = findSlot(info.osmId);
+   const std::size_t nameLength = std::min<std::size_t>(info.name.size(), std::numeric_limits<std::uint16_t>::max());
+   Record& record = m_slots[slot];
+   record.osmId = info.osmId;
+   record.latitude = toFixedPoint(info.latitude, sc_coordinateScale);
+   record.longitude = toFixedPoint(info.longitude, sc_coordinateScale);
+   record.nameOffset = static_cast<std::uint32_t>(m_names.size());
+   record.nameLength = static_cast<std::uint16_t>(nameLength);
+   record.referenced = 0;
+   record.countryId = info.country.GetId();
+   record.addressTypeId = info.addressType.GetId();
+   m_names.append(info.name, 0, nameLength);
+   ++m_size;
+
+   if (m_garbageBytes > m_names.size() * sc_maxGarbageShare)
+      compactNames();
+}
+
+void RelationTable::erase(std::size_t slot)
+{
+   m_garbageBytes += m_slots[slot].nameLength;
+   --m_size;
+
+   // Backward shift deletion: records which would not be found after the hole is made are moved into it.
+   const std::size_t mask = m_slots.size() - 1;
+   std::size_t hole = slot;
+   for (std::size_t next = (hole + 1) & mask; m_slots[next].osmId != 0; next = (next + 1) & mask)
+   {
+      const std::size_t home = getHomeSlot(m_slots[next].osmId, m_slots.size());
+      const bool homeIsAfterHole = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+      if (!homeIsAfterHole)
+      {
+         m_slots[hole] = m_slots[next];
+         hole = next;
+      }
+   }
+   m_slots[hole] = Record{};
+}
+
+std::size_t RelationTable::findVictim()
+{
+   const std::size_t mask = m_slots.size() - 1;
+   for (;; m_hand = (m_hand + 1) & mask)
+   {
+      Record& record = m_slots[m_hand];
+      if (record.osmId == 0)
+         continue;
+
+      if (record.referenced)
+      {
+         record.referenced = 0;
+         continue;
+      }
+
+      // The hand stays, as another record may be shifted into the slot after the victim is erased.
+      return m_hand;
+   }
+}
+
+void RelationTable::rehash(std::size_t numSlots)
+{
+   std::vector<Record> slots(numSlots);
+   std::swap(slots, m_slots);
+
+   const std::size_t mask = m_slots.size() - 1;
+   for (const auto& record : slots)
+   {
+      if (record.osmId == 0)
+         continue;
+
+      std::size_t slot = getHomeSlot(record.osmId, m_slots.size());
+      while (m_slots[slot].osmId != 0)
+         slot = (slot + 1) & mask;
+      m_slots[slot] = record;
+   }
+   m_hand = 0;
+}
+
+std::size_t RelationTable::getNumSlots(std::size_t numRecords)
+{
+   const auto minSlots = static_cast<std::size_t>(std::ceil(numRecords / sc_maxLoadFactor));
+   return std::max(sc_minSlots, std::bit_ceil(minSlots));
+}
+
+std::size_t RelationTable::getMemoryUsage() const
+{
+   return m_slots.capacity() * sizeof(Record) + m_names.capacity() + m_sketch.GetMemoryUsage() +
+          m_window.GetMemoryUsage();
+}
+
+void RelationTable::compactNames()
+{
+   std::string names;
+   names.reserve(m_names.size() - m_garbageBytes);
+   for (auto& record : m_slots)
+   {
+      if (record.osmId == 0)
+         continue;
+
+      const auto offset = static_cast<std::uint32_t>(names.size());
+      names.append(m_names, record.nameOffset, record.nameLength);
+      record.nameOffset = offset;
+   }
+   m_names = std::move(names);
+   m_garbageBytes = 0;
+}
+
+nominatim::RelationInfo RelationTable::toRelationInfo(const Record& record) const
+{
+   nominatim::RelationInfo info;
+   info.osmId = record.osmId;
+   info.name.assign(m_names, record.nameOffset, record.nameLength);
+   info.country = StringInterner::Instance().Find(record.countryId);
+   info.addressType = StringInterner::Instance().Find(record.addressTypeId);
+   info.latitude = record.latitude * sc_coordinateScale;
+   info.longitude = record.longitude * sc_coordinateScale;
+   return info;
+}
+
+}  // namespace geo
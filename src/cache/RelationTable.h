@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../search/NominatimApiUtils.h"
+#include "../utils/StringInterner.h"
+#include "FrequencySketch.h"
+#include "LruCache.h"
+#include "ThreadLocalCache.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace geo
+{
+
+// RelationTable is a cache of Nominatim relation information with a dense memory layout.
+// A relation takes a 32-byte record in an open addressing table keyed by OSM id, and its name is kept
+// in a shared arena. Coordinates are stored as fixed point numbers, country and address type as ids of
+// interned strings.
+// Eviction follows W-TinyLFU: new relations get into a small LRU window, and a relation evicted from the window
+// replaces the CLOCK victim of the table only if it has been looked up more often, so that bulk region scans
+// do not evict popular relations. Lookups of the hottest relations are served by a per-thread cache without locking.
+// The class is thread-safe.
+class RelationTable
+{
+public:
+   // @param maxEntries Maximum number of cached relations, 0 disables caching
+   explicit RelationTable(std::size_t maxEntries);
+
+   // Returns the cached relation and marks it as recently used
+   std::optional<nominatim::RelationInfo> Find(nominatim::OsmId osmId);
+
+   // Checks whether the relation is cached, without marking it as used or counting the lookup
+   bool Contains(nominatim::OsmId osmId) const;
+
+   // Inserts or replaces the relation. A new relation gets into the window, from which it may later be admitted
+   // to the table in place of a less popular one.
+   void Insert(const nominatim::RelationInfo& info);
+
+   // Returns the number of cached relations
+   std::size_t Size() const;
+
+   // Returns the number of bytes allocated for records and names
+   std::size_t GetMemoryUsage() const;
+
+   // Returns the number of relations found in the cache since it was created
+   std::uint64_t GetHits() const;
+
+   // Evicts relations which have not been used recently and shrinks the table to free the given number of bytes
+   // @return Number of freed bytes
+   std::size_t Evict(std::size_t bytes);
+
+private:
+   struct Record
+   {
+      std::int64_t osmId;                // OSM ID of the relation, 0 for an empty slot
+      std::int32_t latitude;             // Latitude in units of sc_coordinateScale
+      std::int32_t longitude;            // Longitude in units of sc_coordinateScale
+      std::uint32_t nameOffset;          // Offset of the name in m_names
+      std::uint16_t nameLength;          // Length of the name in m_names
+      std::uint16_t referenced;          // Non-zero if the record was used since the CLOCK hand passed it
+      InternedString::Id countryId;      // Country name
+      InternedString::Id addressTypeId;  // Nominatim "addresstype"
+   };
+   static_assert(sizeof(Record) == 32, "Two records must fit into a cache line");
+
+   // Returns the slot of the relation, or the empty slot where it belongs. Must be called under the lock.
+   std::size_t findSlot(nominatim::OsmId osmId) const;
+
+   // Removes the record, shifting the following records of the probe sequence back. Must be called under the lock.
+   void erase(std::size_t slot);
+
+   // Returns the slot of a record which has not been used recently. Must be called under the lock.
+   std::size_t findVictim();
+
+   // Stores a relation evicted from the window if it is used more often than the CLOCK victim.
+   // Must be called under the lock.
+   void admit(const nominatim::RelationInfo& info);
+
+   // Stores a relation, the table must have a free slot for it. Must be called under the lock.
+   void store(const nominatim::RelationInfo& info);
+
+   // Moves records into a table with the given number of slots. Must be called under the lock.
+   void rehash(std::size_t numSlots);
+
+   // Returns the number of slots needed for the given number of records
+   static std::size_t getNumSlots(std::size_t numRecords);
+
+   // Returns the number of bytes taken by the table. Must be called under the lock.
+   std::size_t getMemoryUsage() const;
+
+   // Copies names of stored records into a new arena to free space of removed names. Must be called under the lock.
+   void compactNames();
+
+   // Converts a record back to relation information. Must be called under the lock.
+   nominatim::RelationInfo toRelationInfo(const Record& record) const;
+
+private:
+   static constexpr double sc_coordinateScale = 1e-7;  // 1e-7 degrees is about 1 cm
+   static constexpr std::size_t sc_minSlots = 1024;    // Initial number of slots
+   static constexpr std::size_t sc_windowPercent = 1;  // Share of the window in the maximum number of relations
+
+   const std::size_t m_maxEntries;  // Maximum number of relations in the table, excluding the window
+
+   ThreadLocalCache<nominatim::OsmId, nominatim::RelationInfo> m_threadCache;  // Recently found relations per thread
+   std::atomic<std::uint64_t> m_hits = 0;  // Number of successful lookups, including ones served by thread caches
+
+   mutable std::mutex m_mutex;                                    // Guards all the members below
+   FrequencySketch m_sketch;                                      // Lookup frequencies of OSM ids
+   LruCache<nominatim::OsmId, nominatim::RelationInfo> m_window;  // Recently inserted relations
+   std::vector<Record> m_slots;                                   // Table with linear probing, size is a power of two
+   std::size_t m_size = 0;                                        // Number of non-empty slots
+   std::size_t m_hand = 0;                                        // CLOCK hand, the next slot to check for eviction
+   std::string m_names;                                           // Arena with names of relations
+   std::size_t m_garbageBytes = 0;                                // Bytes of m_names taken by removed names
+};
+
+}  // namespace geo
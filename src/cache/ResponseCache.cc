@@ -0,0 +1,83 @@
+#include "ResponseCache.h"
+
+#include "ResponseVersionCache.h"
+
+#include <grpcpp/support/slice.h>
+
+#include <format>
+#include <vector>
+
+namespace geo
+{
+
+ResponseCache::ResponseCache(const ResponseCacheSettings& settings)
+   : m_settings(settings)
+   , m_responses(settings.maxEntries)
+   , m_hitsCounter(Metrics::Instance().GetCounter("geo_response_cache_hits_total"))
+   , m_missesCounter(Metrics::Instance().GetCounter("geo_response_cache_misses_total"))
+{
+}
+
+bool ResponseCache::ServeCached(std::string_view method, const grpc::ByteBuffer& rawRequest,
+   grpc::ByteBuffer& rawResponse, std::uint64_t dataVersion)
+{
+   if (!find(formatKey(method, rawRequest), dataVersion, rawResponse))
+      return false;
+
+   ++m_hitsCounter;
+   return true;
+}
+
+std::size_t ResponseCache::GetMemoryUsage() const
+{
+   return m_responses.GetMemoryUsage();
+}
+
+std::uint64_t ResponseCache::GetHits() const
+{
+   return m_responses.GetHits();
+}
+
+std::size_t ResponseCache::Evict(std::size_t bytes)
+{
+   return m_responses.Evict(bytes);
+}
+
+std::string ResponseCache::formatKey(std::string_view method, const grpc::ByteBuffer& request)
+{
+   std::vector<grpc::Slice> slices;
+   request.Dump(&slices);
+
+   std::string key;
+   key.reserve(method.size() + 1 + request.Length());
+   key.append(method);
+   key.push_back('/');
+   for (const auto& slice : slices)
+      key.append(reinterpret_cast<const char*>(slice.begin()), slice.size());
+   return key;
+}
+
+std::string ResponseCache::formatKey(std::string_view method, const google::protobuf::MessageLite& request)
+{
+   return ResponseVersionCache::FormatKey(method, request);
+}
+
+bool ResponseCache::find(const std::string& key, std::uint64_t dataVersion, grpc::ByteBuffer& response)
+{
+   const auto entry = m_responses.Find(key);
+   if (!entry || entry->dataVersion != dataVersion || entry->expiresAt < std::chrono::steady_clock::now())
+      return false;
+
+   response = entry->response;
+   return true;
+}
+
+void ResponseCache::store(const std::string& key, const grpc::ByteBuffer& response, std::uint64_t dataVersion)
+{
+   if (response.Length() > m_settings.maxResponseBytes)
+      return;
+
+   m_responses.Insert(key, Entry{response, dataVersion, std::chrono::steady_clock::now() + m_settings.ttl});
+}
+
+}  // namespace geo
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "../utils/MessageArena.h"
+#include "../utils/Metrics.h"
+#include "../utils/Task.h"
+#include "LruCache.h"
+
+#include <grpcpp/impl/codegen/proto_utils.h>
+#include <grpcpp/support/byte_buffer.h>
+#include <grpcpp/support/status.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace google::protobuf
+{
+class MessageLite;
+}  // namespace google::protobuf
+
+namespace geo
+{
+
+struct ResponseCacheSettings
+{
+   std::size_t maxEntries = 1000;                // Maximum number of cached responses.
+   std::size_t maxResponseBytes = 1024 * 1024;  // Bigger responses are not cached.
+   std::chrono::seconds ttl{60};                 // Responses older than this are built again.
+};
+
+// ResponseCache keeps serialized responses of unary RPCs by request bytes.
+// Cached responses are sent as is, so that repeated requests bypass the search engine and protobuf serialization.
+// A response is valid while the data version of the search engine does not change and its TTL has not expired.
+// The class is thread-safe.
+class ResponseCache
+{
+public:
+   explicit ResponseCache(const ResponseCacheSettings& settings);
+
+   // Answers a raw RPC from the cache by request bytes as sent by the client, without parsing the request,
+   // so that cached responses can be sent by the thread which receives the RPC.
+   // @param method Name of the RPC
+   // @param rawRequest Serialized request
+   // @param rawResponse Receives serialized response
+   // @param dataVersion Data version of the search engine taken before the request is handled
+   // @return true if the response is found, false if the request must be passed to Serve()
+   bool ServeCached(std::string_view method, const grpc::ByteBuffer& rawRequest, grpc::ByteBuffer& rawResponse,
+      std::uint64_t dataVersion);
+
+   // Answers a raw RPC from the cache, or parses the request, awaits the handler and caches its response.
+   // Requests are looked up by bytes as sent by the client, and then by their canonical form,
+   // so that requests which differ only in order of map entries share the response.
+   // @param method Name of the RPC
+   // @param rawRequest Serialized TRequest
+   // @param rawResponse Receives serialized TResponse
+   // @param dataVersion Data version of the search engine taken before the request is handled
+   // @param handler Function with signature Task<grpc::Status>(const TRequest&, TResponse&), called on a cache miss.
+   //                The request and the response outlive the task of the handler.
+   // @param isCacheable Optional function which tells whether a response may be cached, e.g. false for partial ones
+   // @return Status of the RPC
+   template <typename TRequest, typename TResponse, typename THandler>
+   Task<grpc::Status> ServeAsync(std::string_view method, const grpc::ByteBuffer& rawRequest,
+      grpc::ByteBuffer& rawResponse, std::uint64_t dataVersion, THandler handler,
+      bool (*isCacheable)(const TResponse&) = nullptr)
+   {
+      const std::string rawKey = formatKey(method, rawRequest);
+      if (find(rawKey, dataVersion, rawResponse))
+      {
+         ++m_hitsCounter;
+         co_return grpc::Status::OK;
+      }
+
+      // Deserialization consumes the buffer, while slices of the copy are shared with the original.
+      // The request is parsed on an arena of the RPC. The response is not: protobuf allocates characters of strings
+      // on the heap even for arena messages, and places moved into an arena message would be copied.
+      grpc::ByteBuffer requestBuffer = rawRequest;
+      MessageArena arena;
+      TRequest& request = arena.Create<TRequest>();
+      if (!grpc::SerializationTraits<TRequest>::Deserialize(&requestBuffer, &request).ok())
+         co_return grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, "Cannot parse request"};
+
+      co_return co_await serveParsedAsync<TRequest, TResponse>(
+         method, rawKey, request, rawResponse, dataVersion, std::move(handler), isCacheable);
+   }
+
+   // Same as ServeAsync(), for RPCs whose requests have been parsed already, e.g. to choose how to handle them
+   // @param request rawRequest parsed, outlives the task
+   template <typename TRequest, typename TResponse, typename THandler>
+   Task<grpc::Status> ServeParsedAsync(std::string_view method, const grpc::ByteBuffer& rawRequest,
+      const TRequest& request, grpc::ByteBuffer& rawResponse, std::uint64_t dataVersion, THandler handler,
+      bool (*isCacheable)(const TResponse&) = nullptr)
+   {
+      const std::string rawKey = formatKey(method, rawRequest);
+      if (find(rawKey, dataVersion, rawResponse))
+      {
+         ++m_hitsCounter;
+         co_return grpc::Status::OK;
+      }
+
+      co_return co_await serveParsedAsync<TRequest, TResponse>(
+         method, rawKey, request, rawResponse, dataVersion, std::move(handler), isCacheable);
+   }
+
+   // Returns the estimated number of bytes taken by cached responses
+   std::size_t GetMemoryUsage() const;
+
+   // Returns the number of responses found in the cache since it was created
+   std::uint64_t GetHits() const;
+
+   // Evicts the least recently used responses to free the given number of bytes
+   // @return Number of freed bytes
+   std::size_t Evict(std::size_t bytes);
+
+private:
+   struct Entry
+   {
+      grpc::ByteBuffer response;                        // Serialized response, slices are shared on copy.
+      std::uint64_t dataVersion;                        // Data version the response was built from.
+      std::chrono::steady_clock::time_point expiresAt;  // When the response is built again.
+
+      // Returns the number of bytes taken by the entry, slices of the response are counted as if not shared
+      friend std::size_t EstimateMemoryUsage(const Entry& entry)
+      {
+         return sizeof(entry) + entry.response.Length();
+      }
+   };
+
+   // Formats a key from the method name and request bytes as sent by the client
+   static std::string formatKey(std::string_view method, const grpc::ByteBuffer& request);
+
+   // Formats a key from the method name and deterministically serialized request
+   static std::string formatKey(std::string_view method, const google::protobuf::MessageLite& request);
+
+   // Copies the cached response if it is still valid for the data version
+   // @return true if the response is found
+   bool find(const std::string& key, std::uint64_t dataVersion, grpc::ByteBuffer& response);
+
+   // Caches the response unless it is too big
+   void store(const std::string& key, const grpc::ByteBuffer& response, std::uint64_t dataVersion);
+
+   // Answers a parsed RPC which is not found by its raw key, see ServeAsync()
+   // @param rawKey Key of the request bytes as sent by the client
+   template <typename TRequest, typename TResponse, typename THandler>
+   Task<grpc::Status> serveParsedAsync(std::string_view method, const std::string& rawKey, const TRequest& request,
+      grpc::ByteBuffer& rawResponse, std::uint64_t dataVersion, THandler handler, bool (*isCacheable)(const TResponse&))
+   {
+      const std::string key = formatKey(method, request);
+      if (key != rawKey && find(key, dataVersion, rawResponse))
+      {
+         ++m_hitsCounter;
+         store(rawKey, rawResponse, dataVersion);
+         co_return grpc::Status::OK;
+      }
+
+      ++m_missesCounter;
+      TResponse response;
+      if (auto status = co_await handler(request, response); !status.ok())
+         co_return status;
+
+      bool ownBuffer = false;
+      if (auto status = grpc::SerializationTraits<TResponse>::Serialize(response, &rawResponse, &ownBuffer);
+          !status.ok())
+         co_return status;
+
+      if (isCacheable && !isCacheable(response))
+         co_return grpc::Status::OK;
+
+      store(key, rawResponse, dataVersion);
+      if (key != rawKey)
+         store(rawKey, rawResponse, dataVersion);
+      co_return grpc::Status::OK;
+   }
+
+private:
+   ResponseCacheSettings m_settings;          // Cache settings.
+   LruCache<std::string, Entry> m_responses;  // Serialized responses by request key.
+
+   Metrics::Counter& m_hitsCounter;    // Number of requests answered from the cache
+   Metrics::Counter& m_missesCounter;  // Number of requests passed to handlers
+};
+
+}  // namespace geo
@@ -0,0 +1,74 @@
+#include "ResponseVersionCache.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/message_lite.h>
+
+#include <format>
+#include <functional>
+
+namespace
+{
+
+// Serializes a message with map entries sorted by key, so that equal messages produce equal bytes
+std::string serializeDeterministically(const google::protobuf::MessageLite& message)
+{
+   std::string result;
+   {
+      google::protobuf::io::StringOutputStream stream(&result);
+      google::protobuf::io::CodedOutputStream output(&stream);
+      output.SetSerializationDeterministic(true);
+      message.SerializeToCodedStream(&output);
+   }
+   return result;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+ResponseVersionCache::ResponseVersionCache(const ResponseVersionCacheSettings& settings)
+   : m_ttl(settings.ttl)
+   , m_versions(settings.maxEntries)
+{
+}
+
+std::string ResponseVersionCache::FormatKey(std::string_view method, const google::protobuf::MessageLite& request)
+{
+   return std::format("{}/{}", method, serializeDeterministically(request));
+}
+
+std::optional<std::string> ResponseVersionCache::Find(const std::string& key, std::uint64_t dataVersion)
+{
+   const auto entry = m_versions.Find(key);
+   if (!entry || entry->dataVersion != dataVersion || entry->expiresAt < std::chrono::steady_clock::now())
+      return std::nullopt;
+   return entry->version;
+}
+
+std::string ResponseVersionCache::Store(
+   const std::string& key, const google::protobuf::MessageLite& result, std::uint64_t dataVersion)
+{
+   const std::size_t hash = std::hash<std::string>{}(serializeDeterministically(result));
+   std::string version = std::format("{:016x}-{}", hash, dataVersion);
+   m_versions.Insert(key, Entry{version, dataVersion, std::chrono::steady_clock::now() + m_ttl});
+   return version;
+}
+
+std::size_t ResponseVersionCache::GetMemoryUsage() const
+{
+   return m_versions.GetMemoryUsage();
+}
+
+std::uint64_t ResponseVersionCache::GetHits() const
+{
+   return m_versions.GetHits();
+}
+
+std::size_t ResponseVersionCache::Evict(std::size_t bytes)
+{
+   return m_versions.Evict(bytes);
+}
+
+}  // namespace geo
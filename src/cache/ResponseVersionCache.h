@@ -0,0 +1,78 @@
+#pragma once
+
+#include "LruCache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace google::protobuf
+{
+class MessageLite;
+}  // namespace google::protobuf
+
+namespace geo
+{
+
+struct ResponseVersionCacheSettings
+{
+   std::size_t maxEntries = 10'000;  // Maximum number of remembered requests.
+   std::chrono::seconds ttl{60};     // Versions older than this are not trusted, and the result is built again.
+                                     // Not every upstream reports data changes, so this bounds staleness.
+};
+
+// ResponseVersionCache remembers the version of the last result sent for a request.
+// A version is a hash of the result combined with the data version of the search engine. While the data version
+// does not change, a request with a matching if_none_match can be answered as "not modified" without building
+// the result. The class is thread-safe.
+class ResponseVersionCache
+{
+public:
+   explicit ResponseVersionCache(const ResponseVersionCacheSettings& settings);
+
+   // Formats a key identifying a request. Requests which differ only in order of map entries have equal keys.
+   // @param method Name of the RPC
+   // @param request Request without if_none_match
+   static std::string FormatKey(std::string_view method, const google::protobuf::MessageLite& request);
+
+   // Returns the version of the last result for the request, if it is still valid for the data version
+   std::optional<std::string> Find(const std::string& key, std::uint64_t dataVersion);
+
+   // Computes and stores the version of a result
+   // @param key Request key, see FormatKey()
+   // @param result Message with the result (e.g. CitiesResponse without version fields)
+   // @param dataVersion Data version of the search engine taken before the result was built
+   // @return Version of the result
+   std::string Store(const std::string& key, const google::protobuf::MessageLite& result, std::uint64_t dataVersion);
+
+   // Returns the estimated number of bytes taken by cached versions
+   std::size_t GetMemoryUsage() const;
+
+   // Returns the number of versions found in the cache since it was created
+   std::uint64_t GetHits() const;
+
+   // Evicts the least recently used versions to free the given number of bytes
+   // @return Number of freed bytes
+   std::size_t Evict(std::size_t bytes);
+
+private:
+   struct Entry
+   {
+      std::string version;                              // Version of the last result.
+      std::uint64_t dataVersion;                        // Data version the result was built from.
+      std::chrono::steady_clock::time_point expiresAt;  // When the version is no longer trusted.
+
+      // Returns the number of bytes taken by the entry
+      friend std::size_t EstimateMemoryUsage(const Entry& entry)
+      {
+         return sizeof(entry) - sizeof(entry.version) + geo::EstimateMemoryUsage(entry.version);
+      }
+   };
+
+   std::chrono::seconds m_ttl;               // See ResponseVersionCacheSettings::ttl.
+   LruCache<std::string, Entry> m_versions;  // Versions by request key.
+};
+
+}  // namespace geo
@@ -0,0 +1,93 @@
+#include "ScanSessionCache.h"
+
+#include "../utils/MemoryUsage.h"
+
+#include <format>
+#include <iterator>
+
+namespace
+{
+
+// Estimated overhead of a node of std::set: color and three pointers, rounded up by the allocator
+constexpr std::size_t sc_setNodeOverhead = 4 * sizeof(void*);
+
+}  // namespace
+
+namespace geo
+{
+
+std::size_t ScanSession::GetMemoryUsage() const
+{
+   return geo::EstimateMemoryUsage(scope) + processedIds.size() * (sizeof(std::int64_t) + sc_setNodeOverhead) +
+          completedTiles.size() * (sizeof(BoundingBox) + sc_setNodeOverhead);
+}
+
+ScanSessionCache::ScanSessionCache(const ScanSessionCacheSettings& settings)
+   : m_settings(settings)
+   , m_sessions(settings.maxEntries)
+   , m_startedCounter(Metrics::Instance().GetCounter("geo_scan_sessions_started_total"))
+{
+}
+
+std::pair<std::string, std::shared_ptr<ScanSession>> ScanSessionCache::Open(
+   const std::string& id, const std::string& scope)
+{
+   const auto now = std::chrono::steady_clock::now();
+   if (!id.empty())
+   {
+      const auto entry = m_sessions.Find(id);
+      if (entry && entry->expiresAt >= now && entry->session->scope == scope)
+         return {id, entry->session};
+   }
+
+   std::string newId = generateId();
+   auto session = std::make_shared<ScanSession>(scope);
+   m_sessions.Insert(newId, Entry{session, 0, now + m_settings.ttl});
+   ++m_startedCounter;
+   return {std::move(newId), std::move(session)};
+}
+
+void ScanSessionCache::Close(const std::string& id, const ScanSession& session)
+{
+   const std::size_t memoryUsage = session.GetMemoryUsage();
+   const auto expiresAt = std::chrono::steady_clock::now() + m_settings.ttl;
+   m_sessions.Update(id,
+      [memoryUsage, expiresAt](Entry& entry)
+      {
+         entry.memoryUsage = memoryUsage;
+         entry.expiresAt = expiresAt;
+      });
+
+   // Sessions grow after they are inserted, so the cap is checked whenever their size changes.
+   const std::size_t totalBytes = m_sessions.GetMemoryUsage();
+   if (totalBytes > m_settings.maxBytes)
+      m_sessions.Evict(totalBytes - m_settings.maxBytes);
+}
+
+std::size_t ScanSessionCache::GetMemoryUsage() const
+{
+   return m_sessions.GetMemoryUsage();
+}
+
+std::uint64_t ScanSessionCache::GetHits() const
+{
+   return m_sessions.GetHits();
+}
+
+std::size_t ScanSessionCache::Evict(std::size_t bytes)
+{
+   return m_sessions.Evict(bytes);
+}
+
+std::string ScanSessionCache::generateId()
+{
+   // Ids are drawn from the random device itself: an engine seeded with a few of its values could be recovered
+   // from the ids it has given out. Sessions are started rarely, so the device is fast enough.
+   std::lock_guard lock(m_randomMutex);
+   std::string id;
+   for (int i = 0; i < 4; ++i)
+      std::format_to(std::back_inserter(id), "{:08x}", static_cast<std::uint32_t>(m_random()));
+   return id;
+}
+
+}  // namespace geo
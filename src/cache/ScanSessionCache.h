@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../utils/GeoUtils.h"
+#include "../utils/Metrics.h"
+#include "LruCache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace geo
+{
+
+struct ScanSessionCacheSettings
+{
+   std::size_t maxEntries = 10'000;          // Maximum number of sessions.
+   std::size_t maxBytes = 64 * 1024 * 1024;  // Maximum memory taken by sessions, least recently used ones are dropped.
+   std::chrono::seconds ttl{1800};           // Sessions not used for this long expire.
+};
+
+// State of a scan session, which spans several GetRegions requests of a client scanning a large area.
+struct ScanSession
+{
+   const std::string scope;               // Preferences of the scan, requests with other preferences start a new one
+   std::mutex mutex;                      // Serializes requests of the session, guards the members below
+   std::set<std::int64_t> processedIds;   // Ids of regions returned in the session
+   std::set<BoundingBox> completedTiles;  // Tiles whose regions have been returned in the session
+
+   // Returns the estimated number of bytes taken by the session. Must be called under the lock.
+   std::size_t GetMemoryUsage() const;
+};
+
+// ScanSessionCache keeps scan sessions by id, so that a scan can be continued by follow-up requests.
+// Sessions expire after a TTL, and the least recently used sessions are dropped once the memory cap is exceeded.
+// The class is thread-safe.
+class ScanSessionCache
+{
+public:
+   explicit ScanSessionCache(const ScanSessionCacheSettings& settings);
+
+   // Returns the session with the given id, or starts a new one if the id is empty, unknown, expired,
+   // or the session belongs to a scan with other preferences
+   // @param id Id of the session passed by the client
+   // @param scope Preferences of the request, see ScanSession::scope
+   // @return Id of the session and its state
+   std::pair<std::string, std::shared_ptr<ScanSession>> Open(const std::string& id, const std::string& scope);
+
+   // Extends the session lifetime and accounts for its new size after a request, dropping the least recently used
+   // sessions if the memory cap is exceeded. Must be called under the session lock.
+   // @param id Id of the session returned by Open()
+   // @param session State of the session
+   void Close(const std::string& id, const ScanSession& session);
+
+   // Returns the estimated number of bytes taken by sessions
+   std::size_t GetMemoryUsage() const;
+
+   // Returns the number of continued sessions
+   std::uint64_t GetHits() const;
+
+   // Drops the least recently used sessions to free the given number of bytes
+   // @return Number of freed bytes
+   std::size_t Evict(std::size_t bytes);
+
+private:
+   struct Entry
+   {
+      std::shared_ptr<ScanSession> session;             // State of the session.
+      std::size_t memoryUsage = 0;                      // Size of the session as of the last Close().
+      std::chrono::steady_clock::time_point expiresAt;  // When the session expires.
+
+      // Returns the number of bytes taken by the entry
+      friend std::size_t EstimateMemoryUsage(const Entry& entry)
+      {
+         return sizeof(entry) + sizeof(ScanSession) + entry.memoryUsage;
+      }
+   };
+
+   // Generates a random id of a new session, so that clients cannot stumble upon sessions of each other
+   std::string generateId();
+
+private:
+   ScanSessionCacheSettings m_settings;      // Cache settings.
+   LruCache<std::string, Entry> m_sessions;  // Sessions by id.
+
+   std::mutex m_randomMutex;     // Guards the generator below
+   std::random_device m_random;  // Generator of session ids, unpredictable unlike seeded engines
+
+   Metrics::Counter& m_startedCounter;  // Number of started sessions
+};
+
+}  // namespace geo
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace geo
+{
+
+// ThreadLocalCache is a small direct-mapped cache in front of a shared cache, with separate slots for every thread.
+// Lookups take no locks and touch only memory of the calling thread, besides reading the generation counter which
+// is written only on invalidation. A cached value is valid while the generation equals the one it was stored with,
+// so the owner of the shared cache calls Invalidate() whenever a value changes there.
+// Every slot holds a single key, which is replaced by the next stored key with the same slot.
+// Slots of a thread are shared by all the caches of the same type, every slot remembers the cache it belongs to.
+template <typename TKey, typename TValue, std::size_t NumSlots = 256, typename THash = std::hash<TKey>>
+class alignas(64) ThreadLocalCache
+{
+   static_assert(std::has_single_bit(NumSlots), "Number of slots must be a power of two");
+
+public:
+   ThreadLocalCache()
+      : m_owner(s_nextOwner.fetch_add(1, std::memory_order_relaxed))
+   {
+   }
+
+   // Returns the current generation, it must be taken before the value is read from the shared cache
+   std::uint64_t GetGeneration() const
+   {
+      return m_generation.load(std::memory_order_acquire);
+   }
+
+   // Returns a copy of the value cached by the calling thread, if it is still valid.
+   // Every sc_refreshPeriod-th hit of a slot is reported as a miss, so that the shared cache sees that
+   // the key is still used and does not evict it.
+   std::optional<TValue> Find(const TKey& key) const
+   {
+      Slot& slot = getSlot(key);
+      if (slot.owner != m_owner || slot.generation != GetGeneration() || !(slot.key == key))
+         return std::nullopt;
+
+      if (++slot.hits % sc_refreshPeriod == 0)
+         return std::nullopt;
+      return slot.value;
+   }
+
+   // Caches the value for the calling thread
+   // @param generation Result of GetGeneration() taken before the value was read from the shared cache
+   void Store(const TKey& key, const TValue& value, std::uint64_t generation)
+   {
+      Slot& slot = getSlot(key);
+      slot.owner = m_owner;
+      slot.generation = generation;
+      slot.hits = 0;
+      slot.key = key;
+      slot.value = value;
+   }
+
+   // Makes values cached by all the threads invalid
+   void Invalidate()
+   {
+      m_generation.fetch_add(1, std::memory_order_acq_rel);
+   }
+
+private:
+   struct Slot
+   {
+      std::uint64_t owner = 0;       // Cache the slot belongs to, 0 if the slot is empty
+      std::uint64_t generation = 0;  // Generation of the cache when the value was read from the shared cache
+      std::uint32_t hits = 0;        // Number of hits since the value was stored
+      TKey key{};                    // Key of the cached value
+      TValue value{};                // Cached value
+   };
+
+   static constexpr std::uint32_t sc_refreshPeriod = 64;  // See Find()
+
+   // Returns the slot of the key in the slots of the calling thread
+   static Slot& getSlot(const TKey& key)
+   {
+      // Fibonacci hashing spreads sequential keys (e.g. OSM ids) over the slots.
+      constexpr std::uint64_t sc_goldenRatio = 0x9E3779B97F4A7C15ull;
+
+      thread_local std::array<Slot, NumSlots> slots;
+      if constexpr (NumSlots == 1)
+      {
+         return slots[0];
+      }
+      else
+      {
+         const std::uint64_t hash = static_cast<std::uint64_t>(THash{}(key)) * sc_goldenRatio;
+         return slots[static_cast<std::size_t>(hash >> (64 - std::countr_zero(NumSlots)))];
+      }
+   }
+
+private:
+   static inline std::atomic<std::uint64_t> s_nextOwner = 1;  // Identifier of the next created cache
+
+   const std::uint64_t m_owner;                  // Identifier of the cache, stored in its slots
+   std::atomic<std::uint64_t> m_generation = 0;  // Incremented when values of the shared cache change
+};
+
+}  // namespace geo
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "../utils/MemoryUsage.h"
+#include "FrequencySketch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace geo
+{
+
+// Thread-safe cache with a fixed number of entries and W-TinyLFU eviction, which resists scans.
+// New entries get into a small LRU window. Entries evicted from the window are admitted to the main segment
+// only if they have been accessed more often than the entry the main segment would evict, according to
+// a frequency sketch. So a burst of one-off keys (e.g. a bulk scan of tiles) cannot flush popular entries.
+// The main segment is a segmented LRU: entries accessed again while in the probation part move to the protected one.
+// The interface is the same as the one of LruCache, memory taken by entries is tracked the same way.
+template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+class WTinyLfuCache
+{
+public:
+   // @param capacity Maximum number of entries, 0 disables caching
+   explicit WTinyLfuCache(std::size_t capacity)
+      : m_windowCapacity(getWindowCapacity(capacity))
+      , m_protectedCapacity((capacity - m_windowCapacity) * sc_protectedPercent / 100)
+      , m_mainCapacity(capacity - m_windowCapacity)
+      , m_sketch(capacity)
+   {
+   }
+
+   // Returns a copy of the cached value and records the access
+   std::optional<TValue> Find(const TKey& key)
+   {
+      std::lock_guard lock(m_mutex);
+      m_sketch.Increment(m_hash(key));
+
+      const auto it = m_index.find(key);
+      if (it == m_index.end())
+         return std::nullopt;
+
+      ++m_hits;
+      touch(it->second);
+      return it->second.entry->second;
+   }
+
+   // Inserts or replaces the value. A new entry may evict another one, or may be dropped later on admission
+   void Insert(const TKey& key, TValue value)
+   {
+      if (m_mainCapacity == 0)
+         return;
+
+      std::lock_guard lock(m_mutex);
+      if (const auto it = m_index.find(key); it != m_index.end())
+      {
+         auto& entry = *it->second.entry;
+         m_memoryUsage -= EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+         entry.second = std::move(value);
+         m_memoryUsage += EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+         touch(it->second);
+         return;
+      }
+
+      m_window.emplace_front(key, std::move(value));
+      m_index.emplace(key, Position{Segment::Window, m_window.begin()});
+      m_memoryUsage += EstimateCacheEntryMemoryUsage(m_window.front().first, m_window.front().second);
+      if (m_window.size() > m_windowCapacity)
+         admitFromWindow();
+   }
+
+   // Modifies the cached value in place without recording an access
+   // @return true if the entry was found
+   template <typename TUpdater>
+   bool Update(const TKey& key, TUpdater updater)
+   {
+      std::lock_guard lock(m_mutex);
+      const auto it = m_index.find(key);
+      if (it == m_index.end())
+         return false;
+
+      auto& entry = *it->second.entry;
+      m_memoryUsage -= EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+      updater(entry.second);
+      m_memoryUsage += EstimateCacheEntryMemoryUsage(entry.first, entry.second);
+      return true;
+   }
+
+   // Returns the number of cached entries
+   std::size_t Size() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_index.size();
+   }
+
+   // Returns the estimated number of bytes taken by cached entries and the frequency sketch
+   std::size_t GetMemoryUsage() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_memoryUsage + m_sketch.GetMemoryUsage();
+   }
+
+   // Returns the number of successful lookups since the cache was created
+   std::uint64_t GetHits() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_hits;
+   }
+
+   // Evicts entries until the given number of bytes is freed or the cache is empty. Probation entries are evicted
+   // first, then window entries, and protected entries last.
+   // @return Number of freed bytes
+   std::size_t Evict(std::size_t bytes)
+   {
+      std::lock_guard lock(m_mutex);
+      const std::size_t before = m_memoryUsage;
+      while (!m_index.empty() && before - m_memoryUsage < bytes)
+      {
+         Entries& segment = !m_probation.empty() ? m_probation : !m_window.empty() ? m_window : m_protected;
+         erase(segment, std::prev(segment.end()));
+      }
+      return before - m_memoryUsage;
+   }
+
+   // Calls the function for every cached value, e.g. to collect statistics
+   template <typename TVisitor>
+   void ForEach(TVisitor visitor) const
+   {
+      std::lock_guard lock(m_mutex);
+      for (const auto* segment : {&m_window, &m_probation, &m_protected})
+      {
+         for (const auto& entry : *segment)
+            visitor(entry.first, entry.second);
+      }
+   }
+
+private:
+   using Entry = std::pair<TKey, TValue>;
+   using Entries = std::list<Entry>;
+
+   enum class Segment
+   {
+      Window,     // Recently added entries
+      Probation,  // Entries of the main segment accessed once since admission
+      Protected,  // Entries of the main segment accessed more than once
+   };
+
+   struct Position
+   {
+      Segment segment;
+      typename Entries::iterator entry;
+   };
+
+   static constexpr std::size_t sc_windowPercent = 1;      // Share of the window in the capacity
+   static constexpr std::size_t sc_protectedPercent = 80;  // Share of the protected part in the main segment
+
+   // Moves the accessed entry to the front of its segment, promoting it from probation to protected.
+   // Must be called under the lock.
+   void touch(Position& position)
+   {
+      switch (position.segment)
+      {
+      case Segment::Window:
+         m_window.splice(m_window.begin(), m_window, position.entry);
+         break;
+
+      case Segment::Probation:
+         m_protected.splice(m_protected.begin(), m_probation, position.entry);
+         position.segment = Segment::Protected;
+         if (m_protected.size() > m_protectedCapacity)
+         {
+            // The least recently used protected entry gets another chance in probation
+            const auto demoted = std::prev(m_protected.end());
+            m_probation.splice(m_probation.begin(), m_protected, demoted);
+            m_index.at(demoted->first).segment = Segment::Probation;
+         }
+         break;
+
+      case Segment::Protected:
+         m_protected.splice(m_protected.begin(), m_protected, position.entry);
+         break;
+      }
+   }
+
+   // Returns the number of entries kept in the window. The main segment keeps at least one entry, so a cache of
+   // a single entry has no window and admits new entries straight to the main segment.
+   static std::size_t getWindowCapacity(std::size_t capacity)
+   {
+      return capacity > 1 ? std::clamp<std::size_t>(capacity * sc_windowPercent / 100, 1, capacity - 1) : 0;
+   }
+
+   // Moves the least recently used window entry to the main segment if it wins against the main segment's
+   // eviction candidate, otherwise drops it. Must be called under the lock.
+   void admitFromWindow()
+   {
+      const auto candidate = std::prev(m_window.end());
+      if (m_probation.size() + m_protected.size() >= m_mainCapacity)
+      {
+         Entries& victims = m_probation.empty() ? m_protected : m_probation;
+         if (victims.empty() ||
+             m_sketch.Estimate(m_hash(candidate->first)) <= m_sketch.Estimate(m_hash(victims.back().first)))
+         {
+            erase(m_window, candidate);
+            return;
+         }
+
+         erase(victims, std::prev(victims.end()));
+      }
+
+      m_probation.splice(m_probation.begin(), m_window, candidate);
+      m_index.at(candidate->first).segment = Segment::Probation;
+   }
+
+   // Removes the entry from its segment and the index. Must be called under the lock.
+   void erase(Entries& segment, typename Entries::iterator entry)
+   {
+      m_memoryUsage -= EstimateCacheEntryMemoryUsage(entry->first, entry->second);
+      m_index.erase(entry->first);
+      segment.erase(entry);
+   }
+
+private:
+   const std::size_t m_windowCapacity;     // Maximum number of entries in the window
+   const std::size_t m_protectedCapacity;  // Maximum number of entries in the protected part of the main segment
+   const std::size_t m_mainCapacity;       // Maximum number of entries in the main segment
+
+   mutable std::mutex m_mutex;                         // Guards all the members below
+   Entries m_window;                                   // Window entries ordered from the most recently used
+   Entries m_probation;                                // Probation entries ordered from the most recently used
+   Entries m_protected;                                // Protected entries ordered from the most recently used
+   std::unordered_map<TKey, Position, THash> m_index;  // Key to entry lookup
+   FrequencySketch m_sketch;                           // Access frequencies of keys, including absent ones
+   THash m_hash;                                       // Hash function of keys
+   std::size_t m_memoryUsage = 0;                      // Estimated bytes taken by entries
+   std::uint64_t m_hits = 0;                           // Number of successful lookups
+};
+
+}  // namespace geo
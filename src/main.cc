@@ -1,6 +1,9 @@
+#include "AdminServiceImpl.h"
 #include "DebugHelpers.h"
 #include "GeoServiceImpl.h"
+#include "utils/ConfigConstants.h"
 #include "utils/Configuration.h"
+#include "utils/ConfigurationStore.h"
 
 #include <absl/flags/commandlineflag.h>
 #include <absl/flags/flag.h>
@@ -25,14 +28,25 @@ namespace geo
 void RunServer(const std::string& configFilePath)
 {
    std::string server_address("0.0.0.0:50051");
-   Configuration configuration(configFilePath.c_str());
-   GeoServiceImpl service(configuration);
+   ConfigurationStore configurationStore(configFilePath,
+      [](const Configuration& configuration)
+      {
+         GeoServiceImpl::LoadReloadableSettings(configuration);
+      });
+   GeoServiceImpl service(configurationStore);
+   const auto subscription = configurationStore.Subscribe(
+      [&service](const Configuration& configuration)
+      {
+         service.ApplyConfiguration(configuration);
+      });
+   AdminServiceImpl adminService(configurationStore.Current()->GetInt64(sz_adminHeapProfilingKey, 0, 1) != 0);
 
    grpc::EnableDefaultHealthCheckService(true);
 
    grpc::ServerBuilder builder;
    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
    builder.RegisterService(&service);
+   builder.RegisterService(&adminService);
    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
 
    const int lifetimeSeconds = 300;
@@ -55,6 +69,15 @@ ABSL_FLAG(std::uint32_t, filter, 0, "[Debug] Bitmask to specify which features t
 ABSL_FLAG(std::string, name, "", "[Debug] Search for cities by name");
 ABSL_FLAG(std::string, fromDate, "", "[Debug] Start date for weather request");
 ABSL_FLAG(std::string, toDate, "", "[Debug] End date for weather request");
+ABSL_FLAG(std::string, ingestWeather, "", "[Debug] Make a weather archive from this CSV file of daily temperatures");
+ABSL_FLAG(std::string, weatherArchive, "", "[Debug] Path of the weather archive made by --ingestWeather");
+ABSL_FLAG(double, weatherCellSize, 0.25, "[Debug] Width and height of weather archive cells in degrees");
+ABSL_FLAG(std::uint32_t, benchmarkRelations, 0, "[Debug] Benchmark the relation cache with this number of relations");
+ABSL_FLAG(std::uint32_t, benchmarkContention, 0, "[Debug] Benchmark cache lookups with up to this many threads");
+ABSL_FLAG(std::uint32_t, benchmarkExecutor, 0, "[Debug] Benchmark thread pools with up to this many threads");
+ABSL_FLAG(std::uint32_t, benchmarkWeather, 0, "[Debug] Benchmark weather window queries of this many locations");
+ABSL_FLAG(bool, checkExecutor, false, "[Debug] Check the work-stealing deque and the executor on several threads");
+ABSL_FLAG(bool, checkAsyncQueue, false, "[Debug] Check AsyncQueue with producers and consumers on several threads");
 
 int main(int argc, char** argv)
 {
@@ -77,8 +100,31 @@ int main(int argc, char** argv)
       std::string name = absl::GetFlag(FLAGS_name);
       std::string fromDate = absl::GetFlag(FLAGS_fromDate);
       std::string toDate = absl::GetFlag(FLAGS_toDate);
+      std::string ingestWeather = absl::GetFlag(FLAGS_ingestWeather);
+      std::string weatherArchive = absl::GetFlag(FLAGS_weatherArchive);
+      double weatherCellSize = absl::GetFlag(FLAGS_weatherCellSize);
+      std::uint32_t benchmarkRelations = absl::GetFlag(FLAGS_benchmarkRelations);
+      std::uint32_t benchmarkContention = absl::GetFlag(FLAGS_benchmarkContention);
+      std::uint32_t benchmarkExecutor = absl::GetFlag(FLAGS_benchmarkExecutor);
+      std::uint32_t benchmarkWeather = absl::GetFlag(FLAGS_benchmarkWeather);
+      bool checkExecutor = absl::GetFlag(FLAGS_checkExecutor);
+      bool checkAsyncQueue = absl::GetFlag(FLAGS_checkAsyncQueue);
 
-      if (!name.empty())
+      if (!ingestWeather.empty() && !weatherArchive.empty())
+         geo::debug::IngestWeatherArchive(ingestWeather, weatherArchive, weatherCellSize);
+      else if (benchmarkRelations != 0)
+         geo::debug::BenchmarkRelationCache(benchmarkRelations);
+      else if (benchmarkContention != 0)
+         geo::debug::BenchmarkCacheContention(benchmarkContention);
+      else if (benchmarkExecutor != 0)
+         geo::debug::BenchmarkExecutor(benchmarkExecutor);
+      else if (benchmarkWeather != 0)
+         geo::debug::BenchmarkWeatherWindows(benchmarkWeather);
+      else if (checkExecutor)
+         geo::debug::CheckExecutor();
+      else if (checkAsyncQueue)
+         geo::debug::CheckAsyncQueue();
+      else if (!name.empty())
          geo::debug::Search(name, configFilePath);
       else if (lat != NAN && lon != NAN && !fromDate.empty() && !toDate.empty())
          geo::debug::RequestWeather(lat, lon, fromDate, toDate, configFilePath);
@@ -1,7 +1,12 @@
 #include "GetCitiesReactor.h"
 
+#include "../cache/ResponseCache.h"
+#include "../cache/ResponseVersionCache.h"
 #include "../search/SearchEngineItf.h"
+#include "../utils/Bulkhead.h"
 #include "../utils/GeoUtils.h"
+#include "../utils/RequestContext.h"
+#include "../utils/TagDictionary.h"
 #include "../utils/grpcUtils.h"
 #include "RequestValidators.h"
 
@@ -12,37 +17,123 @@
 namespace geo
 {
 
-GetCitiesReactor::GetCitiesReactor(grpc::CallbackServerContext* context, const geoproto::CitiesRequest& request,
-   geoproto::CitiesResponse& response, ISearchEngine& searchEngine)
+GetCitiesReactor::GetCitiesReactor(grpc::CallbackServerContext* context, const grpc::ByteBuffer& rawRequest,
+   grpc::ByteBuffer& rawResponse, ISearchEngine& searchEngine, ResponseVersionCache& versionCache,
+   ResponseCache& responseCache, Bulkhead& bulkhead)
+   : m_requestContext{ExtractDeadline(*context), false, {}, &m_arena, &m_upstreamFailures}
 {
-   if (auto errorString = ValidateCitiesRequest(request))
+   // The data version is taken in advance, so that changes made while the result is built invalidate it.
+   const std::uint64_t dataVersion = searchEngine.GetDataVersion();
+   if (responseCache.ServeCached("GetCities", rawRequest, rawResponse, dataVersion))
    {
-      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
-      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString});
+      Finish(grpc::Status::OK);
       return;
    }
 
+   // Cities are looked up in Overpass, which may take minutes. The response is built by coroutines, which do not
+   // block threads while waiting, and the RPC is finished by the one which completes it. The bulkhead bounds
+   // the number of such RPCs in progress.
+   Bulkhead::Job job;
+   job.run = [this, context, &rawRequest, &rawResponse, &searchEngine, &versionCache, &responseCache, dataVersion](
+                Bulkhead::Permit permit)
+   {
+      const auto build = [this, context, &searchEngine, &versionCache, dataVersion](
+                            const geoproto::CitiesRequest& request, geoproto::CitiesResponse& response)
+      {
+         return process(*context, request, response, searchEngine, versionCache, dataVersion, m_upstreamFailures);
+      };
+
+      const ScopedRequestContext scopedRequestContext(m_requestContext);
+      StartDetached(responseCache.ServeAsync<geoproto::CitiesRequest, geoproto::CitiesResponse>(
+                       "GetCities", rawRequest, rawResponse, dataVersion, build),
+         [this, permit = std::move(permit)](grpc::Status status) mutable
+         {
+            permit.Release();
+            Finish(status);
+         });
+   };
+   job.drop = [this](Bulkhead::DropReason reason)
+   {
+      Finish(ToStatus(reason));
+   };
+   job.isCancelled = [context]
+   {
+      return context->IsCancelled();
+   };
+   job.deadline = m_requestContext.deadline;
+   if (!bulkhead.TrySubmit(std::move(job)))
+      Finish(grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many GetCities requests are in progress"});
+}
+
+Task<grpc::Status> GetCitiesReactor::process(grpc::CallbackServerContext& context,
+   const geoproto::CitiesRequest& request, geoproto::CitiesResponse& response, ISearchEngine& searchEngine,
+   ResponseVersionCache& versionCache, std::uint64_t dataVersion, const UpstreamFailures& upstreamFailures)
+{
+   if (auto errorString = ValidateCitiesRequest(request))
+   {
+      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(context));
+      co_return grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString};
+   }
+
+   // Answer "not modified" without building the result if the client already has its current version.
+   geoproto::CitiesRequest canonicalRequest = request;
+   canonicalRequest.clear_if_none_match();
+   const std::string requestKey = ResponseVersionCache::FormatKey("GetCities", canonicalRequest);
+   if (request.has_if_none_match())
+   {
+      if (const auto version = versionCache.Find(requestKey, dataVersion); version == request.if_none_match())
+      {
+         response.set_version(*version);
+         response.set_not_modified(true);
+         co_return grpc::Status::OK;
+      }
+   }
+
    GeoProtoPlaces cities;  // Container to hold the search results.
 
+   // Dictionary of feature tags, if the client has asked for compact tags.
+   TagDictionary tagDictionary;
+   TagDictionary* const tagDictionaryPtr = request.compact_tags() ? &tagDictionary : nullptr;
+
    // Check if the request includes a position (latitude/longitude) for the search.
    if (request.has_position())
    {
       // Find cities by their geographic position.
-      cities = searchEngine.FindCitiesByPosition(
-         request.position().latitude(), request.position().longitude(), request.include_details());
+      cities = co_await searchEngine.FindCitiesByPositionAsync(
+         request.position().latitude(), request.position().longitude(), request.include_details(), tagDictionaryPtr);
    }
    // Check if the request includes a city name for the search.
    else if (request.has_name())
    {
       // Find cities by their name.
-      cities = searchEngine.FindCitiesByName(request.name(), request.include_details());
+      cities = co_await searchEngine.FindCitiesByNameAsync(request.name(), request.include_details(), tagDictionaryPtr);
+   }
+
+   // Cities missing because of upstream errors would make the response look complete, so it is neither sent nor
+   // cached nor versioned.
+   if (auto status = ToStatus(upstreamFailures); !status.ok())
+   {
+      LOG(ERROR) << std::format("Cannot find cities: {}", status.error_message());
+      co_return status;
    }
 
    // Populate the response with the found cities.
    *response.mutable_cities() = {std::make_move_iterator(cities.begin()), std::make_move_iterator(cities.end())};
+   auto tagStrings = tagDictionary.Release();
+   *response.mutable_tag_dictionary() = {
+      std::make_move_iterator(tagStrings.begin()), std::make_move_iterator(tagStrings.end())};
+
+   // Versioning the result and dropping it if the client already has the same one.
+   response.set_version(versionCache.Store(requestKey, response, dataVersion));
+   if (request.has_if_none_match() && response.version() == request.if_none_match())
+   {
+      response.clear_cities();
+      response.clear_tag_dictionary();
+      response.set_not_modified(true);
+   }
 
    // Finish the RPC with a success status.
-   Finish(grpc::Status::OK);
+   co_return grpc::Status::OK;
 }
 
 }  // namespace geo
@@ -1,18 +1,26 @@
 #pragma once
 
+#include "../utils/RequestArena.h"
+#include "../utils/RequestContext.h"
+#include "../utils/Task.h"
 #include "geo.grpc.pb.h"
 
 #include <absl/log/log.h>
 #include <grpc/grpc.h>
+#include <grpcpp/support/byte_buffer.h>
 #include <grpcpp/support/server_callback.h>
 
+#include <cstdint>
 #include <format>
 
 namespace geo
 {
 
+class Bulkhead;
 class WebClient;
 class ISearchEngine;
+class ResponseCache;
+class ResponseVersionCache;
 
 // Reactor class for handling unary (non-streaming) responses for the GetCities RPC.
 // This class is responsible for processing a single request and returning a single response
@@ -21,14 +29,26 @@ class GetCitiesReactor : public grpc::ServerUnaryReactor
 {
 public:
    // Constructor for the GetCitiesReactor.
+   // The RPC is registered as a raw method, so that cached serialized responses can be sent as is.
    // @param context: Server context.
-   // @param request: The incoming CitiesRequest from the client.
-   // @param response: The CitiesResponse to be populated and sent back to the client.
+   // @param rawRequest: The incoming serialized CitiesRequest from the client.
+   // @param rawResponse: The serialized CitiesResponse to be sent back to the client.
    // @param searchEngine: Reference to the search engine used to find cities.
-   GetCitiesReactor(grpc::CallbackServerContext* context, const geoproto::CitiesRequest& request,
-      geoproto::CitiesResponse& response, ISearchEngine& searchEngine);
+   // @param versionCache: Versions of previously sent results, used to answer requests with if_none_match.
+   // @param responseCache: Serialized responses to repeated requests.
+   // @param bulkhead: Limits RPCs which build responses not found in the response cache.
+   GetCitiesReactor(grpc::CallbackServerContext* context, const grpc::ByteBuffer& rawRequest,
+      grpc::ByteBuffer& rawResponse, ISearchEngine& searchEngine, ResponseVersionCache& versionCache,
+      ResponseCache& responseCache, Bulkhead& bulkhead);
 
 private:
+   // Builds the response to a request which is not found in the response cache.
+   // @param upstreamFailures: Failures of upstream requests made for the RPC.
+   // @return Status of the RPC
+   static Task<grpc::Status> process(grpc::CallbackServerContext& context, const geoproto::CitiesRequest& request,
+      geoproto::CitiesResponse& response, ISearchEngine& searchEngine, ResponseVersionCache& versionCache,
+      std::uint64_t dataVersion, const UpstreamFailures& upstreamFailures);
+
    // Called when the RPC is completed. Logs the completion and cleans up the reactor.
    void OnDone() override
    {
@@ -38,6 +58,11 @@ private:
 
    // Called when the RPC is cancelled by the client. Logs the cancellation.
    void OnCancel() override { LOG(ERROR) << std::format("GetCities() RPC cancelled"); }
+
+private:
+   RequestArena m_arena;                 // Temporary objects of the RPC, released when OnDone() deletes the reactor
+   UpstreamFailures m_upstreamFailures;  // Failures of upstream requests made for the RPC
+   RequestContext m_requestContext;      // Upstream requests of the RPC are ordered and dropped by its deadline
 };
 
 }  // namespace geo
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "GetNearestCitiesReactor.h"
+
+#include "../search/SearchEngineItf.h"
+#include "../utils/grpcUtils.h"
+#include "RequestValidators.h"
+
+#include <absl/log/log.h>
+
+#include <format>
+
+namespace geo
+{
+
+GetNearestCitiesReactor::GetNearestCitiesReactor(grpc::CallbackServerContext* context,
+   const geoproto::NearestCitiesRequest& request, geoproto::NearestCitiesResponse& response,
+   ISearchEngine& searchEngine)
+{
+   if (const char* errorString = ValidateNearestCitiesRequest(request))
+   {
+      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
+      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString});
+      return;
+   }
+
+   // Find the cities in the index, nearest ones first.
+   const auto cities = searchEngine.FindNearestCities(
+      request.position().latitude(), request.position().longitude(), request.k(), request.max_distance_km());
+
+   // Populate the response with the found cities.
+   response.mutable_cities()->Reserve(static_cast<int>(cities.size()));
+   for (const auto& city : cities)
+   {
+      auto& nearestCity = *response.add_cities();
+      *nearestCity.mutable_city() = city.place;
+      nearestCity.set_distance_km(city.distanceKm);
+   }
+
+   // Finish the RPC with a success status.
+   Finish(grpc::Status::OK);
+}
+
+}  // namespace geo
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "geo.grpc.pb.h"
+
+#include <absl/log/log.h>
+#include <grpc/grpc.h>
+#include <grpcpp/support/server_callback.h>
+
+#include <format>
+
+namespace geo
+{
+
+class ISearchEngine;
+
+// Reactor class for handling unary (non-streaming) responses for the GetNearestCities RPC.
+// Cities are found in the in-memory city index without asking upstreams, so the response is built
+// by the thread which received the RPC.
+class GetNearestCitiesReactor : public grpc::ServerUnaryReactor
+{
+public:
+   // Constructor for the GetNearestCitiesReactor.
+   // @param context: Server context.
+   // @param request: The incoming NearestCitiesRequest from the client.
+   // @param response: The NearestCitiesResponse to be populated and sent back to the client.
+   // @param searchEngine: Reference to the search engine used to find cities.
+   GetNearestCitiesReactor(grpc::CallbackServerContext* context, const geoproto::NearestCitiesRequest& request,
+      geoproto::NearestCitiesResponse& response, ISearchEngine& searchEngine);
+
+private:
+   // Called when the RPC is completed. Logs the completion and cleans up the reactor.
+   void OnDone() override
+   {
+      LOG(INFO) << std::format("GetNearestCities() RPC completed");
+      delete this;
+   }
+
+   // Called when the RPC is cancelled by the client. Logs the cancellation.
+   void OnCancel() override { LOG(ERROR) << std::format("GetNearestCities() RPC cancelled"); }
+};
+
+}  // namespace geo
@@ -1,41 +1,272 @@
 #include "GetRegionsReactor.h"
 
+#include "../cache/ResponseCache.h"
+#include "../cache/ResponseVersionCache.h"
+#include "../cache/ScanSessionCache.h"
 #include "../search/SearchEngineItf.h"
+#include "../utils/Bulkhead.h"
 #include "../utils/GeoUtils.h"
+#include "../utils/RequestContext.h"
 #include "../utils/grpcUtils.h"
 #include "RequestValidators.h"
 
+#include <cstdint>
 #include <format>
 #include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using namespace geo;
+
+// Finds regions in the tiles of the box, loading tiles missing in caches from upstreams
+// @return Found regions
+Task<GeoProtoPlaces> findRegionsAsync(
+   BoundingBox box, const ISearchEngine::RegionPreferences& prefs, ISearchEngine& searchEngine)
+{
+   // Tiles are aligned to a grid, so results for them can be cached and reused by requests for nearby positions.
+   // Tiles crossing edges of the box are clipped to it, so regions beyond the requested distance are not returned.
+   std::set<std::int64_t> processed;
+   GeoProtoPlaces result;
+   std::vector<BoundingBox> tiles = CreateClippedGridTiles(box, prefs.maxTileSizeDegrees);
+   for (auto& tile : co_await searchEngine.ScanRegionsAsync(std::move(tiles), prefs, processed))
+   {
+      result.insert(
+         result.end(), std::make_move_iterator(tile.regions.begin()), std::make_move_iterator(tile.regions.end()));
+   }
+
+   // Users pan maps, so the next request likely needs the tiles around this box.
+   searchEngine.PrefetchRegionsAround(box, prefs);
+   co_return result;
+}
+
+// Finds regions in cached data only and describes which tiles are covered
+void findCachedRegions(const BoundingBox& box, const ISearchEngine::RegionPreferences& prefs,
+   ISearchEngine& searchEngine, geoproto::RegionsResponse& response)
+{
+   std::vector<ISearchEngine::TileCoverage> tiles;
+   auto regions = searchEngine.FindCachedRegions(box, prefs, tiles);
+   response.mutable_regions()->Add(std::make_move_iterator(regions.begin()), std::make_move_iterator(regions.end()));
+
+   auto& coverage = *response.mutable_coverage();
+   coverage.set_complete(true);
+   coverage.set_max_staleness_seconds(static_cast<std::uint32_t>(searchEngine.GetMaxStaleness().count()));
+   for (const auto& tile : tiles)
+   {
+      auto& protoTile = *coverage.add_tiles();
+      protoTile.mutable_south_west()->set_latitude(tile.tile[0]);
+      protoTile.mutable_south_west()->set_longitude(tile.tile[1]);
+      protoTile.mutable_north_east()->set_latitude(tile.tile[2]);
+      protoTile.mutable_north_east()->set_longitude(tile.tile[3]);
+      protoTile.set_covered(tile.covered);
+      protoTile.set_coarse(tile.coarse);
+
+      // Regions of a larger tile may lie outside the requested box, and some of them are dropped once the tile
+      // itself is loaded, so such results are incomplete too.
+      if (!tile.covered || tile.coarse)
+         coverage.set_complete(false);
+   }
+}
+
+// Continues a scan session: tiles scanned earlier in the session are skipped, and so are regions returned before.
+// The session is not locked while upstreams are requested, so the scan works on a copy of its state, which is merged
+// back afterwards. Concurrent requests of the same session may then return the same regions.
+// @param sessionId Receives the id of the session
+// @return Found regions
+Task<GeoProtoPlaces> findRegionsInSessionAsync(BoundingBox box, const ISearchEngine::RegionPreferences& prefs,
+   const geoproto::RegionsRequest& request, ISearchEngine& searchEngine, ScanSessionCache& scanSessions,
+   std::string& sessionId)
+{
+   std::shared_ptr<ScanSession> session;
+   std::tie(sessionId, session) =
+      scanSessions.Open(request.session_id(), ResponseVersionCache::FormatKey("GetRegions", request.prefs()));
+
+   std::vector<BoundingBox> tiles = CreateClippedGridTiles(box, prefs.maxTileSizeDegrees);
+   std::set<std::int64_t> processedIds;
+   {
+      std::lock_guard lock(session->mutex);
+      std::erase_if(tiles,
+         [&session](const BoundingBox& tile)
+         {
+            return session->completedTiles.contains(tile);
+         });
+      processedIds = session->processedIds;
+   }
+
+   auto tileRegions = co_await searchEngine.ScanRegionsAsync(tiles, prefs, processedIds);
+
+   GeoProtoPlaces result;
+   {
+      std::lock_guard lock(session->mutex);
+      for (std::size_t i = 0; i < tiles.size(); ++i)
+      {
+         // Tiles with regions which were not looked up are scanned again by the next request. So are tiles without
+         // new regions: an Overpass error gives no regions either, and such tiles are cheap to scan thanks
+         // to the tile cache.
+         auto& [regions, complete] = tileRegions[i];
+         if (complete && !regions.empty())
+            session->completedTiles.insert(tiles[i]);
+         result.insert(result.end(), std::make_move_iterator(regions.begin()), std::make_move_iterator(regions.end()));
+      }
+      session->processedIds.merge(processedIds);
+      scanSessions.Close(sessionId, *session);
+   }
+
+   searchEngine.PrefetchRegionsAround(box, prefs);
+   co_return result;
+}
+
+// Results of scan sessions depend on previous requests, and incomplete results change as soon as missing tiles are
+// loaded, so such results are neither cached nor versioned
+bool isCacheable(const geoproto::RegionsResponse& response)
+{
+   return response.session_id().empty() && (!response.has_coverage() || response.coverage().complete());
+}
+
+}  // namespace
 
 namespace geo
 {
 
-GetRegionsReactor::GetRegionsReactor(grpc::CallbackServerContext* context, const geoproto::RegionsRequest& request,
-   geoproto::RegionsResponse& response, ISearchEngine& searchEngine)
+GetRegionsReactor::GetRegionsReactor(grpc::CallbackServerContext* context, const grpc::ByteBuffer& rawRequest,
+   grpc::ByteBuffer& rawResponse, ISearchEngine& searchEngine, ResponseVersionCache& versionCache,
+   ResponseCache& responseCache, ScanSessionCache& scanSessions, Bulkhead& upstreamBulkhead, Bulkhead& cacheBulkhead,
+   double maxTileSizeDegrees)
+   : m_requestContext{ExtractDeadline(*context), false, {}, &m_arena, &m_upstreamFailures}
 {
-   if (auto errorString = ValidateRegionsRequest(request))
+   // The data version is taken in advance, so that changes made while the result is built invalidate it.
+   const std::uint64_t dataVersion = searchEngine.GetDataVersion();
+   if (responseCache.ServeCached("GetRegions", rawRequest, rawResponse, dataVersion))
+   {
+      Finish(grpc::Status::OK);
+      return;
+   }
+
+   // The request is parsed once, both to choose its bulkhead and to build the response.
+   grpc::ByteBuffer requestBuffer = rawRequest;
+   if (!grpc::SerializationTraits<geoproto::RegionsRequest>::Deserialize(&requestBuffer, &m_request).ok())
    {
-      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
-      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString});
+      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, "Cannot parse request"});
       return;
    }
 
+   // Scans wait for Overpass and Nominatim, so they get their own bulkhead, and requests for cached data get
+   // another one, which slow upstreams cannot fill. The response is built by coroutines, and the RPC is finished
+   // by the one which completes it.
+   Bulkhead& bulkhead =
+      m_request.consistency() == geoproto::RegionsRequest::CONSISTENCY_FAST ? cacheBulkhead : upstreamBulkhead;
+   Bulkhead::Job job;
+   job.run = [this, context, &rawRequest, &rawResponse, &searchEngine, &versionCache, &responseCache, &scanSessions,
+                dataVersion, maxTileSizeDegrees](Bulkhead::Permit permit)
+   {
+      const auto build = [this, context, &searchEngine, &versionCache, &scanSessions, dataVersion, maxTileSizeDegrees](
+                            const geoproto::RegionsRequest& request, geoproto::RegionsResponse& response)
+      {
+         return process(*context, request, response, searchEngine, versionCache, scanSessions, dataVersion,
+            m_upstreamFailures, maxTileSizeDegrees);
+      };
+
+      const ScopedRequestContext scopedRequestContext(m_requestContext);
+      StartDetached(responseCache.ServeParsedAsync<geoproto::RegionsRequest, geoproto::RegionsResponse>(
+                       "GetRegions", rawRequest, m_request, rawResponse, dataVersion, build, isCacheable),
+         [this, permit = std::move(permit)](grpc::Status status) mutable
+         {
+            permit.Release();
+            Finish(status);
+         });
+   };
+   job.drop = [this](Bulkhead::DropReason reason)
+   {
+      Finish(ToStatus(reason));
+   };
+   job.isCancelled = [context]
+   {
+      return context->IsCancelled();
+   };
+   job.deadline = m_requestContext.deadline;
+   if (!bulkhead.TrySubmit(std::move(job)))
+      Finish(grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many GetRegions requests are in progress"});
+}
+
+Task<grpc::Status> GetRegionsReactor::process(grpc::CallbackServerContext& context,
+   const geoproto::RegionsRequest& request, geoproto::RegionsResponse& response, ISearchEngine& searchEngine,
+   ResponseVersionCache& versionCache, ScanSessionCache& scanSessions, std::uint64_t dataVersion,
+   const UpstreamFailures& upstreamFailures, double maxTileSizeDegrees)
+{
+   if (auto errorString = ValidateRegionsRequest(request))
+   {
+      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(context));
+      co_return grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString};
+   }
+
+   // Answer "not modified" without building the result if the client already has its current version.
+   const bool fast = request.consistency() == geoproto::RegionsRequest::CONSISTENCY_FAST;
+   const bool inSession = request.has_session_id() && !fast;
+   geoproto::RegionsRequest canonicalRequest = request;
+   canonicalRequest.clear_if_none_match();
+   const std::string requestKey = ResponseVersionCache::FormatKey("GetRegions", canonicalRequest);
+   if (request.has_if_none_match() && !inSession)
+   {
+      if (const auto version = versionCache.Find(requestKey, dataVersion); version == request.if_none_match())
+      {
+         response.set_version(*version);
+         response.set_not_modified(true);
+         co_return grpc::Status::OK;
+      }
+   }
+
    // Convert protocol buffer properties to search engine preferences
    const ISearchEngine::RegionPreferences::Properties props = {
       request.prefs().properties().begin(), request.prefs().properties().end()};
-   ISearchEngine::RegionPreferences prefs{request.prefs().mask(), std::move(props)};
+   ISearchEngine::RegionPreferences prefs{request.prefs().mask(), std::move(props), maxTileSizeDegrees};
 
    // Create bounding box around requested position (converting km to meters)
    const auto box =
       CreateBoundingBox(request.position().latitude(), request.position().longitude(), request.distance_km() * 1000);
 
-   // Execute region search and populate response
-   auto regions = searchEngine.StartFindRegions()(box, prefs);
-   *response.mutable_regions() = {std::make_move_iterator(regions.begin()), std::make_move_iterator(regions.end())};
+   // Execute region search and populate response.
+   if (fast)
+   {
+      findCachedRegions(box, prefs, searchEngine, response);
+      if (!isCacheable(response))
+         co_return grpc::Status::OK;
+   }
+   else if (inSession)
+   {
+      auto regions = co_await findRegionsInSessionAsync(
+         box, prefs, request, searchEngine, scanSessions, *response.mutable_session_id());
+      response.mutable_regions()->Add(std::make_move_iterator(regions.begin()), std::make_move_iterator(regions.end()));
+      co_return grpc::Status::OK;
+   }
+   else
+   {
+      // Regions missing because of upstream errors would make the response look complete, so it is neither sent
+      // nor cached nor versioned.
+      auto regions = co_await findRegionsAsync(box, prefs, searchEngine);
+      if (auto status = ToStatus(upstreamFailures); !status.ok())
+      {
+         LOG(ERROR) << std::format("Cannot find regions: {}", status.error_message());
+         co_return status;
+      }
+      response.mutable_regions()->Add(std::make_move_iterator(regions.begin()), std::make_move_iterator(regions.end()));
+   }
+
+   // Versioning the result and dropping it if the client already has the same one.
+   response.set_version(versionCache.Store(requestKey, response, dataVersion));
+   if (request.has_if_none_match() && response.version() == request.if_none_match())
+   {
+      response.clear_regions();
+      response.set_not_modified(true);
+   }
 
    // Complete the RPC successfully
-   Finish(grpc::Status::OK);
+   co_return grpc::Status::OK;
 }
 
 }  // namespace geo
@@ -1,18 +1,27 @@
 #pragma once
 
+#include "../utils/RequestArena.h"
+#include "../utils/RequestContext.h"
+#include "../utils/Task.h"
 #include "geo.grpc.pb.h"
 
 #include <absl/log/log.h>
 #include <grpc/grpc.h>
+#include <grpcpp/support/byte_buffer.h>
 #include <grpcpp/support/server_callback.h>
 
+#include <cstdint>
 #include <format>
 
 namespace geo
 {
 
+class Bulkhead;
 class WebClient;
 class ISearchEngine;
+class ResponseCache;
+class ResponseVersionCache;
+class ScanSessionCache;
 
 // Reactor class for handling unary (non-streaming) responses for the GetRegions RPC.
 // This class processes a single request and returns region data matching the query.
@@ -20,14 +29,32 @@ class GetRegionsReactor : public grpc::ServerUnaryReactor
 {
 public:
    // Constructor for the GetRegionsReactor.
+   // The RPC is registered as a raw method, so that cached serialized responses can be sent as is.
    // @param context: Server context.
-   // @param request: The incoming RegionsRequest containing search parameters.
-   // @param response: The RegionsResponse to be populated with results.
+   // @param rawRequest: The incoming serialized RegionsRequest from the client.
+   // @param rawResponse: The serialized RegionsResponse to be sent back to the client.
    // @param searchEngine: Reference to the search engine used to find regions.
-   GetRegionsReactor(grpc::CallbackServerContext* context, const geoproto::RegionsRequest& request,
-      geoproto::RegionsResponse& response, ISearchEngine& searchEngine);
+   // @param versionCache: Versions of previously sent results, used to answer requests with if_none_match.
+   // @param responseCache: Serialized responses to repeated requests.
+   // @param scanSessions: Scan sessions continued by requests with session_id.
+   // @param upstreamBulkhead: Limits RPCs which build responses from upstream data.
+   // @param cacheBulkhead: Limits RPCs which build responses from cached data only, see CONSISTENCY_FAST.
+   // @param maxTileSizeDegrees: Largest grid tile searched, taken from the current configuration.
+   GetRegionsReactor(grpc::CallbackServerContext* context, const grpc::ByteBuffer& rawRequest,
+      grpc::ByteBuffer& rawResponse, ISearchEngine& searchEngine, ResponseVersionCache& versionCache,
+      ResponseCache& responseCache, ScanSessionCache& scanSessions, Bulkhead& upstreamBulkhead,
+      Bulkhead& cacheBulkhead, double maxTileSizeDegrees);
 
 private:
+   // Builds the response to a request which is not found in the response cache.
+   // @param upstreamFailures: Failures of upstream requests made for the RPC.
+   // @param maxTileSizeDegrees: Largest grid tile searched.
+   // @return Status of the RPC
+   static Task<grpc::Status> process(grpc::CallbackServerContext& context, const geoproto::RegionsRequest& request,
+      geoproto::RegionsResponse& response, ISearchEngine& searchEngine, ResponseVersionCache& versionCache,
+      ScanSessionCache& scanSessions, std::uint64_t dataVersion, const UpstreamFailures& upstreamFailures,
+      double maxTileSizeDegrees);
+
    // Called when the RPC is completed. Logs completion and cleans up the reactor.
    void OnDone() override
    {
@@ -37,6 +64,12 @@ private:
 
    // Called when the RPC is cancelled. Logs the cancellation.
    void OnCancel() override { LOG(ERROR) << "GetRegions() RPC cancelled"; }
+
+private:
+   RequestArena m_arena;                 // Temporary objects of the RPC, released when OnDone() deletes the reactor
+   UpstreamFailures m_upstreamFailures;  // Failures of upstream requests made for the RPC
+   RequestContext m_requestContext;      // Upstream requests of the RPC are ordered and dropped by its deadline
+   geoproto::RegionsRequest m_request;   // Parsed request, kept until the response is built
 };
 
 }  // namespace geo
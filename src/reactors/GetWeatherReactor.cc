@@ -0,0 +1,190 @@
+#include "GetWeatherReactor.h"
+
+#include "../search/OpenMeteoApiUtils.h"
+#include "../search/SearchEngineItf.h"
+#include "../utils/Bulkhead.h"
+#include "../utils/Executor.h"
+#include "../utils/RequestContext.h"
+#include "../utils/Task.h"
+#include "../utils/TimeUtils.h"
+#include "../utils/grpcUtils.h"
+#include "RequestValidators.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace
+{
+
+using namespace geo;
+
+// Aggregates daily weather of a year, which is not in the local archive.
+WeatherSummary summarizeWeather(const WeatherInfoVector& weather)
+{
+   WeatherSummary summary;
+   summary.temperatureMin = std::numeric_limits<double>::max();
+   summary.temperatureMax = std::numeric_limits<double>::lowest();
+   for (const auto& day : weather)
+   {
+      ++summary.numDays;
+      summary.sumTemperatureAverage += day.temperatureAverage;
+      summary.temperatureMax = std::max(summary.temperatureMax, day.temperatureMax);
+      summary.temperatureMin = std::min(summary.temperatureMin, day.temperatureMin);
+   }
+   return summary;
+}
+
+// Aggregates historical weather of a location over all the years, see WeatherRequest.
+// A year without weather is a failed Open-Meteo request rather than a year without days, and the aggregate of
+// the other years would differ from the requested one without any sign of it, so the location fails then.
+// @param yearlyWeather: Weather of the location for each of the years.
+// @param result: Receives maximum, minimum and average temperatures of all the days.
+// @return: false if there is no weather for some of the years.
+bool aggregateWeather(std::span<const WeatherSummary> yearlyWeather, geoproto::Weather& result)
+{
+   std::size_t numDays = 0;
+   double sumAverage = 0;
+   double maxTemperature = std::numeric_limits<double>::lowest();
+   double minTemperature = std::numeric_limits<double>::max();
+   for (const auto& summary : yearlyWeather)
+   {
+      if (summary.numDays == 0)
+         return false;
+
+      numDays += summary.numDays;
+      sumAverage += summary.sumTemperatureAverage;
+      maxTemperature = std::max(maxTemperature, summary.temperatureMax);
+      minTemperature = std::min(minTemperature, summary.temperatureMin);
+   }
+   if (numDays == 0)
+      return false;
+
+   result.set_max_temperature(maxTemperature);
+   result.set_min_temperature(minTemperature);
+   result.set_average_temperature(sumAverage / numDays);
+   return true;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+GetWeatherReactor::GetWeatherReactor(grpc::CallbackServerContext* context, const geoproto::WeatherRequest& request,
+   geoproto::WeatherResponse& response, ISearchEngine& searchEngine, Bulkhead& bulkhead, Executor& executor)
+   : m_requestContext{ExtractDeadline(*context), false, {}, &m_arena}
+{
+   if (auto errorString = ValidateWeatherRequest(request))
+   {
+      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
+      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString});
+      return;
+   }
+
+   // The years are computed once, so that the archive and Open-Meteo are asked for the same dates even if the RPC
+   // runs across midnight.
+   const DateRange dateRange{TimePointToDate(TimestampToTimePoint(request.from_date())),
+      TimePointToDate(TimestampToTimePoint(request.to_date()))};
+   m_yearlyRanges =
+      openmeteo::CollectHistoricalRanges(dateRange, std::chrono::system_clock::now(), request.num_years());
+
+   // Reading the archive may wait for its pages to be loaded from disk, which must not block the thread of gRPC.
+   executor.Post(
+      [this, context, &request, &response, &searchEngine, &bulkhead]
+      {
+         summarizeArchived(*context, request, response, searchEngine, bulkhead);
+      },
+      Executor::Priority::Foreground);
+}
+
+void GetWeatherReactor::summarizeArchived(grpc::CallbackServerContext& context,
+   const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response, ISearchEngine& searchEngine,
+   Bulkhead& bulkhead)
+{
+   // Archived years are aggregated from precomputed tables without reading their days.
+   m_summaries.reserve(request.locations_size() * m_yearlyRanges.size());
+   for (const auto& location : request.locations())
+   {
+      for (auto& summary :
+         searchEngine.SummarizeArchivedWeather(location.latitude(), location.longitude(), m_yearlyRanges))
+      {
+         if (!summary)
+            m_missingSummaries.push_back(m_summaries.size());
+         m_summaries.push_back(summary.value_or(WeatherSummary{}));
+      }
+   }
+
+   // Fully archived RPCs do not wait behind Open-Meteo requests in the bulkhead.
+   if (m_missingSummaries.empty())
+   {
+      Finish(buildResponse(request, response));
+      return;
+   }
+
+   // Open-Meteo requests of a slow incident must not take the places of other RPCs.
+   Bulkhead::Job job;
+   job.run = [this, &request, &response, &searchEngine](Bulkhead::Permit permit)
+   {
+      const ScopedRequestContext scopedRequestContext(m_requestContext);
+      StartDetached(process(request, response, searchEngine),
+         [this, permit = std::move(permit)](grpc::Status status) mutable
+         {
+            permit.Release();
+            Finish(status);
+         });
+   };
+   job.drop = [this](Bulkhead::DropReason reason)
+   {
+      Finish(ToStatus(reason));
+   };
+   job.isCancelled = [&context]
+   {
+      return context.IsCancelled();
+   };
+   job.deadline = m_requestContext.deadline;
+   if (!bulkhead.TrySubmit(std::move(job)))
+      Finish(grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many GetWeather requests are in progress"});
+}
+
+Task<grpc::Status> GetWeatherReactor::process(
+   const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response, ISearchEngine& searchEngine)
+{
+   // Weather of the locations and years which are not archived is requested at once, without looking them up
+   // in the archive again. Every year is cached separately, so that requests for overlapping years reuse it.
+   // Responses are parsed by executor workers as they arrive.
+   std::vector<Task<WeatherInfoVector>> requests;
+   for (const std::size_t i : m_missingSummaries)
+   {
+      const auto& location = request.locations(static_cast<int>(i / m_yearlyRanges.size()));
+      requests.push_back(searchEngine.GetUpstreamWeatherAsync(
+         location.latitude(), location.longitude(), m_yearlyRanges[i % m_yearlyRanges.size()]));
+   }
+   const std::vector<WeatherInfoVector> weather = co_await WhenAll(std::move(requests));
+   for (std::size_t i = 0; i < weather.size(); ++i)
+      m_summaries[m_missingSummaries[i]] = summarizeWeather(weather[i]);
+
+   co_return buildResponse(request, response);
+}
+
+grpc::Status GetWeatherReactor::buildResponse(
+   const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response) const
+{
+   for (std::size_t i = 0; i < static_cast<std::size_t>(request.locations_size()); ++i)
+   {
+      const auto locationWeather = std::span(m_summaries).subspan(i * m_yearlyRanges.size(), m_yearlyRanges.size());
+      if (!aggregateWeather(locationWeather, *response.add_historical_weather()))
+      {
+         LOG(ERROR) << std::format("No historical weather for some of the years of location {}", i);
+         return grpc::Status{grpc::StatusCode::UNAVAILABLE, "Historical weather is not available"};
+      }
+   }
+   return grpc::Status::OK;
+}
+
+}  // namespace geo
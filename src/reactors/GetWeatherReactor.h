@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../utils/Bulkhead.h"
+#include "../utils/RequestArena.h"
+#include "../utils/RequestContext.h"
+#include "../utils/Task.h"
+#include "../utils/TimeUtils.h"
+#include "../utils/WeatherInfo.h"
+#include "geo.grpc.pb.h"
+
+#include <absl/log/log.h>
+#include <grpc/grpc.h>
+#include <grpcpp/support/server_callback.h>
+
+#include <cstddef>
+#include <format>
+#include <vector>
+
+namespace geo
+{
+
+class Executor;
+class ISearchEngine;
+
+// Reactor class for handling unary (non-streaming) responses for the GetWeather RPC.
+// Historical weather of every location is taken from the local archive or requested from Open-Meteo for each
+// of the years at once, and aggregated per location.
+class GetWeatherReactor : public grpc::ServerUnaryReactor
+{
+public:
+   // Constructor for the GetWeatherReactor.
+   // @param context: Server context.
+   // @param request: The incoming WeatherRequest from the client.
+   // @param response: The WeatherResponse to be sent back to the client.
+   // @param searchEngine: Reference to the search engine used to request historical weather.
+   // @param bulkhead: Limits RPCs which request weather from Open-Meteo.
+   // @param executor: Runs lookups in the local archive.
+   GetWeatherReactor(grpc::CallbackServerContext* context, const geoproto::WeatherRequest& request,
+      geoproto::WeatherResponse& response, ISearchEngine& searchEngine, Bulkhead& bulkhead, Executor& executor);
+
+private:
+   // Aggregates archived weather, and submits the RPC to the bulkhead if some of the weather is not archived.
+   // Finishes the RPC if all of it is.
+   void summarizeArchived(grpc::CallbackServerContext& context, const geoproto::WeatherRequest& request,
+      geoproto::WeatherResponse& response, ISearchEngine& searchEngine, Bulkhead& bulkhead);
+
+   // Requests weather which is not archived, and builds the response.
+   // @return Status of the RPC
+   Task<grpc::Status> process(
+      const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response, ISearchEngine& searchEngine);
+
+   // Aggregates weather of every location over all the years into the response.
+   // @return Status of the RPC, UNAVAILABLE if some of the years of a location have no weather
+   grpc::Status buildResponse(const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response) const;
+
+   // Called when the RPC is completed. Logs the completion and cleans up the reactor.
+   void OnDone() override
+   {
+      LOG(INFO) << std::format("GetWeather() RPC completed");
+      delete this;
+   }
+
+   // Called when the RPC is cancelled by the client. Logs the cancellation.
+   void OnCancel() override { LOG(ERROR) << std::format("GetWeather() RPC cancelled"); }
+
+private:
+   RequestArena m_arena;             // Temporary objects of the RPC, released when the reactor is deleted by OnDone()
+   RequestContext m_requestContext;  // Upstream requests of the RPC are ordered and dropped by its deadline
+
+   std::vector<DateRange> m_yearlyRanges;        // Dates of the request in each of the years
+   std::vector<WeatherSummary> m_summaries;      // Weather of every location in each of the years
+   std::vector<std::size_t> m_missingSummaries;  // Indexes of the summaries which are not archived
+};
+
+}  // namespace geo
@@ -55,4 +55,56 @@ const char* ValidateRegionsRequest(const geoproto::RegionsRequest& request)
    return nullptr;
 }
 
+const char* ValidateNearestCitiesRequest(const geoproto::NearestCitiesRequest& request)
+{
+   if (!request.has_position())
+      return "Position must be set in NearestCitiesRequest";
+
+   if (!geo::IsValidLatitude(request.position().latitude()))
+      return "Wrong latitude in NearestCitiesRequest";
+
+   if (!geo::IsValidLongitude(request.position().longitude()))
+      return "Wrong longitude in NearestCitiesRequest";
+
+   if (request.k() == 0 || request.k() > 1000)
+      return "k is out-of-range";
+
+   // Negated comparison rejects NaN as well.
+   if (!(request.max_distance_km() >= 0))
+      return "max_distance_km is out-of-range";
+
+   return nullptr;
+}
+
+const char* ValidateWeatherRequest(const geoproto::WeatherRequest& request)
+{
+   if (request.locations().empty())
+      return "At least one location must be set in WeatherRequest";
+
+   // Every location is requested for every year, so the product is limited.
+   if (request.locations_size() > 100)
+      return "Too many locations in WeatherRequest";
+
+   for (const auto& location : request.locations())
+   {
+      if (!geo::IsValidLatitude(location.latitude()))
+         return "Wrong latitude in WeatherRequest";
+
+      if (!geo::IsValidLongitude(location.longitude()))
+         return "Wrong longitude in WeatherRequest";
+   }
+
+   if (!request.has_from_date() || !request.has_to_date())
+      return "Dates must be set in WeatherRequest";
+
+   if (request.from_date().seconds() > request.to_date().seconds())
+      return "from_date must not be later than to_date";
+
+   // Open-Meteo archive starts in 1940.
+   if (request.num_years() > 50)
+      return "num_years is out-of-range";
+
+   return nullptr;
+}
+
 }  // namespace geo
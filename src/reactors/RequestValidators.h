@@ -3,7 +3,9 @@
 namespace geoproto
 {
 class CitiesRequest;
+class NearestCitiesRequest;
 class RegionsRequest;
+class WeatherRequest;
 }  // namespace geoproto
 
 namespace geo
@@ -19,4 +21,14 @@ const char* ValidateCitiesRequest(const geoproto::CitiesRequest& request);
 // Returns an error string or nullptr if a request is valid.
 const char* ValidateRegionsRequest(const geoproto::RegionsRequest& request);
 
+// Helper function to validate the NearestCitiesRequest. Ensures that a valid position is provided,
+// and that the number of cities and the maximum distance are within acceptable ranges.
+// Returns an error string or nullptr if a request is valid.
+const char* ValidateNearestCitiesRequest(const geoproto::NearestCitiesRequest& request);
+
+// Helper function to validate the WeatherRequest. Ensures that valid locations and dates are provided,
+// and that the numbers of locations and years are within acceptable ranges.
+// Returns an error string or nullptr if a request is valid.
+const char* ValidateWeatherRequest(const geoproto::WeatherRequest& request);
+
 }  // namespace geo
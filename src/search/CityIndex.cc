@@ -0,0 +1,294 @@
+#include "CityIndex.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <numbers>
+#include <queue>
+#include <string_view>
+#include <utility>
+
+namespace
+{
+
+// Mean radius of the Earth, the error of the spherical model is negligible for ranking cities
+constexpr double sc_earthRadiusKm = 6371.0088;
+
+// Parses a floating point number, the whole string must be a number
+std::optional<double> parseDouble(std::string_view text)
+{
+   double value = 0;
+   const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+   if (error != std::errc() || end != text.data() + text.size())
+      return std::nullopt;
+   return value;
+}
+
+// Parses a "name,country,latitude,longitude" line of a dataset. Fields are taken from the end,
+// so names may contain commas.
+std::optional<geo::IndexedCity> parseDatasetLine(std::string_view line)
+{
+   std::array<std::string_view, 3> fields;
+   for (auto it = fields.rbegin(); it != fields.rend(); ++it)
+   {
+      const auto comma = line.rfind(',');
+      if (comma == std::string_view::npos)
+         return std::nullopt;
+      *it = line.substr(comma + 1);
+      line = line.substr(0, comma);
+   }
+
+   const auto latitude = parseDouble(fields[1]);
+   const auto longitude = parseDouble(fields[2]);
+   if (line.empty() || !latitude || !longitude || std::abs(*latitude) > 90 || std::abs(*longitude) > 180)
+      return std::nullopt;
+
+   geo::IndexedCity city;
+   city.name = line;
+   city.country = geo::StringInterner::Instance().Intern(fields[0]);
+   city.latitude = *latitude;
+   city.longitude = *longitude;
+   return city;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+CityIndex::CityIndex()
+   : m_snapshot(std::make_shared<const Snapshot>(Snapshot{std::make_shared<const Cities>(), {}}))
+{
+}
+
+void CityIndex::Add(IndexedCity city)
+{
+   std::lock_guard lock(m_mutex);
+   if (remember(city))
+      insert({std::move(city)});
+}
+
+std::optional<std::size_t> CityIndex::LoadDataset(const std::string& path)
+{
+   std::ifstream file(path);
+   if (!file)
+   {
+      LOG(ERROR) << std::format("Cannot open city dataset {}", path);
+      return std::nullopt;
+   }
+
+   std::vector<IndexedCity> cities;
+   std::size_t numMalformed = 0;
+   for (std::string line; std::getline(file, line);)
+   {
+      if (line.empty() || line.front() == '#')
+         continue;
+
+      if (auto city = parseDatasetLine(line))
+         cities.push_back(std::move(*city));
+      else
+         ++numMalformed;
+   }
+
+   if (numMalformed > 0)
+      LOG(ERROR) << std::format("{} malformed lines are skipped in city dataset {}", numMalformed, path);
+
+   // Cities are inserted at once, so that the tree is built once.
+   std::lock_guard lock(m_mutex);
+   std::erase_if(cities,
+      [this](const IndexedCity& city)
+      {
+         return !remember(city);
+      });
+   const std::size_t numCities = cities.size();
+   insert(std::move(cities));
+   return numCities;
+}
+
+std::vector<CityIndex::Neighbour> CityIndex::FindNearest(
+   double latitude, double longitude, std::size_t k, double maxDistanceKm) const
+{
+   if (k == 0)
+      return {};
+
+   // Squared straight-line distances are compared instead of great-circle ones, they grow together.
+   const Point query = toPoint(latitude, longitude);
+   const auto squaredDistance = [&query](const Point& point)
+   {
+      const double dx = point[0] - query[0];
+      const double dy = point[1] - query[1];
+      const double dz = point[2] - query[2];
+      return dx * dx + dy * dy + dz * dz;
+   };
+
+   double maxSquaredDistance = std::numeric_limits<double>::infinity();
+   if (maxDistanceKm > 0 && maxDistanceKm < std::numbers::pi * sc_earthRadiusKm)
+   {
+      const double chord = 2 * std::sin(maxDistanceKm / sc_earthRadiusKm / 2);
+      maxSquaredDistance = chord * chord;
+   }
+
+   // Found cities by squared distance, the farthest one on top
+   using Candidate = std::pair<double, const IndexedCity*>;
+   std::priority_queue<Candidate> found;
+   const auto consider = [&found, k, maxSquaredDistance](double distance, const IndexedCity& city)
+   {
+      if (distance > maxSquaredDistance)
+         return;
+
+      if (found.size() == k)
+      {
+         if (distance >= found.top().first)
+            return;
+         found.pop();
+      }
+      found.emplace(distance, &city);
+   };
+
+   const auto snapshot = m_snapshot.load();
+   for (std::size_t i = 0; i < snapshot->added.points.size(); ++i)
+      consider(squaredDistance(snapshot->added.points[i]), snapshot->added.cities[i]);
+
+   // Ranges of the tree by the lower bound of the squared distance to their points, the nearest one on top
+   struct Range
+   {
+      double bound;
+      std::size_t begin;
+      std::size_t end;
+      std::size_t depth;
+
+      bool operator>(const Range& other) const { return bound > other.bound; }
+   };
+
+   const Cities& tree = *snapshot->tree;
+   std::priority_queue<Range, std::vector<Range>, std::greater<>> ranges;
+   if (!tree.points.empty())
+      ranges.push({0, 0, tree.points.size(), 0});
+
+   while (!ranges.empty())
+   {
+      const Range range = ranges.top();
+      ranges.pop();
+
+      // Nothing in this range and the farther ones can beat the cities found so far.
+      const double limit = found.size() == k ? found.top().first : maxSquaredDistance;
+      if (range.bound > limit)
+         break;
+
+      const std::size_t median = range.begin + (range.end - range.begin) / 2;
+      consider(squaredDistance(tree.points[median]), tree.cities[median]);
+
+      // Points of the far half are at least as far as the splitting plane.
+      const double delta = tree.points[median][range.depth % 3] - query[range.depth % 3];
+      const Range lower{delta > 0 ? range.bound : std::max(range.bound, delta * delta), range.begin, median,
+         range.depth + 1};
+      const Range upper{delta > 0 ? std::max(range.bound, delta * delta) : range.bound, median + 1, range.end,
+         range.depth + 1};
+      if (lower.begin < lower.end)
+         ranges.push(lower);
+      if (upper.begin < upper.end)
+         ranges.push(upper);
+   }
+
+   std::vector<Neighbour> result(found.size());
+   for (auto it = result.rbegin(); it != result.rend(); ++it)
+   {
+      const auto [distance, city] = found.top();
+      found.pop();
+      it->city = *city;
+      it->distanceKm = 2 * sc_earthRadiusKm * std::asin(std::min(1.0, std::sqrt(distance) / 2));
+   }
+   return result;
+}
+
+std::size_t CityIndex::Size() const
+{
+   const auto snapshot = m_snapshot.load();
+   return snapshot->tree->cities.size() + snapshot->added.cities.size();
+}
+
+CityIndex::Point CityIndex::toPoint(double latitude, double longitude)
+{
+   const double lat = latitude * std::numbers::pi / 180;
+   const double lon = longitude * std::numbers::pi / 180;
+   return {std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)};
+}
+
+void CityIndex::buildTree(std::vector<std::size_t>& order, const std::vector<Point>& points, std::size_t begin,
+   std::size_t end, std::size_t depth)
+{
+   if (end - begin < 2)
+      return;
+
+   const std::size_t median = begin + (end - begin) / 2;
+   const std::size_t axis = depth % 3;
+   std::nth_element(order.begin() + begin, order.begin() + median, order.begin() + end,
+      [&points, axis](std::size_t lhs, std::size_t rhs)
+      {
+         return points[lhs][axis] < points[rhs][axis];
+      });
+   buildTree(order, points, begin, median, depth + 1);
+   buildTree(order, points, median + 1, end, depth + 1);
+}
+
+bool CityIndex::remember(const IndexedCity& city)
+{
+   if (city.osmId != 0)
+      return m_osmIds.insert(city.osmId).second;
+   return m_datasetKeys.insert(std::format("{}/{}/{}", city.name, city.latitude, city.longitude)).second;
+}
+
+void CityIndex::insert(std::vector<IndexedCity> cities)
+{
+   if (cities.empty())
+      return;
+
+   const auto current = m_snapshot.load();
+   auto snapshot = std::make_shared<Snapshot>();
+   if (current->added.cities.size() + cities.size() < sc_maxAddedCities)
+   {
+      snapshot->tree = current->tree;
+      snapshot->added = current->added;
+      for (auto& city : cities)
+      {
+         snapshot->added.points.push_back(toPoint(city.latitude, city.longitude));
+         snapshot->added.cities.push_back(std::move(city));
+      }
+      m_snapshot.store(std::move(snapshot));
+      return;
+   }
+
+   // All the cities are copied into a new tree, which takes O(n log n) once per sc_maxAddedCities added ones.
+   std::vector<IndexedCity> all = current->tree->cities;
+   all.insert(all.end(), current->added.cities.begin(), current->added.cities.end());
+   all.insert(all.end(), std::make_move_iterator(cities.begin()), std::make_move_iterator(cities.end()));
+
+   std::vector<Point> points;
+   points.reserve(all.size());
+   for (const auto& city : all)
+      points.push_back(toPoint(city.latitude, city.longitude));
+
+   std::vector<std::size_t> order(all.size());
+   for (std::size_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+   buildTree(order, points, 0, order.size(), 0);
+
+   auto tree = std::make_shared<Cities>();
+   tree->cities.reserve(all.size());
+   tree->points.reserve(all.size());
+   for (const auto i : order)
+   {
+      tree->cities.push_back(std::move(all[i]));
+      tree->points.push_back(points[i]);
+   }
+   snapshot->tree = std::move(tree);
+   m_snapshot.store(std::move(snapshot));
+}
+
+}  // namespace geo
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../utils/StringInterner.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace geo
+{
+
+// City known to the city index.
+// Country is interned like the one of nominatim::RelationInfo, there are only a few hundred distinct values of it.
+struct IndexedCity
+{
+   std::int64_t osmId = 0;  // OSM ID of the city relation, 0 for cities of a local dataset
+   std::string name;        // Name of the city in the native language
+   InternedString country;  // Country name in the native language
+   double latitude = 0;     // Latitude of the city center
+   double longitude = 0;    // Longitude of the city center
+};
+
+// CityIndex finds cities nearest to a point without asking upstreams.
+// Cities are kept in a KD-tree of points on the unit sphere, where the straight-line distance grows with
+// the great-circle distance, so poles and the antimeridian need no special handling. Searches are best-first:
+// subtrees are visited in the order of their distance bounds, and the search stops once the nearest unvisited
+// subtree is farther than the k-th found city.
+// Added cities are collected in a small buffer which is scanned linearly, and the tree is rebuilt once the buffer
+// grows. Searches read an immutable snapshot of the index and take no locks.
+// The class is thread-safe.
+class CityIndex
+{
+public:
+   struct Neighbour
+   {
+      IndexedCity city;   // Found city
+      double distanceKm;  // Great-circle distance to the city
+   };
+
+   CityIndex();
+
+   // Adds a city, unless a city with the same OSM ID, or with the same name at the same position, is indexed
+   void Add(IndexedCity city);
+
+   // Loads cities from a CSV file with "name,country,latitude,longitude" lines. Empty lines and lines starting
+   // with '#' are skipped, and so are malformed lines.
+   // @param path Path to the file
+   // @return Number of added cities, or std::nullopt if the file cannot be read
+   std::optional<std::size_t> LoadDataset(const std::string& path);
+
+   // Finds cities nearest to the point
+   // @param latitude Latitude of the point in degrees
+   // @param longitude Longitude of the point in degrees
+   // @param k Maximum number of cities to find
+   // @param maxDistanceKm Maximum distance to the cities, 0 for no limit
+   // @return Found cities ordered by distance
+   std::vector<Neighbour> FindNearest(double latitude, double longitude, std::size_t k, double maxDistanceKm) const;
+
+   // Returns the number of indexed cities
+   std::size_t Size() const;
+
+private:
+   using Point = std::array<double, 3>;  // Point on the unit sphere
+
+   struct Cities
+   {
+      std::vector<IndexedCity> cities;  // Cities
+      std::vector<Point> points;        // Points of the cities
+   };
+
+   // Immutable state of the index
+   struct Snapshot
+   {
+      std::shared_ptr<const Cities> tree;  // Cities arranged into an implicit KD-tree: the median of a range is
+                                           // its root, and the halves of the range are its subtrees
+      Cities added;                        // Cities added after the tree was built
+   };
+
+   // Converts coordinates in degrees to a point on the unit sphere
+   static Point toPoint(double latitude, double longitude);
+
+   // Orders points of the range as an implicit KD-tree, splitting by coordinate depth % 3 at each level
+   // @param order Indices of the points, reordered by the function
+   static void buildTree(std::vector<std::size_t>& order, const std::vector<Point>& points, std::size_t begin,
+      std::size_t end, std::size_t depth);
+
+   // Remembers the city, so that it is not indexed twice. Must be called under the lock.
+   // @return false if the city is already indexed
+   bool remember(const IndexedCity& city);
+
+   // Makes a snapshot with the new cities, rebuilding the tree once enough cities are added.
+   // Must be called under the lock.
+   void insert(std::vector<IndexedCity> cities);
+
+private:
+   static constexpr std::size_t sc_maxAddedCities = 256;  // Added cities are scanned linearly until there are
+                                                          // this many of them
+
+   std::atomic<std::shared_ptr<const Snapshot>> m_snapshot;  // Current state, replaced on every change
+
+   std::mutex m_mutex;                             // Serializes changes, guards the members below
+   std::unordered_set<std::int64_t> m_osmIds;      // OSM IDs of indexed cities
+   std::unordered_set<std::string> m_datasetKeys;  // Names and positions of indexed cities without OSM IDs
+};
+
+}  // namespace geo
@@ -2,7 +2,11 @@
 
 #include "NominatimApiUtils.h"
 
+#include "../utils/Executor.h"
+#include "../utils/JsonDocument.h"
 #include "../utils/JsonUtils.h"
+#include "../utils/MemoryUsage.h"
+#include "../utils/RequestContext.h"
 #include "../utils/WebClient.h"
 
 #include <absl/log/log.h>
@@ -12,7 +16,11 @@
 #include <charconv>
 #include <cmath>
 #include <format>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace
 {
@@ -20,9 +28,6 @@ namespace
 using namespace geo;
 using namespace geo::nominatim;
 
-const auto sc_chunkSize = 50u;  // Maximum number of OSM IDs to process in a single API request.
-                                // from https://nominatim.org/release-docs/latest/api/Lookup/#endpoint
-
 // Formats a request string for the Nominatim API lookup endpoint.
 // @param itBegin: Iterator to the start of the OSM IDs list.
 // @param itEnd: Iterator to the end of the OSM IDs list.
@@ -31,14 +36,15 @@ const auto sc_chunkSize = 50u;  // Maximum number of OSM IDs to process in a sin
 std::string formatRelationLookupRequest(
    const OsmIds::const_iterator& itBegin, const OsmIds::const_iterator& itEnd, const char* language = nullptr)
 {
+   // Ids are formatted into the request in place, without temporary strings.
+   constexpr std::size_t sc_maxIdLength = 21;  // ",R" and up to 19 digits
    std::string request = "format=json&osm_ids=";
+   request.reserve(request.size() + std::distance(itBegin, itEnd) * sc_maxIdLength);
    for (auto itID = itBegin; itID != itEnd; ++itID)
-   {
-      if (itID != itBegin)
-         request += ",";
-      request += "R" + std::to_string(*itID);
-   }
-   return request + (language ? std::format("&accept-language={}", language) : "");
+      std::format_to(std::back_inserter(request), "{}R{}", itID != itBegin ? "," : "", *itID);
+   if (language)
+      std::format_to(std::back_inserter(request), "&accept-language={}", language);
+   return request;
 }
 
 // Converts a string view to a double value.
@@ -61,7 +67,8 @@ TObject jsonToObject(TJsonValue& value, const std::string& addressType)
    TObject result;
    result.osmId = json::GetInt64(json::Get(value, "osm_id"));
    result.name = json::GetString(json::Get(value, "address", addressType.c_str()));
-   result.country = json::GetString(json::Get(value, "address", "country"));
+   result.country = StringInterner::Instance().Intern(json::GetString(json::Get(value, "address", "country")));
+   result.addressType = StringInterner::Instance().Intern(addressType);
    result.latitude = getDoubleFromString(json::GetString(json::Get(value, "lat")));
    result.longitude = getDoubleFromString(json::GetString(json::Get(value, "lon")));
    return result;
@@ -73,33 +80,52 @@ TObject jsonToObject(TJsonValue& value, const std::string& addressType)
 template <typename THandler>
 void forEachChunk(const OsmIds& relationIds, THandler fn)
 {
-   for (auto itBegin = relationIds.begin(); itBegin < relationIds.end(); itBegin = std::next(itBegin, sc_chunkSize))
+   for (auto itBegin = relationIds.begin(); itBegin < relationIds.end();
+        itBegin = std::next(itBegin, sc_maxIdsPerLookup))
    {
-      const auto itEnd = std::min(std::next(itBegin, sc_chunkSize), relationIds.end());
+      const auto itEnd = std::min(std::next(itBegin, sc_maxIdsPerLookup), relationIds.end());
       fn(itBegin, itEnd);
    }
 }
 
-// Splits the list of OSM IDs into chunks, sends requests to the Nominatim API, and processes the responses.
+// Splits the list of OSM IDs into chunks and sends requests for all the chunks to the Nominatim API at once.
 // @param relationIds: List of OSM IDs to process.
 // @param client: WebClient instance to interact with the Nominatim API.
-// @param responseHandler: Handler function to process each API response.
-template <typename THandler>
-void splitInChunksAndParseResponses(const OsmIds& relationIds, WebClient& client, THandler responseHandler)
+// @return: Responses in the order of the chunks, empty ones for failed requests.
+Task<std::vector<std::string>> loadChunksAsync(const OsmIds& relationIds, WebClient& client)
 {
+   std::vector<Task<std::string>> requests;
    forEachChunk(relationIds,
-      [&client, responseHandler](const auto& itBegin, const auto& itEnd)
+      [&client, &requests](const auto& itBegin, const auto& itEnd)
       {
-         const std::string request = formatRelationLookupRequest(itBegin, itEnd);
-         const std::string response = client.Get(request);
-         if (response.empty())
-            return;
-
-         rapidjson::Document document;
-         document.Parse(response.c_str());
+         requests.push_back(client.GetAsync(formatRelationLookupRequest(itBegin, itEnd)));
+      });
+   return WhenAll(std::move(requests));
+}
 
-         responseHandler(document);
+// Parses responses of the Nominatim API and processes them in order.
+// Responses are parsed in parallel on the executor of the current thread, if any, as large lookups return
+// dozens of chunks at once. Documents are allocated from the memory resource of the RPC, which workers
+// parsing them do not have as their current one.
+// @param responses: Responses returned by loadChunksAsync().
+// @param responseHandler: Handler function to process each API response.
+template <typename THandler>
+void parseResponses(const std::vector<std::string>& responses, THandler responseHandler)
+{
+   std::pmr::memory_resource* const resource = RequestContext::Current().memoryResource;
+   std::vector<std::optional<json::ArenaDocument>> documents(responses.size());
+   ParallelFor(responses.size(),
+      [&responses, &documents, resource](std::size_t index)
+      {
+         if (!responses[index].empty())
+            documents[index].emplace(responses[index], resource);
       });
+
+   for (std::size_t i = 0; i < responses.size(); ++i)
+   {
+      if (!responses[i].empty())
+         responseHandler(*documents[i]);
+   }
 }
 
 }  // namespace
@@ -107,25 +133,47 @@ void splitInChunksAndParseResponses(const OsmIds& relationIds, WebClient& client
 namespace geo::nominatim
 {
 
-RelationInfos LookupRelationInformation(const OsmIds& relationIds, WebClient& nominatimApiClient)
+std::size_t EstimateMemoryUsage(const RelationInfo& info)
+{
+   return sizeof(info) - sizeof(info.name) + geo::EstimateMemoryUsage(info.name);
+}
+
+Task<RelationInfos> LookupRelationInformationAsync(OsmIds relationIds, WebClient& nominatimApiClient, OsmIds* failedIds)
 {
+   const auto responses = co_await loadChunksAsync(relationIds, nominatimApiClient);
+
+   // Failed requests give empty responses, while regions missing in successful ones are not known to Nominatim.
+   if (failedIds)
+   {
+      std::size_t index = 0;
+      forEachChunk(relationIds,
+         [&responses, failedIds, &index](const auto& itBegin, const auto& itEnd)
+         {
+            if (responses[index++].empty())
+               failedIds->insert(failedIds->end(), itBegin, itEnd);
+         });
+   }
+
    RelationInfos regions;
-   splitInChunksAndParseResponses(relationIds, nominatimApiClient,
-      [&regions](const rapidjson::Document& document)
+   parseResponses(responses,
+      [&regions](const rapidjson::Value& document)
       {
-         RelationInfos regions;
          for (const auto& item : document.GetArray())
             regions.emplace_back(
-               jsonToObject<RelationInfo>(item, json::GetString(json::Get(item, "address_type")).data()));
+               jsonToObject<RelationInfo>(item, std::string(json::GetString(json::Get(item, "addresstype")))));
       });
-   return regions;
+   co_return regions;
 }
 
-RelationInfos LookupRelationInformationForCities(const OsmIds& relationIds, Match match, WebClient& nominatimApiClient)
+Task<RelationInfos> LookupRelationInformationForCitiesAsync(
+   OsmIds relationIds, Match match, WebClient& nominatimApiClient)
 {
+   // Responses are processed in the order of the chunks, as matching depends on the cities found before.
+   const auto responses = co_await loadChunksAsync(relationIds, nominatimApiClient);
+
    RelationInfos cities;
-   splitInChunksAndParseResponses(relationIds, nominatimApiClient,
-      [&cities, match](const rapidjson::Document& document)
+   parseResponses(responses,
+      [&cities, match](const rapidjson::Value& document)
       {
          auto areCloseCoordinates = [](const RelationInfo& c1, const RelationInfo& c2)
          {
@@ -182,7 +230,7 @@ RelationInfos LookupRelationInformationForCities(const OsmIds& relationIds, Matc
                break;
          }
       });
-   return cities;
+   co_return cities;
 }
 
 }  // namespace geo::nominatim
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "../utils/StringInterner.h"
+#include "../utils/Task.h"
+
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -15,6 +19,10 @@ namespace geo::nominatim
 using OsmId = std::int64_t;         // Type alias for OpenStreetMap (OSM) IDs.
 using OsmIds = std::vector<OsmId>;  // Type alias for a list of OSM IDs.
 
+// Maximum number of OSM IDs to process in a single API request.
+// from https://nominatim.org/release-docs/latest/api/Lookup/#endpoint
+inline constexpr std::size_t sc_maxIdsPerLookup = 50;
+
 // Enum to define the matching strategy for city lookups.
 enum Match
 {
@@ -23,31 +31,41 @@ enum Match
 };
 
 // Structure to hold information about a geographic relation (e.g., city, town, state).
+// Country and address type are interned, because there are only a few hundred distinct values of them.
 struct RelationInfo
 {
-   std::int64_t osmId = 0;  // OSM ID of the relation.
-   std::string name;        // Name of the relation in the native language.
-   std::string country;     // Country name in the native language.
-   double latitude = 0;     // Latitude of the relation's center.
-   double longitude = 0;    // Longitude of the relation's center.
+   std::int64_t osmId = 0;      // OSM ID of the relation.
+   std::string name;            // Name of the relation in the native language.
+   InternedString country;      // Country name in the native language.
+   InternedString addressType;  // Nominatim "addresstype" of the relation (e.g., "city", "state").
+   double latitude = 0;         // Latitude of the relation's center.
+   double longitude = 0;        // Longitude of the relation's center.
 };
 
 using RelationInfos = std::vector<RelationInfo>;  // Type alias for a list of RelationInfo objects.
 
+// Returns the number of bytes taken by relation information, interned strings are not counted.
+std::size_t EstimateMemoryUsage(const RelationInfo& info);
+
 // Requests the Nominatim Address Lookup API for objects with the given OSM IDs.
+// IDs are looked up in chunks, and requests for all the chunks are sent at once.
 // See https://nominatim.org/release-docs/latest/api/Lookup/
 // @param relationIds: List of OSM IDs to look up.
 // @param nominatimApiClient: WebClient instance to interact with the Nominatim API.
+// @param failedIds: Receives IDs of the chunks whose requests have failed, may be nullptr. Must outlive the task.
 // @return: A list of RelationInfo objects containing details about the requested relations.
-RelationInfos LookupRelationInformation(const OsmIds& relationIds, WebClient& nominatimApiClient);
+Task<RelationInfos> LookupRelationInformationAsync(
+   OsmIds relationIds, WebClient& nominatimApiClient, OsmIds* failedIds = nullptr);
 
 // Requests the Nominatim Address Lookup API for objects with the given OSM IDs,
 // filtering results to include only those with "addresstype" relevant for cities.
+// IDs are looked up in chunks, and requests for all the chunks are sent at once.
 // @param relationIds: List of OSM IDs to look up.
 // @param match: Matching strategy (Best or Any).
 // @param nominatimApiClient: WebClient instance to interact with the Nominatim API.
 // @return: A list of RelationInfo objects containing details about the requested cities.
-RelationInfos LookupRelationInformationForCities(const OsmIds& relationIds, Match match, WebClient& nominatimApiClient);
+Task<RelationInfos> LookupRelationInformationForCitiesAsync(
+   OsmIds relationIds, Match match, WebClient& nominatimApiClient);
 
 }  // namespace geo::nominatim
 
@@ -1,5 +1,6 @@
 #include "OpenMeteoApiUtils.h"
 
+#include "../utils/JsonDocument.h"
 #include "../utils/JsonUtils.h"
 #include "../utils/WebClient.h"
 
@@ -36,8 +37,7 @@ std::string formatHistoricalWeatherRequest(
 // Parse Open Meteo API response.
 WeatherInfoVector parseWeatherResponse(const std::string& response)
 {
-   rapidjson::Document document;
-   document.Parse(response.c_str());
+   json::ArenaDocument document(response);
 
    const auto& timeValues = json::Get(document, "daily", "time").GetArray();
    const auto& temperatureMaxValues = json::Get(document, "daily", "temperature_2m_max").GetArray();
@@ -98,12 +98,12 @@ std::vector<DateRange> CollectHistoricalRanges(
    return result;
 }
 
-WeatherInfoVector LoadHistoricalWeather(
-   WebClient& client, double latitude, double longitude, const DateRange& dateRange)
+Task<WeatherInfoVector> LoadHistoricalWeatherAsync(
+   WebClient& client, double latitude, double longitude, DateRange dateRange)
 {
-   const std::string request = formatHistoricalWeatherRequest(latitude, longitude, dateRange.first, dateRange.second);
-   const std::string response = client.Get(request);
-   return !response.empty() ? parseWeatherResponse(response) : WeatherInfoVector{};
+   std::string request = formatHistoricalWeatherRequest(latitude, longitude, dateRange.first, dateRange.second);
+   const std::string response = co_await client.GetAsync(std::move(request));
+   co_return !response.empty() ? parseWeatherResponse(response) : WeatherInfoVector{};
 }
 
 }  // namespace geo::openmeteo
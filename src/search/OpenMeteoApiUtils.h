@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../utils/Task.h"
 #include "../utils/TimeUtils.h"
 #include "../utils/WeatherInfo.h"
 #include "../utils/WebClient.h"
@@ -25,7 +26,7 @@ std::vector<DateRange> CollectHistoricalRanges(
 // @param longitude: The longitude of the location.
 // @param dateRange: The range of dates to request historical weather for.
 // @return: A list of weather information for each date in the range.
-WeatherInfoVector LoadHistoricalWeather(
-   WebClient& client, double latitude, double longitude, const DateRange& dateRange);
+Task<WeatherInfoVector> LoadHistoricalWeatherAsync(
+   WebClient& client, double latitude, double longitude, DateRange dateRange);
 
 }  // namespace geo::openmeteo
@@ -1,12 +1,19 @@
 #include "OverpassApiUtils.h"
 
+#include "../utils/JsonDocument.h"
 #include "../utils/JsonUtils.h"
+#include "../utils/MemoryUsage.h"
+#include "../utils/RequestContext.h"
 #include "../utils/WebClient.h"
 #include "ProtoTypes.h"
 
 #include <rapidjson/document.h>
 
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <format>
+#include <iterator>
 
 namespace
 {
@@ -30,43 +37,213 @@ constexpr const char* sz_requestByCoordinatesFormat =
                 // which define the outlines of the found "area" entities to the result set.
    "out ids;";  // Return ids.
 
+// Overpass API query format to find tourist attractions inside the areas of relations, {0} is a list of their IDs.
+// Nodes of every relation follow the ID of the relation in the response.
+constexpr const char* sz_requestTouristNodesByRelationsFormat =
+   "[out:json][timeout:180];"
+   "rel(id:{0});"
+   "foreach -> .rel("             // Handle the relations one by one.
+   ".rel out ids;"                // Return the id of the relation, which starts its nodes.
+   ".rel map_to_area -> .area;"  // Save "area" entity of the relation to .area set.
+   "node[tourism~\"^(attraction|museum|gallery|viewpoint|zoo|theme_park|artwork)$\"][name](area.area);"
+   "out {1};"  // Return at most {1} nodes with coordinates and tags.
+   ");";
+
+// Tags of tourist nodes which are sent to clients. Other tags are dropped to keep responses small.
+constexpr std::array<const char*, 5> sc_touristNodeTags = {"tourism", "name", "name:en", "ele", "wikidata"};
+
+// Elements of streamed responses up to this size are parsed in memory reused from previous elements.
+constexpr std::size_t sc_largestElementBlock = 64 * 1024;
+
+// Converts a string view to an int64 value.
+// @param s: String view containing the numeric value.
+// @return: Parsed value or 0 if parsing fails.
+std::int64_t getInt64FromString(std::string_view s)
+{
+   std::int64_t value = 0;
+   std::from_chars(s.data(), s.data() + s.size(), value);
+   return value;
+}
+
 }  // namespace
 
 namespace geo::overpass
 {
 
-OsmIds ExtractRelationIds(const std::string& json)
+QueryResult ParseQueryResult(const std::string& json)
 {
    if (json.empty())
       return {};
 
-   rapidjson::Document document;
-   document.Parse(json.c_str());
+   json::ArenaDocument document(json);
    if (!document.IsObject())
       return {};
 
-   OsmIds result;
+   QueryResult result;
+   result.timestampOsmBase = json::GetString(json::Get(document, "osm3s", "timestamp_osm_base"));
    for (const auto& e : document["elements"].GetArray())
    {
-      const auto& id = json::Get(e, "id");
-      if (!id.IsNull() && json::GetString(json::Get(e, "type")) == "relation")
-         result.emplace_back(json::GetInt64(id));
+      const auto type = json::GetString(json::Get(e, "type"));
+      if (type == "relation")
+      {
+         const auto& id = json::Get(e, "id");
+         if (!id.IsNull())
+            result.relationIds.emplace_back(json::GetInt64(id));
+      }
+      else if (type == "count")
+      {
+         // Counts are returned as strings, e.g. "tags": {"relations": "3", "total": "5", ...}.
+         result.relationCounts.push_back(getInt64FromString(json::GetString(json::Get(e, "tags", "relations"))));
+         result.totalCounts.push_back(getInt64FromString(json::GetString(json::Get(e, "tags", "total"))));
+      }
+   }
+   return result;
+}
+
+std::size_t EstimateMemoryUsage(const QueryResult& result)
+{
+   return geo::EstimateMemoryUsage(result.relationIds) + geo::EstimateMemoryUsage(result.relationCounts) +
+          geo::EstimateMemoryUsage(result.totalCounts) + geo::EstimateMemoryUsage(result.timestampOsmBase);
+}
+
+std::vector<TaggedNodes> ParseTaggedNodesByRelation(const std::string& json, const OsmIds& relationIds)
+{
+   std::vector<TaggedNodes> result(relationIds.size());
+   if (json.empty())
+      return result;
+
+   json::ArenaDocument document(json);
+   if (!document.IsObject())
+      return result;
+
+   TaggedNodes* nodes = nullptr;  // Nodes of the relation whose ID has been met last
+   for (const auto& e : document["elements"].GetArray())
+   {
+      const auto type = json::GetString(json::Get(e, "type"));
+      if (type == "relation")
+      {
+         const auto it = std::find(relationIds.begin(), relationIds.end(), json::GetInt64(json::Get(e, "id")));
+         nodes = it != relationIds.end() ? &result[it - relationIds.begin()] : nullptr;
+         continue;
+      }
+      if (type != "node" || !nodes)
+         continue;
+
+      TaggedNode node;
+      node.latitude = json::GetDouble(json::Get(e, "lat"));
+      node.longitude = json::GetDouble(json::Get(e, "lon"));
+      for (const char* tag : sc_touristNodeTags)
+      {
+         if (json::Has(e, "tags", tag))
+            node.tags.emplace_back(StringInterner::Instance().Intern(tag), json::GetString(json::Get(e, "tags", tag)));
+      }
+      nodes->emplace_back(std::move(node));
+   }
+   return result;
+}
+
+OsmIds ExtractRelationIds(const std::string& json)
+{
+   return ParseQueryResult(json).relationIds;
+}
+
+RelationIdStream::RelationIdStream()
+   : m_elementMemory(std::pmr::pool_options{0, sc_largestElementBlock}, RequestContext::Current().memoryResource)
+{
+}
+
+OsmIds RelationIdStream::Feed(std::string_view chunk)
+{
+   // Elements are objects at the third level: {"elements": [{...}, ...]}. Brackets inside strings do not count.
+   OsmIds result;
+   for (const char c : chunk)
+   {
+      if (m_inElement)
+         m_element.push_back(c);
+
+      if (m_inString)
+      {
+         if (m_escaped)
+            m_escaped = false;
+         else if (c == '\\')
+            m_escaped = true;
+         else if (c == '"')
+            m_inString = false;
+         continue;
+      }
+
+      switch (c)
+      {
+      case '"':
+         m_inString = true;
+         break;
+
+      case '{':
+      case '[':
+         m_brackets.push_back(c);
+         if (m_brackets.size() == 3 && m_brackets[1] == '[' && c == '{')
+         {
+            m_inElement = true;
+            m_element.assign(1, c);
+         }
+         break;
+
+      case '}':
+      case ']':
+         if (m_brackets.empty())
+            break;
+         if (m_inElement && m_brackets.size() == 3)
+         {
+            m_inElement = false;
+            parseElement(result);
+         }
+         m_brackets.pop_back();
+         break;
+
+      default:
+         break;
+      }
    }
    return result;
 }
 
-OsmIds LoadRelationIdsByName(WebClient& client, const std::string& name)
+void RelationIdStream::parseElement(OsmIds& result)
+{
+   json::ArenaDocument document(m_element, &m_elementMemory);
+   if (!document.IsObject() || json::GetString(json::Get(document, "type")) != "relation")
+      return;
+
+   const auto& id = json::Get(document, "id");
+   if (!id.IsNull())
+      result.emplace_back(json::GetInt64(id));
+}
+
+Task<OsmIds> LoadRelationIdsByNameAsync(WebClient& client, std::string name)
+{
+   std::string request = std::format(sz_requestByNameFormat, name);
+   const std::string response = co_await client.PostAsync(std::move(request));
+   co_return ExtractRelationIds(response);
+}
+
+Task<OsmIds> LoadRelationIdsByLocationAsync(WebClient& client, double latitude, double longitude)
 {
-   const std::string request = std::format(sz_requestByNameFormat, name);
-   const std::string response = client.Post(request);
-   return ExtractRelationIds(response);
+   std::string request = std::format(sz_requestByCoordinatesFormat, latitude, longitude);
+   const std::string response = co_await client.PostAsync(std::move(request));
+   co_return ExtractRelationIds(response);
 }
 
-OsmIds LoadRelationIdsByLocation(WebClient& client, double latitude, double longitude)
+Task<std::vector<TaggedNodes>> LoadTouristNodesByRelationsAsync(
+   WebClient& client, OsmIds relationIds, std::size_t maxCount)
 {
-   const std::string request = std::format(sz_requestByCoordinatesFormat, latitude, longitude);
-   const std::string response = client.Post(request);
-   return ExtractRelationIds(response);
+   if (relationIds.empty())
+      co_return std::vector<TaggedNodes>{};
+
+   std::string ids;
+   for (const OsmId id : relationIds)
+      std::format_to(std::back_inserter(ids), "{}{}", ids.empty() ? "" : ",", id);
+   std::string request = std::format(sz_requestTouristNodesByRelationsFormat, ids, maxCount);
+   const std::string response = co_await client.PostAsync(std::move(request));
+   co_return ParseTaggedNodesByRelation(response, relationIds);
 }
 
 }  // namespace geo::overpass
\ No newline at end of file
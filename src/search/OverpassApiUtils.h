@@ -1,7 +1,14 @@
 #pragma once
 
+#include "../utils/StringInterner.h"
+#include "../utils/Task.h"
+
+#include <cstddef>
 #include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace geo
@@ -15,22 +22,93 @@ namespace geo::overpass
 using OsmId = std::int64_t;         // Type alias for OpenStreetMap (OSM) IDs.
 using OsmIds = std::vector<OsmId>;  // Type alias for a list of OSM IDs.
 
+// Parsed content of an Overpass API JSON response.
+struct QueryResult
+{
+   OsmIds relationIds;                        // IDs of entities with type "relation".
+   std::vector<std::int64_t> relationCounts;  // "relations" tag of entities with type "count", in output order.
+   std::vector<std::int64_t> totalCounts;     // "total" tag of entities with type "count", in output order.
+   std::string timestampOsmBase;              // "osm3s.timestamp_osm_base", the date of the data in the response.
+};
+
+// Returns the number of bytes taken by a query result.
+std::size_t EstimateMemoryUsage(const QueryResult& result);
+
+// A node with tags, e.g. a tourist attraction. Tag keys are interned, as only a few distinct keys are used.
+struct TaggedNode
+{
+   double latitude = 0;                                       // Latitude of the node.
+   double longitude = 0;                                      // Longitude of the node.
+   std::vector<std::pair<InternedString, std::string>> tags;  // Tags of the node, only the ones sent to clients.
+};
+
+using TaggedNodes = std::vector<TaggedNode>;  // Type alias for a list of tagged nodes.
+
+// Parses a JSON response of the Overpass API.
+// @param json: The JSON response from the Overpass API.
+// @return: Relation IDs and counts found in the response.
+QueryResult ParseQueryResult(const std::string& json);
+
+// Extracts entities with type "node" with their coordinates and tags from a JSON response, where nodes of every
+// relation follow the ID of the relation.
+// @param json: The JSON response from the Overpass API.
+// @param relationIds: IDs of the relations.
+// @return: Lists of nodes found, one for every relation in the order of their IDs.
+std::vector<TaggedNodes> ParseTaggedNodesByRelation(const std::string& json, const OsmIds& relationIds);
+
 // Extracts all IDs of entities with type "relation" from a JSON response.
 // @param json: The JSON response from the Overpass API.
 // @return: A list of OSM IDs for the relations found.
 OsmIds ExtractRelationIds(const std::string& json);
 
+// Extracts IDs of entities with type "relation" from a JSON response of the Overpass API while it is being received.
+// Each element of the response is parsed as soon as it is complete, other parts of the response are skipped.
+class RelationIdStream
+{
+public:
+   // Memory of parsed elements is taken from the memory resource of the current RPC.
+   RelationIdStream();
+
+   // Parses the next part of the response.
+   // @param chunk: Part of the response which follows the parts passed before.
+   // @return: IDs of relations completed by this part.
+   OsmIds Feed(std::string_view chunk);
+
+private:
+   // Parses a complete element and adds its ID to the result if it is a relation.
+   void parseElement(OsmIds& result);
+
+private:
+   std::string m_element;         // Text of the element being received.
+   std::vector<char> m_brackets;  // Brackets enclosing the current position, the innermost one last.
+   bool m_inElement = false;      // The current position is inside an element of the "elements" array.
+   bool m_inString = false;       // The current position is inside a string.
+   bool m_escaped = false;        // The previous character of the string is an unescaped backslash.
+
+   // Memory of the element being parsed, reused by the next ones, as a response has thousands of elements.
+   std::pmr::unsynchronized_pool_resource m_elementMemory;
+};
+
 // Finds relation IDs by name using the Overpass API.
 // @param client: WebClient instance to interact with the Overpass API.
 // @param name: The name to search for.
 // @return: A list of OSM IDs for the relations found.
-OsmIds LoadRelationIdsByName(WebClient& client, const std::string& name);
+Task<OsmIds> LoadRelationIdsByNameAsync(WebClient& client, std::string name);
 
 // Finds relation IDs by location (latitude/longitude) using the Overpass API.
 // @param client: WebClient instance to interact with the Overpass API.
 // @param latitude: The latitude of the location.
 // @param longitude: The longitude of the location.
 // @return: A list of OSM IDs for the relations found.
-OsmIds LoadRelationIdsByLocation(WebClient& client, double latitude, double longitude);
+Task<OsmIds> LoadRelationIdsByLocationAsync(WebClient& client, double latitude, double longitude);
+
+// Finds tourist attractions (museums, viewpoints, etc.) inside the areas of relations using the Overpass API.
+// All the relations are handled by a single query.
+// @param client: WebClient instance to interact with the Overpass API.
+// @param relationIds: OSM IDs of the relations, e.g. cities.
+// @param maxCount: Maximum number of nodes to return for every relation.
+// @return: Lists of nodes with their tags, one for every relation in the order of their IDs.
+Task<std::vector<TaggedNodes>> LoadTouristNodesByRelationsAsync(
+   WebClient& client, OsmIds relationIds, std::size_t maxCount);
 
 }  // namespace geo::overpass
@@ -0,0 +1,138 @@
+#include "OverpassQueryPlanner.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <bit>
+#include <format>
+
+namespace
+{
+
+using namespace geo::overpass;
+
+constexpr double sc_areaUnitKm2 = 10'000;  // Statistics are normalized to this area.
+constexpr double sc_learningRate = 0.2;    // Weight of a new sample in exponentially weighted averages.
+
+// Expected number of regions with admin_level=4 per 10 000 km2. Used to convert the density of a feature
+// into the share of the bounding box which survives the feature filter.
+constexpr double sc_regionDensity = 0.3;
+
+// Priors used until enough responses are seen.
+struct Prior
+{
+   Feature feature;
+   double density;
+   double cost;
+};
+
+constexpr std::array<Prior, 4> sc_priors = {{
+   {Feature::Airports, 0.02, 5},     // Very rare, cheap tag lookup.
+   {Feature::Peaks, 0.15, 10},       // Common in mountains, tag lookup with a numeric filter.
+   {Feature::SeaBeaches, 0.1, 60},   // "around" on coastlines is the most expensive filter.
+   {Feature::SaltLakes, 0.05, 20},   // Rare, but requires recursing down to nodes of big polygons.
+}};
+
+std::size_t indexOf(Feature feature)
+{
+   return std::countr_zero(static_cast<std::uint32_t>(feature));
+}
+
+double updateAverage(double average, std::uint32_t samples, double sample)
+{
+   return samples == 0 ? sample : average + sc_learningRate * (sample - average);
+}
+
+}  // namespace
+
+namespace geo::overpass
+{
+
+QueryPlanner::QueryPlanner()
+{
+   for (const auto& prior : sc_priors)
+   {
+      auto& statistics = m_statistics[indexOf(prior.feature)];
+      statistics.density = prior.density;
+      statistics.cost = prior.cost;
+   }
+}
+
+FeaturePlan QueryPlanner::Plan(std::uint32_t mask) const
+{
+   FeaturePlan plan;
+   for (const auto& prior : sc_priors)
+      if (mask & static_cast<std::uint32_t>(prior.feature))
+         plan.push_back(prior.feature);
+
+   if (plan.size() < 2)
+      return plan;
+
+   std::lock_guard lock(m_mutex);
+
+   // There are at most 4! orders, so all of them are checked.
+   std::sort(plan.begin(), plan.end());
+   FeaturePlan bestPlan = plan;
+   double bestCost = estimateCost(plan);
+   while (std::next_permutation(plan.begin(), plan.end()))
+   {
+      const double cost = estimateCost(plan);
+      if (cost < bestCost)
+      {
+         bestCost = cost;
+         bestPlan = plan;
+      }
+   }
+   return bestPlan;
+}
+
+void QueryPlanner::Learn(const FeaturePlan& plan, double areaKm2, const std::vector<std::int64_t>& relationCounts,
+   std::chrono::milliseconds elapsed)
+{
+   if (plan.empty() || relationCounts.size() != plan.size() || areaKm2 <= 0)
+      return;
+
+   const double areaUnits = areaKm2 / sc_areaUnitKm2;
+
+   std::lock_guard lock(m_mutex);
+
+   // Only the first feature is evaluated over the whole bounding box, so only its count
+   // is an unbiased sample of the density.
+   auto& first = m_statistics[indexOf(plan.front())];
+   first.density = updateAverage(first.density, first.densitySamples, relationCounts.front() / areaUnits);
+   ++first.densitySamples;
+
+   // Server time can be attributed to a feature only when it is the single one in the query.
+   if (plan.size() == 1)
+   {
+      first.cost = updateAverage(first.cost, first.costSamples, elapsed.count() / areaUnits);
+      ++first.costSamples;
+   }
+
+#ifndef NDEBUG
+   LOG(INFO) << std::format("Query planner: feature {} density {:.3f}, cost {:.1f}",
+      static_cast<std::uint32_t>(plan.front()), first.density, first.cost);
+#endif
+}
+
+FeatureStatistics QueryPlanner::GetStatistics(Feature feature) const
+{
+   std::lock_guard lock(m_mutex);
+   return m_statistics[indexOf(feature)];
+}
+
+// Every step is evaluated only inside the share of the bounding box which survived all the previous steps.
+double QueryPlanner::estimateCost(const FeaturePlan& plan) const
+{
+   double cost = 0;
+   double survivingShare = 1;
+   for (const auto feature : plan)
+   {
+      const auto& statistics = m_statistics[indexOf(feature)];
+      cost += statistics.cost * survivingShare;
+      survivingShare *= std::min(1.0, statistics.density / sc_regionDensity);
+   }
+   return cost;
+}
+
+}  // namespace geo::overpass
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace geo::overpass
+{
+
+// Geographical features which can be requested in a regions query.
+// Values match geoproto.RegionsRequest.Preferences.GeographicalFeature bits.
+enum class Feature : std::uint32_t
+{
+   Airports = 1,
+   Peaks = 2,
+   SeaBeaches = 4,
+   SaltLakes = 8
+};
+
+// Order in which features are evaluated by a single regions query.
+// The first feature is evaluated over the whole bounding box, every next one only inside the regions
+// which survived all the previous features.
+using FeaturePlan = std::vector<Feature>;
+
+// Statistics collected for a single feature.
+struct FeatureStatistics
+{
+   double density = 0;                // Expected number of matching regions per 10 000 km2.
+   double cost = 0;                   // Expected Overpass server time in milliseconds per 10 000 km2.
+   std::uint32_t densitySamples = 0;  // Number of responses used to learn the density.
+   std::uint32_t costSamples = 0;     // Number of responses used to learn the cost.
+};
+
+// QueryPlanner chooses the order of feature filters in a regions query.
+// Rare features (e.g. international airports) restrict the areas in which expensive ones
+// (e.g. coastlines with "around") are evaluated. Statistics start from built-in priors and are
+// refined from the responses of executed queries.
+// The class is thread-safe.
+class QueryPlanner
+{
+public:
+   QueryPlanner();
+
+   // Builds the cheapest evaluation order for the features selected in the mask.
+   // @param mask: Bitmask of Feature values.
+   // @return: Features in evaluation order, empty if the mask has no known features.
+   FeaturePlan Plan(std::uint32_t mask) const;
+
+   // Updates statistics from the response of a query built with the given plan.
+   // @param plan: The plan the query was built with.
+   // @param areaKm2: Area of the queried bounding box in square kilometers.
+   // @param relationCounts: Number of matching regions after each step of the plan.
+   // @param elapsed: Time spent waiting for the response.
+   void Learn(const FeaturePlan& plan, double areaKm2, const std::vector<std::int64_t>& relationCounts,
+      std::chrono::milliseconds elapsed);
+
+   // Returns the current statistics for the feature.
+   FeatureStatistics GetStatistics(Feature feature) const;
+
+private:
+   // Estimates relative Overpass server time for the plan.
+   double estimateCost(const FeaturePlan& plan) const;
+
+private:
+   mutable std::mutex m_mutex;                       // Guards m_statistics.
+   std::array<FeatureStatistics, 4> m_statistics{};  // Statistics indexed by the feature bit position.
+};
+
+}  // namespace geo::overpass
@@ -0,0 +1,97 @@
+#include "OverpassTileCache.h"
+
+#include <utility>
+
+namespace geo::overpass
+{
+
+std::size_t EstimateMemoryUsage(const CachedTile& tile)
+{
+   return sizeof(tile) - sizeof(tile.result) - sizeof(tile.timestampOsmBase) + EstimateMemoryUsage(tile.result) +
+          geo::EstimateMemoryUsage(tile.timestampOsmBase);
+}
+
+TileCache::TileCache(const TileCacheSettings& settings)
+   : m_settings(settings)
+   , m_tiles(settings.maxEntries)
+{
+}
+
+std::optional<CachedTile> TileCache::Find(const std::string& key)
+{
+   return m_tiles.Find(key);
+}
+
+TileCache::Freshness TileCache::GetFreshness(const CachedTile& tile) const
+{
+   const auto now = std::chrono::steady_clock::now();
+   if (now - tile.loadedAt >= m_settings.maxAge)
+      return Freshness::Expired;
+
+   if (now - tile.validatedAt < m_settings.revalidateAfter)
+      return Freshness::Fresh;
+
+   // Revalidation needs the timestamp of the cached data, which might be absent in a malformed response.
+   if (m_settings.revalidation == Revalidation::Timestamp && !tile.timestampOsmBase.empty())
+      return Freshness::NeedsRevalidation;
+
+   return Freshness::Expired;
+}
+
+bool TileCache::IsWithinStaleness(const CachedTile& tile, std::chrono::seconds maxStaleness) const
+{
+   const auto now = std::chrono::steady_clock::now();
+   return now - tile.loadedAt < m_settings.maxAge &&
+          (now - tile.validatedAt < maxStaleness || now - tile.validatedAt < m_settings.revalidateAfter);
+}
+
+void TileCache::Store(const std::string& key, QueryResult result, bool prefetched)
+{
+   const auto now = std::chrono::steady_clock::now();
+   CachedTile tile;
+   tile.timestampOsmBase = result.timestampOsmBase;
+   tile.result = std::move(result);
+   tile.loadedAt = now;
+   tile.validatedAt = now;
+   tile.prefetched = prefetched;
+   m_tiles.Insert(key, std::move(tile));
+}
+
+void TileCache::MarkValidated(const std::string& key, const std::string& timestampOsmBase)
+{
+   m_tiles.Update(key,
+      [&timestampOsmBase](CachedTile& tile)
+      {
+         tile.validatedAt = std::chrono::steady_clock::now();
+         if (!timestampOsmBase.empty())
+            tile.timestampOsmBase = timestampOsmBase;
+      });
+}
+
+bool TileCache::TakePrefetched(const std::string& key)
+{
+   bool prefetched = false;
+   m_tiles.Update(key,
+      [&prefetched](CachedTile& tile)
+      {
+         prefetched = std::exchange(tile.prefetched, false);
+      });
+   return prefetched;
+}
+
+std::size_t TileCache::GetMemoryUsage() const
+{
+   return m_tiles.GetMemoryUsage();
+}
+
+std::uint64_t TileCache::GetHits() const
+{
+   return m_tiles.GetHits();
+}
+
+std::size_t TileCache::Evict(std::size_t bytes)
+{
+   return m_tiles.Evict(bytes);
+}
+
+}  // namespace geo::overpass
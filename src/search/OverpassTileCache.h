@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../cache/WTinyLfuCache.h"
+#include "OverpassApiUtils.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace geo::overpass
+{
+
+// Defines what happens with a cached tile once it is older than TileCacheSettings::revalidateAfter.
+enum class Revalidation
+{
+   Refetch,    // The tile is loaded again.
+   Timestamp,  // Overpass is asked whether anything in the tile has changed since the cached data timestamp,
+               // and the tile is loaded again only if it has.
+};
+
+struct TileCacheSettings
+{
+   std::size_t maxEntries = 10'000;                      // Maximum number of cached tiles.
+   std::chrono::seconds revalidateAfter{3600};           // Cached tiles younger than this are used as is.
+   std::chrono::seconds maxAge{7 * 24 * 3600};           // Cached tiles older than this are always loaded again.
+                                                         // "newer" filter does not report deleted entities,
+                                                         // so this limits how long a deletion can go unnoticed.
+   Revalidation revalidation = Revalidation::Timestamp;  // See Revalidation.
+};
+
+// Cached result of a regions query for a single tile.
+struct CachedTile
+{
+   QueryResult result;                                 // Parsed Overpass response.
+   std::string timestampOsmBase;                       // Date of the Overpass data the result was built from.
+   std::chrono::steady_clock::time_point loadedAt;     // When the result was loaded from Overpass.
+   std::chrono::steady_clock::time_point validatedAt;  // When the result was last known to be up-to-date.
+   bool prefetched = false;                            // Loaded by the prefetcher and not used by a request yet.
+};
+
+// Returns the number of bytes taken by a cached tile.
+std::size_t EstimateMemoryUsage(const CachedTile& tile);
+
+// TileCache keeps results of Overpass regions queries per tile and decides when they need revalidation.
+// The class is thread-safe.
+class TileCache
+{
+public:
+   // State of a cached tile relative to the current time.
+   enum class Freshness
+   {
+      Fresh,              // The tile can be used as is.
+      NeedsRevalidation,  // The tile can be used if Overpass reports no changes since CachedTile::timestampOsmBase.
+      Expired,            // The tile must be loaded again.
+   };
+
+   explicit TileCache(const TileCacheSettings& settings);
+
+   // Returns the cached tile, if any.
+   std::optional<CachedTile> Find(const std::string& key);
+
+   // Returns the freshness of the cached tile.
+   Freshness GetFreshness(const CachedTile& tile) const;
+
+   // Checks whether the cached tile can be used without revalidation by requests which accept data of the given age.
+   // Tiles older than TileCacheSettings::maxAge are never used.
+   bool IsWithinStaleness(const CachedTile& tile, std::chrono::seconds maxStaleness) const;
+
+   // Stores a tile just loaded from Overpass.
+   // @param prefetched true if the tile is loaded in advance, see TakePrefetched().
+   void Store(const std::string& key, QueryResult result, bool prefetched = false);
+
+   // Marks the cached tile as up-to-date as of the given Overpass data timestamp.
+   void MarkValidated(const std::string& key, const std::string& timestampOsmBase);
+
+   // Marks the cached tile as used by a request.
+   // @return true if the tile was prefetched and has not been used before, i.e. the prefetch was useful.
+   bool TakePrefetched(const std::string& key);
+
+   // Returns the estimated number of bytes taken by cached tiles.
+   std::size_t GetMemoryUsage() const;
+
+   // Returns the number of tiles found in the cache since it was created.
+   std::uint64_t GetHits() const;
+
+   // Evicts the least valuable tiles to free the given number of bytes.
+   // @return Number of freed bytes.
+   std::size_t Evict(std::size_t bytes);
+
+private:
+   TileCacheSettings m_settings;                    // Cache settings.
+   WTinyLfuCache<std::string, CachedTile> m_tiles;  // Cached tiles by key.
+};
+
+}  // namespace geo::overpass
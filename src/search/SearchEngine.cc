@@ -1,8 +1,12 @@
 #include "SearchEngine.h"
 
+#include "../utils/AsyncQueue.h"
 #include "../utils/GeoUtils.h"
+#include "../utils/RequestContext.h"
+#include "../utils/TagDictionary.h"
 #include "../utils/WebClient.h"
 #include "NominatimApiUtils.h"
+#include "OpenMeteoApiUtils.h"
 #include "OverpassApiUtils.h"
 #include "ProtoTypes.h"
 #include "SearchEngineItf.h"
@@ -11,7 +15,16 @@
 #include <rapidjson/document.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <format>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 
 namespace
 {
@@ -26,28 +39,38 @@ constexpr const char* sz_requestFooter = ";out tags;";
 constexpr const char* sz_requestRelationsByNodes =
    "{0} -> {1};"                // Save entities from a set or a statement into a named set.
    "{1} is_in -> {2};"          // Save "area" entities which contain nodes from an input set to a named set.
-   "rel(pivot{2}){3} -> {4};";  // Save "relation" entities which define the outlines of the found "area" entities into
+   "rel(pivot{2}){3} -> {4};"   // Save "relation" entities which define the outlines of the found "area" entities into
                                 // a named set.
+   "{4} out count;";            // Report the number of found "relation" entities, it is used by the query planner.
+
+constexpr const char* sz_requestScopeByRelations =
+   "{0} map_to_area -> .scope;";  // Save "area" entities of the found "relation" entities to restrict next features.
+
+constexpr const char* sz_scopeFilter = "(area.scope)";
 
 // Definitions below which produce "way" or "relation" entities for further recurse down operator application
 // use named result set to not pollute the default result set.
+// {0} is a bounding box, {1} is either empty or a filter restricting entities to regions found by previous features.
 
-constexpr const char* sz_nodeAirportsDef = "("
-                                           "nwr[\"aeroway\"=\"aerodrome\"][\"aerodrome:type\"=\"international\"]({0});"
-                                           "nwr[\"aerodrome\"=\"international\"]({0});"
-                                           ") -> .outA;"
-                                           ".outA > -> .outA;"  // Recurse down (to ways and nodes)
-                                           "node.outA";         // Select only nodes.
+constexpr const char* sz_nodeAirportsDef =
+   "("
+   "nwr[\"aeroway\"=\"aerodrome\"][\"aerodrome:type\"=\"international\"]({0}){1};"
+   "nwr[\"aerodrome\"=\"international\"]({0}){1};"
+   ") -> .outA;"
+   ".outA > -> .outA;"  // Recurse down (to ways and nodes)
+   "node.outA";         // Select only nodes.
 
 constexpr const char* sz_nodePeaksDef =
-   "node[natural=peak][name]({0})(if: is_number(t[\"ele\"]) && number(t[\"ele\"]) > {1})";  // Nodes are ready.
+   "node[natural=peak][name]({0}){1}(if: is_number(t[\"ele\"]) && number(t[\"ele\"]) > {2})";  // Nodes are ready.
 
-constexpr const char* sz_nodeSeaBeachesDef = "way[natural=coastline]({0}) -> .coastlines;"
-                                             "node(around.coastlines:100)[natural=beach]";  // Nodes are ready.
+constexpr const char* sz_nodeAnyPeaksDef = "node[natural=peak][name]({0}){1}";  // Peaks of any height.
+
+constexpr const char* sz_nodeSeaBeachesDef = "way[natural=coastline]({0}){1} -> .coastlines;"
+                                             "node(around.coastlines:100)[natural=beach]{1}";  // Nodes are ready.
 
 // Note - in the following query we select only nodes belonging to a bounding box,
 // because big objects (such as lakes/seas) may contain nodes from different regions and even countries.
-constexpr const char* sz_nodeSaltLakesDef = "wr[natural=water][water=lake][salt=no][name]({0}) -> .outL;"
+constexpr const char* sz_nodeSaltLakesDef = "wr[natural=water][water=lake][salt=no][name]({0}){1} -> .outL;"
                                             ".outL > -> .outL;"  // Recurse down (to ways and nodes).
                                             "node.outL({0})";    // Select only nodes.
 
@@ -55,106 +78,257 @@ constexpr const char* sz_nodeSaltLakesDef = "wr[natural=water][water=lake][salt=
 // name, but not such as big as a whole country.
 constexpr const char* sz_regionsTags = "[boundary=administrative][admin_level=4]";
 
+// Definitions below are used to check whether anything used by a regions query has changed in a bounding box.
+// "newer" filter selects entities modified after the given date. Only counts are returned, so the check is cheap.
+// {0} is a bounding box, {1} is the timestamp of the cached Overpass data.
+
+constexpr const char* sz_requestChangesHeader = "[out:json][timeout:60];(";
+constexpr const char* sz_requestChangesFooter = ");out count;";
+
+constexpr const char* sz_changedRegionsDef = "rel[boundary=administrative][admin_level=4]({0})(newer:\"{1}\");";
+constexpr const char* sz_changedAirportsDef = "nwr[aeroway=aerodrome]({0})(newer:\"{1}\");"
+                                              "nwr[aerodrome]({0})(newer:\"{1}\");";
+constexpr const char* sz_changedPeaksDef = "node[natural=peak]({0})(newer:\"{1}\");";
+constexpr const char* sz_changedSeaBeachesDef = "way[natural=coastline]({0})(newer:\"{1}\");"
+                                                "nwr[natural=beach]({0})(newer:\"{1}\");";
+constexpr const char* sz_changedSaltLakesDef = "wr[natural=water]({0})(newer:\"{1}\");";
+
+// Maximum number of features (tourist attractions) returned for a city.
+constexpr std::size_t sc_maxFeaturesPerCity = 100;
+
+// Prefetched tiles are not needed by anyone yet, so their upstream requests do not wait long.
+constexpr std::chrono::seconds sc_prefetchTimeout{30};
+
+// Closes queues of a pipeline once the last coroutine of a stage exits, also when it throws, so that neither
+// the previous stage waits for room nor the next stage waits for items forever
+template <typename T>
+class StageExit
+{
+public:
+   StageExit(std::atomic<std::size_t>& numRunning, std::initializer_list<AsyncQueue<T>*> queues)
+      : m_numRunning(numRunning)
+      , m_queues(queues)
+   {
+   }
+
+   ~StageExit()
+   {
+      if (m_numRunning.fetch_sub(1) != 1)
+         return;
+      for (auto* queue : m_queues)
+         queue->Close();
+   }
+
+   StageExit(const StageExit&) = delete;
+   StageExit& operator=(const StageExit&) = delete;
+
+private:
+   std::atomic<std::size_t>& m_numRunning;  // Number of running coroutines of the stage
+   std::vector<AsyncQueue<T>*> m_queues;    // Queues to close
+};
+
 // Converts Nominatim relation info to a GeoProtoPlace object
 GeoProtoPlace toGeoProtoPlace(const nominatim::RelationInfo& info)
 {
    GeoProtoPlace location;
    location.set_name(info.name);
-   location.set_country(info.country);
+   location.set_country(std::string(info.country.View()));
    location.mutable_center()->set_latitude(info.latitude);
    location.mutable_center()->set_longitude(info.longitude);
    return location;
 }
 
-// Finds cities using Overpass and Nominatim APIs based on relation IDs
-GeoProtoPlaces findCities(const overpass::OsmIds& relationIds, nominatim::Match match, WebClient& nominatimApiClient,
-   WebClient& overpassApiClient, bool includeDetails)
+// Adds tourist attractions of the city to its features.
+// Tags are either copied to the features, or added to the dictionary and referenced by index.
+void addCityFeatures(GeoProtoPlace& city, overpass::TaggedNodes nodes, TagDictionary* tagDictionary)
+{
+   for (auto& node : nodes)
+   {
+      auto& feature = *city.add_features();
+      feature.mutable_position()->set_latitude(node.latitude);
+      feature.mutable_position()->set_longitude(node.longitude);
+      if (tagDictionary)
+      {
+         auto& indices = *feature.mutable_tag_indices();
+         indices.Reserve(static_cast<int>(node.tags.size() * 2));
+         for (const auto& [key, value] : node.tags)
+         {
+            indices.Add(tagDictionary->Add(key.View()));
+            indices.Add(tagDictionary->Add(value));
+         }
+      }
+      else
+      {
+         auto& tags = *feature.mutable_tags();
+         for (auto& [key, value] : node.tags)
+            tags[std::string(key.View())] = std::move(value);
+      }
+   }
+}
+
+// Finds cities using Overpass and Nominatim APIs based on relation IDs.
+// Found cities are added to the city index.
+Task<GeoProtoPlaces> findCitiesAsync(overpass::OsmIds relationIds, nominatim::Match match,
+   WebClient& nominatimApiClient, WebClient& overpassApiClient, CityIndex& cityIndex, bool includeDetails,
+   TagDictionary* tagDictionary)
 {
    if (relationIds.empty())
-      return {};
+      co_return GeoProtoPlaces{};
 
    // Use Nominatim API to load some detailed information for all the found "relation" entities.
    // However, `infos` contains information only for those entities which are considered "cities".
    // There is no way to select cities from all the entities in advance.
-   const auto infos = nominatim::LookupRelationInformationForCities(relationIds, match, nominatimApiClient);
+   const std::size_t numRelationIds = relationIds.size();
+   const auto infos =
+      co_await nominatim::LookupRelationInformationForCitiesAsync(std::move(relationIds), match, nominatimApiClient);
    if (infos.empty())
-      LOG(ERROR) << std::format("Cannot find cities in Nominatim (checked {} relation ids)", relationIds.size());
+      LOG(ERROR) << std::format("Cannot find cities in Nominatim (checked {} relation ids)", numRelationIds);
    else
-      LOG(INFO) << std::format(
-         "Found {} cities in Nominatim (checked {} relation ids)", infos.size(), relationIds.size());
+      LOG(INFO) << std::format("Found {} cities in Nominatim (checked {} relation ids)", infos.size(), numRelationIds);
+
+   // Features of all the cities are requested by one query, but added in the order of the cities,
+   // so that equal results get equal tag dictionaries.
+   std::vector<overpass::TaggedNodes> features;
+   if (includeDetails)
+   {
+      overpass::OsmIds cityIds;
+      for (const auto& i : infos)
+         cityIds.push_back(i.osmId);
+      features = co_await overpass::LoadTouristNodesByRelationsAsync(
+         overpassApiClient, std::move(cityIds), sc_maxFeaturesPerCity);
+   }
 
    GeoProtoPlaces result;
-   for (const auto& i : infos)
+   for (std::size_t index = 0; index < infos.size(); ++index)
    {
+      const auto& i = infos[index];
+      cityIndex.Add({i.osmId, i.name, i.country, i.latitude, i.longitude});
+
       GeoProtoPlace city = toGeoProtoPlace(i);
       if (includeDetails)
-      {
-         // TODO
-      }
+         addCityFeatures(city, std::move(features[index]), tagDictionary);
       result.emplace_back(std::move(city));
    }
-   return result;
+   co_return result;
 }
 
-// Formats an Overpass API request string based on region preferences and bounding box
-std::string formatRegionsRequest(const ISearchEngine::RegionPreferences& prefs, const BoundingBox& boundingBox)
+// Names of the sets produced by a single feature of a regions query.
+struct FeatureSets
 {
-   const char* sz_relAirports = ".relA";
-   const char* sz_relPeaks = ".relP";
-   const char* sz_relSeaBeaches = ".relS";
-   const char* sz_relSaltLakes = ".relL";
+   const char* nodes;
+   const char* areas;
+   const char* relations;
+};
 
-   const std::string boundingBoxStr =
-      std::format("{}, {}, {}, {}", boundingBox[0], boundingBox[2], boundingBox[1], boundingBox[3]);
-
-   std::string request = sz_requestHeader;
-   if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS)
+FeatureSets getFeatureSets(overpass::Feature feature)
+{
+   switch (feature)
    {
-      const auto nodes = std::format(sz_nodeAirportsDef, boundingBoxStr);
-      request += std::format(sz_requestRelationsByNodes, nodes, ".nodesA", ".areasA", sz_regionsTags, sz_relAirports);
+   case overpass::Feature::Airports:
+      return {".nodesA", ".areasA", ".relA"};
+   case overpass::Feature::Peaks:
+      return {".nodesP", ".areasP", ".relP"};
+   case overpass::Feature::SeaBeaches:
+      return {".nodesS", ".areasS", ".relS"};
+   case overpass::Feature::SaltLakes:
+      return {".nodesL", ".areasL", ".relL"};
    }
+   return {};
+}
 
-   if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS)
+// Formats a statement which selects nodes of the feature
+std::string formatFeatureNodes(overpass::Feature feature, const ISearchEngine::RegionPreferences& prefs,
+   const std::string& boundingBox, const std::string& scope)
+{
+   switch (feature)
+   {
+   case overpass::Feature::Airports:
+      return std::format(sz_nodeAirportsDef, boundingBox, scope);
+   case overpass::Feature::Peaks:
    {
       auto itLength = prefs.properties.find("minPeakHeight");
-      if (itLength != prefs.properties.end())
-      {
-         const int heightMeters = std::atoi(itLength->second.c_str());
-         const auto nodes = std::format(sz_nodePeaksDef, boundingBoxStr, heightMeters);
-         request += std::format(sz_requestRelationsByNodes, nodes, ".nodesP", ".areasP", sz_regionsTags, sz_relPeaks);
-      }
+      if (itLength == prefs.properties.end())
+         return std::format(sz_nodeAnyPeaksDef, boundingBox, scope);
+      const int heightMeters = std::atoi(itLength->second.c_str());
+      return std::format(sz_nodePeaksDef, boundingBox, scope, heightMeters);
    }
-
-   if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SEA_BEACHES)
-   {
-      const auto nodes = std::format(sz_nodeSeaBeachesDef, boundingBoxStr);
-      request += std::format(sz_requestRelationsByNodes, nodes, ".nodesS", ".areasS", sz_regionsTags, sz_relSeaBeaches);
+   case overpass::Feature::SeaBeaches:
+      return std::format(sz_nodeSeaBeachesDef, boundingBox, scope);
+   case overpass::Feature::SaltLakes:
+      return std::format(sz_nodeSaltLakesDef, boundingBox, scope);
    }
+   return {};
+}
 
-   if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SALT_LAKES)
+// Formats an Overpass API request string based on region preferences and bounding box.
+// Features are evaluated in the order given by the plan, every next feature only inside the regions
+// found by the previous ones.
+std::string formatRegionsRequest(
+   const ISearchEngine::RegionPreferences& prefs, const BoundingBox& boundingBox, const overpass::FeaturePlan& plan)
+{
+   if (plan.empty())
+      return {};
+
+   const std::string boundingBoxStr =
+      std::format("{}, {}, {}, {}", boundingBox[0], boundingBox[2], boundingBox[1], boundingBox[3]);
+
+   // Parts are formatted into the request in place, without temporary strings.
+   std::string request = sz_requestHeader;
+   std::string scope;
+   std::string intersection = "rel";
+   for (std::size_t i = 0; i < plan.size(); ++i)
    {
-      const auto nodes = std::format(sz_nodeSaltLakesDef, boundingBoxStr);
-      request += std::format(sz_requestRelationsByNodes, nodes, ".nodesL", ".areasL", sz_regionsTags, sz_relSeaBeaches);
+      const auto sets = getFeatureSets(plan[i]);
+      const auto nodes = formatFeatureNodes(plan[i], prefs, boundingBoxStr, scope);
+      std::format_to(std::back_inserter(request), sz_requestRelationsByNodes, nodes, sets.nodes, sets.areas,
+         sz_regionsTags, sets.relations);
+      if (i + 1 < plan.size())
+      {
+         std::format_to(std::back_inserter(request), sz_requestScopeByRelations, sets.relations);
+         scope = sz_scopeFilter;
+      }
+      intersection += sets.relations;
    }
 
-   if (request == sz_requestHeader)
-      return {};
-
    // The result set is an intersection of multiple named sets.
-   request += "rel";
+   // Restricted features already produce subsets of the previous ones, but regions may overlap.
+   request += intersection;
+   request += sz_requestFooter;
+
+   return request;
+}
+
+// Formats an Overpass API request string which counts entities changed since the timestamp in the bounding box
+std::string formatChangesRequest(
+   const ISearchEngine::RegionPreferences& prefs, const BoundingBox& boundingBox, const std::string& timestampOsmBase)
+{
+   const std::string boundingBoxStr =
+      std::format("{}, {}, {}, {}", boundingBox[0], boundingBox[2], boundingBox[1], boundingBox[3]);
+
+   std::string request = sz_requestChangesHeader;
+   request += std::format(sz_changedRegionsDef, boundingBoxStr, timestampOsmBase);
    if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS)
-      request += sz_relAirports;
+      request += std::format(sz_changedAirportsDef, boundingBoxStr, timestampOsmBase);
    if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS)
-      request += sz_relPeaks;
+      request += std::format(sz_changedPeaksDef, boundingBoxStr, timestampOsmBase);
    if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SEA_BEACHES)
-      request += sz_relSeaBeaches;
+      request += std::format(sz_changedSeaBeachesDef, boundingBoxStr, timestampOsmBase);
    if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SALT_LAKES)
-      request += sz_relSaltLakes;
-   request += sz_requestFooter;
+      request += std::format(sz_changedSaltLakesDef, boundingBoxStr, timestampOsmBase);
+   request += sz_requestChangesFooter;
 
    return request;
 }
 
+// Formats a key of the tile cache. Results depend on the bounding box and on all the preferences.
+std::string formatTileKey(const ISearchEngine::RegionPreferences& prefs, const BoundingBox& boundingBox)
+{
+   auto itLength = prefs.properties.find("minPeakHeight");
+   const std::string minPeakHeight = itLength != prefs.properties.end() ? itLength->second : "";
+   return std::format("{}/{}/{},{},{},{}", prefs.objects, minPeakHeight, boundingBox[0], boundingBox[1],
+      boundingBox[2], boundingBox[3]);
+}
+
 bool isValidBoundingBox(const BoundingBox& bbox)
 {
    static const auto sc_maxDimensionKm = 1000;  // A kind of safety check
@@ -168,97 +342,622 @@ bool isValidBoundingBox(const BoundingBox& bbox)
 namespace geo
 {
 
-SearchEngine::SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient)
+// State of ScanRegionsAsync() shared by the stages of the pipeline:
+// loading ids of regions -> dropping ids found in previous tiles -> looking up information about regions
+struct SearchEngine::RegionScan
+{
+   // Ids of regions in a tile, passed between the stages
+   struct ScannedTile
+   {
+      std::size_t index = 0;              // Index of the tile
+      overpass::OsmIds relationIds;       // Ids of regions in the tile
+      nominatim::RelationInfos lookedUp;  // Regions looked up while the tile was loaded
+   };
+
+   RegionScan(std::vector<BoundingBox> tiles, const RegionPreferences& prefs, std::set<overpass::OsmId>& processed,
+      std::size_t numLoaders, std::size_t numLookups, std::size_t queueCapacity)
+      : tiles(std::move(tiles))
+      , prefs(prefs)
+      , processed(processed)
+      , numLoaders(numLoaders)
+      , numLookups(numLookups)
+      , loaded(queueCapacity)
+      , deduplicated(queueCapacity)
+      , results(this->tiles.size())
+   {
+      skipped.ids = processed;
+   }
+
+   const std::vector<BoundingBox> tiles;  // Scanned tiles
+   const RegionPreferences& prefs;        // Search preferences
+   std::set<overpass::OsmId>& processed;  // Ids of found regions, used only by the deduplicating stage
+
+   std::atomic<std::size_t> nextTile = 0;          // Index of the next tile to load
+   std::atomic<std::size_t> numLoaders;            // Number of running coroutines of the loading stage
+   std::atomic<std::size_t> numDeduplicators = 1;  // The deduplicating stage runs a single coroutine
+   std::atomic<std::size_t> numLookups;            // Number of running coroutines of the lookup stage
+
+   AsyncQueue<ScannedTile> loaded;        // Tiles loaded by the first stage, in any order
+   AsyncQueue<ScannedTile> deduplicated;  // Tiles with new regions, in the order of the tiles
+
+   std::vector<TileRegions> results;  // Found regions of each tile, written by the lookup stage
+   SkippedIds skipped;                // Ids the loading stage does not look up, shared by its coroutines
+
+   std::mutex mutex;              // Guards the member below
+   overpass::OsmIds notFoundIds;  // Ids which were not looked up because of upstream errors
+};
+
+SearchEngine::SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient, WebClient& openMeteoApiClient,
+   const SearchEngineSettings& settings, MemoryAccountant* memoryAccountant)
    : m_overpassApiClient(overpassApiClient)
    , m_nominatimApiClient(nominatimApiClient)
+   , m_openMeteoApiClient(openMeteoApiClient)
+   , m_maxStaleness(settings.maxStaleness)
+   , m_scanOverpassConcurrency(std::max<std::size_t>(settings.scanOverpassConcurrency, 1))
+   , m_scanNominatimConcurrency(std::max<std::size_t>(settings.scanNominatimConcurrency, 1))
+   , m_scanQueueCapacity(settings.scanQueueCapacity)
+   , m_tileCache(settings.tileCache)
+   , m_relationCache(settings.relationCacheMaxEntries)
+   , m_weatherCache(settings.weatherCacheMaxEntries)
+   , m_prefetcher(settings.prefetchMaxPendingTiles,
+        [this](const BoundingBox& tile, const RegionPreferences& prefs, std::stop_token stopToken)
+        {
+           return prefetchRegions(tile, prefs, std::move(stopToken));
+        })
 {
+   if (memoryAccountant)
+   {
+      m_memoryRegistrations.push_back(memoryAccountant->RegisterCache("tile_cache", m_tileCache));
+      m_memoryRegistrations.push_back(memoryAccountant->RegisterCache("relation_cache", m_relationCache));
+      m_memoryRegistrations.push_back(memoryAccountant->RegisterCache("weather_cache", m_weatherCache));
+   }
+
+   if (!settings.citiesDatasetPath.empty())
+   {
+      if (const auto numCities = m_cityIndex.LoadDataset(settings.citiesDatasetPath))
+         LOG(INFO) << std::format("Indexed {} cities of dataset {}", *numCities, settings.citiesDatasetPath);
+   }
+
+   if (!settings.weatherArchivePath.empty())
+      m_weatherArchive.Open(settings.weatherArchivePath);
+}
+
+GeoProtoPlaces SearchEngine::FindCitiesByName(
+   const std::string& name, bool includeDetails, TagDictionary* tagDictionary)
+{
+   return SyncWait(FindCitiesByNameAsync(name, includeDetails, tagDictionary));
 }
 
-GeoProtoPlaces SearchEngine::FindCitiesByName(const std::string& name, bool includeDetails)
+Task<GeoProtoPlaces> SearchEngine::FindCitiesByNameAsync(
+   std::string name, bool includeDetails, TagDictionary* tagDictionary)
 {
    // First, find ids of "relation" entities by name.
-   const overpass::OsmIds relationIds = overpass::LoadRelationIdsByName(m_overpassApiClient, name);
-   return findCities(relationIds, nominatim::Match::Any, m_nominatimApiClient, m_overpassApiClient, includeDetails);
+   overpass::OsmIds relationIds = co_await overpass::LoadRelationIdsByNameAsync(m_overpassApiClient, std::move(name));
+   co_return co_await findCitiesAsync(std::move(relationIds), nominatim::Match::Any, m_nominatimApiClient,
+      m_overpassApiClient, m_cityIndex, includeDetails, tagDictionary);
+}
+
+GeoProtoPlaces SearchEngine::FindCitiesByPosition(
+   double latitude, double longitude, bool includeDetails, TagDictionary* tagDictionary)
+{
+   return SyncWait(FindCitiesByPositionAsync(latitude, longitude, includeDetails, tagDictionary));
 }
 
-GeoProtoPlaces SearchEngine::FindCitiesByPosition(double latitude, double longitude, bool includeDetails)
+Task<GeoProtoPlaces> SearchEngine::FindCitiesByPositionAsync(
+   double latitude, double longitude, bool includeDetails, TagDictionary* tagDictionary)
 {
    // First, find ids of "relation" entities by a coordinate of a point.
-   const overpass::OsmIds relationIds = overpass::LoadRelationIdsByLocation(m_overpassApiClient, latitude, longitude);
-   return findCities(relationIds, nominatim::Match::Best, m_nominatimApiClient, m_overpassApiClient, includeDetails);
+   overpass::OsmIds relationIds =
+      co_await overpass::LoadRelationIdsByLocationAsync(m_overpassApiClient, latitude, longitude);
+   co_return co_await findCitiesAsync(std::move(relationIds), nominatim::Match::Best, m_nominatimApiClient,
+      m_overpassApiClient, m_cityIndex, includeDetails, tagDictionary);
 }
 
 ISearchEngine::IncrementalSearchHandler SearchEngine::StartFindRegions()
 {
+   // Every bounding box is scanned as a single tile, so the search shares the pipeline of scans.
    const auto processed = std::make_shared<std::set<overpass::OsmId>>();
    return IncrementalSearchHandler(
       [this, processed](const BoundingBox& bbox, const RegionPreferences& prefs)
       {
-         GeoProtoPlaces result;
-         const nominatim::RelationInfos iterationResult = findRegions(bbox, prefs, *processed);
-         for (const auto& r : iterationResult)
-            result.emplace_back(toGeoProtoPlace(r));
-         return result;
+         return std::move(SyncWait(ScanRegionsAsync({bbox}, prefs, *processed)).front().regions);
       });
 }
 
-WeatherInfoVector SearchEngine::GetWeather(double latitude, double longitude, const DateRange& dateRange)
+Task<std::vector<ISearchEngine::TileRegions>> SearchEngine::ScanRegionsAsync(
+   std::vector<BoundingBox> tiles, const RegionPreferences& prefs, std::set<std::int64_t>& processed)
 {
-   return {};
+   // Prefetching for the previous search must not compete with this one for upstream capacity.
+   m_prefetcher.CancelPending();
+
+   if (tiles.empty())
+      co_return std::vector<TileRegions>{};
+
+   // Stages have no more coroutines than tiles, idle ones would only wait for the queues to close.
+   const std::size_t numLoaders = std::min(m_scanOverpassConcurrency, tiles.size());
+   const std::size_t numLookups = std::min(m_scanNominatimConcurrency, tiles.size());
+   RegionScan scan(std::move(tiles), prefs, processed, numLoaders, numLookups, m_scanQueueCapacity);
+
+   std::vector<Task<std::size_t>> stages;
+   for (std::size_t i = 0; i < numLoaders; ++i)
+      stages.push_back(loadScannedTilesAsync(scan));
+   stages.push_back(deduplicateScannedTilesAsync(scan));
+   for (std::size_t i = 0; i < numLookups; ++i)
+      stages.push_back(lookupScannedTilesAsync(scan));
+   const auto counts = co_await WhenAll(std::move(stages));
+   LOG(INFO) << std::format("Scanned {} tiles, {} of them have new regions", scan.tiles.size(), counts[numLoaders]);
+
+   // Regions which were not looked up are not found yet, so the next search tries them again.
+   for (const auto id : scan.notFoundIds)
+      processed.erase(id);
+   co_return std::move(scan.results);
+}
+
+void SearchEngine::PrefetchRegionsAround(const BoundingBox& bbox, const RegionPreferences& prefs)
+{
+   // The same tile size is used for the ring, so the tiles are the ones a search for a shifted box would need.
+   // Tiles at the sides of the box go first, they are more likely to be needed than the corner ones.
+   std::vector<BoundingBox> tiles = CreateGridRing(bbox, ChooseGridTileSize(bbox, prefs.maxTileSizeDegrees));
+   const double centerLatitude = (bbox[0] + bbox[2]) / 2;
+   const double centerLongitude = (bbox[1] + bbox[3]) / 2;
+   std::ranges::stable_sort(tiles, {},
+      [centerLatitude, centerLongitude](const BoundingBox& tile)
+      {
+         return std::hypot((tile[0] + tile[2]) / 2 - centerLatitude, (tile[1] + tile[3]) / 2 - centerLongitude);
+      });
+   m_prefetcher.Schedule(tiles, prefs);
 }
 
-// Finds and returns region information within a bounding box, filtering by preferences and tracking processed IDs
-nominatim::RelationInfos SearchEngine::findRegions(
-   const BoundingBox& bbox, const RegionPreferences& prefs, std::set<overpass::OsmId>& processed)
+GeoProtoPlaces SearchEngine::FindCachedRegions(
+   const BoundingBox& bbox, const RegionPreferences& prefs, std::vector<TileCoverage>& coverage)
 {
+   coverage.clear();
    if (!isValidBoundingBox(bbox))
    {
-      LOG(ERROR) << std::format("Too big bounding box is passed into findRegions()");
+      LOG(ERROR) << std::format("Too big bounding box is passed into FindCachedRegions()");
       return {};
    }
 
-   const std::string request = formatRegionsRequest(prefs, bbox);
+   GeoProtoPlaces result;
+   std::set<overpass::OsmId> processed;
+   const auto addRegions = [&result, &processed](const nominatim::RelationInfos& infos)
+   {
+      for (const auto& info : infos)
+      {
+         if (processed.insert(info.osmId).second)
+            result.emplace_back(toGeoProtoPlace(info));
+      }
+   };
+
+   // Uncovered tiles are loaded first, tiles covered by larger ones only refine the result.
+   std::vector<BoundingBox> missingTiles;
+   std::vector<BoundingBox> coarseTiles;
+   const double tileSizeDegrees = ChooseGridTileSize(bbox, prefs.maxTileSizeDegrees);
+   for (const auto& tile : CreateGridTiles(bbox, tileSizeDegrees))
+   {
+      TileCoverage& tileCoverage = coverage.emplace_back(TileCoverage{tile});
+      if (const auto infos = findCachedTileRegions(tile, prefs))
+      {
+         tileCoverage.covered = true;
+         addRegions(*infos);
+         continue;
+      }
+
+      // Larger tiles of the grid which contain the tile have all its regions, and maybe some more.
+      const double centerLatitude = (tile[0] + tile[2]) / 2;
+      const double centerLongitude = (tile[1] + tile[3]) / 2;
+      const BoundingBox center = {centerLatitude, centerLongitude, centerLatitude, centerLongitude};
+      for (double size = tileSizeDegrees * 2; size <= sc_maxTileSizeDegrees && !tileCoverage.covered; size *= 2)
+      {
+         if (const auto infos = findCachedTileRegions(CreateGridTiles(center, size).front(), prefs))
+         {
+            tileCoverage.covered = true;
+            tileCoverage.coarse = true;
+            addRegions(*infos);
+         }
+      }
+      (tileCoverage.covered ? coarseTiles : missingTiles).push_back(tile);
+   }
+
+   missingTiles.insert(missingTiles.end(), coarseTiles.begin(), coarseTiles.end());
+   m_prefetcher.Schedule(missingTiles, prefs);
+   return result;
+}
+
+std::chrono::seconds SearchEngine::GetMaxStaleness() const
+{
+   return m_maxStaleness;
+}
+
+std::vector<ISearchEngine::NearestCity> SearchEngine::FindNearestCities(
+   double latitude, double longitude, std::size_t k, double maxDistanceKm)
+{
+   std::vector<NearestCity> result;
+   for (const auto& neighbour : m_cityIndex.FindNearest(latitude, longitude, k, maxDistanceKm))
+   {
+      NearestCity& city = result.emplace_back();
+      city.place.set_name(neighbour.city.name);
+      city.place.set_country(std::string(neighbour.city.country.View()));
+      city.place.mutable_center()->set_latitude(neighbour.city.latitude);
+      city.place.mutable_center()->set_longitude(neighbour.city.longitude);
+      city.distanceKm = neighbour.distanceKm;
+   }
+   return result;
+}
+
+WeatherInfoVector SearchEngine::GetWeather(double latitude, double longitude, const DateRange& dateRange)
+{
+   return SyncWait(GetWeatherAsync(latitude, longitude, dateRange));
+}
+
+Task<WeatherInfoVector> SearchEngine::GetWeatherAsync(double latitude, double longitude, DateRange dateRange)
+{
+   // Open-Meteo API is asked only for places and dates which are not archived.
+   if (auto archived = m_weatherArchive.Find(latitude, longitude, dateRange))
+      co_return std::move(*archived);
+   co_return co_await GetUpstreamWeatherAsync(latitude, longitude, dateRange);
+}
+
+Task<WeatherInfoVector> SearchEngine::GetUpstreamWeatherAsync(double latitude, double longitude, DateRange dateRange)
+{
+   // Locations closer than about 10 meters share the cached weather.
+   const std::string key = std::format("{:.4f},{:.4f},{},{}", latitude, longitude, dateRange.first, dateRange.second);
+   if (auto cached = m_weatherCache.Find(key))
+      co_return std::move(*cached);
+
+   WeatherInfoVector weather =
+      co_await openmeteo::LoadHistoricalWeatherAsync(m_openMeteoApiClient, latitude, longitude, dateRange);
+   if (!weather.empty())
+      m_weatherCache.Insert(key, weather);
+   co_return weather;
+}
+
+std::vector<std::optional<WeatherSummary>> SearchEngine::SummarizeArchivedWeather(
+   double latitude, double longitude, std::span<const DateRange> dateRanges) const
+{
+   return m_weatherArchive.Summarize(latitude, longitude, dateRanges);
+}
+
+std::uint64_t SearchEngine::GetDataVersion() const
+{
+   return m_dataVersion.load();
+}
+
+// Tiles are taken one by one by all the coroutines of the stage, and passed on as soon as they are loaded
+Task<std::size_t> SearchEngine::loadScannedTilesAsync(RegionScan& scan)
+{
+   const StageExit<RegionScan::ScannedTile> stageExit(scan.numLoaders, {&scan.loaded});
+   std::size_t numLoaded = 0;
+   for (std::size_t index = scan.nextTile++; index < scan.tiles.size(); index = scan.nextTile++)
+   {
+      // Tiles without regions are passed on too, as the next stage takes the tiles in their order.
+      // The processed set belongs to the next stage, so loaders share their own copy of it, which also receives ids
+      // being looked up for other tiles: neighbouring tiles have many regions in common.
+      RegionScan::ScannedTile tile{index};
+      if (isValidBoundingBox(scan.tiles[index]))
+      {
+         tile.relationIds =
+            co_await loadRegionIdsWithLookupsAsync(scan.tiles[index], scan.prefs, scan.skipped, tile.lookedUp);
+      }
+      else
+      {
+         LOG(ERROR) << std::format("Too big bounding box is passed into ScanRegionsAsync()");
+      }
+
+      if (!co_await scan.loaded.Push(std::move(tile)))
+         break;
+      ++numLoaded;
+   }
+   co_return numLoaded;
+}
+
+// Ids are marked as processed as soon as they are passed on, so that next tiles do not look them up again
+Task<std::size_t> SearchEngine::deduplicateScannedTilesAsync(RegionScan& scan)
+{
+   const StageExit<RegionScan::ScannedTile> stageExit(scan.numDeduplicators, {&scan.loaded, &scan.deduplicated});
+   std::map<std::size_t, RegionScan::ScannedTile> reordered;  // Loaded tiles waiting for previous ones
+   std::size_t nextIndex = 0;
+   std::size_t numPassed = 0;
+   while (auto loaded = co_await scan.loaded.Pop())
+   {
+      reordered.emplace(loaded->index, std::move(*loaded));
+      for (auto it = reordered.begin(); it != reordered.end() && it->first == nextIndex; it = reordered.erase(it))
+      {
+         ++nextIndex;
+         overpass::OsmIds& relationIds = it->second.relationIds;
+         RegionScan::ScannedTile tile{it->first, {}, std::move(it->second.lookedUp)};
+         std::sort(relationIds.begin(), relationIds.end());
+         std::set_difference(relationIds.begin(), relationIds.end(), scan.processed.begin(), scan.processed.end(),
+            std::back_inserter(tile.relationIds));
+         if (tile.relationIds.empty())
+            continue;
+
+         scan.processed.insert(tile.relationIds.begin(), tile.relationIds.end());
+         if (!co_await scan.deduplicated.Push(std::move(tile)))
+            co_return numPassed;
+         ++numPassed;
+      }
+   }
+   co_return numPassed;
+}
+
+// Tiles are looked up in parallel, each of them is written to its own slot of the result
+Task<std::size_t> SearchEngine::lookupScannedTilesAsync(RegionScan& scan)
+{
+   const StageExit<RegionScan::ScannedTile> stageExit(scan.numLookups, {&scan.deduplicated});
+   std::size_t numLookedUp = 0;
+   while (auto tile = co_await scan.deduplicated.Pop())
+   {
+      // Requests for some chunks of ids may fail while others succeed, so failures are tracked per chunk.
+      overpass::OsmIds failedIds;
+      const auto infos = co_await lookupRemainingRegionsAsync(tile->relationIds, std::move(tile->lookedUp), &failedIds);
+      TileRegions& result = scan.results[tile->index];
+      for (const auto& info : infos)
+         result.regions.emplace_back(toGeoProtoPlace(info));
+
+      if (!failedIds.empty())
+      {
+         LOG(ERROR) << std::format("Cannot find {} of {} regions in Nominatim", failedIds.size(),
+            tile->relationIds.size());
+         result.complete = false;
+         std::lock_guard lock(scan.mutex);
+         scan.notFoundIds.insert(scan.notFoundIds.end(), failedIds.begin(), failedIds.end());
+         continue;
+      }
+
+      LOG(INFO) << std::format(
+         "Found {} regions in Nominatim (checked {} relation ids)", infos.size(), tile->relationIds.size());
+      ++numLookedUp;
+   }
+   co_return numLookedUp;
+}
+
+// Takes information about known regions from the relation cache, and requests Nominatim API for the rest
+Task<nominatim::RelationInfos> SearchEngine::lookupRegionsAsync(
+   overpass::OsmIds relationIds, overpass::OsmIds* failedIds)
+{
+   nominatim::RelationInfos infos;
+   overpass::OsmIds missingIds;
+   for (const auto id : relationIds)
+   {
+      if (auto info = m_relationCache.Find(id))
+         infos.emplace_back(std::move(*info));
+      else
+         missingIds.push_back(id);
+   }
+
+   if (missingIds.empty())
+      co_return infos;
+
+   for (auto& info :
+      co_await nominatim::LookupRelationInformationAsync(std::move(missingIds), m_nominatimApiClient, failedIds))
+   {
+      m_relationCache.Insert(info);
+      infos.emplace_back(std::move(info));
+   }
+   co_return infos;
+}
+
+// Regions looked up in advance are kept aside, as the relation cache may not admit them
+Task<nominatim::RelationInfos> SearchEngine::lookupRemainingRegionsAsync(
+   std::span<const overpass::OsmId> relationIds, nominatim::RelationInfos lookedUp, overpass::OsmIds* failedIds)
+{
+   std::erase_if(lookedUp,
+      [&relationIds](const nominatim::RelationInfo& info)
+      {
+         return !std::binary_search(relationIds.begin(), relationIds.end(), info.osmId);
+      });
+
+   std::pmr::vector<overpass::OsmId> lookedUpIds(RequestContext::Current().memoryResource);
+   lookedUpIds.reserve(lookedUp.size());
+   for (const auto& info : lookedUp)
+      lookedUpIds.push_back(info.osmId);
+   std::sort(lookedUpIds.begin(), lookedUpIds.end());
+
+   overpass::OsmIds remainingIds;
+   std::set_difference(relationIds.begin(), relationIds.end(), lookedUpIds.begin(), lookedUpIds.end(),
+      std::back_inserter(remainingIds));
+
+   nominatim::RelationInfos infos = std::move(lookedUp);
+   if (!remainingIds.empty())
+   {
+      for (auto& info : co_await lookupRegionsAsync(std::move(remainingIds), failedIds))
+         infos.emplace_back(std::move(info));
+   }
+
+   // The order does not depend on which regions were cached or looked up in advance.
+   std::ranges::sort(infos, {}, &nominatim::RelationInfo::osmId);
+   co_return infos;
+}
+
+// Loads ids of regions in the tile from the tile cache or from Overpass API
+Task<overpass::OsmIds> SearchEngine::loadRegionIdsAsync(
+   BoundingBox bbox, const RegionPreferences& prefs, IdsFunction onIds)
+{
+   const bool background = RequestContext::Current().background;
+   const std::string tileKey = formatTileKey(prefs, bbox);
+   const auto cached = m_tileCache.Find(tileKey);
+   if (cached)
+   {
+      // Only requests of RPCs make a prefetch useful.
+      if (cached->prefetched && !background && m_tileCache.TakePrefetched(tileKey))
+         m_prefetcher.RecordHit();
+
+      switch (m_tileCache.GetFreshness(*cached))
+      {
+      case overpass::TileCache::Freshness::Fresh:
+         co_return cached->result.relationIds;
+
+      case overpass::TileCache::Freshness::NeedsRevalidation:
+         if (const auto timestamp = co_await findTimestampIfUnchangedAsync(bbox, prefs, cached->timestampOsmBase))
+         {
+            m_tileCache.MarkValidated(tileKey, *timestamp);
+            co_return cached->result.relationIds;
+         }
+         break;
+
+      case overpass::TileCache::Freshness::Expired:
+         break;
+      }
+   }
+
+   const overpass::FeaturePlan plan = m_queryPlanner.Plan(prefs.objects);
+   std::string request = formatRegionsRequest(prefs, bbox, plan);
    if (request.empty())
-      return {};
+      co_return overpass::OsmIds{};
 
    // Use Overpass API to load "relation" entities for regions found in the passed bounding box,
    // taking into account passed preferences.
-   const std::string response = m_overpassApiClient.Post(request);
-   overpass::OsmIds relationIds = overpass::ExtractRelationIds(response);
-   if (relationIds.size())
-      return {};
+   const auto started = std::chrono::steady_clock::now();
+   std::string response;
+   if (onIds)
+   {
+      overpass::RelationIdStream stream;
+      response = co_await m_overpassApiClient.PostStreamingAsync(std::move(request),
+         [&stream, &onIds](std::string_view chunk)
+         {
+            if (const auto relationIds = stream.Feed(chunk); !relationIds.empty())
+               onIds(relationIds);
+         });
+   }
+   else
+   {
+      response = co_await m_overpassApiClient.PostAsync(std::move(request));
+   }
+   const auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
 
-   // Remove ids which have already been processed.
-   // This is an optimization for cases when one "relation" entity (i.e. a geographic region)
-   // belongs to more than one bounding box, and findRegions() is called in a loop.
-   overpass::OsmIds relationIdsToProcess;
-   std::sort(relationIds.begin(), relationIds.end());
-   std::set_difference(relationIds.begin(), relationIds.end(), processed.begin(), processed.end(),
-      std::back_inserter(relationIdsToProcess));
+   overpass::QueryResult queryResult = overpass::ParseQueryResult(response);
 
-#ifndef NDEBUG
-   if (relationIds.size() != relationIdsToProcess.size())
-      LOG(INFO) << std::format(
-         "std::set_difference() filtered out {} relation ids", relationIds.size() - relationIdsToProcess.size());
-#endif
+   // Every successful Overpass response has a data timestamp. Responses without it are errors reported in the body,
+   // e.g. runtime errors of the query, which must not pass for empty tiles.
+   if (queryResult.timestampOsmBase.empty())
+   {
+      if (UpstreamFailures* failures = RequestContext::Current().upstreamFailures; failures && !response.empty())
+         ++failures->numFailed;
+      co_return overpass::OsmIds{};
+   }
 
-   if (!relationIdsToProcess.empty())
-      return {};
+   const auto [widthKm, heightKm] = GetBoundingBoxDimensionsKm(bbox);
+   m_queryPlanner.Learn(plan, widthKm * heightKm, queryResult.relationCounts, elapsed);
+
+   overpass::OsmIds relationIds = queryResult.relationIds;
+   if (cached && cached->result.relationIds != relationIds)
+      ++m_dataVersion;  // Results which include this tile have changed.
+   m_tileCache.Store(tileKey, std::move(queryResult), background);
+   if (background)
+      m_prefetcher.RecordLoaded();
+   co_return relationIds;
+}
 
-   // Use Nominatim API to load some detailed information for all the found "relation" entities.
-   const auto infos = nominatim::LookupRelationInformation(relationIdsToProcess, m_overpassApiClient);
-   if (infos.empty())
+// Lookups are started by the function receiving ids, which runs on the event loop thread while this coroutine waits.
+// A region skipped here because another tile looks it up is looked up again if the deduplicating stage assigns it
+// to this tile, but then it is usually cached already.
+Task<overpass::OsmIds> SearchEngine::loadRegionIdsWithLookupsAsync(BoundingBox bbox, const RegionPreferences& prefs,
+   SkippedIds& skipped, nominatim::RelationInfos& lookedUp)
+{
+   overpass::OsmIds pendingIds;
+   std::vector<Task<nominatim::RelationInfos>> lookups;
+   const auto onIds = [this, &skipped, &pendingIds, &lookups](const overpass::OsmIds& relationIds)
    {
-      LOG(ERROR) << std::format(
-         "Cannot find regions in Nominatim (checked {} relation ids)", relationIdsToProcess.size());
-      return {};
+      overpass::OsmIds newIds;
+      {
+         std::lock_guard lock(skipped.mutex);
+         for (const auto id : relationIds)
+         {
+            if (skipped.ids.insert(id).second)
+               newIds.push_back(id);
+         }
+      }
+
+      for (const auto id : newIds)
+      {
+         if (m_relationCache.Contains(id))
+            continue;
+
+         pendingIds.push_back(id);
+         if (pendingIds.size() == nominatim::sc_maxIdsPerLookup)
+         {
+            // Failed lookups are not reported to the RPC: the lookup stage looks their regions up again.
+            lookups.push_back(StartEagerly(
+               [this, ids = std::exchange(pendingIds, {})]() mutable
+               {
+                  return nominatim::LookupRelationInformationAsync(std::move(ids), m_nominatimApiClient);
+               }));
+         }
+      }
+   };
+
+   // Ids which do not fill a request are left for the caller, which looks them up with the ones found in caches.
+   overpass::OsmIds relationIds = co_await loadRegionIdsAsync(bbox, prefs, onIds);
+   if (!lookups.empty())
+      LOG(INFO) << std::format("Looked up {} chunks of regions while loading them from Overpass", lookups.size());
+   for (auto& infos : co_await WhenAll(std::move(lookups)))
+   {
+      for (auto& info : infos)
+      {
+         m_relationCache.Insert(info);
+         lookedUp.emplace_back(std::move(info));
+      }
    }
+   co_return relationIds;
+}
 
-   LOG(INFO) << std::format(
-      "Found {} regions in Nominatim (checked {} relation ids)", infos.size(), relationIdsToProcess.size());
-   processed.insert(relationIdsToProcess.begin(), relationIdsToProcess.end());
+// Takes the tile and information about its regions from caches without asking upstreams
+std::optional<nominatim::RelationInfos> SearchEngine::findCachedTileRegions(
+   const BoundingBox& tile, const RegionPreferences& prefs)
+{
+   const std::string tileKey = formatTileKey(prefs, tile);
+   const auto cached = m_tileCache.Find(tileKey);
+   if (!cached || !m_tileCache.IsWithinStaleness(*cached, m_maxStaleness))
+      return std::nullopt;
+
+   nominatim::RelationInfos infos;
+   for (const auto id : cached->result.relationIds)
+   {
+      auto info = m_relationCache.Find(id);
+      if (!info)
+         return std::nullopt;
+      infos.emplace_back(std::move(*info));
+   }
 
+   if (cached->prefetched && m_tileCache.TakePrefetched(tileKey))
+      m_prefetcher.RecordHit();
    return infos;
 }
 
+// Loads the tile and Nominatim information about its regions, the way a search would, but as background work
+bool SearchEngine::prefetchRegions(const BoundingBox& tile, const RegionPreferences& prefs, std::stop_token stopToken)
+{
+   if (!m_overpassApiClient.HasSpareCapacity())
+      return false;
+
+   const RequestContext context{RequestContext::Clock::now() + sc_prefetchTimeout, true, std::move(stopToken)};
+   const ScopedRequestContext scopedContext(context);
+   const overpass::OsmIds relationIds = SyncWait(loadRegionIdsAsync(tile, prefs));
+   if (!relationIds.empty() && m_nominatimApiClient.HasSpareCapacity())
+      SyncWait(lookupRegionsAsync(relationIds));
+   return true;
+}
+
+// Asks Overpass API whether entities used by the regions query have changed in the tile since the given timestamp
+Task<std::optional<std::string>> SearchEngine::findTimestampIfUnchangedAsync(
+   BoundingBox bbox, const RegionPreferences& prefs, std::string timestampOsmBase)
+{
+   std::string request = formatChangesRequest(prefs, bbox, timestampOsmBase);
+   if (request.empty())
+      co_return std::nullopt;
+
+   const auto result = overpass::ParseQueryResult(co_await m_overpassApiClient.PostAsync(std::move(request)));
+   if (result.timestampOsmBase.empty() || result.totalCounts.size() != 1)
+   {
+      LOG(ERROR) << "Cannot revalidate a cached tile, loading it again";
+      co_return std::nullopt;
+   }
+
+   const bool unchanged = result.totalCounts.front() == 0;
+   LOG(INFO) << std::format("Cached tile {} since {}", unchanged ? "is unchanged" : "has changes", timestampOsmBase);
+   co_return unchanged ? std::make_optional(result.timestampOsmBase) : std::nullopt;
+}
+
 }  // namespace geo
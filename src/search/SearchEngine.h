@@ -1,44 +1,202 @@
 #pragma once
 
 #include "../../proto/ProtoTypes.h"
+#include "../cache/MemoryAccountant.h"
+#include "../cache/RelationTable.h"
+#include "../cache/WTinyLfuCache.h"
+#include "CityIndex.h"
 #include "NominatimApiUtils.h"
 #include "OverpassApiUtils.h"
+#include "OverpassQueryPlanner.h"
+#include "OverpassTileCache.h"
 #include "SearchEngineItf.h"
+#include "TilePrefetcher.h"
+#include "WeatherArchive.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <span>
+#include <stop_token>
 #include <string>
+#include <vector>
 
 namespace geo
 {
 
 class WebClient;
 
+struct SearchEngineSettings
+{
+   overpass::TileCacheSettings tileCache;          // Settings of the cache of regions queries.
+   std::size_t relationCacheMaxEntries = 100'000;  // Maximum number of cached Nominatim relation infos.
+   std::size_t weatherCacheMaxEntries = 10'000;    // Maximum number of cached Open-Meteo responses.
+   std::size_t prefetchMaxPendingTiles = 32;       // Maximum number of tiles waiting to be prefetched, 0 disables
+                                                   // prefetching.
+   std::chrono::seconds maxStaleness{24 * 3600};   // Maximum age of cached tiles used by FindCachedRegions().
+   std::string citiesDatasetPath;                  // CSV file with cities indexed for FindNearestCities(), may be
+                                                   // empty.
+   std::size_t scanOverpassConcurrency = 2;        // Tiles of a region scan queried in Overpass API at the same time.
+   std::size_t scanNominatimConcurrency = 2;       // Tiles of a region scan looked up in Nominatim API at the same
+                                                   // time.
+   std::size_t scanQueueCapacity = 4;              // Tiles of a region scan waiting between pipeline stages.
+   std::string weatherArchivePath;                 // Archive made by WeatherArchive::Ingest() which is served
+                                                   // instead of Open-Meteo API, may be empty.
+};
+
 class SearchEngine : public ISearchEngine
 {
 public:
-   // Constructs a SearchEngine with references to Overpass and Nominatim API clients
-   SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient);
+   // Constructs a SearchEngine with references to Overpass, Nominatim and Open-Meteo API clients.
+   // If a memory accountant is passed, caches of the engine are registered in it.
+   SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient, WebClient& openMeteoApiClient,
+      const SearchEngineSettings& settings = {}, MemoryAccountant* memoryAccountant = nullptr);
 
    // See ISearchEngine::FindCitiesByName for documentation
-   GeoProtoPlaces FindCitiesByName(const std::string& name, bool includeDetails) override;
+   GeoProtoPlaces FindCitiesByName(const std::string& name, bool includeDetails, TagDictionary* tagDictionary) override;
+
+   // See ISearchEngine::FindCitiesByNameAsync for documentation
+   Task<GeoProtoPlaces> FindCitiesByNameAsync(
+      std::string name, bool includeDetails, TagDictionary* tagDictionary) override;
 
    // See ISearchEngine::FindCitiesByPosition for documentation
-   GeoProtoPlaces FindCitiesByPosition(double latitude, double longitude, bool includeDetails) override;
+   GeoProtoPlaces FindCitiesByPosition(
+      double latitude, double longitude, bool includeDetails, TagDictionary* tagDictionary) override;
+
+   // See ISearchEngine::FindCitiesByPositionAsync for documentation
+   Task<GeoProtoPlaces> FindCitiesByPositionAsync(
+      double latitude, double longitude, bool includeDetails, TagDictionary* tagDictionary) override;
 
    // See ISearchEngine::StartFindRegions for documentation
    IncrementalSearchHandler StartFindRegions() override;
 
+   // See ISearchEngine::ScanRegionsAsync for documentation
+   Task<std::vector<TileRegions>> ScanRegionsAsync(
+      std::vector<BoundingBox> tiles, const RegionPreferences& prefs, std::set<std::int64_t>& processed) override;
+
+   // See ISearchEngine::PrefetchRegionsAround for documentation
+   void PrefetchRegionsAround(const BoundingBox& bbox, const RegionPreferences& prefs) override;
+
+   // See ISearchEngine::FindCachedRegions for documentation
+   GeoProtoPlaces FindCachedRegions(
+      const BoundingBox& bbox, const RegionPreferences& prefs, std::vector<TileCoverage>& coverage) override;
+
+   // See ISearchEngine::GetMaxStaleness for documentation
+   std::chrono::seconds GetMaxStaleness() const override;
+
+   // See ISearchEngine::FindNearestCities for documentation
+   std::vector<NearestCity> FindNearestCities(
+      double latitude, double longitude, std::size_t k, double maxDistanceKm) override;
+
    // See ISearchEngine::GetWeather for documentation
    WeatherInfoVector GetWeather(double latitude, double longitude, const DateRange& dateRange) override;
 
+   // See ISearchEngine::GetWeatherAsync for documentation
+   Task<WeatherInfoVector> GetWeatherAsync(double latitude, double longitude, DateRange dateRange) override;
+
+   // See ISearchEngine::GetUpstreamWeatherAsync for documentation
+   Task<WeatherInfoVector> GetUpstreamWeatherAsync(double latitude, double longitude, DateRange dateRange) override;
+
+   // See ISearchEngine::SummarizeArchivedWeather for documentation
+   std::vector<std::optional<WeatherSummary>> SummarizeArchivedWeather(
+      double latitude, double longitude, std::span<const DateRange> dateRanges) const override;
+
+   // See ISearchEngine::GetDataVersion for documentation
+   std::uint64_t GetDataVersion() const override;
+
 private:
-   // Finds region information within a bounding box based on preferences
-   nominatim::RelationInfos findRegions(
-      const BoundingBox& bbox, const RegionPreferences& prefs, std::set<overpass::OsmId>& processed);
+   struct RegionScan;
+
+   // Receives ids of regions as soon as they arrive from Overpass API
+   using IdsFunction = std::function<void(const overpass::OsmIds& relationIds)>;
+
+   // Ids of regions not to look up while tiles are loaded, shared by the coroutines loading tiles of a scan
+   struct SkippedIds
+   {
+      std::mutex mutex;               // Guards the ids
+      std::set<overpass::OsmId> ids;  // Ids found by previous searches or being looked up for other tiles
+   };
+
+   // Stage of ScanRegionsAsync() which loads ids of regions in the tiles from the tile cache or Overpass API
+   // @return Number of tiles loaded by this coroutine
+   Task<std::size_t> loadScannedTilesAsync(RegionScan& scan);
+
+   // Stage of ScanRegionsAsync() which drops ids of regions found in previous tiles. The tiles are taken
+   // in their order, so that a region is always returned for the first tile containing it.
+   // @return Number of tiles with regions to look up
+   static Task<std::size_t> deduplicateScannedTilesAsync(RegionScan& scan);
+
+   // Stage of ScanRegionsAsync() which looks up information about regions of the tiles
+   // @return Number of tiles looked up by this coroutine
+   Task<std::size_t> lookupScannedTilesAsync(RegionScan& scan);
+
+   // Looks up Nominatim information about regions, using cached information when possible
+   // @param failedIds Receives ids which were not looked up because of upstream errors, may be nullptr
+   Task<nominatim::RelationInfos> lookupRegionsAsync(
+      overpass::OsmIds relationIds, overpass::OsmIds* failedIds = nullptr);
+
+   // Looks up regions like lookupRegionsAsync(), except for the ones which have been looked up already
+   // @param relationIds Sorted ids of regions, kept by the caller until the task is finished
+   // @param lookedUp Regions looked up by loadRegionIdsWithLookupsAsync(), ones not in relationIds are dropped
+   // @param failedIds Receives ids which were not looked up because of upstream errors, may be nullptr
+   // @return Found regions ordered by id
+   Task<nominatim::RelationInfos> lookupRemainingRegionsAsync(std::span<const overpass::OsmId> relationIds,
+      nominatim::RelationInfos lookedUp, overpass::OsmIds* failedIds = nullptr);
+
+   // Loads ids of regions within a bounding box, using cached results when they are up-to-date
+   // @param onIds Function to pass ids to while the Overpass response is received, may be empty.
+   //              It is not called for cached tiles.
+   Task<overpass::OsmIds> loadRegionIdsAsync(BoundingBox bbox, const RegionPreferences& prefs, IdsFunction onIds = {});
+
+   // Loads ids of regions like loadRegionIdsAsync(). While the Overpass response is received, regions missing
+   // in the relation cache are looked up in Nominatim as soon as there are enough of them for a request,
+   // so that most lookups finish together with the Overpass request.
+   // @param skipped Ids of regions not to look up, ids looked up by this task are added
+   // @param lookedUp Receives the regions looked up in advance
+   Task<overpass::OsmIds> loadRegionIdsWithLookupsAsync(BoundingBox bbox, const RegionPreferences& prefs,
+      SkippedIds& skipped, nominatim::RelationInfos& lookedUp);
+
+   // Finds regions of the tile in caches, accepting data up to the maximum staleness
+   // @return std::nullopt unless both the tile and all its regions are cached
+   std::optional<nominatim::RelationInfos> findCachedTileRegions(
+      const BoundingBox& tile, const RegionPreferences& prefs);
+
+   // Loads regions of the tile into caches as background work, called by the prefetcher
+   // @param stopToken Requested when the prefetch is cancelled, aborts upstream requests
+   // @return false if upstreams have no spare capacity
+   bool prefetchRegions(const BoundingBox& tile, const RegionPreferences& prefs, std::stop_token stopToken);
+
+   // Checks whether the data used by a regions query has changed since the timestamp
+   // @return New data timestamp if nothing has changed, std::nullopt otherwise
+   Task<std::optional<std::string>> findTimestampIfUnchangedAsync(
+      BoundingBox bbox, const RegionPreferences& prefs, std::string timestampOsmBase);
 
 private:
    WebClient& m_overpassApiClient;   // Client for Overpass API requests
    WebClient& m_nominatimApiClient;  // Client for Nominatim API requests
+   WebClient& m_openMeteoApiClient;  // Client for Open-Meteo API requests
+
+   const std::chrono::seconds m_maxStaleness;     // See SearchEngineSettings::maxStaleness
+   const std::size_t m_scanOverpassConcurrency;   // See SearchEngineSettings::scanOverpassConcurrency
+   const std::size_t m_scanNominatimConcurrency;  // See SearchEngineSettings::scanNominatimConcurrency
+   const std::size_t m_scanQueueCapacity;         // See SearchEngineSettings::scanQueueCapacity
+
+   overpass::QueryPlanner m_queryPlanner;                         // Chooses the order of filters in regions queries
+   overpass::TileCache m_tileCache;                               // Results of regions queries per tile
+   RelationTable m_relationCache;                                 // Nominatim information about regions
+   WTinyLfuCache<std::string, WeatherInfoVector> m_weatherCache;  // Historical weather by location and dates
+   CityIndex m_cityIndex;                                         // Cities of the dataset and of city searches
+   WeatherArchive m_weatherArchive;                               // Local historical weather, asked before Open-Meteo
+
+   std::atomic<std::uint64_t> m_dataVersion = 0;  // Incremented when a cached tile turns out to be changed
+
+   TilePrefetcher m_prefetcher;  // Loads tiles around recent searches, destroyed before the caches it fills
+
+   std::vector<MemoryAccountant::Registration> m_memoryRegistrations;  // Registrations of the caches above
 };
 
 }  // namespace geo
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "../../proto/ProtoTypes.h"
 #include "../utils/GeoUtils.h"
+#include "../utils/Task.h"
 #include "../utils/TimeUtils.h"
 #include "../utils/WeatherInfo.h"
 
@@ -9,12 +10,17 @@
 #include <cstdint>
 #include <functional>
 #include <optional>
+#include <set>
+#include <span>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace geo
 {
 
+class TagDictionary;
+
 class ISearchEngine
 {
 public:
@@ -23,15 +29,30 @@ public:
    // Searches for cities matching the specified name
    // @param name The city name to search for
    // @param includeDetails If true, includes additional details like features in the response
+   // @param tagDictionary If not nullptr, feature tags are added to the dictionary and referenced by
+   //                      TaggedFeature.tag_indices instead of being copied to TaggedFeature.tags
    // @return GeoProtoPlaces containing matching cities
-   virtual GeoProtoPlaces FindCitiesByName(const std::string& name, bool includeDetails) = 0;
+   virtual GeoProtoPlaces FindCitiesByName(
+      const std::string& name, bool includeDetails, TagDictionary* tagDictionary) = 0;
+
+   // Coroutine version of FindCitiesByName(), which does not block the thread while upstreams are requested.
+   // The tag dictionary must outlive the task.
+   virtual Task<GeoProtoPlaces> FindCitiesByNameAsync(
+      std::string name, bool includeDetails, TagDictionary* tagDictionary) = 0;
 
    // Searches for cities at or near the specified geographic coordinates
    // @param latitude The latitude coordinate (-90 to 90)
    // @param longitude The longitude coordinate (-180 to 180)
    // @param includeDetails If true, includes additional details like features in the response
+   // @param tagDictionary See FindCitiesByName
    // @return GeoProtoPlaces containing cities found at or near the coordinates
-   virtual GeoProtoPlaces FindCitiesByPosition(double latitude, double longitude, bool includeDetails) = 0;
+   virtual GeoProtoPlaces FindCitiesByPosition(
+      double latitude, double longitude, bool includeDetails, TagDictionary* tagDictionary) = 0;
+
+   // Coroutine version of FindCitiesByPosition(), which does not block the thread while upstreams are requested.
+   // The tag dictionary must outlive the task.
+   virtual Task<GeoProtoPlaces> FindCitiesByPositionAsync(
+      double latitude, double longitude, bool includeDetails, TagDictionary* tagDictionary) = 0;
 
    struct RegionPreferences
    {
@@ -40,6 +61,8 @@ public:
 
       using Properties = std::unordered_map<std::string, std::string>;
       Properties properties;  // Additional key-value pairs for filtering region features (e.g., "minPeakHeight")
+
+      double maxTileSizeDegrees = sc_maxTileSizeDegrees;  // Largest grid tile searched, see ChooseGridTileSize()
    };
 
    // Initiates an incremental search for regions within bounding boxes
@@ -48,8 +71,87 @@ public:
    using IncrementalSearchHandler = std::function<GeoProtoPlaces(const BoundingBox&, const RegionPreferences&)>;
    virtual IncrementalSearchHandler StartFindRegions() = 0;
 
+   // Regions found in a tile by ScanRegionsAsync()
+   struct TileRegions
+   {
+      GeoProtoPlaces regions;  // Regions first found in the tile
+      bool complete = true;    // False if some regions of the tile were not looked up because of upstream errors
+   };
+
+   // Finds regions in several tiles. Unlike searches tile by tile, Overpass queries of next tiles run while regions
+   // of previous tiles are looked up in Nominatim, so both upstreams are busy at the same time.
+   // A region found in several tiles is returned for the first of them.
+   // @param tiles Tiles to scan
+   // @param prefs Search preferences, must outlive the task
+   // @param processed Ids of regions found by previous searches, which are skipped. Ids of found regions are added,
+   //                  so the set must outlive the task. Ids which were not looked up are not added.
+   // @return Found regions of each tile, in the order of the tiles
+   virtual Task<std::vector<TileRegions>> ScanRegionsAsync(
+      std::vector<BoundingBox> tiles, const RegionPreferences& prefs, std::set<std::int64_t>& processed) = 0;
+
+   // Schedules loading of regions around the bounding box in the background, so that requests for adjacent areas
+   // are answered from caches. Background loading uses only spare upstream capacity and gives way to new searches.
+   // @param bbox Bounding box of a finished regions search
+   // @param prefs Preferences of the search
+   virtual void PrefetchRegionsAround(const BoundingBox& bbox, const RegionPreferences& prefs) = 0;
+
+   // Describes how a tile of a search answered from cached data is covered
+   struct TileCoverage
+   {
+      BoundingBox tile;      // Tile of the requested bounding box
+      bool covered = false;  // Regions of the tile are found in caches
+      bool coarse = false;   // Regions are taken from a larger cached tile, so they may lie outside the tile
+   };
+
+   // Finds regions within a bounding box using cached data only, which may be older than usual.
+   // Tiles which are not covered by cached data are loaded in the background.
+   // @param bbox Bounding box to search
+   // @param prefs Search preferences
+   // @param coverage Receives coverage of the tiles the bounding box is split into
+   // @return Regions found in the covered tiles
+   virtual GeoProtoPlaces FindCachedRegions(
+      const BoundingBox& bbox, const RegionPreferences& prefs, std::vector<TileCoverage>& coverage) = 0;
+
+   // Returns the maximum age of the cached data used by FindCachedRegions()
+   virtual std::chrono::seconds GetMaxStaleness() const = 0;
+
+   // City found by FindNearestCities()
+   struct NearestCity
+   {
+      GeoProtoPlace place;    // City without features
+      double distanceKm = 0;  // Great-circle distance to the city
+   };
+
+   // Finds cities nearest to the point in the local city index, without asking upstreams.
+   // The index holds cities of the configured dataset and cities found by previous city searches.
+   // @param latitude The latitude coordinate (-90 to 90)
+   // @param longitude The longitude coordinate (-180 to 180)
+   // @param k Maximum number of cities to find
+   // @param maxDistanceKm Maximum distance to the cities, 0 for no limit
+   // @return Found cities ordered by distance
+   virtual std::vector<NearestCity> FindNearestCities(
+      double latitude, double longitude, std::size_t k, double maxDistanceKm) = 0;
+
    // Returns weather for given location.
    virtual WeatherInfoVector GetWeather(double latitude, double longitude, const DateRange& dateRange) = 0;
+
+   // Coroutine version of GetWeather(), which does not block the thread while upstreams are requested.
+   virtual Task<WeatherInfoVector> GetWeatherAsync(double latitude, double longitude, DateRange dateRange) = 0;
+
+   // Returns weather for given location from upstreams or their cache, skipping the local weather archive.
+   // Used for dates which are known not to be archived, see SummarizeArchivedWeather().
+   virtual Task<WeatherInfoVector> GetUpstreamWeatherAsync(double latitude, double longitude, DateRange dateRange) = 0;
+
+   // Aggregates weather for given location in the local weather archive for each of the date ranges, e.g. the same
+   // days of several years. Takes constant time per year of a range.
+   // @return Summary of each range, std::nullopt for ranges with days which are not archived
+   virtual std::vector<std::optional<WeatherSummary>> SummarizeArchivedWeather(
+      double latitude, double longitude, std::span<const DateRange> dateRanges) const = 0;
+
+   // Returns version of the data snapshot used by searches.
+   // The version changes whenever the search engine notices that upstream data has changed,
+   // so results built with the same data version can be considered unchanged.
+   virtual std::uint64_t GetDataVersion() const = 0;
 };
 
 }  // namespace geo
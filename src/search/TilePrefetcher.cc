@@ -0,0 +1,102 @@
+#include "TilePrefetcher.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+namespace geo
+{
+
+TilePrefetcher::TilePrefetcher(std::size_t maxPendingTiles, LoadFunction load)
+   : m_maxPendingTiles(maxPendingTiles)
+   , m_load(std::move(load))
+   , m_loadedCounter(Metrics::Instance().GetCounter("geo_prefetch_loaded_tiles_total"))
+   , m_hitsCounter(Metrics::Instance().GetCounter("geo_prefetch_hits_total"))
+   , m_cancelledCounter(Metrics::Instance().GetCounter("geo_prefetch_cancelled_tiles_total"))
+   , m_hitRateGauge(Metrics::Instance().RegisterGauge("geo_prefetch_hit_rate",
+        [this]
+        {
+           const auto loaded = m_loadedCounter.load();
+           return loaded > 0 ? static_cast<double>(m_hitsCounter.load()) / static_cast<double>(loaded) : 0.0;
+        }))
+{
+   if (m_maxPendingTiles > 0)
+   {
+      m_thread = std::jthread(
+         [this](std::stop_token stopToken)
+         {
+            run(std::move(stopToken));
+         });
+   }
+}
+
+void TilePrefetcher::Schedule(const std::vector<BoundingBox>& tiles, const ISearchEngine::RegionPreferences& prefs)
+{
+   if (m_maxPendingTiles == 0 || tiles.empty())
+      return;
+
+   {
+      std::lock_guard lock(m_mutex);
+      dropPending();
+      const std::size_t numTiles = std::min(tiles.size(), m_maxPendingTiles);
+      m_pendingTiles.assign(tiles.begin(), tiles.begin() + static_cast<std::ptrdiff_t>(numTiles));
+      m_prefs = prefs;
+   }
+   m_wakeup.notify_one();
+}
+
+void TilePrefetcher::CancelPending()
+{
+   std::stop_source loadStopSource;
+   {
+      std::lock_guard lock(m_mutex);
+      dropPending();
+      loadStopSource = m_loadStopSource;
+   }
+
+   // Stop callbacks run on this thread, and aborting a request may take locks of its own, so the mutex is not held.
+   loadStopSource.request_stop();
+}
+
+void TilePrefetcher::RecordLoaded()
+{
+   ++m_loadedCounter;
+}
+
+void TilePrefetcher::RecordHit()
+{
+   ++m_hitsCounter;
+}
+
+void TilePrefetcher::run(std::stop_token stopToken)
+{
+   const auto hasPendingTiles = [this]
+   {
+      return !m_pendingTiles.empty();
+   };
+
+   std::unique_lock lock(m_mutex);
+   while (m_wakeup.wait(lock, stopToken, hasPendingTiles))
+   {
+      const BoundingBox tile = m_pendingTiles.front();
+      const ISearchEngine::RegionPreferences prefs = m_prefs;
+      m_pendingTiles.pop_front();
+      m_loadStopSource = std::stop_source();
+
+      lock.unlock();
+      const bool hasSpareCapacity = m_load(tile, prefs, m_loadStopSource.get_token());
+      lock.lock();
+
+      // Requests of RPCs keep the upstream busy, the rest of the tiles would not get capacity either.
+      if (!hasSpareCapacity)
+         dropPending();
+   }
+}
+
+void TilePrefetcher::dropPending()
+{
+   m_cancelledCounter += m_pendingTiles.size();
+   m_pendingTiles.clear();
+}
+
+}  // namespace geo
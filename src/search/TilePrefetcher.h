@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../utils/GeoUtils.h"
+#include "../utils/Metrics.h"
+#include "SearchEngineItf.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace geo
+{
+
+// TilePrefetcher loads tiles around recently requested areas in the background, so that the next requests of users
+// panning a map are answered from caches. Tiles are loaded one by one by a background thread.
+// Prefetching gives way to foreground work: pending tiles are dropped once a new regions search starts or
+// the upstream has no spare capacity, and requests already sent are aborted by the upstream dispatcher.
+// The share of prefetched tiles which are later used by requests is exported as the prefetch hit rate.
+// The class is thread-safe.
+class TilePrefetcher
+{
+public:
+   // Loads a tile into caches, called by the background thread
+   // @param stopToken Requested by CancelPending() while the tile is loaded
+   // @return false if the upstream has no spare capacity, then the remaining tiles are dropped
+   using LoadFunction = std::function<bool(
+      const BoundingBox& tile, const ISearchEngine::RegionPreferences& prefs, std::stop_token stopToken)>;
+
+   // @param maxPendingTiles Maximum number of tiles waiting to be loaded, 0 disables prefetching
+   // @param load Function which loads a tile
+   TilePrefetcher(std::size_t maxPendingTiles, LoadFunction load);
+
+   // Schedules loading of tiles, replacing the ones scheduled before: the latest request predicts the next one best.
+   // Tiles above the limit are skipped, so the most wanted tiles must go first.
+   // @param tiles Tiles to load
+   // @param prefs Preferences of the request the tiles are loaded for
+   void Schedule(const std::vector<BoundingBox>& tiles, const ISearchEngine::RegionPreferences& prefs);
+
+   // Drops tiles waiting to be loaded, and stops loading of the current tile
+   void CancelPending();
+
+   // Records that a tile has been loaded by the prefetcher
+   void RecordLoaded();
+
+   // Records that a prefetched tile has been used by a request
+   void RecordHit();
+
+private:
+   // Loads pending tiles until stop is requested
+   void run(std::stop_token stopToken);
+
+   // Drops pending tiles. Must be called under the lock.
+   void dropPending();
+
+private:
+   const std::size_t m_maxPendingTiles;  // Maximum number of pending tiles
+   const LoadFunction m_load;            // Loads a tile into caches
+
+   Metrics::Counter& m_loadedCounter;     // Number of tiles loaded by the prefetcher
+   Metrics::Counter& m_hitsCounter;       // Number of prefetched tiles used by requests
+   Metrics::Counter& m_cancelledCounter;  // Number of pending tiles dropped before loading
+   Metrics::Gauge m_hitRateGauge;         // Share of loaded tiles used by requests
+
+   std::mutex m_mutex;                          // Guards all the members below
+   std::deque<BoundingBox> m_pendingTiles;      // Tiles waiting to be loaded, the first one is loaded next
+   ISearchEngine::RegionPreferences m_prefs{};  // Preferences of the request the pending tiles are loaded for
+   std::stop_source m_loadStopSource;           // Stops loading of the current tile
+   std::condition_variable_any m_wakeup;        // Wakes the background thread up when tiles are scheduled
+   std::jthread m_thread;                       // Background thread, destroyed first so that it stops before
+                                                // other members are destroyed
+};
+
+}  // namespace geo
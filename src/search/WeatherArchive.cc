@@ -0,0 +1,566 @@
+#include "WeatherArchive.h"
+
+#include <absl/log/log.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using namespace geo;
+
+// Beginning of an archive file, followed by the keys of the chunks, the keys of the years, temperatures
+// of the chunks and aggregation tables of the years
+struct FileHeader
+{
+   char magic[8];            // sc_magic
+   std::uint32_t chunkDays;  // Number of days in a chunk
+   std::uint32_t reserved;   // Zero
+   double cellSizeDegrees;   // Width and height of a cell
+   std::uint64_t numChunks;  // Number of chunks
+   std::uint64_t numYears;   // Number of years of all the cells
+};
+static_assert(std::is_trivially_copyable_v<FileHeader> && sizeof(FileHeader) == 40);
+
+constexpr char sc_magic[8] = {'G', 'E', 'O', 'W', 'X', 'A', 'R', '2'};
+
+// Temperature of a day which is not archived
+constexpr std::int16_t sc_missing = std::numeric_limits<std::int16_t>::min();
+
+// Smallest width and height of a cell, about 1 km. Indexes of smaller cells would not fit into 32 bits of the keys.
+constexpr double sc_minCellSizeDegrees = 0.01;
+
+// Number of temperatures in a chunk, the minimum and the maximum of each day
+constexpr std::size_t sc_chunkValues = 2 * WeatherArchive::sc_chunkDays;
+
+// Record of a CSV file
+struct DayRecord
+{
+   Date date;
+   double latitude;
+   double longitude;
+   std::int16_t temperatureMin;  // Tenths of a degree
+   std::int16_t temperatureMax;  // Tenths of a degree
+};
+
+// Day of a cell read from a CSV file, ingested records are sorted by cell and day
+struct CellDay
+{
+   std::uint32_t cellIndex;      // Cell of the day, see getCellIndex()
+   std::int32_t dayNumber;       // Days since the Unix epoch
+   std::int16_t temperatureMin;  // Tenths of a degree
+   std::int16_t temperatureMax;  // Tenths of a degree
+};
+
+// Checks whether cells of the size cover the globe in a grid whose indexes fit into the keys
+bool isValidCellSize(double cellSizeDegrees)
+{
+   return cellSizeDegrees >= sc_minCellSizeDegrees && cellSizeDegrees <= 90;
+}
+
+// Returns the number of days since the Unix epoch, invalid dates are moved to the last day of their month
+std::int64_t toDayNumber(const Date& date)
+{
+   return std::chrono::floor<std::chrono::days>(DateToTimePoint(date)).time_since_epoch().count();
+}
+
+// Returns the index of the chunk containing the day, counted from the chunk starting at the Unix epoch
+std::int64_t getChunkNumber(std::int64_t dayNumber)
+{
+   const std::int64_t chunkDays = WeatherArchive::sc_chunkDays;
+   return dayNumber >= 0 ? dayNumber / chunkDays : (dayNumber - chunkDays + 1) / chunkDays;
+}
+
+// Returns the key of the chunk containing the day of the cell. Keys are ordered by cell, then by day.
+std::uint64_t makeChunkKey(std::uint32_t cellIndex, std::int64_t dayNumber)
+{
+   const auto chunkNumber = static_cast<std::uint32_t>(getChunkNumber(dayNumber) + (std::int64_t{1} << 31));
+   return (static_cast<std::uint64_t>(cellIndex) << 32) | chunkNumber;
+}
+
+// Returns the key of the year of the cell. Keys are ordered by cell, then by year.
+std::uint64_t makeYearKey(std::uint32_t cellIndex, std::chrono::year year)
+{
+   const auto yearNumber = static_cast<std::uint32_t>(static_cast<int>(year) + (std::int64_t{1} << 31));
+   return (static_cast<std::uint64_t>(cellIndex) << 32) | yearNumber;
+}
+
+// Returns the index of the cell containing the location, rows of cells go from south to north
+// @param cellSizeDegrees Size of a cell, see isValidCellSize()
+// @return std::nullopt if the coordinates are out of range
+std::optional<std::uint32_t> getCellIndex(double latitude, double longitude, double cellSizeDegrees)
+{
+   // Comparisons are written so that NaNs are rejected too.
+   if (!(std::abs(latitude) <= 90) || !(std::abs(longitude) <= 180))
+      return std::nullopt;
+
+   const auto numRows = static_cast<std::uint32_t>(std::ceil(180 / cellSizeDegrees));
+   const auto numColumns = static_cast<std::uint32_t>(std::ceil(360 / cellSizeDegrees));
+   const auto row = std::min(static_cast<std::uint32_t>((latitude + 90) / cellSizeDegrees), numRows - 1);
+   const auto column = static_cast<std::uint32_t>((longitude + 180) / cellSizeDegrees) % numColumns;
+   return row * numColumns + column;
+}
+
+// Parses a floating point number, the whole string must be a number
+std::optional<double> parseDouble(std::string_view text)
+{
+   double value = 0;
+   const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+   if (error != std::errc() || end != text.data() + text.size())
+      return std::nullopt;
+   return value;
+}
+
+// Parses a temperature in degrees into tenths of a degree
+std::optional<std::int16_t> parseTemperature(std::string_view text)
+{
+   const auto value = parseDouble(text);
+   if (!value || !(std::abs(*value) < std::numeric_limits<std::int16_t>::max() / 10.0))
+      return std::nullopt;
+   return static_cast<std::int16_t>(std::lround(*value * 10));
+}
+
+// Parses a "date,latitude,longitude,temperature_min,temperature_max" line of a CSV file
+std::optional<DayRecord> parseCsvLine(std::string_view line)
+{
+   std::array<std::string_view, 5> fields;
+   for (auto& field : fields)
+   {
+      const auto comma = line.find(',');
+      field = line.substr(0, comma);
+      line = comma != std::string_view::npos ? line.substr(comma + 1) : std::string_view();
+      if (comma == std::string_view::npos && &field != &fields.back())
+         return std::nullopt;
+   }
+
+   const Date date = StringToDate(fields[0]);
+   const auto latitude = parseDouble(fields[1]);
+   const auto longitude = parseDouble(fields[2]);
+   const auto temperatureMin = parseTemperature(fields[3]);
+   const auto temperatureMax = parseTemperature(fields[4]);
+   if (!date.ok() || !latitude || !longitude || !temperatureMin || !temperatureMax || !line.empty())
+      return std::nullopt;
+   return DayRecord{date, *latitude, *longitude, *temperatureMin, *temperatureMax};
+}
+
+}  // namespace
+
+namespace geo
+{
+
+// Aggregation tables of a year of a cell, index 0 is January 1. With prefix sums the sum of a range is a difference
+// of two sums, and with sparse tables the minimum of a range is the minimum of two overlapping power-of-two ranges.
+// Values read together are stored together, so that a range is aggregated with about four cache misses.
+struct WeatherArchive::YearTable
+{
+   static constexpr std::size_t sc_days = 366;                        // Days of a leap year
+   static constexpr std::size_t sc_levels = std::bit_width(sc_days);  // Levels of the sparse tables
+
+   struct Prefix
+   {
+      std::int32_t sum;    // Sum of minimum and maximum temperatures of the archived days before the index
+      std::int32_t count;  // Number of archived days before the index
+   };
+
+   struct Extrema
+   {
+      std::int16_t temperatureMin;  // Minimum temperature of 2^level days starting at the index
+      std::int16_t temperatureMax;  // Maximum temperature of 2^level days starting at the index
+   };
+
+   Prefix prefixes[sc_days + 1];          // Prefix sums of the days
+   Extrema extrema[sc_levels][sc_days];  // Sparse tables of the days
+
+   // Fills the tables
+   // @param temperatures Minimum and maximum temperature of every day of the year, sc_missing if not archived
+   void Build(std::span<const std::int16_t> temperatures)
+   {
+      prefixes[0] = {0, 0};
+      for (std::size_t i = 0; i < sc_days; ++i)
+      {
+         const std::int16_t temperatureMin = temperatures[2 * i];
+         const std::int16_t temperatureMax = temperatures[2 * i + 1];
+         const bool archived = temperatureMin != sc_missing;
+         prefixes[i + 1].sum = prefixes[i].sum + (archived ? temperatureMin + temperatureMax : 0);
+         prefixes[i + 1].count = prefixes[i].count + (archived ? 1 : 0);
+         extrema[0][i] = archived ? Extrema{temperatureMin, temperatureMax}
+                                  : Extrema{std::numeric_limits<std::int16_t>::max(), sc_missing};
+      }
+
+      // Ranges which would end after the year are never read, they are filled only to keep the file deterministic.
+      for (std::size_t level = 1; level < sc_levels; ++level)
+      {
+         const std::size_t half = std::size_t{1} << (level - 1);
+         for (std::size_t i = 0; i < sc_days; ++i)
+         {
+            const Extrema& first = extrema[level - 1][i];
+            const Extrema& second = extrema[level - 1][std::min(i + half, sc_days - 1)];
+            extrema[level][i] = i + 2 * half <= sc_days
+               ? Extrema{std::min(first.temperatureMin, second.temperatureMin),
+                    std::max(first.temperatureMax, second.temperatureMax)}
+               : Extrema{0, 0};
+         }
+      }
+   }
+};
+
+WeatherArchive::WeatherArchive()
+   : m_hitsCounter(Metrics::Instance().GetCounter("geo_weather_archive_hits_total"))
+   , m_missesCounter(Metrics::Instance().GetCounter("geo_weather_archive_misses_total"))
+{
+}
+
+WeatherArchive::~WeatherArchive()
+{
+   if (m_mapping)
+      munmap(m_mapping, m_mappingSize);
+}
+
+bool WeatherArchive::Open(const std::string& path)
+{
+   const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (file < 0)
+   {
+      LOG(ERROR) << std::format("Cannot open weather archive {}", path);
+      return false;
+   }
+
+   struct stat status{};
+   void* mapping = MAP_FAILED;
+   if (fstat(file, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(FileHeader)))
+      mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+   close(file);
+   if (mapping == MAP_FAILED)
+   {
+      LOG(ERROR) << std::format("Cannot read weather archive {}", path);
+      return false;
+   }
+
+   const auto size = static_cast<std::size_t>(status.st_size);
+   FileHeader header;
+   std::memcpy(&header, mapping, sizeof(header));
+
+   // Sizes are compared by the numbers of chunks and years first, so that the expected size does not overflow.
+   const std::size_t chunkBytes = sizeof(std::uint64_t) + sc_chunkValues * sizeof(std::int16_t);
+   const std::size_t yearBytes = sizeof(std::uint64_t) + sizeof(YearTable);
+   if (std::memcmp(header.magic, sc_magic, sizeof(sc_magic)) != 0 || header.chunkDays != sc_chunkDays ||
+       !isValidCellSize(header.cellSizeDegrees) || header.numChunks > size / chunkBytes ||
+       header.numYears > size / yearBytes ||
+       size != sizeof(FileHeader) + header.numChunks * chunkBytes + header.numYears * yearBytes)
+   {
+      munmap(mapping, size);
+      LOG(ERROR) << std::format("File {} is not a weather archive", path);
+      return false;
+   }
+
+   // Lookups read a couple of chunks at random places, reading ahead would only load pages nobody needs.
+   madvise(mapping, size, MADV_RANDOM);
+
+   if (m_mapping)
+      munmap(m_mapping, m_mappingSize);
+   m_mapping = mapping;
+   m_mappingSize = size;
+   m_cellSizeDegrees = header.cellSizeDegrees;
+
+   // Temperatures of the chunks take a multiple of 8 bytes, so the tables of the years which follow are aligned.
+   const auto* keys = reinterpret_cast<const std::uint64_t*>(static_cast<const char*>(mapping) + sizeof(FileHeader));
+   m_keys = std::span(keys, header.numChunks);
+   m_yearKeys = std::span(keys + header.numChunks, header.numYears);
+   m_temperatures = std::span(reinterpret_cast<const std::int16_t*>(m_yearKeys.data() + header.numYears),
+      header.numChunks * sc_chunkValues);
+   m_yearTables = reinterpret_cast<const YearTable*>(m_temperatures.data() + m_temperatures.size());
+
+   LOG(INFO) << std::format("Opened weather archive {} with {} chunks and {} years of {}-degree cells", path,
+      header.numChunks, header.numYears, header.cellSizeDegrees);
+   return true;
+}
+
+std::optional<WeatherInfoVector> WeatherArchive::Find(
+   double latitude, double longitude, const DateRange& dateRange) const
+{
+   if (!m_mapping)
+      return std::nullopt;
+
+   WeatherInfoVector weather;
+   std::chrono::sys_days day = std::chrono::floor<std::chrono::days>(DateToTimePoint(dateRange.first));
+   const bool found = readDays(latitude, longitude, dateRange,
+      [&weather, &day](std::int16_t temperatureMin, std::int16_t temperatureMax)
+      {
+         WeatherInfo& info = weather.emplace_back();
+         info.time = Date{day++};
+         info.temperatureMin = temperatureMin / 10.0;
+         info.temperatureMax = temperatureMax / 10.0;
+         info.temperatureAverage = (info.temperatureMax + info.temperatureMin) / 2.0;
+      });
+
+   ++(found ? m_hitsCounter : m_missesCounter);
+   return found ? std::optional(std::move(weather)) : std::nullopt;
+}
+
+std::vector<std::optional<WeatherSummary>> WeatherArchive::Summarize(
+   double latitude, double longitude, std::span<const DateRange> dateRanges) const
+{
+   std::vector<std::optional<WeatherSummary>> summaries(dateRanges.size());
+   if (!m_mapping)
+      return summaries;
+
+   // Keys of the years of a cell have the same upper half, so the years of the cell are next to each other.
+   if (const auto cellIndex = getCellIndex(latitude, longitude, m_cellSizeDegrees))
+   {
+      const std::uint64_t cellKey = std::uint64_t{*cellIndex} << 32;
+      const auto cellBegin = std::ranges::lower_bound(m_yearKeys, cellKey);
+      const auto cellEnd = std::ranges::lower_bound(cellBegin, m_yearKeys.end(), cellKey + (std::uint64_t{1} << 32));
+      const auto cellYears = m_yearKeys.subspan(cellBegin - m_yearKeys.begin(), cellEnd - cellBegin);
+      for (std::size_t i = 0; i < dateRanges.size(); ++i)
+         summaries[i] = summarizeDays(*cellIndex, cellYears, dateRanges[i]);
+   }
+
+   for (const auto& summary : summaries)
+      ++(summary ? m_hitsCounter : m_missesCounter);
+   return summaries;
+}
+
+std::optional<std::size_t> WeatherArchive::Ingest(
+   const std::string& csvPath, const std::string& archivePath, double cellSizeDegrees)
+{
+   if (!isValidCellSize(cellSizeDegrees))
+   {
+      LOG(ERROR) << std::format("Cell size of weather archive must be within [{}, 90] degrees, not {}",
+         sc_minCellSizeDegrees, cellSizeDegrees);
+      return std::nullopt;
+   }
+
+   std::ifstream input(csvPath);
+   if (!input)
+   {
+      LOG(ERROR) << std::format("Cannot open weather file {}", csvPath);
+      return std::nullopt;
+   }
+
+   // Days are kept in compact records and sorted by cell and day, which is the order of both the chunks and
+   // the years in the file, so that each of them is then written in one pass without maps of buffers.
+   std::vector<CellDay> days;
+   std::size_t numMalformed = 0;
+   for (std::string line; std::getline(input, line);)
+   {
+      if (line.empty() || line.front() == '#')
+         continue;
+
+      const auto record = parseCsvLine(line);
+      const auto cellIndex = record ? getCellIndex(record->latitude, record->longitude, cellSizeDegrees) : std::nullopt;
+      if (!cellIndex)
+      {
+         ++numMalformed;
+         continue;
+      }
+      days.push_back(CellDay{*cellIndex, static_cast<std::int32_t>(toDayNumber(record->date)),
+         record->temperatureMin, record->temperatureMax});
+   }
+
+   if (numMalformed > 0)
+      LOG(ERROR) << std::format("{} malformed lines are skipped in weather file {}", numMalformed, csvPath);
+
+   // The last line of a repeated day wins, as the sort is stable.
+   const auto cellAndDay = [](const CellDay& day)
+   {
+      return std::pair(day.cellIndex, day.dayNumber);
+   };
+   std::ranges::stable_sort(days, {}, cellAndDay);
+   const auto repeated = std::ranges::unique(days.rbegin(), days.rend(), {}, cellAndDay);
+   days.erase(days.begin(), repeated.begin().base());
+
+   const auto getChunkKey = [](const CellDay& day)
+   {
+      return makeChunkKey(day.cellIndex, day.dayNumber);
+   };
+   const auto getYear = [](const CellDay& day)
+   {
+      return std::chrono::year_month_day{std::chrono::sys_days{std::chrono::days{day.dayNumber}}}.year();
+   };
+   const auto getYearKey = [&getYear](const CellDay& day)
+   {
+      return makeYearKey(day.cellIndex, getYear(day));
+   };
+
+   std::vector<std::uint64_t> keys;
+   std::vector<std::uint64_t> yearKeys;
+   for (const CellDay& day : days)
+   {
+      if (keys.empty() || keys.back() != getChunkKey(day))
+         keys.push_back(getChunkKey(day));
+      if (yearKeys.empty() || yearKeys.back() != getYearKey(day))
+         yearKeys.push_back(getYearKey(day));
+   }
+
+   const std::string temporaryPath = archivePath + ".tmp";
+   {
+      std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+      FileHeader header{};
+      std::memcpy(header.magic, sc_magic, sizeof(sc_magic));
+      header.chunkDays = sc_chunkDays;
+      header.cellSizeDegrees = cellSizeDegrees;
+      header.numChunks = keys.size();
+      header.numYears = yearKeys.size();
+      output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      output.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(std::uint64_t));
+      output.write(reinterpret_cast<const char*>(yearKeys.data()), yearKeys.size() * sizeof(std::uint64_t));
+
+      // Days which are not in the file stay missing.
+      std::array<std::int16_t, sc_chunkValues> chunk;
+      for (auto it = days.begin(); it != days.end();)
+      {
+         chunk.fill(sc_missing);
+         const std::uint64_t key = getChunkKey(*it);
+         for (; it != days.end() && getChunkKey(*it) == key; ++it)
+         {
+            const std::int64_t dayInChunk = it->dayNumber - getChunkNumber(it->dayNumber) * sc_chunkDays;
+            chunk[2 * dayInChunk] = it->temperatureMin;
+            chunk[2 * dayInChunk + 1] = it->temperatureMax;
+         }
+         output.write(reinterpret_cast<const char*>(chunk.data()), chunk.size() * sizeof(std::int16_t));
+      }
+
+      // Days of the chunks are regrouped by calendar year, which the aggregation tables are built for.
+      const auto table = std::make_unique<YearTable>();
+      std::vector<std::int16_t> temperatures(2 * YearTable::sc_days);
+      for (auto it = days.begin(); it != days.end();)
+      {
+         std::ranges::fill(temperatures, sc_missing);
+         const std::uint64_t key = getYearKey(*it);
+         const std::chrono::sys_days yearStart{getYear(*it) / std::chrono::January / 1};
+         for (; it != days.end() && getYearKey(*it) == key; ++it)
+         {
+            const auto dayOfYear = it->dayNumber - yearStart.time_since_epoch().count();
+            temperatures[2 * dayOfYear] = it->temperatureMin;
+            temperatures[2 * dayOfYear + 1] = it->temperatureMax;
+         }
+         table->Build(temperatures);
+         output.write(reinterpret_cast<const char*>(table.get()), sizeof(YearTable));
+      }
+
+      output.close();
+      if (!output)
+      {
+         LOG(ERROR) << std::format("Cannot write weather archive {}", temporaryPath);
+         return std::nullopt;
+      }
+   }
+
+   std::error_code error;
+   std::filesystem::rename(temporaryPath, archivePath, error);
+   if (error)
+   {
+      LOG(ERROR) << std::format("Cannot rename {} to {}: {}", temporaryPath, archivePath, error.message());
+      return std::nullopt;
+   }
+
+   LOG(INFO) << std::format("Archived {} days in {} chunks and {} years into {}", days.size(), keys.size(),
+      yearKeys.size(), archivePath);
+   return days.size();
+}
+
+bool WeatherArchive::readDays(
+   double latitude, double longitude, const DateRange& dateRange, const DayFunction& onDay) const
+{
+   if (!m_mapping)
+      return false;
+
+   const auto cellIndex = getCellIndex(latitude, longitude, m_cellSizeDegrees);
+   const std::int64_t firstDay = toDayNumber(dateRange.first);
+   const std::int64_t lastDay = toDayNumber(dateRange.second);
+   if (!cellIndex || lastDay < firstDay)
+      return false;
+
+   // Consecutive days mostly share the chunk, it is looked up only when the days cross into the next one.
+   const std::int16_t* chunk = nullptr;
+   std::uint64_t chunkKey = 0;
+   for (std::int64_t dayNumber = firstDay; dayNumber <= lastDay; ++dayNumber)
+   {
+      const std::uint64_t key = makeChunkKey(*cellIndex, dayNumber);
+      if (!chunk || key != chunkKey)
+      {
+         const auto it = std::ranges::lower_bound(m_keys, key);
+         if (it == m_keys.end() || *it != key)
+            return false;
+         chunk = m_temperatures.data() + (it - m_keys.begin()) * sc_chunkValues;
+         chunkKey = key;
+      }
+
+      const std::int64_t dayInChunk = dayNumber - getChunkNumber(dayNumber) * sc_chunkDays;
+      const std::int16_t temperatureMin = chunk[2 * dayInChunk];
+      const std::int16_t temperatureMax = chunk[2 * dayInChunk + 1];
+      if (temperatureMin == sc_missing)
+         return false;
+      onDay(temperatureMin, temperatureMax);
+   }
+   return true;
+}
+
+std::optional<WeatherSummary> WeatherArchive::summarizeDays(
+   std::uint32_t cellIndex, std::span<const std::uint64_t> cellYears, const DateRange& dateRange) const
+{
+   const auto firstDay = std::chrono::floor<std::chrono::days>(DateToTimePoint(dateRange.first));
+   const auto lastDay = std::chrono::floor<std::chrono::days>(DateToTimePoint(dateRange.second));
+   if (lastDay < firstDay)
+      return std::nullopt;
+
+   // Ranges crossing New Year are aggregated in the tables of both years.
+   std::int64_t sum = 0;
+   std::int16_t temperatureMin = std::numeric_limits<std::int16_t>::max();
+   std::int16_t temperatureMax = std::numeric_limits<std::int16_t>::min();
+   for (auto day = firstDay; day <= lastDay;)
+   {
+      const std::chrono::year year = std::chrono::year_month_day{day}.year();
+      const std::uint64_t key = makeYearKey(cellIndex, year);
+      const auto it = std::ranges::lower_bound(cellYears, key);
+      if (it == cellYears.end() || *it != key)
+         return std::nullopt;
+
+      const YearTable& table = m_yearTables[&*it - m_yearKeys.data()];
+      const std::chrono::sys_days yearStart{year / std::chrono::January / 1};
+      const auto endDay = std::min(lastDay, std::chrono::sys_days{year / std::chrono::December / 31});
+      const auto first = static_cast<std::size_t>((day - yearStart).count());
+      const auto last = static_cast<std::size_t>((endDay - yearStart).count());
+      const auto& [firstSum, firstCount] = table.prefixes[first];
+      const auto& [endSum, endCount] = table.prefixes[last + 1];
+      if (static_cast<std::size_t>(endCount - firstCount) != last - first + 1)
+         return std::nullopt;
+
+      // Two ranges of 2^level days, one starting at the first day and one ending at the last day, cover the range.
+      const std::size_t level = std::bit_width(last - first + 1) - 1;
+      const auto& firstExtrema = table.extrema[level][first];
+      const auto& lastExtrema = table.extrema[level][last + 1 - (std::size_t{1} << level)];
+      sum += endSum - firstSum;
+      temperatureMin = std::min({temperatureMin, firstExtrema.temperatureMin, lastExtrema.temperatureMin});
+      temperatureMax = std::max({temperatureMax, firstExtrema.temperatureMax, lastExtrema.temperatureMax});
+      day = endDay + std::chrono::days{1};
+   }
+
+   WeatherSummary summary;
+   summary.numDays = static_cast<std::size_t>((lastDay - firstDay).count()) + 1;
+   summary.temperatureMin = temperatureMin / 10.0;
+   summary.temperatureMax = temperatureMax / 10.0;
+   summary.sumTemperatureAverage = sum / 20.0;
+   return summary;
+}
+
+}  // namespace geo
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../utils/Metrics.h"
+#include "../utils/TimeUtils.h"
+#include "../utils/WeatherInfo.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace geo
+{
+
+// WeatherArchive serves historical daily temperatures from a local file, so that weather of archived places
+// does not depend on Open-Meteo API.
+// The globe is divided into a grid of cells of the same size in degrees, and days of a cell are stored in chunks
+// of sc_chunkDays consecutive days. The file holds the sorted keys of the chunks followed by their temperatures
+// in tenths of a degree, so a lookup is a binary search over the keys and a read of one or two chunks.
+// Cells and days which are not archived take no space. The file is mapped into memory and its pages are loaded
+// by the OS on demand, so archives larger than the memory of the process are served too.
+// For every year of a cell the file also holds prefix sums of the temperatures and sparse tables of their minima
+// and maxima, so that temperatures of any range of days are aggregated with a few reads per year.
+// Archives are made by Ingest() from CSV files.
+// The class is thread-safe once the archive is opened.
+class WeatherArchive
+{
+public:
+   static constexpr std::uint32_t sc_chunkDays = 64;  // Number of days in a chunk
+
+   WeatherArchive();
+
+   // Unmaps the archive
+   ~WeatherArchive();
+
+   WeatherArchive(const WeatherArchive&) = delete;
+   WeatherArchive& operator=(const WeatherArchive&) = delete;
+
+   // Maps an archive made by Ingest(). Must be called before lookups.
+   // @return false if the file cannot be read or is not an archive, e.g. its cell size is out of range, then
+   //         no weather is archived
+   bool Open(const std::string& path);
+
+   // Finds weather of the cell containing the location
+   // @param dateRange First and last days of the weather
+   // @return Weather of each day of the range, or std::nullopt if any of the days is not archived
+   std::optional<WeatherInfoVector> Find(double latitude, double longitude, const DateRange& dateRange) const;
+
+   // Aggregates weather of the cell containing the location in each of the ranges, e.g. the same days of several
+   // years. The years of the cell are found once, and every range takes constant time per year.
+   // @param dateRanges First and last days of each summary
+   // @return Summary of the days of each range, std::nullopt for ranges with days which are not archived
+   std::vector<std::optional<WeatherSummary>> Summarize(
+      double latitude, double longitude, std::span<const DateRange> dateRanges) const;
+
+   // Makes an archive from a CSV file with "date,latitude,longitude,temperature_min,temperature_max" lines,
+   // where the date is YYYY-MM-DD and the coordinates are anywhere within a cell, e.g. in its center.
+   // Empty lines and lines starting with '#' are skipped, and so are malformed lines. The archive is written
+   // next to the destination and renamed to it, so a running service keeps reading the previous archive.
+   // Days are sorted in memory, taking 12 bytes per line of the file.
+   // @param cellSizeDegrees Width and height of a cell from 0.01 to 90, the grid starts at latitude -90 and longitude
+   //                        -180
+   // @return Number of archived days of all the cells, or std::nullopt if the files cannot be read or written or
+   //         the cell size is out of range
+   static std::optional<std::size_t> Ingest(
+      const std::string& csvPath, const std::string& archivePath, double cellSizeDegrees);
+
+private:
+   struct YearTable;
+
+   // Receives minimum and maximum temperatures of a day in tenths of a degree
+   using DayFunction = std::function<void(std::int16_t temperatureMin, std::int16_t temperatureMax)>;
+
+   // Passes temperatures of the days of the range to the function in their order
+   // @return false if any of the days is not archived
+   bool readDays(double latitude, double longitude, const DateRange& dateRange, const DayFunction& onDay) const;
+
+   // Aggregates weather of a range of days of a cell
+   // @param cellYears Part of m_yearKeys with the keys of all the years of the cell
+   // @return std::nullopt if any of the days is not archived
+   std::optional<WeatherSummary> summarizeDays(
+      std::uint32_t cellIndex, std::span<const std::uint64_t> cellYears, const DateRange& dateRange) const;
+
+private:
+   void* m_mapping = nullptr;                     // Mapped archive file, nullptr if no archive is open
+   std::size_t m_mappingSize = 0;                 // Size of the mapped file
+   double m_cellSizeDegrees = 0;                  // Width and height of a cell
+   std::span<const std::uint64_t> m_keys;         // Sorted keys of the chunks, ordered by cell, then by day
+   std::span<const std::int16_t> m_temperatures;  // Minimum and maximum temperature of every day of the chunks
+   std::span<const std::uint64_t> m_yearKeys;     // Sorted keys of the years of the cells, ordered like m_keys
+   const YearTable* m_yearTables = nullptr;       // Aggregation tables of the years, in the order of their keys
+
+   Metrics::Counter& m_hitsCounter;    // Number of lookups answered by the archive
+   Metrics::Counter& m_missesCounter;  // Number of lookups of places or days which are not archived
+};
+
+}  // namespace geo
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace geo
+{
+
+// AsyncQueue is a bounded queue connecting coroutines: producers are suspended while the queue is full,
+// and consumers are suspended while it is empty. Once the queue is closed, pushes fail and pops drain the queue.
+// A suspended coroutine is resumed by the coroutine which pushes or pops next, on the thread of that coroutine.
+// Queues are meant to connect coroutines of the same RPC, which run with the same RequestContext, so the context
+// is not restored on resumption.
+// The class is thread-safe.
+template <typename T>
+class AsyncQueue
+{
+public:
+   // @param capacity Maximum number of queued items, at least 1
+   explicit AsyncQueue(std::size_t capacity)
+      : m_capacity(capacity > 0 ? capacity : 1)
+   {
+   }
+
+   AsyncQueue(const AsyncQueue&) = delete;
+   AsyncQueue& operator=(const AsyncQueue&) = delete;
+
+   // Adds an item, suspending the awaiting coroutine while the queue is full
+   // @return false if the queue is closed, then the item is dropped
+   auto Push(T value)
+   {
+      struct Awaiter
+      {
+         AsyncQueue& queue;
+         Pusher pusher;
+
+         bool await_ready() noexcept { return false; }
+
+         bool await_suspend(std::coroutine_handle<> handle)
+         {
+            pusher.handle = handle;
+            return queue.push(pusher);
+         }
+
+         bool await_resume() noexcept { return pusher.pushed; }
+      };
+      return Awaiter{*this, Pusher{{}, std::move(value), false}};
+   }
+
+   // Takes the oldest item, suspending the awaiting coroutine while the queue is empty
+   // @return std::nullopt if the queue is closed and empty
+   auto Pop()
+   {
+      struct Awaiter
+      {
+         AsyncQueue& queue;
+         Popper popper;
+
+         bool await_ready() noexcept { return false; }
+
+         bool await_suspend(std::coroutine_handle<> handle)
+         {
+            popper.handle = handle;
+            return queue.pop(popper);
+         }
+
+         std::optional<T> await_resume() { return std::move(popper.value); }
+      };
+      return Awaiter{*this, Popper{}};
+   }
+
+   // Closes the queue and resumes suspended coroutines. Queued items can still be popped.
+   void Close()
+   {
+      std::vector<std::coroutine_handle<>> resumed;
+      {
+         std::lock_guard lock(m_mutex);
+         m_closed = true;
+         for (Pusher* pusher : m_pushers)
+            resumed.push_back(pusher->handle);
+         for (Popper* popper : m_poppers)
+            resumed.push_back(popper->handle);
+         m_pushers.clear();
+         m_poppers.clear();
+      }
+      for (const auto handle : resumed)
+         handle.resume();
+   }
+
+private:
+   // Coroutine pushing an item
+   struct Pusher
+   {
+      std::coroutine_handle<> handle;  // Coroutine to resume once the item is queued
+      T value;                         // Item to push
+      bool pushed;                     // The item is queued
+   };
+
+   // Coroutine popping an item
+   struct Popper
+   {
+      std::coroutine_handle<> handle;  // Coroutine to resume once the item is taken
+      std::optional<T> value;          // Taken item
+   };
+
+   // @return true if the pusher is suspended until there is room in the queue
+   bool push(Pusher& pusher)
+   {
+      std::unique_lock lock(m_mutex);
+      if (m_closed)
+         return false;
+
+      pusher.pushed = true;
+      if (!m_poppers.empty())
+      {
+         // A waiting consumer means the queue is empty, so the item is handed over directly.
+         Popper* popper = m_poppers.front();
+         m_poppers.pop_front();
+         popper->value.emplace(std::move(pusher.value));
+         lock.unlock();
+         popper->handle.resume();
+         return false;
+      }
+
+      if (m_items.size() < m_capacity)
+      {
+         m_items.push_back(std::move(pusher.value));
+         return false;
+      }
+
+      pusher.pushed = false;
+      m_pushers.push_back(&pusher);
+      return true;
+   }
+
+   // @return true if the popper is suspended until there is an item in the queue
+   bool pop(Popper& popper)
+   {
+      std::unique_lock lock(m_mutex);
+      if (m_items.empty())
+      {
+         if (m_closed)
+            return false;
+         m_poppers.push_back(&popper);
+         return true;
+      }
+
+      popper.value.emplace(std::move(m_items.front()));
+      m_items.pop_front();
+      if (m_pushers.empty())
+         return false;
+
+      // The room is taken by the oldest waiting producer.
+      Pusher* pusher = m_pushers.front();
+      m_pushers.pop_front();
+      m_items.push_back(std::move(pusher->value));
+      pusher->pushed = true;
+      lock.unlock();
+      pusher->handle.resume();
+      return false;
+   }
+
+private:
+   const std::size_t m_capacity;  // Maximum number of queued items
+
+   std::mutex m_mutex;             // Guards the members below
+   std::deque<T> m_items;          // Queued items
+   std::deque<Pusher*> m_pushers;  // Producers waiting for room, their items are not queued yet
+   std::deque<Popper*> m_poppers;  // Consumers waiting for items
+   bool m_closed = false;          // Pushes fail, pops fail once the queue is empty
+};
+
+}  // namespace geo
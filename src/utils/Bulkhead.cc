@@ -0,0 +1,226 @@
+#include "Bulkhead.h"
+
+#include "Executor.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace
+{
+
+std::string formatMetricName(const char* name, const std::string& bulkhead)
+{
+   return std::format("geo_bulkhead_{}{{bulkhead=\"{}\"}}", name, bulkhead);
+}
+
+}  // namespace
+
+namespace geo
+{
+
+Bulkhead::Permit::Permit(Bulkhead& bulkhead)
+   : m_bulkhead(&bulkhead)
+{
+}
+
+Bulkhead::Permit::Permit(Permit&& other) noexcept
+   : m_bulkhead(std::exchange(other.m_bulkhead, nullptr))
+{
+}
+
+Bulkhead::Permit& Bulkhead::Permit::operator=(Permit&& other) noexcept
+{
+   if (this != &other)
+   {
+      Release();
+      m_bulkhead = std::exchange(other.m_bulkhead, nullptr);
+   }
+   return *this;
+}
+
+Bulkhead::Permit::~Permit()
+{
+   Release();
+}
+
+void Bulkhead::Permit::Release()
+{
+   if (m_bulkhead)
+      std::exchange(m_bulkhead, nullptr)->release();
+}
+
+Bulkhead::Bulkhead(Settings settings, std::shared_ptr<Executor> executor)
+   : m_name(std::move(settings.name))
+   , m_executor(std::move(executor))
+   , m_maxRunningJobs(std::max<std::size_t>(settings.maxRunningJobs, 1))
+   , m_maxQueueLength(settings.maxQueueLength)
+   , m_admittedCounter(Metrics::Instance().GetCounter(formatMetricName("admitted_total", m_name)))
+   , m_rejectedCounter(Metrics::Instance().GetCounter(formatMetricName("rejected_total", m_name)))
+   , m_droppedCounter(Metrics::Instance().GetCounter(formatMetricName("dropped_total", m_name)))
+{
+   auto& metrics = Metrics::Instance();
+   m_gauges.push_back(metrics.RegisterGauge(formatMetricName("running_jobs", m_name),
+      [this]
+      {
+         std::lock_guard lock(m_mutex);
+         return static_cast<double>(m_running);
+      }));
+   m_gauges.push_back(metrics.RegisterGauge(formatMetricName("queue_length", m_name),
+      [this]
+      {
+         std::lock_guard lock(m_mutex);
+         return static_cast<double>(m_queue.size());
+      }));
+
+   // Share of the capacity taken by running and queued jobs, new jobs are rejected at 1.
+   m_gauges.push_back(metrics.RegisterGauge(formatMetricName("saturation", m_name),
+      [this]
+      {
+         std::lock_guard lock(m_mutex);
+         return static_cast<double>(m_running + m_queue.size()) / (m_maxRunningJobs + m_maxQueueLength);
+      }));
+}
+
+Bulkhead::~Bulkhead()
+{
+   // Queued jobs would only delay the shutdown, so they are dropped, while permits of running jobs refer
+   // to the bulkhead and must be released before it is gone.
+   std::vector<std::pair<Job, DropReason>> dropped;
+   {
+      std::lock_guard lock(m_mutex);
+      m_stopping = true;
+      for (auto& job : m_queue)
+         dropped.emplace_back(std::move(job), DropReason::ShutDown);
+      m_queue.clear();
+   }
+   m_droppedCounter += dropped.size();
+   drop(dropped);
+
+   std::unique_lock lock(m_mutex);
+   m_idle.wait(lock,
+      [this]
+      {
+         return m_running == 0;
+      });
+}
+
+bool Bulkhead::TrySubmit(Job job)
+{
+   {
+      std::unique_lock lock(m_mutex);
+      // Jobs beyond the maximum number of running ones wait in the queue.
+      if (m_stopping || m_running + m_queue.size() >= m_maxRunningJobs + m_maxQueueLength)
+      {
+         lock.unlock();
+         ++m_rejectedCounter;
+         LOG(ERROR) << std::format("Job is rejected, bulkhead {} is saturated", m_name);
+         return false;
+      }
+
+      ++m_admittedCounter;
+      if (m_running >= m_maxRunningJobs)
+      {
+         m_queue.push_back(std::move(job));
+         return true;
+      }
+      ++m_running;
+   }
+
+   start(std::move(job));
+   return true;
+}
+
+void Bulkhead::SetLimits(std::size_t maxRunningJobs, std::size_t maxQueueLength)
+{
+   std::vector<Job> started;
+   std::vector<std::pair<Job, DropReason>> dropped;
+   {
+      std::lock_guard lock(m_mutex);
+      m_maxRunningJobs = std::max<std::size_t>(maxRunningJobs, 1);
+      m_maxQueueLength = maxQueueLength;
+      takeRunnable(started, dropped);
+   }
+
+   for (auto& job : started)
+      start(std::move(job));
+   drop(dropped);
+}
+
+void Bulkhead::start(Job job)
+{
+   // The permit is made by the worker, as jobs of the executor are copyable.
+   m_executor->Post(
+      [this, run = std::move(job.run)]
+      {
+         run(Permit(*this));
+      },
+      Executor::Priority::Foreground);
+}
+
+void Bulkhead::release()
+{
+   std::vector<Job> started;
+   std::vector<std::pair<Job, DropReason>> dropped;
+   std::unique_lock lock(m_mutex);
+   --m_running;
+   takeRunnable(started, dropped);
+   while (!dropped.empty())
+   {
+      // The destructor returns once no places are taken, so the place of the finished job is kept while dropped jobs
+      // are finished, and jobs queued meanwhile are taken into it afterwards.
+      ++m_running;
+      lock.unlock();
+      drop(dropped);
+      dropped.clear();
+      lock.lock();
+      --m_running;
+      takeRunnable(started, dropped);
+   }
+   if (m_running == 0)
+      m_idle.notify_all();
+   lock.unlock();
+
+   // Started jobs hold places, so the bulkhead outlives them.
+   for (auto& job : started)
+      start(std::move(job));
+}
+
+void Bulkhead::takeRunnable(std::vector<Job>& started, std::vector<std::pair<Job, DropReason>>& dropped)
+{
+   // RPCs cancelled or timed out while their jobs were queued have been finished by gRPC already, so running them
+   // would only keep the place from jobs which are still needed.
+   const auto now = Job::Clock::now();
+   while (m_running < m_maxRunningJobs && !m_queue.empty())
+   {
+      Job job = std::move(m_queue.front());
+      m_queue.pop_front();
+      if (job.isCancelled && job.isCancelled())
+      {
+         dropped.emplace_back(std::move(job), DropReason::Cancelled);
+      }
+      else if (job.deadline <= now)
+      {
+         dropped.emplace_back(std::move(job), DropReason::Expired);
+      }
+      else
+      {
+         ++m_running;
+         started.push_back(std::move(job));
+      }
+   }
+   m_droppedCounter += dropped.size();
+}
+
+void Bulkhead::drop(std::vector<std::pair<Job, DropReason>>& dropped)
+{
+   for (auto& [job, reason] : dropped)
+   {
+      if (job.drop)
+         job.drop(reason);
+   }
+}
+
+}  // namespace geo
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace geo
+{
+
+class Executor;
+
+// Bulkhead bounds the number of RPCs which depend on the same upstreams (e.g. Open-Meteo API) and run at once.
+// RPCs do not block threads while the upstream answers, but every running RPC holds memory and competes for upstream
+// slots, so every group of them gets its own limit and queue: a slow upstream then saturates only its bulkhead,
+// and RPCs of other upstreams and cached responses are served as usual. Jobs which do not fit into a saturated
+// bulkhead are rejected at once rather than queued without limit.
+// Jobs are run by workers of the executor. A job receives a permit, which it keeps until the RPC is done, usually
+// in the coroutine finishing the RPC, and the next queued job is started once the permit is released.
+// Queued jobs whose RPCs are cancelled or past their deadlines by the time they are dequeued are dropped rather than
+// run, and so are the jobs still queued when the bulkhead is destroyed.
+// The class is thread-safe.
+class Bulkhead
+{
+public:
+   struct Settings
+   {
+      std::string name;                  // Name of the bulkhead, used in logs and metrics
+      std::size_t maxRunningJobs = 4;    // Number of jobs running at the same time
+      std::size_t maxQueueLength = 100;  // Maximum number of jobs waiting for a permit
+   };
+
+   // Place of a running job in the bulkhead, released when the permit is destroyed
+   class Permit
+   {
+   public:
+      Permit() = default;
+
+      Permit(Permit&& other) noexcept;
+      Permit& operator=(Permit&& other) noexcept;
+
+      // Releases the place, see Release()
+      ~Permit();
+
+      Permit(const Permit&) = delete;
+      Permit& operator=(const Permit&) = delete;
+
+      // Releases the place of the job and starts the next queued job, if any
+      void Release();
+
+   private:
+      friend class Bulkhead;
+
+      explicit Permit(Bulkhead& bulkhead);
+
+   private:
+      Bulkhead* m_bulkhead = nullptr;  // Bulkhead of the job, nullptr once the place is released
+   };
+
+   // Reason why a queued job is dropped instead of being run
+   enum class DropReason
+   {
+      Cancelled,  // The job is no longer needed, e.g. its RPC is cancelled
+      Expired,    // The deadline of the job has passed while it was queued
+      ShutDown,   // The bulkhead is destroyed
+   };
+
+   struct Job
+   {
+      using Clock = std::chrono::steady_clock;
+
+      std::function<void(Permit permit)> run;       // Runs the job, which keeps the permit until it is done
+      std::function<void(DropReason reason)> drop;  // Called instead of run() if the job is dropped, may be empty
+      std::function<bool()> isCancelled;            // Checked when the job is dequeued, may be empty
+      Clock::time_point deadline = Clock::time_point::max();  // Queued jobs are dropped once it has passed
+   };
+
+   // @param executor Runs the jobs
+   Bulkhead(Settings settings, std::shared_ptr<Executor> executor);
+
+   // Drops the queued jobs and waits until all the permits are released
+   ~Bulkhead();
+
+   Bulkhead(const Bulkhead&) = delete;
+   Bulkhead& operator=(const Bulkhead&) = delete;
+
+   // Runs the job, or queues it if the maximum number of jobs are running
+   // @return false if the bulkhead is saturated, then the job is neither run nor dropped
+   bool TrySubmit(Job job);
+
+   // Changes the limits, e.g. when the configuration is reloaded. Queued jobs are started at once if the maximum
+   // number of running jobs grows, while jobs above a lowered limit keep running until they are done.
+   void SetLimits(std::size_t maxRunningJobs, std::size_t maxQueueLength);
+
+private:
+   // Runs the job on the executor, the place of the job must be taken
+   void start(Job job);
+
+   // Releases the place of a finished job, starts the next queued job in it
+   void release();
+
+   // Takes queued jobs which may be started within the limit, taking their places, and jobs which are to be dropped
+   void takeRunnable(std::vector<Job>& started, std::vector<std::pair<Job, DropReason>>& dropped);
+
+   // Calls the drop functions of the jobs, must be called without the lock
+   static void drop(std::vector<std::pair<Job, DropReason>>& dropped);
+
+private:
+   const std::string m_name;                    // Name of the bulkhead, used in logs and metrics
+   const std::shared_ptr<Executor> m_executor;  // Runs the jobs
+
+   std::mutex m_mutex;              // Guards the members below
+   std::condition_variable m_idle;  // Wakes the destructor up when the last permit is released
+   std::size_t m_maxRunningJobs;    // Number of jobs running at the same time, at least 1
+   std::size_t m_maxQueueLength;    // Maximum number of jobs waiting for a permit
+   std::deque<Job> m_queue;         // Jobs waiting for a permit
+   std::size_t m_running = 0;       // Number of jobs holding permits
+   bool m_stopping = false;         // The bulkhead is destroyed, new jobs are rejected
+
+   Metrics::Counter& m_admittedCounter;   // Number of accepted jobs
+   Metrics::Counter& m_rejectedCounter;   // Number of jobs rejected because the bulkhead was saturated
+   Metrics::Counter& m_droppedCounter;    // Number of queued jobs dropped instead of being run
+   std::vector<Metrics::Gauge> m_gauges;  // Running jobs, queue length and saturation
+};
+
+}  // namespace geo
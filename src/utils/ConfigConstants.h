@@ -8,5 +8,36 @@ inline constexpr auto sz_nominatimEndpointKey = "nominatim-endpoint";
 inline constexpr auto sz_openMeteoEndpointKey = "openmeteo-endpoint";
 inline constexpr auto sz_maxBoxWidthKey = "maxBoxWidth";
 inline constexpr auto sz_maxBoxHeightKey = "maxBoxHeight";
+inline constexpr auto sz_overpassCacheMaxEntriesKey = "overpassCacheMaxEntries";
+inline constexpr auto sz_overpassCacheRevalidateSecondsKey = "overpassCacheRevalidateSeconds";
+inline constexpr auto sz_overpassCacheMaxAgeSecondsKey = "overpassCacheMaxAgeSeconds";
+inline constexpr auto sz_overpassCacheRevalidationKey = "overpassCacheRevalidation";
+inline constexpr auto sz_relationCacheMaxEntriesKey = "relationCacheMaxEntries";
+inline constexpr auto sz_weatherCacheMaxEntriesKey = "weatherCacheMaxEntries";
+inline constexpr auto sz_overpassMaxConcurrentRequestsKey = "overpassMaxConcurrentRequests";
+inline constexpr auto sz_nominatimMaxConcurrentRequestsKey = "nominatimMaxConcurrentRequests";
+inline constexpr auto sz_responseVersionCacheMaxEntriesKey = "responseVersionCacheMaxEntries";
+inline constexpr auto sz_responseVersionTtlSecondsKey = "responseVersionTtlSeconds";
+inline constexpr auto sz_responseCacheMaxEntriesKey = "responseCacheMaxEntries";
+inline constexpr auto sz_responseCacheMaxResponseBytesKey = "responseCacheMaxResponseBytes";
+inline constexpr auto sz_responseCacheTtlSecondsKey = "responseCacheTtlSeconds";
+inline constexpr auto sz_memoryBudgetBytesKey = "memoryBudgetBytes";
+inline constexpr auto sz_prefetchMaxPendingTilesKey = "prefetchMaxPendingTiles";
+inline constexpr auto sz_fastRegionsMaxStalenessSecondsKey = "fastRegionsMaxStalenessSeconds";
+inline constexpr auto sz_scanSessionsMaxEntriesKey = "scanSessionsMaxEntries";
+inline constexpr auto sz_scanSessionsMaxBytesKey = "scanSessionsMaxBytes";
+inline constexpr auto sz_scanSessionTtlSecondsKey = "scanSessionTtlSeconds";
+inline constexpr auto sz_citiesDatasetPathKey = "citiesDatasetPath";
+inline constexpr auto sz_weatherArchivePathKey = "weatherArchivePath";
+inline constexpr auto sz_scanOverpassConcurrencyKey = "scanOverpassConcurrency";
+inline constexpr auto sz_scanNominatimConcurrencyKey = "scanNominatimConcurrency";
+inline constexpr auto sz_scanQueueCapacityKey = "scanQueueCapacity";
+inline constexpr auto sz_maxOngoingWeatherRequestsKey = "maxOngoingWeatherRequests";
+inline constexpr auto sz_executorThreadsKey = "executorThreads";
+inline constexpr auto sz_searchBulkheadSizeKey = "searchBulkheadSize";
+inline constexpr auto sz_openMeteoBulkheadSizeKey = "openMeteoBulkheadSize";
+inline constexpr auto sz_cacheBulkheadSizeKey = "cacheBulkheadSize";
+inline constexpr auto sz_bulkheadMaxQueueLengthKey = "bulkheadMaxQueueLength";
+inline constexpr auto sz_adminHeapProfilingKey = "adminHeapProfiling";
 
 }
\ No newline at end of file
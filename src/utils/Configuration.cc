@@ -44,8 +44,15 @@ std::string Configuration::GetString(const char* name) const
       LOG(ERROR) << std::format("Configuration key not found: {}", std::string(name));
       throw std::runtime_error("Configuration key not found: " + std::string(name));
    }
+   // Check the type, a value of another type would be read as garbage
+   const auto& value = json::Get(m_config, name);
+   if (!value.IsString())
+   {
+      LOG(ERROR) << std::format("Configuration value {} is not a string", name);
+      throw std::runtime_error(std::format("Configuration value {} is not a string", name));
+   }
    // Return the string value
-   return std::string(json::GetString(json::Get(m_config, name)));
+   return std::string(json::GetString(value));
 }
 
 std::int64_t Configuration::GetInt64(const char* name) const
@@ -56,8 +63,27 @@ std::int64_t Configuration::GetInt64(const char* name) const
       LOG(ERROR) << std::format("Configuration key not found: {}", std::string(name));
       throw std::runtime_error("Configuration key not found: " + std::string(name));
    }
+   // Check the type, a value of another type would be read as garbage
+   const auto& value = json::Get(m_config, name);
+   if (!value.IsInt64())
+   {
+      LOG(ERROR) << std::format("Configuration value {} is not an integer", name);
+      throw std::runtime_error(std::format("Configuration value {} is not an integer", name));
+   }
    // Return the int64 value
-   return json::GetInt64(json::Get(m_config, name));
+   return json::GetInt64(value);
+}
+
+std::int64_t Configuration::GetInt64(const char* name, std::int64_t minValue, std::int64_t maxValue) const
+{
+   const std::int64_t value = GetInt64(name);
+   if (value < minValue || value > maxValue)
+   {
+      LOG(ERROR) << std::format(
+         "Configuration value {} = {} is out of range [{}, {}]", name, value, minValue, maxValue);
+      throw std::runtime_error(std::format("Configuration value {} is out of range", name));
+   }
+   return value;
 }
 
 }  // namespace geo
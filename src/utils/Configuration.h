@@ -1,6 +1,9 @@
 #pragma once
 
 #include <rapidjson/document.h>
+
+#include <cstdint>
+#include <memory>
 #include <string>
 
 namespace geo
@@ -14,11 +17,17 @@ public:
    explicit Configuration(const char* filename);
 
    // Retrieves a string value from the configuration by key
+   // @throw std::runtime_error if the key is not found or the value is not a string
    std::string GetString(const char* name) const;
 
    // Retrieves an int64 value from the configuration by key
+   // @throw std::runtime_error if the key is not found or the value is not an integer
    std::int64_t GetInt64(const char* name) const;
 
+   // Retrieves an int64 value from the configuration by key and checks that it is within the range
+   // @throw std::runtime_error if the value is less than minValue or greater than maxValue
+   std::int64_t GetInt64(const char* name, std::int64_t minValue, std::int64_t maxValue) const;
+
 private:
    rapidjson::Document m_config; // RapidJSON document holding the parsed configuration
 };
@@ -0,0 +1,210 @@
+#include "ConfigurationStore.h"
+
+#include <absl/log/log.h>
+
+#include <csignal>
+#include <exception>
+#include <format>
+#include <system_error>
+#include <utility>
+
+namespace
+{
+
+using namespace geo;
+
+// Set by the SIGHUP handler, checked by the watching thread
+std::atomic<bool> s_reloadRequested = false;
+static_assert(std::atomic<bool>::is_always_lock_free, "The flag must be lock-free to be set by a signal handler");
+
+// Source of generations of all stores, so that a snapshot cached for a destroyed store is not taken for one of
+// a new store at the same address
+std::atomic<std::uint64_t> s_nextGeneration = 1;
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Generations must be read without locks");
+
+// Snapshot read by a thread, see ConfigurationStore::Current()
+struct CachedSnapshot
+{
+   const ConfigurationStore* store = nullptr;           // Store the snapshot is read from
+   std::uint64_t generation = 0;                        // Generation of the store the snapshot is read at
+   std::shared_ptr<const Configuration> configuration;  // Snapshot
+};
+
+thread_local CachedSnapshot s_cachedSnapshot;  // Snapshot read last by the thread
+
+// Handles SIGHUP
+void requestReload(int)
+{
+   s_reloadRequested = true;
+}
+
+// Returns the modification time of the file, or the minimal time if it cannot be read
+std::filesystem::file_time_type getLastWriteTime(const std::string& filename)
+{
+   std::error_code error;
+   const auto time = std::filesystem::last_write_time(filename, error);
+   return error ? std::filesystem::file_time_type::min() : time;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+ConfigurationStore::Subscription::Subscription(ConfigurationStore& store, std::uint64_t id)
+   : m_store(&store)
+   , m_id(id)
+{
+}
+
+ConfigurationStore::Subscription::Subscription(Subscription&& other) noexcept
+   : m_store(std::exchange(other.m_store, nullptr))
+   , m_id(other.m_id)
+{
+}
+
+ConfigurationStore::Subscription& ConfigurationStore::Subscription::operator=(Subscription&& other) noexcept
+{
+   if (this != &other)
+   {
+      if (m_store)
+         m_store->unsubscribe(m_id);
+      m_store = std::exchange(other.m_store, nullptr);
+      m_id = other.m_id;
+   }
+   return *this;
+}
+
+ConfigurationStore::Subscription::~Subscription()
+{
+   if (m_store)
+      m_store->unsubscribe(m_id);
+}
+
+ConfigurationStore::ConfigurationStore(std::string filename, Validator validator)
+   : m_filename(std::move(filename))
+   , m_validator(std::move(validator))
+   , m_reloadsCounter(Metrics::Instance().GetCounter("geo_config_reloads_total"))
+   , m_failedReloadsCounter(Metrics::Instance().GetCounter("geo_config_failed_reloads_total"))
+{
+   // The time is taken before reading, so that the file changed while it is read is loaded again.
+   m_lastWriteTime = getLastWriteTime(m_filename);
+   auto configuration = std::make_shared<const Configuration>(m_filename.c_str());
+   if (m_validator)
+      m_validator(*configuration);
+   publish(std::move(configuration));
+
+   std::signal(SIGHUP, requestReload);
+   m_thread = std::jthread(
+      [this](std::stop_token stopToken)
+      {
+         run(std::move(stopToken));
+      });
+}
+
+std::shared_ptr<const Configuration> ConfigurationStore::Current() const
+{
+   // The generation is changed after the snapshot, so a snapshot loaded after the generation is at least as new.
+   // A reload between the two loads makes the cache look older than it is, and the next read loads it again.
+   const std::uint64_t generation = m_generation.load(std::memory_order_acquire);
+   CachedSnapshot& cached = s_cachedSnapshot;
+   if (cached.store != this || cached.generation != generation)
+   {
+      cached.configuration = m_current.load(std::memory_order_acquire);
+      cached.store = this;
+      cached.generation = generation;
+   }
+   return cached.configuration;
+}
+
+ConfigurationStore::Subscription ConfigurationStore::Subscribe(Listener listener)
+{
+   std::lock_guard lock(m_mutex);
+   const std::uint64_t id = m_nextId++;
+   m_listeners.emplace(id, std::move(listener));
+   return Subscription(*this, id);
+}
+
+bool ConfigurationStore::Reload()
+{
+   std::lock_guard lock(m_mutex);
+   m_lastWriteTime = getLastWriteTime(m_filename);
+
+   std::shared_ptr<const Configuration> configuration;
+   try
+   {
+      configuration = std::make_shared<const Configuration>(m_filename.c_str());
+      if (m_validator)
+         m_validator(*configuration);
+   }
+   catch (const std::exception& e)
+   {
+      // The file is not loaded again until it is changed, as it is likely being edited.
+      ++m_failedReloadsCounter;
+      LOG(ERROR) << std::format("Configuration is not reloaded, the previous one is kept: {}", e.what());
+      return false;
+   }
+
+   publish(configuration);
+   ++m_reloadsCounter;
+   LOG(INFO) << std::format("Configuration is reloaded from {}", m_filename);
+
+   for (const auto& [id, listener] : m_listeners)
+   {
+      try
+      {
+         listener(*configuration);
+      }
+      catch (const std::exception& e)
+      {
+         LOG(ERROR) << std::format("Configuration is not fully applied: {}", e.what());
+      }
+   }
+   return true;
+}
+
+void ConfigurationStore::publish(std::shared_ptr<const Configuration> configuration)
+{
+   m_current.store(std::move(configuration), std::memory_order_release);
+   m_generation.store(s_nextGeneration.fetch_add(1, std::memory_order_relaxed), std::memory_order_release);
+}
+
+void ConfigurationStore::unsubscribe(std::uint64_t id)
+{
+   std::lock_guard lock(m_mutex);
+   m_listeners.erase(id);
+}
+
+void ConfigurationStore::run(std::stop_token stopToken)
+{
+   // The wait is interrupted only when stop is requested, the signal handler cannot notify the thread.
+   const auto neverReady = []
+   {
+      return false;
+   };
+
+   std::unique_lock lock(m_threadMutex);
+   while (!stopToken.stop_requested())
+   {
+      m_threadWakeup.wait_for(lock, stopToken, sc_checkPeriod, neverReady);
+      if (stopToken.stop_requested())
+         break;
+
+      if (s_reloadRequested.exchange(false))
+      {
+         LOG(INFO) << "SIGHUP is received, reloading configuration";
+         Reload();
+         continue;
+      }
+
+      bool changed = false;
+      {
+         std::lock_guard dataLock(m_mutex);
+         changed = getLastWriteTime(m_filename) != m_lastWriteTime;
+      }
+      if (changed)
+         Reload();
+   }
+}
+
+}  // namespace geo
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Configuration.h"
+#include "Metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+namespace geo
+{
+
+// ConfigurationStore publishes the configuration file as immutable snapshots, and replaces the current snapshot
+// when the file is changed or the process receives SIGHUP.
+// Readers share snapshots, which are deleted once the last reader releases them, so a reader may keep a snapshot
+// as long as it likes. Every thread caches the snapshot it read last, so that reads on hot paths take no lock,
+// see Current().
+// Components which cannot read the snapshot on every use, such as upstream dispatchers, subscribe to changes.
+// A file which cannot be parsed or is rejected by the validator is not published, the previous snapshot stays
+// current.
+// The class is thread-safe.
+class ConfigurationStore
+{
+public:
+   // Called on the watching thread after a new snapshot is published
+   using Listener = std::function<void(const Configuration& configuration)>;
+
+   // Checks a loaded file before it is published
+   // @throw std::exception if the configuration is invalid, e.g. a required setting is missing or out of range
+   using Validator = std::function<void(const Configuration& configuration)>;
+
+   // RAII handle of a listener. The listener is removed when the handle is destroyed,
+   // which waits for the listener to return if it is being called.
+   class Subscription
+   {
+   public:
+      Subscription(Subscription&& other) noexcept;
+      Subscription& operator=(Subscription&& other) noexcept;
+      ~Subscription();
+
+   private:
+      friend class ConfigurationStore;
+      Subscription(ConfigurationStore& store, std::uint64_t id);
+
+      ConfigurationStore* m_store;  // Store the listener is added to, nullptr if moved out
+      std::uint64_t m_id;           // Identifier of the listener
+   };
+
+   // Loads the file and starts watching it
+   // @param filename Path to the configuration file
+   // @param validator Checks every loaded file, may be empty
+   // @throw std::exception if the file cannot be loaded or is rejected by the validator
+   explicit ConfigurationStore(std::string filename, Validator validator = {});
+
+   ConfigurationStore(const ConfigurationStore&) = delete;
+   ConfigurationStore& operator=(const ConfigurationStore&) = delete;
+
+   // Returns the current snapshot. The snapshot cached by the calling thread is returned while the generation of
+   // the store is unchanged, which takes an atomic load and an increment of the reference count. The first read
+   // of a thread after a reload takes the snapshot from m_current, which std::atomic<std::shared_ptr> guards
+   // with a lock. A cached snapshot is released by the next read of the thread after a reload.
+   std::shared_ptr<const Configuration> Current() const;
+
+   // Adds a listener of changes, which must stay alive until the subscription is destroyed
+   [[nodiscard]] Subscription Subscribe(Listener listener);
+
+   // Loads the file, publishes it and notifies listeners
+   // @return false if the file cannot be loaded or is rejected by the validator, then the current snapshot is kept
+   bool Reload();
+
+private:
+   // Makes the snapshot current and gives the store a new generation
+   void publish(std::shared_ptr<const Configuration> configuration);
+
+   // Removes a listener
+   void unsubscribe(std::uint64_t id);
+
+   // Reloads the file when it is changed or SIGHUP is received, until stop is requested
+   void run(std::stop_token stopToken);
+
+private:
+   static constexpr std::chrono::seconds sc_checkPeriod{1};  // How often the file and the signal are checked
+
+   const std::string m_filename;  // Path to the configuration file
+   const Validator m_validator;   // Checks loaded files, may be empty
+
+   std::atomic<std::shared_ptr<const Configuration>> m_current;  // Current snapshot
+   std::atomic<std::uint64_t> m_generation = 0;                   // Changed after every publication, unique among
+                                                                  // all stores, checked by thread caches of snapshots
+
+   std::mutex m_mutex;                               // Guards all the members below, held while listeners are called so
+                                                     // that reloads do not interleave
+   std::filesystem::file_time_type m_lastWriteTime;  // Modification time of the published file
+   std::map<std::uint64_t, Listener> m_listeners;    // Listeners by identifier
+   std::uint64_t m_nextId = 0;                       // Identifier of the next listener
+
+   Metrics::Counter& m_reloadsCounter;          // Number of published snapshots after the first one
+   Metrics::Counter& m_failedReloadsCounter;    // Number of reloads of files which cannot be loaded or are invalid
+   std::mutex m_threadMutex;                    // Used by the watching thread to wait for the next check
+   std::condition_variable_any m_threadWakeup;  // Wakes the watching thread up when stop is requested
+   std::jthread m_thread;                       // Watching thread, destroyed first so that it stops before other
+                                                // members are destroyed
+};
+
+}  // namespace geo
@@ -0,0 +1,338 @@
+#include "Executor.h"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+namespace
+{
+
+using namespace geo;
+
+thread_local Executor* s_currentExecutor = nullptr;  // Executor running the current thread as a worker
+thread_local std::size_t s_workerIndex = 0;          // Index of the worker in the executor
+thread_local std::size_t s_nextVictim = 0;           // Worker to steal from first, rotated to spread thieves
+
+// Indices are split into about this many batches per worker, so that workers finishing early take over
+// the rest of the work, while short calls do not contend on the shared index too often.
+constexpr std::size_t sc_batchesPerWorker = 4;
+
+}  // namespace
+
+namespace geo
+{
+
+// State of Executor::ParallelFor(), shared by the calling thread and the posted helpers.
+// Helpers may start after the call returns, so they take the state by a shared pointer and do not touch
+// the function once all the indices are taken.
+struct Executor::ParallelForState
+{
+   ParallelForState(std::size_t count, std::size_t batchSize, const std::function<void(std::size_t)>& body)
+      : count(count)
+      , batchSize(batchSize)
+      , body(body)
+   {
+   }
+
+   // Calls the function for batches of indices until all the indices are taken
+   // @return true if this call has finished the last of the calls
+   bool Run()
+   {
+      bool finishedLast = false;
+      for (std::size_t begin = nextIndex.fetch_add(batchSize); begin < count; begin = nextIndex.fetch_add(batchSize))
+      {
+         const std::size_t end = std::min(begin + batchSize, count);
+         for (std::size_t index = begin; index < end; ++index)
+         {
+            try
+            {
+               body(index);
+            }
+            catch (...)
+            {
+               const std::lock_guard lock(mutex);
+               if (!exception)
+                  exception = std::current_exception();
+            }
+         }
+
+         if (numFinished.fetch_add(end - begin) + (end - begin) == count)
+         {
+            numFinished.notify_all();
+            finishedLast = true;
+         }
+      }
+      return finishedLast;
+   }
+
+   // Checks whether all the calls are finished
+   bool IsFinished() const { return numFinished.load() == count; }
+
+   // Waits for the calls made by other threads
+   void Wait()
+   {
+      for (std::size_t finished = numFinished.load(); finished < count; finished = numFinished.load())
+         numFinished.wait(finished);
+   }
+
+   const std::size_t count;                       // Number of indices
+   const std::size_t batchSize;                   // Number of indices taken at once
+   const std::function<void(std::size_t)>& body;  // Function to call, owned by the calling thread
+   std::atomic<std::size_t> nextIndex = 0;        // First index which is not taken yet
+   std::atomic<std::size_t> numFinished = 0;      // Number of finished calls
+   std::mutex mutex;                              // Guards the exception
+   std::exception_ptr exception;                  // First exception thrown by the function
+};
+
+Executor::Executor(std::size_t numThreads)
+   : m_stolenCounter(Metrics::Instance().GetCounter("geo_executor_stolen_jobs_total"))
+{
+   if (numThreads == 0)
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+   // All the workers are created before any of them starts, as workers look at each other.
+   for (std::size_t i = 0; i < numThreads; ++i)
+      m_workers.push_back(std::make_unique<Worker>());
+   for (std::size_t i = 0; i < numThreads; ++i)
+   {
+      m_workers[i]->thread = std::jthread(
+         [this, i]
+         {
+            run(i);
+         });
+   }
+}
+
+Executor::~Executor()
+{
+   m_stopping = true;
+   m_epoch.fetch_add(1);
+   m_epoch.notify_all();
+   for (auto& worker : m_workers)
+      worker->thread.join();
+
+   // Jobs posted by other threads after the workers have exited are run here, later ones by the posting threads.
+   for (;;)
+   {
+      std::unique_lock lock(m_mutex);
+      const auto queue = std::ranges::find_if(m_queued,
+         [](const auto& jobs)
+         {
+            return !jobs.empty();
+         });
+      if (queue == m_queued.end())
+      {
+         m_stopped = true;
+         break;
+      }
+
+      Job* const job = queue->front();
+      queue->pop_front();
+      lock.unlock();
+      runJob(job);
+   }
+}
+
+Executor* Executor::Current()
+{
+   return s_currentExecutor;
+}
+
+Executor::Priority Executor::CurrentPriority()
+{
+   return RequestContext::Current().background ? Priority::Background : Priority::Foreground;
+}
+
+std::size_t Executor::GetNumThreads() const
+{
+   return m_workers.size();
+}
+
+void Executor::Post(Job job, Priority priority)
+{
+   const auto index = static_cast<std::size_t>(priority);
+   auto posted = std::make_unique<Job>(std::move(job));
+   if (s_currentExecutor == this)
+   {
+      // Jobs posted by a worker go to its own deque without locking, idle workers steal them from there.
+      m_workers[s_workerIndex]->jobs[index].Push(posted.release());
+   }
+   else
+   {
+      std::unique_lock lock(m_mutex);
+      if (m_stopped)
+      {
+         lock.unlock();
+         runJob(posted.release());
+         return;
+      }
+      m_queued[index].push_back(posted.release());
+      ++m_numQueued;
+   }
+   wakeUp();
+}
+
+void Executor::ParallelFor(std::size_t count, const std::function<void(std::size_t index)>& body)
+{
+   if (count == 0)
+      return;
+
+   const std::size_t batchSize = std::max<std::size_t>(1, count / (m_workers.size() * sc_batchesPerWorker));
+   const std::size_t numBatches = (count + batchSize - 1) / batchSize;
+   const auto state = std::make_shared<ParallelForState>(count, batchSize, body);
+
+   // The calling thread takes batches too, so one helper fewer is needed.
+   const std::size_t numHelpers = std::min(m_workers.size(), numBatches) - 1;
+   for (std::size_t i = 0; i < numHelpers; ++i)
+   {
+      Post(
+         [this, state]
+         {
+            // A worker waiting for the calls sleeps until the epoch changes, see waitForParallelFor().
+            if (state->Run())
+            {
+               m_epoch.fetch_add(1);
+               m_epoch.notify_all();
+            }
+         });
+   }
+
+   state->Run();
+   if (s_currentExecutor == this)
+      waitForParallelFor(*state);
+   else
+      state->Wait();
+   if (state->exception)
+      std::rethrow_exception(state->exception);
+}
+
+void Executor::waitForParallelFor(const ParallelForState& state)
+{
+   // Blocking the worker would take it away from the jobs which the unfinished calls may wait for, and with all
+   // the workers blocked so nothing would run them, so the worker runs jobs until the calls are finished.
+   for (;;)
+   {
+      // The epoch is read before checking the calls, so that finishing them meanwhile makes the wait return at once.
+      const std::uint32_t epoch = m_epoch.load();
+      if (state.IsFinished())
+         break;
+      if (Job* const job = findJob(s_workerIndex))
+      {
+         runJob(job);
+         continue;
+      }
+
+      ++m_numSleeping;
+      m_epoch.wait(epoch);
+      --m_numSleeping;
+   }
+}
+
+void Executor::run(std::size_t index)
+{
+   s_currentExecutor = this;
+   s_workerIndex = index;
+   s_nextVictim = index + 1;
+
+   for (;;)
+   {
+      // The epoch is read before looking for jobs, so that a job posted meanwhile makes the wait return at once.
+      const std::uint32_t epoch = m_epoch.load();
+      if (Job* const job = findJob(index))
+      {
+         runJob(job);
+         continue;
+      }
+      if (m_stopping)
+         break;
+
+      ++m_numSleeping;
+      m_epoch.wait(epoch);
+      --m_numSleeping;
+   }
+
+   s_currentExecutor = nullptr;
+}
+
+Executor::Job* Executor::findJob(std::size_t index)
+{
+   Worker& worker = *m_workers[index];
+   for (std::size_t priority = 0; priority < sc_numPriorities; ++priority)
+   {
+      if (const auto job = worker.jobs[priority].Pop())
+         return *job;
+      if (Job* const job = takeQueuedJob(priority))
+         return job;
+      if (Job* const job = stealJob(index, priority))
+         return job;
+   }
+   return nullptr;
+}
+
+Executor::Job* Executor::takeQueuedJob(std::size_t priority)
+{
+   if (m_numQueued == 0)
+      return nullptr;
+
+   const std::lock_guard lock(m_mutex);
+   auto& jobs = m_queued[priority];
+   if (jobs.empty())
+      return nullptr;
+
+   Job* const job = jobs.front();
+   jobs.pop_front();
+   --m_numQueued;
+   return job;
+}
+
+Executor::Job* Executor::stealJob(std::size_t index, std::size_t priority)
+{
+   const std::size_t numWorkers = m_workers.size();
+   for (std::size_t i = 0; i < numWorkers; ++i)
+   {
+      const std::size_t victim = (s_nextVictim + i) % numWorkers;
+      if (victim == index)
+         continue;
+
+      // Stealing fails if another thread takes the same job first, then the deque is tried again while it has jobs.
+      auto& jobs = m_workers[victim]->jobs[priority];
+      while (!jobs.IsEmpty())
+      {
+         if (const auto job = jobs.Steal())
+         {
+            s_nextVictim = victim;
+            ++m_stolenCounter;
+            return *job;
+         }
+      }
+   }
+   s_nextVictim = (s_nextVictim + 1) % numWorkers;
+   return nullptr;
+}
+
+void Executor::runJob(Job* job)
+{
+   const std::unique_ptr<Job> owned(job);
+   (*owned)();
+}
+
+void Executor::wakeUp()
+{
+   m_epoch.fetch_add(1);
+   if (m_numSleeping > 0)
+      m_epoch.notify_one();
+}
+
+void ParallelFor(std::size_t count, const std::function<void(std::size_t index)>& body)
+{
+   if (Executor* const executor = Executor::Current())
+   {
+      executor->ParallelFor(count, body);
+      return;
+   }
+
+   for (std::size_t index = 0; index < count; ++index)
+      body(index);
+}
+
+}  // namespace geo
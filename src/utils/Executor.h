@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Metrics.h"
+#include "RequestContext.h"
+#include "WorkStealingDeque.h"
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace geo
+{
+
+// Executor is a work-stealing thread pool for bursts of small CPU-bound jobs, such as parsing upstream responses
+// for the tiles of a region scan or for the years of a weather request.
+// Every worker has its own lock-free deques, where the jobs posted by the worker go, so that fan-out from workers
+// does not contend on a shared lock. Idle workers steal the oldest jobs of busy ones. Jobs posted by other threads
+// go to a shared queue.
+// Jobs of RPCs (foreground) are run before speculative jobs, such as prefetching (background).
+// The class is thread-safe.
+class Executor
+{
+public:
+   using Job = std::function<void()>;
+
+   // Jobs of a priority are run only when there are no jobs of the higher one
+   enum class Priority
+   {
+      Foreground,  // Jobs of RPCs
+      Background,  // Speculative jobs, see RequestContext::background
+   };
+
+   // @param numThreads Number of worker threads, 0 for the number of hardware threads
+   explicit Executor(std::size_t numThreads = 0);
+
+   // Runs the queued jobs and stops the workers
+   ~Executor();
+
+   Executor(const Executor&) = delete;
+   Executor& operator=(const Executor&) = delete;
+
+   // Returns the executor which runs the current thread as a worker, or nullptr
+   static Executor* Current();
+
+   // Returns the priority of jobs posted on behalf of the current RequestContext
+   static Priority CurrentPriority();
+
+   // Returns the number of worker threads
+   std::size_t GetNumThreads() const;
+
+   // Queues the job. Jobs must not block, as they hold up the other jobs of the worker, and must not throw.
+   // Jobs posted while the executor is destroyed are run by the posting thread.
+   void Post(Job job, Priority priority = CurrentPriority());
+
+   // Suspends the awaiting coroutine and resumes it on a worker with its RequestContext.
+   // Coroutines which already run on a worker of this executor continue without suspension.
+   auto Schedule() { return ScheduleAwaiter(*this); }
+
+   // Calls the function for every index from 0 to count - 1, and returns when all the calls are finished.
+   // Indices are taken in small batches by workers and by the calling thread, so uneven calls are balanced.
+   // A worker calling it runs other jobs while it waits for the calls taken by other workers, so it may be called
+   // by jobs, including the function itself.
+   // The first exception thrown by the function is rethrown once all the calls are finished.
+   void ParallelFor(std::size_t count, const std::function<void(std::size_t index)>& body);
+
+private:
+   struct ParallelForState;
+
+   // Resumes a coroutine on a worker, see Schedule()
+   class ScheduleAwaiter
+   {
+   public:
+      explicit ScheduleAwaiter(Executor& executor)
+         : m_executor(executor)
+      {
+      }
+
+      bool await_ready() const noexcept { return Current() == &m_executor; }
+
+      void await_suspend(std::coroutine_handle<> handle)
+      {
+         m_executor.Post(
+            [handle, context = RequestContext::Current()]
+            {
+               const ScopedRequestContext scopedContext(context);
+               handle.resume();
+            });
+      }
+
+      void await_resume() const noexcept {}
+
+   private:
+      Executor& m_executor;  // Executor to resume the coroutine on
+   };
+
+   static constexpr std::size_t sc_numPriorities = 2;
+
+   struct Worker
+   {
+      std::array<WorkStealingDeque<Job*>, sc_numPriorities> jobs;  // Jobs posted by the worker, by priority
+      std::jthread thread;                                         // Worker thread
+   };
+
+   // Runs jobs until the executor is destroyed and there are no jobs left
+   void run(std::size_t index);
+
+   // Takes the next job for the worker: its own jobs first, then jobs posted by other threads,
+   // then jobs stolen from other workers, all of the foreground priority before any of the background one
+   // @return nullptr if there are no jobs
+   Job* findJob(std::size_t index);
+
+   // Takes the oldest job of the priority posted by other threads
+   // @return nullptr if there are no such jobs
+   Job* takeQueuedJob(std::size_t priority);
+
+   // Steals a job of the priority from other workers
+   // @return nullptr if there are no such jobs
+   Job* stealJob(std::size_t index, std::size_t priority);
+
+   // Runs and deletes the job
+   static void runJob(Job* job);
+
+   // Runs jobs on the current worker until all the calls of ParallelFor() are finished
+   void waitForParallelFor(const ParallelForState& state);
+
+   // Wakes a sleeping worker up, if any
+   void wakeUp();
+
+private:
+   std::vector<std::unique_ptr<Worker>> m_workers;  // Workers, the vector is not changed once they are started
+
+   std::mutex m_mutex;                                       // Guards the members below
+   std::array<std::deque<Job*>, sc_numPriorities> m_queued;  // Jobs posted by other threads, by priority
+   bool m_stopped = false;                                   // Workers are stopped, jobs are run by posters
+
+   std::atomic<std::size_t> m_numQueued = 0;    // Number of jobs in m_queued, checked before locking
+   std::atomic<std::uint32_t> m_epoch = 0;      // Changed when jobs are posted, sleeping workers wait for a change
+   std::atomic<std::size_t> m_numSleeping = 0;  // Number of workers waiting for m_epoch to change
+   std::atomic<bool> m_stopping = false;        // Workers exit once there are no jobs left
+
+   Metrics::Counter& m_stolenCounter;  // Number of jobs taken from other workers
+};
+
+// Calls the function for every index from 0 to count - 1 on the executor of the current thread,
+// see Executor::ParallelFor(). Threads which are not workers call the function for the indices one by one.
+void ParallelFor(std::size_t count, const std::function<void(std::size_t index)>& body);
+
+}  // namespace geo
@@ -1,5 +1,6 @@
 #include "GeoUtils.h"
 
+#include <algorithm>
 #include <cmath>
 
 // From https://stackoverflow.com/a/74798098
@@ -8,6 +9,8 @@
 namespace
 {
 
+using namespace geo;
+
 // Minimum valid latitude value (-90 degrees)
 const double sc_minLatitude = -90;
 // Maximum valid latitude value (90 degrees)
@@ -48,6 +51,41 @@ double wgs84EarthRadius(double lat_radians)
    return std::sqrt((An * An + Bn * Bn) / (Ad * Ad + Bd * Bd));
 }
 
+// Range of grid cells covering a bounding box, bounds are inclusive
+struct GridCells
+{
+   std::int64_t firstRow;
+   std::int64_t lastRow;
+   std::int64_t firstColumn;
+   std::int64_t lastColumn;
+};
+
+// Returns grid cells covering the bounding box
+GridCells getGridCells(const BoundingBox& bbox, double tileSizeDegrees)
+{
+   // Integer cell indices keep tile borders exactly equal for neighbouring boxes.
+   const auto firstRow = static_cast<std::int64_t>(std::floor(bbox[0] / tileSizeDegrees));
+   const auto lastRow = std::max(firstRow, static_cast<std::int64_t>(std::ceil(bbox[2] / tileSizeDegrees)) - 1);
+   const auto firstColumn = static_cast<std::int64_t>(std::floor(bbox[1] / tileSizeDegrees));
+   const auto lastColumn =
+      std::max(firstColumn, static_cast<std::int64_t>(std::ceil(bbox[3] / tileSizeDegrees)) - 1);
+   return {firstRow, lastRow, firstColumn, lastColumn};
+}
+
+// Checks whether the grid cell overlaps valid coordinates
+bool isValidGridCell(std::int64_t row, std::int64_t column, double tileSizeDegrees)
+{
+   return row * tileSizeDegrees < sc_maxLatitude && (row + 1) * tileSizeDegrees > sc_minLatitude &&
+          column * tileSizeDegrees < sc_maxLongitude && (column + 1) * tileSizeDegrees > sc_minLongitude;
+}
+
+// Returns the tile of the grid cell, clipped to valid coordinates
+BoundingBox createGridTile(std::int64_t row, std::int64_t column, double tileSizeDegrees)
+{
+   return {std::max(row * tileSizeDegrees, sc_minLatitude), std::max(column * tileSizeDegrees, sc_minLongitude),
+      std::min((row + 1) * tileSizeDegrees, sc_maxLatitude), std::min((column + 1) * tileSizeDegrees, sc_maxLongitude)};
+}
+
 }  // namespace
 
 namespace geo
@@ -111,6 +149,76 @@ std::vector<BoundingBox> CreateBoundingBoxes(
    return v;
 }
 
+std::vector<BoundingBox> CreateGridTiles(const BoundingBox& bbox, double tileSizeDegrees)
+{
+   const GridCells cells = getGridCells(bbox, tileSizeDegrees);
+
+   std::vector<BoundingBox> v;
+   for (auto row = cells.firstRow; row <= cells.lastRow; ++row)
+   {
+      for (auto column = cells.firstColumn; column <= cells.lastColumn; ++column)
+         v.push_back(createGridTile(row, column, tileSizeDegrees));
+   }
+   return v;
+}
+
+std::vector<BoundingBox> CreateGridTiles(const BoundingBox& bbox)
+{
+   return CreateGridTiles(bbox, ChooseGridTileSize(bbox));
+}
+
+std::vector<BoundingBox> CreateClippedGridTiles(const BoundingBox& bbox, double maxTileSizeDegrees)
+{
+   std::vector<BoundingBox> v = CreateGridTiles(bbox, ChooseGridTileSize(bbox, maxTileSizeDegrees));
+   for (auto& tile : v)
+   {
+      tile[0] = std::max(tile[0], bbox[0]);
+      tile[1] = std::max(tile[1], bbox[1]);
+      tile[2] = std::min(tile[2], bbox[2]);
+      tile[3] = std::min(tile[3], bbox[3]);
+   }
+   return v;
+}
+
+double ChooseGridTileSize(const BoundingBox& bbox, double maxTileSizeDegrees)
+{
+   const double halfSide = std::max(bbox[2] - bbox[0], bbox[3] - bbox[1]) / 2;
+   const double largestTileSize = std::min(maxTileSizeDegrees, sc_maxTileSizeDegrees);
+
+   double tileSizeDegrees = sc_minTileSizeDegrees;
+   while (tileSizeDegrees < halfSide && tileSizeDegrees < largestTileSize)
+      tileSizeDegrees *= 2;
+   return tileSizeDegrees;
+}
+
+double GetMaxGridTileSize(double maxWidthDegrees, double maxHeightDegrees)
+{
+   const double maxSide = std::min(maxWidthDegrees, maxHeightDegrees);
+
+   double tileSizeDegrees = sc_minTileSizeDegrees;
+   while (tileSizeDegrees * 2 <= maxSide && tileSizeDegrees < sc_maxTileSizeDegrees)
+      tileSizeDegrees *= 2;
+   return tileSizeDegrees;
+}
+
+std::vector<BoundingBox> CreateGridRing(const BoundingBox& bbox, double tileSizeDegrees)
+{
+   const GridCells cells = getGridCells(bbox, tileSizeDegrees);
+
+   std::vector<BoundingBox> v;
+   for (auto row = cells.firstRow - 1; row <= cells.lastRow + 1; ++row)
+   {
+      for (auto column = cells.firstColumn - 1; column <= cells.lastColumn + 1; ++column)
+      {
+         const bool inside = row >= cells.firstRow && row <= cells.lastRow && column >= cells.firstColumn &&
+                             column <= cells.lastColumn;
+         if (!inside && isValidGridCell(row, column, tileSizeDegrees))
+            v.push_back(createGridTile(row, column, tileSizeDegrees));
+      }
+   }
+   return v;
+}
+
 std::pair<double, double> GetBoundingBoxDimensionsKm(const BoundingBox& bbox)
 {
    // Convert degrees to radians
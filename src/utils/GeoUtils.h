@@ -20,6 +20,10 @@ bool IsValidLongitude(double lon);
 // Type alias for a bounding box represented as [minLat, minLon, maxLat, maxLon]
 using BoundingBox = std::array<double, 4>;
 
+// Limits of the tile size chosen by CreateGridTiles()
+inline constexpr double sc_minTileSizeDegrees = 0.25;
+inline constexpr double sc_maxTileSizeDegrees = 8;
+
 // Creates a bounding box around a given point with a specified range in meters
 // @param latitude Center point latitude in degrees
 // @param longitude Center point longitude in degrees
@@ -37,6 +41,49 @@ BoundingBox CreateBoundingBox(double latitude, double longitude, std::uint32_t r
 std::vector<BoundingBox> CreateBoundingBoxes(
    double latitude, double longitude, std::uint32_t rangeMeters, std::uint32_t maxBoxWidth, std::uint32_t maxBoxHeight);
 
+// Splits a bounding box into tiles of a regular grid aligned to multiples of the tile size.
+// Equal grid cells always produce equal tiles, so tiles can be used as cache keys.
+// @param bbox Bounding box [minLat, minLon, maxLat, maxLon]
+// @param tileSizeDegrees Width and height of each tile in degrees
+// @return Vector of tiles covering the bounding box
+std::vector<BoundingBox> CreateGridTiles(const BoundingBox& bbox, double tileSizeDegrees);
+
+// Splits a bounding box into tiles of a regular grid, choosing the tile size automatically.
+// Tile size is the smallest power of two degrees (within [sc_minTileSizeDegrees, sc_maxTileSizeDegrees]) which is
+// not less than half of the longest box side, so small boxes are covered by a few small tiles.
+// @param bbox Bounding box [minLat, minLon, maxLat, maxLon]
+// @return Vector of tiles covering the bounding box
+std::vector<BoundingBox> CreateGridTiles(const BoundingBox& bbox);
+
+// Splits a bounding box into tiles like CreateGridTiles(const BoundingBox&), then clips the tiles which cross edges
+// of the box to the box, so that nothing beyond the box is searched.
+// Only the tiles inside the box stay aligned to the grid.
+// @param bbox Bounding box [minLat, minLon, maxLat, maxLon]
+// @param maxTileSizeDegrees Largest tile size, see GetMaxGridTileSize()
+// @return Vector of tiles covering exactly the bounding box
+std::vector<BoundingBox> CreateClippedGridTiles(
+   const BoundingBox& bbox, double maxTileSizeDegrees = sc_maxTileSizeDegrees);
+
+// Chooses the tile size for CreateGridTiles(const BoundingBox&)
+// @param bbox Bounding box [minLat, minLon, maxLat, maxLon]
+// @param maxTileSizeDegrees Largest tile size, see GetMaxGridTileSize()
+// @return Tile size in degrees
+double ChooseGridTileSize(const BoundingBox& bbox, double maxTileSizeDegrees = sc_maxTileSizeDegrees);
+
+// Returns the largest tile size of the grid which fits into the given width and height, within
+// [sc_minTileSizeDegrees, sc_maxTileSizeDegrees]
+// @param maxWidthDegrees Maximum width of a tile in degrees longitude
+// @param maxHeightDegrees Maximum height of a tile in degrees latitude
+// @return Tile size in degrees
+double GetMaxGridTileSize(double maxWidthDegrees, double maxHeightDegrees);
+
+// Returns tiles of a regular grid which surround the tiles covering a bounding box, i.e. the tiles a request
+// for a slightly shifted box would need next. Tiles beyond valid coordinates are skipped.
+// @param bbox Bounding box [minLat, minLon, maxLat, maxLon]
+// @param tileSizeDegrees Width and height of each tile in degrees, see CreateGridTiles()
+// @return Vector of tiles around the bounding box
+std::vector<BoundingBox> CreateGridRing(const BoundingBox& bbox, double tileSizeDegrees);
+
 // Calculates the width and height of a bounding box in kilometers
 // @param bbox Bounding box with min/max latitudes and longitudes in degrees
 // @return Pair<double, double> containing width (longitude distance) and height (latitude distance) in kilometers
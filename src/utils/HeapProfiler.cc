@@ -0,0 +1,447 @@
+#include "HeapProfiler.h"
+
+#include <absl/log/log.h>
+#include <execinfo.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <utility>
+
+namespace
+{
+
+using namespace geo;
+
+// Live sampled allocations are counted in these slots by hashes of their addresses, so that deletions of other
+// allocations, which are the vast majority, are told apart without taking the lock. Counters are changed under
+// the lock of the profiler, so a slot stops matching once all its sampled allocations are deleted. A counter which
+// has reached its maximum is no longer changed, as the number of its allocations is unknown.
+constexpr std::size_t sc_filterSlots = 1 << 16;
+constexpr std::uint8_t sc_filterSaturated = std::numeric_limits<std::uint8_t>::max();  // Counter which is not changed
+
+constinit std::atomic<bool> s_enabled = false;                                              // Allocations are sampled
+constinit std::atomic<std::size_t> s_samplePeriod = HeapProfiler::sc_defaultSamplePeriod;  // Bytes between samples
+constinit std::array<std::atomic<std::uint8_t>, sc_filterSlots> s_sampledFilter{};         // See sc_filterSlots
+
+thread_local bool s_inProfiler = false;            // The thread runs the profiler, its allocations are not sampled
+thread_local std::int64_t s_bytesUntilSample = 0;  // Bytes the thread allocates before its next sample
+thread_local std::uint64_t s_randomState = 0;      // State of the generator of sample intervals, 0 until seeded
+
+// Marks the thread as running the profiler, so that allocations made by the profiler itself are neither sampled
+// nor looked up on deletion, which would take the lock the profiler already holds
+class ProfilerScope
+{
+public:
+   ProfilerScope()
+      : m_wasInProfiler(std::exchange(s_inProfiler, true))
+   {
+   }
+
+   ~ProfilerScope() { s_inProfiler = m_wasInProfiler; }
+
+   ProfilerScope(const ProfilerScope&) = delete;
+   ProfilerScope& operator=(const ProfilerScope&) = delete;
+
+private:
+   const bool m_wasInProfiler;  // Whether the thread has already been running the profiler
+};
+
+// Returns the filter slot of the address
+std::atomic<std::uint8_t>& getFilterSlot(const void* pointer)
+{
+   std::uint64_t hash = reinterpret_cast<std::uintptr_t>(pointer);
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdull;
+   hash ^= hash >> 33;
+   return s_sampledFilter[hash % sc_filterSlots];
+}
+
+// Counts a sampled allocation in the filter. Must be called under the lock of the profiler.
+void addToFilter(const void* pointer)
+{
+   auto& slot = getFilterSlot(pointer);
+   if (const std::uint8_t count = slot.load(std::memory_order_relaxed); count != sc_filterSaturated)
+      slot.store(count + 1, std::memory_order_relaxed);
+}
+
+// Uncounts a sampled allocation which is forgotten. Must be called under the lock of the profiler.
+void removeFromFilter(const void* pointer)
+{
+   auto& slot = getFilterSlot(pointer);
+   if (const std::uint8_t count = slot.load(std::memory_order_relaxed); count != sc_filterSaturated && count != 0)
+      slot.store(count - 1, std::memory_order_relaxed);
+}
+
+// Forgets all the sampled allocations. Must be called under the lock of the profiler.
+void clearFilter()
+{
+   for (auto& slot : s_sampledFilter)
+      slot.store(0, std::memory_order_relaxed);
+}
+
+// Returns the number of bytes the thread allocates before the next sample. Intervals are exponentially distributed,
+// so that sampling is a Poisson process over allocated bytes, which pprof expects when it unsamples the numbers.
+std::int64_t getNextSampleInterval()
+{
+   if (s_randomState == 0)
+      s_randomState = reinterpret_cast<std::uintptr_t>(&s_randomState) | 1;
+
+   // xorshift64* generator, see "An experimental exploration of Marsaglia's xorshift generators" (Vigna, 2016)
+   s_randomState ^= s_randomState >> 12;
+   s_randomState ^= s_randomState << 25;
+   s_randomState ^= s_randomState >> 27;
+   const std::uint64_t random = s_randomState * 0x2545f4914f6cdd1dull;
+
+   const double uniform = static_cast<double>((random >> 11) + 1) * 0x1.0p-53;  // In (0, 1]
+   return static_cast<std::int64_t>(-std::log(uniform) * static_cast<double>(s_samplePeriod.load())) + 1;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+// Called by the replaced operator new and delete
+struct HeapProfilerHooks
+{
+   // Samples the allocation if the thread has allocated enough bytes since its previous sample
+   // @param caller Return address of operator new, where the recorded call stack starts
+   static void OnAllocate(void* pointer, std::size_t size, void* caller)
+   {
+      if (!s_enabled.load(std::memory_order_relaxed) || s_inProfiler)
+         return;
+
+      s_bytesUntilSample -= static_cast<std::int64_t>(size);
+      if (s_bytesUntilSample <= 0)
+         sample(pointer, size, caller);
+   }
+
+   // Forgets the allocation if it is sampled
+   static void OnDeallocate(void* pointer)
+   {
+      if (!pointer || !s_enabled.load(std::memory_order_relaxed) || s_inProfiler)
+         return;
+
+      if (getFilterSlot(pointer).load(std::memory_order_relaxed) == 0)
+         return;
+
+      const ProfilerScope scope;
+      HeapProfiler::Instance().recordDeallocation(pointer);
+   }
+
+   [[gnu::noinline]] static void sample(void* pointer, std::size_t size, void* caller)
+   {
+      const ProfilerScope scope;
+      s_bytesUntilSample = getNextSampleInterval();
+
+      // Frames of the profiler and of operator new are skipped, the stack starts at the caller of operator new.
+      // The whole stack is kept if the caller is not found among the frames.
+      void* frames[HeapProfiler::sc_maxStackDepth + 4];
+      const std::span<void* const> stack(frames, std::max(backtrace(frames, std::size(frames)), 0));
+      const auto callerFrame = std::ranges::find(stack, caller);
+      HeapProfiler::Instance().recordAllocation(pointer, size,
+         callerFrame != stack.end() ? stack.subspan(callerFrame - stack.begin()) : stack);
+   }
+};
+
+std::size_t HeapProfiler::StackHash::operator()(const Stack& stack) const
+{
+   std::size_t hash = stack.size();
+   for (const void* frame : stack)
+      hash = hash * 31 + std::hash<const void*>{}(frame);
+   return hash;
+}
+
+HeapProfiler& HeapProfiler::Instance()
+{
+   // The profiler is never destroyed, as allocations are hooked until the process exits.
+   static HeapProfiler* const instance = new HeapProfiler();
+   return *instance;
+}
+
+void HeapProfiler::Start(std::size_t samplePeriodBytes)
+{
+   const ProfilerScope scope;
+
+   // backtrace() loads the unwinder on first use, which allocates, so it is called before any sample is taken.
+   void* frame = nullptr;
+   backtrace(&frame, 1);
+
+   std::lock_guard lock(m_mutex);
+   m_sites.clear();
+   m_live.clear();
+   clearFilter();
+
+   s_samplePeriod = samplePeriodBytes != 0 ? samplePeriodBytes : sc_defaultSamplePeriod;
+   s_enabled = true;
+   LOG(INFO) << std::format("Heap profiling is started, sample period is {} bytes", s_samplePeriod.load());
+}
+
+void HeapProfiler::Stop()
+{
+   const ProfilerScope scope;
+   s_enabled = false;
+
+   std::lock_guard lock(m_mutex);
+   m_sites.clear();
+   m_live.clear();
+   clearFilter();
+   LOG(INFO) << "Heap profiling is stopped";
+}
+
+bool HeapProfiler::IsEnabled() const
+{
+   return s_enabled;
+}
+
+std::size_t HeapProfiler::GetSamplePeriod() const
+{
+   return s_samplePeriod;
+}
+
+std::string HeapProfiler::FormatProfile()
+{
+   const ProfilerScope scope;
+   std::string profile;
+   {
+      std::lock_guard lock(m_mutex);
+      Site total;
+      for (const auto& [stack, site] : m_sites)
+      {
+         total.liveObjects += site.liveObjects;
+         total.liveBytes += site.liveBytes;
+         total.allocatedObjects += site.allocatedObjects;
+         total.allocatedBytes += site.allocatedBytes;
+      }
+
+      auto out = std::back_inserter(profile);
+      std::format_to(out, "heap profile: {:6}: {:8} [{:6}: {:8}] @ heap_v2/{}\n", total.liveObjects, total.liveBytes,
+         total.allocatedObjects, total.allocatedBytes, s_samplePeriod.load());
+      for (const auto& [stack, site] : m_sites)
+      {
+         std::format_to(out, "{:6}: {:8} [{:6}: {:8}] @", site.liveObjects, site.liveBytes, site.allocatedObjects,
+            site.allocatedBytes);
+         for (const void* frame : stack)
+            std::format_to(out, " {}", frame);
+         profile += '\n';
+      }
+   }
+
+   // The memory map is read without the lock, as reading may take a while.
+   std::stringstream maps;
+   maps << std::ifstream("/proc/self/maps").rdbuf();
+   profile += "\nMAPPED_LIBRARIES:\n";
+   profile += maps.str();
+   return profile;
+}
+
+void HeapProfiler::recordAllocation(void* pointer, std::size_t size, std::span<void* const> stack)
+{
+   Stack key(stack.begin(), std::min(stack.end(), stack.begin() + sc_maxStackDepth));
+
+   std::lock_guard lock(m_mutex);
+   if (!s_enabled)
+      return;
+
+   // The address may belong to a sampled allocation whose deletion was not seen, e.g. one deleted by the profiler.
+   if (const auto it = m_live.find(pointer); it != m_live.end())
+      removeLive(it);
+
+   Site& site = m_sites[std::move(key)];
+   ++site.allocatedObjects;
+   site.allocatedBytes += size;
+   ++site.liveObjects;
+   site.liveBytes += size;
+   m_live.emplace(pointer, LiveAllocation{&site, size});
+   addToFilter(pointer);
+}
+
+void HeapProfiler::recordDeallocation(void* pointer)
+{
+   std::lock_guard lock(m_mutex);
+   if (const auto it = m_live.find(pointer); it != m_live.end())
+      removeLive(it);
+}
+
+void HeapProfiler::removeLive(std::unordered_map<void*, LiveAllocation>::iterator it)
+{
+   --it->second.site->liveObjects;
+   it->second.site->liveBytes -= it->second.size;
+   removeFromFilter(it->first);
+   m_live.erase(it);
+}
+
+}  // namespace geo
+
+namespace
+{
+
+// Allocates memory for operator new, calling the new handler until the memory is allocated
+// @param alignment Alignment of the memory, 0 for the alignment of malloc()
+// @param caller Return address of operator new
+// @return nullptr if the memory cannot be allocated and there is no new handler
+void* allocate(std::size_t size, std::size_t alignment, void* caller)
+{
+   size = std::max<std::size_t>(size, 1);
+   for (;;)
+   {
+      // The size passed to aligned_alloc() must be a multiple of the alignment.
+      void* const pointer = alignment == 0
+         ? std::malloc(size)
+         : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+      if (pointer)
+      {
+         HeapProfilerHooks::OnAllocate(pointer, size, caller);
+         return pointer;
+      }
+
+      const std::new_handler handler = std::get_new_handler();
+      if (!handler)
+         return nullptr;
+      handler();
+   }
+}
+
+// Allocates memory for throwing versions of operator new
+void* allocateOrThrow(std::size_t size, std::size_t alignment, void* caller)
+{
+   if (void* const pointer = allocate(size, alignment, caller))
+      return pointer;
+   throw std::bad_alloc();
+}
+
+// Allocates memory for nothrow versions of operator new
+void* allocateOrNull(std::size_t size, std::size_t alignment, void* caller) noexcept
+{
+   try
+   {
+      return allocate(size, alignment, caller);
+   }
+   catch (...)
+   {
+      return nullptr;
+   }
+}
+
+// Frees memory for operator delete
+void deallocate(void* pointer) noexcept
+{
+   HeapProfilerHooks::OnDeallocate(pointer);
+   std::free(pointer);
+}
+
+}  // namespace
+
+// Replacements of the global allocation functions, see HeapProfiler.
+// Memory is taken from malloc(), like the default functions of libstdc++ do.
+
+void* operator new(std::size_t size)
+{
+   return allocateOrThrow(size, 0, __builtin_return_address(0));
+}
+
+void* operator new[](std::size_t size)
+{
+   return allocateOrThrow(size, 0, __builtin_return_address(0));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+   return allocateOrThrow(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+   return allocateOrThrow(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+   return allocateOrNull(size, 0, __builtin_return_address(0));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+   return allocateOrNull(size, 0, __builtin_return_address(0));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+   return allocateOrNull(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+   return allocateOrNull(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete(void* pointer) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+   deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+   deallocate(pointer);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace geo
+{
+
+// HeapProfiler samples heap allocations to attribute memory of the process to the code which allocated it,
+// e.g. JSON documents, protobuf messages or cache entries.
+// The global operator new and delete are replaced in HeapProfiler.cc. While profiling is stopped they only check
+// a flag. Once it is started, an allocation is sampled each time the allocating thread has allocated the sample
+// period of bytes on average, with exponentially distributed intervals, so that allocations of every size have
+// a chance proportional to their size. The call stack of a sampled allocation is recorded, and the allocation
+// is tracked until it is deleted.
+// Profiles are formatted in the legacy heap profile format of pprof, which unsamples the numbers.
+// The class is thread-safe.
+class HeapProfiler
+{
+public:
+   static constexpr std::size_t sc_defaultSamplePeriod = 512 * 1024;  // Bytes between samples on average
+
+   // Returns the process-wide profiler
+   static HeapProfiler& Instance();
+
+   // Starts sampling allocations, samples of previous profiling are dropped
+   // @param samplePeriodBytes Average number of allocated bytes between samples, 0 for sc_defaultSamplePeriod
+   void Start(std::size_t samplePeriodBytes = sc_defaultSamplePeriod);
+
+   // Stops sampling allocations and drops the samples
+   void Stop();
+
+   // Checks whether allocations are sampled
+   bool IsEnabled() const;
+
+   // Returns the average number of allocated bytes between samples
+   std::size_t GetSamplePeriod() const;
+
+   // Formats sampled allocations by call stack: live ones and all the ones made since profiling was started,
+   // followed by the memory map of the process, which pprof needs to symbolize the stacks
+   std::string FormatProfile();
+
+private:
+   friend struct HeapProfilerHooks;
+
+   static constexpr std::size_t sc_maxStackDepth = 32;
+
+   using Stack = std::vector<void*>;
+
+   struct StackHash
+   {
+      std::size_t operator()(const Stack& stack) const;
+   };
+
+   // Sampled allocations made by the same call stack
+   struct Site
+   {
+      std::uint64_t allocatedObjects = 0;  // Number of sampled allocations since profiling was started
+      std::uint64_t allocatedBytes = 0;    // Bytes of the sampled allocations
+      std::uint64_t liveObjects = 0;       // Number of sampled allocations which are not deleted yet
+      std::uint64_t liveBytes = 0;         // Bytes of the live allocations
+   };
+
+   // Sampled allocation which is not deleted yet
+   struct LiveAllocation
+   {
+      Site* site;        // Site of the allocation
+      std::size_t size;  // Bytes of the allocation
+   };
+
+   HeapProfiler() = default;
+
+   // Records a sampled allocation
+   // @param stack Return addresses of the allocating call stack, the innermost first
+   void recordAllocation(void* pointer, std::size_t size, std::span<void* const> stack);
+
+   // Forgets a sampled allocation which is deleted
+   void recordDeallocation(void* pointer);
+
+   // Forgets a live allocation. Must be called under the lock.
+   void removeLive(std::unordered_map<void*, LiveAllocation>::iterator it);
+
+private:
+   std::mutex m_mutex;                                  // Guards the members below
+   std::unordered_map<Stack, Site, StackHash> m_sites;  // Sampled allocations by call stack
+   std::unordered_map<void*, LiveAllocation> m_live;    // Live sampled allocations by address
+};
+
+}  // namespace geo
@@ -0,0 +1,182 @@
+#include "HttpEventLoop.h"
+
+#include <absl/log/log.h>
+#include <curl/multi.h>
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+
+// The loop wakes up at least this often, even if no socket is ready. cURL also needs this to handle timeouts.
+constexpr int sc_pollTimeoutMs = 1000;
+
+}  // namespace
+
+namespace geo
+{
+
+HttpEventLoop::HttpEventLoop()
+   : m_multi(curl_multi_init(), curl_multi_cleanup)
+   , m_runningGauge(Metrics::Instance().RegisterGauge("geo_http_running_transfers",
+        [this]
+        {
+           return static_cast<double>(m_numRunning.load());
+        }))
+{
+   if (!m_multi)
+      throw std::runtime_error("Cannot create cURL multi instance");
+
+   m_thread = std::jthread(
+      [this](std::stop_token stopToken)
+      {
+         run(std::move(stopToken));
+      });
+}
+
+HttpEventLoop::~HttpEventLoop()
+{
+   m_thread.request_stop();
+   m_thread.join();
+
+   // Nobody waits for the transfers any more, but coroutines awaiting them must be resumed to free their frames.
+   {
+      std::lock_guard lock(m_mutex);
+      m_stopped = true;
+      for (const auto& transfer : m_transfers)
+         m_aborted.push_back(transfer.second.id);
+      for (const auto& transfer : m_started)
+         m_aborted.push_back(transfer.id);
+   }
+   takeCommands();
+}
+
+HttpEventLoop::TransferId HttpEventLoop::Start(CurlPtr curl, CompletionFunction complete, ProgressFunction progress)
+{
+   std::unique_lock lock(m_mutex);
+   const TransferId id = m_nextId++;
+   if (m_stopped)
+   {
+      lock.unlock();
+      complete(CURLE_ABORTED_BY_CALLBACK);
+      return id;
+   }
+
+   m_started.push_back({id, std::move(curl), std::move(complete), std::move(progress)});
+   lock.unlock();
+   curl_multi_wakeup(m_multi.get());
+   return id;
+}
+
+void HttpEventLoop::Abort(TransferId id)
+{
+   {
+      std::lock_guard lock(m_mutex);
+      m_aborted.push_back(id);
+   }
+   curl_multi_wakeup(m_multi.get());
+}
+
+void HttpEventLoop::run(std::stop_token stopToken)
+{
+   const std::stop_callback wakeUp(stopToken,
+      [this]
+      {
+         curl_multi_wakeup(m_multi.get());
+      });
+
+   while (!stopToken.stop_requested())
+   {
+      takeCommands();
+
+      int numRunning = 0;
+      if (const CURLMcode code = curl_multi_perform(m_multi.get(), &numRunning); code != CURLM_OK)
+         LOG(ERROR) << std::format("cURL multi error: {}", curl_multi_strerror(code));
+
+      reportProgress();
+      finishTransfers();
+      curl_multi_poll(m_multi.get(), nullptr, 0, sc_pollTimeoutMs, nullptr);
+   }
+}
+
+void HttpEventLoop::takeCommands()
+{
+   std::vector<Transfer> started;
+   std::vector<TransferId> aborted;
+   {
+      std::lock_guard lock(m_mutex);
+      started.swap(m_started);
+      aborted.swap(m_aborted);
+   }
+
+   for (auto& transfer : started)
+   {
+      CURL* const curl = transfer.curl.get();
+      if (const CURLMcode code = curl_multi_add_handle(m_multi.get(), curl); code != CURLM_OK)
+      {
+         LOG(ERROR) << std::format("Cannot start HTTP transfer: {}", curl_multi_strerror(code));
+         transfer.complete(CURLE_FAILED_INIT);
+         continue;
+      }
+      m_transfers.emplace(curl, std::move(transfer));
+   }
+   m_numRunning = m_transfers.size();
+
+   // Transfers are few, and aborts are rare, so they are found by a linear search.
+   for (const TransferId id : aborted)
+   {
+      const auto it = std::ranges::find_if(m_transfers,
+         [id](const auto& transfer)
+         {
+            return transfer.second.id == id;
+         });
+      if (it != m_transfers.end())
+         finish(it->first, CURLE_ABORTED_BY_CALLBACK);
+   }
+}
+
+void HttpEventLoop::reportProgress()
+{
+   // Progress functions only start and abort transfers through commands, so the map is not changed meanwhile.
+   for (auto& [curl, transfer] : m_transfers)
+   {
+      if (!transfer.progress)
+         continue;
+
+      curl_off_t numReceived = 0;
+      if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &numReceived) == CURLE_OK &&
+          numReceived > transfer.numReceived)
+      {
+         transfer.numReceived = numReceived;
+         transfer.progress();
+      }
+   }
+}
+
+void HttpEventLoop::finishTransfers()
+{
+   int numQueued = 0;
+   while (const CURLMsg* message = curl_multi_info_read(m_multi.get(), &numQueued))
+   {
+      if (message->msg == CURLMSG_DONE)
+         finish(message->easy_handle, message->data.result);
+   }
+}
+
+void HttpEventLoop::finish(CURL* curl, CURLcode result)
+{
+   const auto node = m_transfers.extract(curl);
+   if (node.empty())
+      return;
+
+   curl_multi_remove_handle(m_multi.get(), curl);
+   m_numRunning = m_transfers.size();
+
+   // The completion function may start new transfers, so it is called once the transfer is forgotten.
+   node.mapped().complete(result);
+}
+
+}  // namespace geo
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace geo
+{
+
+// HttpEventLoop runs HTTP transfers of many requests on a single thread using the cURL multi interface,
+// so that requests waiting for upstreams do not take a thread each.
+// Transfers are started from any thread. Completion functions are called on the loop thread, where they usually
+// resume coroutines awaiting the transfers, so they must not block.
+// The class is thread-safe.
+class HttpEventLoop
+{
+public:
+   using CurlPtr = std::shared_ptr<CURL>;  // Configured CURL handle of a transfer
+
+   // Called on the loop thread when the transfer is finished
+   // @param result CURLE_OK on success, CURLE_ABORTED_BY_CALLBACK if the transfer has been aborted
+   using CompletionFunction = std::function<void(CURLcode result)>;
+
+   // Called on the loop thread when the transfer has received more data. Unlike cURL callbacks,
+   // it is called between transfers, so it may start and abort transfers and resume coroutines.
+   using ProgressFunction = std::function<void()>;
+
+   // Identifies a started transfer, see Abort()
+   using TransferId = std::uint64_t;
+
+   HttpEventLoop();
+
+   // Stops the loop thread. Unfinished transfers are aborted, and their completion functions are called.
+   ~HttpEventLoop();
+
+   HttpEventLoop(const HttpEventLoop&) = delete;
+   HttpEventLoop& operator=(const HttpEventLoop&) = delete;
+
+   // Starts a transfer. The handle and the buffers it refers to must be kept until the transfer is finished.
+   // The completion function may be called before the function returns.
+   // @param curl Configured CURL handle
+   // @param complete Function to call when the transfer is finished
+   // @param progress Function to call when data is received, it is called for all the data before completion
+   // @return Id of the transfer
+   TransferId Start(CurlPtr curl, CompletionFunction complete, ProgressFunction progress = {});
+
+   // Aborts the transfer, unless it has already finished. The completion function is called anyway.
+   void Abort(TransferId id);
+
+private:
+   struct Transfer
+   {
+      TransferId id = 0;            // Id of the transfer
+      CurlPtr curl;                 // Handle of the transfer
+      CompletionFunction complete;  // Function to call when the transfer is finished
+      ProgressFunction progress;    // Function to call when data is received, may be empty
+      curl_off_t numReceived = 0;   // Number of bytes received when the progress function was called last
+   };
+
+   // Runs transfers until stop is requested
+   void run(std::stop_token stopToken);
+
+   // Adds started transfers to the multi handle and removes aborted ones. Called by the loop thread.
+   void takeCommands();
+
+   // Calls progress functions of transfers which have received data. Called by the loop thread.
+   void reportProgress();
+
+   // Removes finished transfers from the multi handle and calls their completion functions.
+   // Called by the loop thread.
+   void finishTransfers();
+
+   // Removes the transfer from the multi handle and calls its completion function. Called by the loop thread.
+   void finish(CURL* curl, CURLcode result);
+
+private:
+   std::unique_ptr<CURLM, CURLMcode (*)(CURLM*)> m_multi;  // Multi handle running the transfers
+
+   std::mutex m_mutex;                 // Guards the members below
+   std::vector<Transfer> m_started;    // Transfers started since the last loop iteration
+   std::vector<TransferId> m_aborted;  // Transfers aborted since the last loop iteration
+   TransferId m_nextId = 0;            // Id of the next started transfer
+   bool m_stopped = false;             // The loop is stopped, new transfers are aborted right away
+
+   std::unordered_map<CURL*, Transfer> m_transfers;  // Running transfers, used only by the loop thread
+   std::atomic<std::size_t> m_numRunning = 0;        // Number of running transfers, read by the gauge
+
+   Metrics::Gauge m_runningGauge;  // Exports the number of running transfers
+   std::jthread m_thread;          // Loop thread, destroyed first so that it stops before other members are destroyed
+};
+
+}  // namespace geo
@@ -0,0 +1,75 @@
+#include "JsonDocument.h"
+
+#include "RequestContext.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+
+// Smallest buffer of values, texts of single elements are often shorter than the values they make
+constexpr std::size_t sc_minValueBufferSize = 1024;
+
+// Initial capacity of the parser stack, it grows with the number of elements of the largest array
+constexpr std::size_t sc_stackCapacity = 1024;
+
+// Returns the size of the buffer of values of a text, values which do not fit go to chunks of the same size
+constexpr std::size_t getValueBufferSize(std::size_t textSize)
+{
+   return std::max(textSize, sc_minValueBufferSize);
+}
+
+// Returns the resource the memory of a document of the given size is taken from
+std::pmr::memory_resource& selectResource(std::size_t textSize, std::pmr::memory_resource* resource)
+{
+   if (textSize > geo::json::ArenaDocument::sc_maxArenaTextSize)
+      return *std::pmr::new_delete_resource();
+   return resource ? *resource : *geo::RequestContext::Current().memoryResource;
+}
+
+}  // namespace
+
+namespace geo::json
+{
+
+namespace detail
+{
+
+void* StackAllocator::Malloc(std::size_t size)
+{
+   return size != 0 ? m_resource->allocate(size) : nullptr;
+}
+
+void* StackAllocator::Realloc(void* originalPtr, std::size_t originalSize, std::size_t newSize)
+{
+   if (newSize == 0)
+      return nullptr;
+   if (originalPtr && newSize <= originalSize)
+      return originalPtr;
+
+   void* memory = m_resource->allocate(newSize);
+   if (originalPtr)
+      std::memcpy(memory, originalPtr, originalSize);
+   return memory;
+}
+
+ArenaDocumentMemory::ArenaDocumentMemory(std::size_t textSize, std::pmr::memory_resource& upstream)
+   : resource(getValueBufferSize(textSize) + sc_stackCapacity, &upstream)
+   , valueAllocator(resource.allocate(getValueBufferSize(textSize), alignof(std::max_align_t)),
+        getValueBufferSize(textSize), getValueBufferSize(textSize), &chunkAllocator)
+   , stackAllocator(resource)
+{
+}
+
+}  // namespace detail
+
+ArenaDocument::ArenaDocument(std::string_view text, std::pmr::memory_resource* resource)
+   : ArenaDocumentMemory(text.size(), selectResource(text.size(), resource))
+   , GenericDocument(&valueAllocator, sc_stackCapacity, &stackAllocator)
+{
+   Parse(text.data(), text.size());
+}
+
+}  // namespace geo::json
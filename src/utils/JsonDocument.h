@@ -0,0 +1,73 @@
+#pragma once
+
+#include <rapidjson/document.h>
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+
+namespace geo::json
+{
+
+namespace detail
+{
+
+// Allocator of the rapidjson parser stack on a memory resource. Memory is released with the resource,
+// since rapidjson frees the stack with a static function which cannot reach the resource.
+class StackAllocator
+{
+public:
+   static constexpr bool kNeedFree = false;
+
+   StackAllocator() = default;
+
+   explicit StackAllocator(std::pmr::memory_resource& resource)
+      : m_resource(&resource)
+   {
+   }
+
+   void* Malloc(std::size_t size);
+   void* Realloc(void* originalPtr, std::size_t originalSize, std::size_t newSize);
+   static void Free(void*) {}
+
+private:
+   std::pmr::memory_resource* m_resource = std::pmr::null_memory_resource();  // Serves the stack
+};
+
+// Memory of an ArenaDocument, constructed before the document and destroyed after it
+struct ArenaDocumentMemory
+{
+   // @param textSize Size of the parsed text, the first block of the resource is as large
+   ArenaDocumentMemory(std::size_t textSize, std::pmr::memory_resource& upstream);
+
+   std::pmr::monotonic_buffer_resource resource;     // Takes blocks from the memory resource of the RPC
+   rapidjson::CrtAllocator chunkAllocator;           // Allocates chunks of values which do not fit into the buffer
+   rapidjson::MemoryPoolAllocator<> valueAllocator;  // Allocates values in a buffer of the resource
+   StackAllocator stackAllocator;                    // Allocates the parser stack from the resource
+};
+
+}  // namespace detail
+
+// ArenaDocument is a JSON document whose values and parser stack are allocated from the memory resource of
+// the current RPC, see RequestContext::memoryResource, so that parsing upstream responses does not call the heap
+// allocator. Values take about as many bytes as the text, so a buffer of that size is taken at once.
+// Texts over sc_maxArenaTextSize take their memory from the heap instead, in a few large blocks, so that large
+// responses do not stay in the arena until the RPC ends.
+// Values are rapidjson::Value, so the helpers of JsonUtils.h accept the document and its values.
+// The document must not outlive the RPC.
+class ArenaDocument
+   : private detail::ArenaDocumentMemory
+   , public rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>, detail::StackAllocator>
+{
+public:
+   static constexpr std::size_t sc_maxArenaTextSize = 256 * 1024;  // Larger texts are parsed on the heap
+
+   // Parses the text, see rapidjson::GenericDocument::HasParseError() for errors
+   // @param resource Memory resource of the values, by default the one of the current RPC
+   explicit ArenaDocument(std::string_view text, std::pmr::memory_resource* resource = nullptr);
+
+   ArenaDocument(const ArenaDocument&) = delete;
+   ArenaDocument& operator=(const ArenaDocument&) = delete;
+};
+
+}  // namespace geo::json
@@ -14,8 +14,8 @@ namespace geo::json
 template <typename TJsonValue>
 const rapidjson::Value& Get(const TJsonValue& v)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Get function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, TJsonValue>,
+      "Get function only supports rapidjson::Value and documents of its values");
    return v;
 }
 
@@ -27,8 +27,8 @@ template <typename TJsonValue, typename T, typename... TArgs,
    typename = typename std::enable_if<std::is_same_v<T, const char*>>::type>
 const rapidjson::Value& Get(const TJsonValue& v, T t, TArgs... args)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Get function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, TJsonValue>,
+      "Get function only supports rapidjson::Value and documents of its values");
    return Get(v[t], args...);
 }
 
@@ -36,8 +36,8 @@ const rapidjson::Value& Get(const TJsonValue& v, T t, TArgs... args)
 template <typename TJsonValue>
 bool Has(const TJsonValue& v)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Has function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, TJsonValue>,
+      "Has function only supports rapidjson::Value and documents of its values");
    return !v.IsNull();
 }
 
@@ -48,8 +48,8 @@ template <typename TJsonValue, typename T, typename... TArgs,
    typename = typename std::enable_if<std::is_same_v<T, const char*>>::type>
 bool Has(const TJsonValue& v, T t, TArgs... args)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Has function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, TJsonValue>,
+      "Has function only supports rapidjson::Value and documents of its values");
    if (!v.IsObject() || !v.HasMember(t))
       return false;
    return Has(v[t], args...);
@@ -61,8 +61,8 @@ bool Has(const TJsonValue& v, T t, TArgs... args)
 template <typename JsonValue>
 std::string_view GetString(const JsonValue& v)
 {
-   static_assert(std::is_same_v<JsonValue, rapidjson::Value> || std::is_same_v<JsonValue, rapidjson::Document>,
-      "GetString function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, JsonValue>,
+      "GetString function only supports rapidjson::Value and documents of its values");
    return v.IsNull() ? "" : v.GetString();
 }
 
@@ -72,8 +72,8 @@ std::string_view GetString(const JsonValue& v)
 template <typename JsonValue>
 double GetDouble(const JsonValue& v)
 {
-   static_assert(std::is_same_v<JsonValue, rapidjson::Value> || std::is_same_v<JsonValue, rapidjson::Document>,
-      "GetDouble function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, JsonValue>,
+      "GetDouble function only supports rapidjson::Value and documents of its values");
    return v.IsNull() ? 0 : v.GetDouble();
 }
 
@@ -83,8 +83,8 @@ double GetDouble(const JsonValue& v)
 template <typename JsonValue>
 std::int64_t GetInt64(const JsonValue& v)
 {
-   static_assert(std::is_same_v<JsonValue, rapidjson::Value> || std::is_same_v<JsonValue, rapidjson::Document>,
-      "GetInt64 function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(std::is_base_of_v<rapidjson::Value, JsonValue>,
+      "GetInt64 function only supports rapidjson::Value and documents of its values");
    return v.IsNull() ? 0 : v.GetInt64();
 }
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace geo
+{
+
+// EstimateMemoryUsage() returns the number of bytes taken by an object together with its heap allocations.
+// Types which own heap memory define an overload in their namespace, so that caches can account their entries.
+
+// Returns the size of an object which does not own heap memory
+template <typename T>
+   requires std::is_trivially_copyable_v<T>
+std::size_t EstimateMemoryUsage(const T& value)
+{
+   return sizeof(value);
+}
+
+// Returns the size of a string, including the heap buffer unless the string is stored inline
+inline std::size_t EstimateMemoryUsage(const std::string& value)
+{
+   const auto* object = reinterpret_cast<const char*>(&value);
+   const bool isInline = value.data() >= object && value.data() < object + sizeof(value);
+   return sizeof(value) + (isInline ? 0 : value.capacity() + 1);
+}
+
+// Returns the size of a vector, including the heap buffer and heap allocations of elements
+template <typename T>
+std::size_t EstimateMemoryUsage(const std::vector<T>& value)
+{
+   std::size_t result = sizeof(value) + (value.capacity() - value.size()) * sizeof(T);
+   if constexpr (std::is_trivially_copyable_v<T>)
+   {
+      result += value.size() * sizeof(T);
+   }
+   else
+   {
+      for (const auto& element : value)
+         result += EstimateMemoryUsage(element);
+   }
+   return result;
+}
+
+// Returns the number of bytes taken by an entry of a cache made of a list of entries and a hash map index.
+// The key is stored both in the list and in the index, and nodes of the list and the index take about
+// six pointers for links, the cached hash and the bucket.
+template <typename TKey, typename TValue>
+std::size_t EstimateCacheEntryMemoryUsage(const TKey& key, const TValue& value)
+{
+   return 2 * EstimateMemoryUsage(key) + EstimateMemoryUsage(value) + 6 * sizeof(void*);
+}
+
+}  // namespace geo
@@ -0,0 +1,43 @@
+#include "MessageArena.h"
+
+#include "RequestContext.h"
+
+namespace
+{
+
+// Alignment of blocks of protobuf arenas
+constexpr std::size_t sc_blockAlignment = alignof(std::max_align_t);
+
+// Returns options of an arena which starts with the given block
+google::protobuf::ArenaOptions makeOptions(char* initialBlock)
+{
+   google::protobuf::ArenaOptions options;
+   options.initial_block = initialBlock;
+   options.initial_block_size = geo::MessageArena::sc_initialBlockSize;
+   options.start_block_size = geo::MessageArena::sc_initialBlockSize;
+   options.max_block_size = geo::MessageArena::sc_maxBlockSize;
+   return options;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+MessageArena::InitialBlock::InitialBlock()
+   : resource(RequestContext::Current().memoryResource)
+   , memory(static_cast<char*>(resource->allocate(sc_initialBlockSize, sc_blockAlignment)))
+{
+}
+
+MessageArena::InitialBlock::~InitialBlock()
+{
+   resource->deallocate(memory, sc_initialBlockSize, sc_blockAlignment);
+}
+
+MessageArena::MessageArena()
+   : m_arena(makeOptions(m_initialBlock.memory))
+{
+}
+
+}  // namespace geo
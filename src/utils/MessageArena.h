@@ -0,0 +1,50 @@
+#pragma once
+
+#include <google/protobuf/arena.h>
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace geo
+{
+
+// MessageArena is a protobuf arena for messages of an RPC, such as its parsed request. The first block of the arena
+// is taken from the memory resource of the RPC, see RequestContext::memoryResource, so that messages of usual sizes
+// are built without calling the heap allocator. Larger messages get further blocks from the heap, which grow up to
+// sc_maxBlockSize, so that they take a few allocations rather than a few per field. Characters of strings longer
+// than the inline buffer of std::string are still allocated on the heap by protobuf.
+// The arena must not outlive the RPC.
+class MessageArena
+{
+public:
+   static constexpr std::size_t sc_initialBlockSize = 4 * 1024;  // Bytes taken from the memory resource of the RPC
+   static constexpr std::size_t sc_maxBlockSize = 1024 * 1024;   // Largest block taken from the heap
+
+   MessageArena();
+
+   MessageArena(const MessageArena&) = delete;
+   MessageArena& operator=(const MessageArena&) = delete;
+
+   // Creates a message owned by the arena, it is destroyed with the arena
+   template <typename TMessage>
+   TMessage& Create()
+   {
+      return *google::protobuf::Arena::Create<TMessage>(&m_arena);
+   }
+
+private:
+   // First block of the arena, taken from the memory resource of the current RPC
+   struct InitialBlock
+   {
+      InitialBlock();
+      ~InitialBlock();
+
+      std::pmr::memory_resource* resource;  // Memory resource the block is returned to
+      char* memory;                         // Memory of the block
+   };
+
+   InitialBlock m_initialBlock;      // Constructed before the arena and released after it
+   google::protobuf::Arena m_arena;  // Owns the messages
+};
+
+}  // namespace geo
@@ -0,0 +1,76 @@
+#include "Metrics.h"
+
+#include <format>
+#include <utility>
+
+namespace geo
+{
+
+Metrics::Gauge::Gauge(std::string name)
+   : m_name(std::move(name))
+{
+}
+
+Metrics::Gauge::Gauge(Gauge&& other) noexcept
+   : m_name(std::exchange(other.m_name, {}))
+{
+}
+
+Metrics::Gauge& Metrics::Gauge::operator=(Gauge&& other) noexcept
+{
+   if (this != &other)
+   {
+      if (!m_name.empty())
+         Metrics::Instance().unregisterGauge(m_name);
+      m_name = std::exchange(other.m_name, {});
+   }
+   return *this;
+}
+
+Metrics::Gauge::~Gauge()
+{
+   if (!m_name.empty())
+      Metrics::Instance().unregisterGauge(m_name);
+}
+
+Metrics& Metrics::Instance()
+{
+   static Metrics instance;
+   return instance;
+}
+
+Metrics::Counter& Metrics::GetCounter(const std::string& name)
+{
+   std::lock_guard lock(m_mutex);
+   auto& counter = m_counters[name];
+   if (!counter)
+      counter = std::make_unique<Counter>(0);
+   return *counter;
+}
+
+Metrics::Gauge Metrics::RegisterGauge(const std::string& name, GaugeFunction function)
+{
+   std::lock_guard lock(m_mutex);
+   m_gauges[name] = std::move(function);
+   return Gauge(name);
+}
+
+std::string Metrics::Format() const
+{
+   std::lock_guard lock(m_mutex);
+
+   std::string result;
+   for (const auto& [name, counter] : m_counters)
+      result += std::format("{} {}\n", name, counter->load(std::memory_order_relaxed));
+   for (const auto& [name, function] : m_gauges)
+      result += std::format("{} {}\n", name, function());
+   return result;
+}
+
+void Metrics::unregisterGauge(const std::string& name)
+{
+   std::lock_guard lock(m_mutex);
+   m_gauges.erase(name);
+}
+
+}  // namespace geo
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace geo
+{
+
+// Metrics is a process-wide registry of named counters and gauges.
+// Names may contain Prometheus labels, e.g. geo_upstream_requests_total{upstream="overpass"}.
+// The class is thread-safe.
+class Metrics
+{
+public:
+   using Counter = std::atomic<std::int64_t>;
+   using GaugeFunction = std::function<double()>;
+
+   // RAII handle of a registered gauge. The gauge is removed from the registry when the handle is destroyed.
+   class Gauge
+   {
+   public:
+      Gauge() = default;
+      Gauge(Gauge&& other) noexcept;
+      Gauge& operator=(Gauge&& other) noexcept;
+      ~Gauge();
+
+   private:
+      friend class Metrics;
+      explicit Gauge(std::string name);
+
+      std::string m_name;  // Name of the registered gauge, empty if nothing is registered
+   };
+
+   // Returns the process-wide registry
+   static Metrics& Instance();
+
+   // Returns a counter with the given name, creating it on first use.
+   // The reference stays valid for the lifetime of the process.
+   Counter& GetCounter(const std::string& name);
+
+   // Registers a gauge whose value is calculated when metrics are collected.
+   // @param name Name of the gauge
+   // @param function Function returning the current value, called under the registry lock
+   // @return Handle which unregisters the gauge on destruction
+   [[nodiscard]] Gauge RegisterGauge(const std::string& name, GaugeFunction function);
+
+   // Formats all the metrics in Prometheus text exposition format
+   std::string Format() const;
+
+private:
+   Metrics() = default;
+
+   // Removes a gauge from the registry
+   void unregisterGauge(const std::string& name);
+
+private:
+   mutable std::mutex m_mutex;                                  // Guards all the members below
+   std::map<std::string, std::unique_ptr<Counter>> m_counters;  // Counters by name
+   std::map<std::string, GaugeFunction> m_gauges;               // Gauges by name
+};
+
+}  // namespace geo
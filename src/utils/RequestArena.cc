@@ -0,0 +1,118 @@
+#include "RequestArena.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+namespace
+{
+
+// Blocks up to this size are pooled, larger ones go to the heap
+constexpr std::size_t sc_largestPooledBlock = 1024 * 1024;
+
+// Offsets of allocations are multiples of this, so that objects of any fundamental type fit without padding
+constexpr std::size_t sc_alignment = alignof(std::max_align_t);
+
+// Rounds the number of bytes up to a multiple of the alignment
+constexpr std::size_t roundUp(std::size_t bytes, std::size_t alignment)
+{
+   return (bytes + alignment - 1) / alignment * alignment;
+}
+
+// Returns the pool shared by all the arenas, it keeps the blocks of finished RPCs for the next ones
+std::pmr::memory_resource& getSharedPool()
+{
+   static std::pmr::synchronized_pool_resource pool(std::pmr::pool_options{0, sc_largestPooledBlock});
+   return pool;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+RequestArena::RequestArena()
+   : m_allocationsCounter(Metrics::Instance().GetCounter("geo_request_arena_allocations_total"))
+   , m_upstreamAllocationsCounter(Metrics::Instance().GetCounter("geo_request_arena_upstream_allocations_total"))
+{
+}
+
+RequestArena::~RequestArena()
+{
+   m_allocationsCounter += m_numAllocations.load();
+   m_upstreamAllocationsCounter += m_numBlocks;
+
+   constexpr std::size_t sc_headerSize = roundUp(sizeof(Block), sc_alignment);
+   for (Block* block = m_current.load(); block;)
+   {
+      Block* const previous = block->previous;
+      const std::size_t size = block->size;
+      block->~Block();
+      getSharedPool().deallocate(block, sc_headerSize + size, sc_alignment);
+      block = previous;
+   }
+}
+
+std::size_t RequestArena::GetNumAllocations() const
+{
+   return m_numAllocations.load();
+}
+
+std::size_t RequestArena::GetNumUpstreamAllocations() const
+{
+   std::lock_guard lock(m_mutex);
+   return m_numBlocks;
+}
+
+void* RequestArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+   m_numAllocations.fetch_add(1, std::memory_order_relaxed);
+
+   // Over-aligned objects get room to be aligned within their allocation.
+   constexpr std::size_t sc_headerSize = roundUp(sizeof(Block), sc_alignment);
+   const std::size_t size = roundUp(alignment > sc_alignment ? bytes + alignment : bytes, sc_alignment);
+   for (;;)
+   {
+      // Threads take their parts of the current block by advancing the offset, so no two of them get the same part.
+      Block* const block = m_current.load(std::memory_order_acquire);
+      if (block)
+      {
+         const std::size_t offset = block->used.fetch_add(size, std::memory_order_relaxed);
+         if (offset + size <= block->size)
+         {
+            void* memory = reinterpret_cast<std::byte*>(block) + sc_headerSize + offset;
+            std::size_t space = size;
+            return alignment > sc_alignment ? std::align(alignment, bytes, memory, space) : memory;
+         }
+      }
+
+      // The block is used up. The thread which locks first adds the next block, the others retry with it.
+      std::lock_guard lock(m_mutex);
+      if (m_current.load(std::memory_order_relaxed) == block)
+         addBlock(size);
+   }
+}
+
+void RequestArena::do_deallocate(void*, std::size_t, std::size_t)
+{
+   // The memory is released with the arena.
+}
+
+bool RequestArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+   return this == &other;
+}
+
+void RequestArena::addBlock(std::size_t minSize)
+{
+   constexpr std::size_t sc_headerSize = roundUp(sizeof(Block), sc_alignment);
+   const std::size_t size = std::max(m_nextBlockSize, minSize);
+   void* const memory = getSharedPool().allocate(sc_headerSize + size, sc_alignment);
+   m_current.store(new (memory) Block{m_current.load(std::memory_order_relaxed), size}, std::memory_order_release);
+
+   // Blocks grow with the RPC, up to the largest size the pool keeps.
+   m_nextBlockSize = std::min(m_nextBlockSize * 2, sc_largestPooledBlock);
+   ++m_numBlocks;
+}
+
+}  // namespace geo
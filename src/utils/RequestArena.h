@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+
+namespace geo
+{
+
+// RequestArena is a monotonic memory resource for temporary objects of an RPC, such as coroutine frames
+// and intermediate id lists. Allocations bump a pointer, deallocations do nothing, and all the memory is released
+// at once when the arena is destroyed with the RPC.
+// Memory is taken in blocks of a pool shared by all the arenas, so that blocks of finished RPCs are reused rather
+// than returned to the heap. The first block is taken by the first allocation, so RPCs served from caches without
+// allocating anything cost nothing.
+// Coroutines of an RPC may run on several threads at once, so the class is thread-safe. Allocations from the current
+// block only bump an atomic offset, the lock is taken only to add the next block.
+class RequestArena final : public std::pmr::memory_resource
+{
+public:
+   static constexpr std::size_t sc_initialBlockSize = 4 * 1024;  // Bytes of the first block, next ones are larger
+
+   RequestArena();
+
+   // Releases all the memory, adds statistics of the arena to metrics
+   ~RequestArena() override;
+
+   RequestArena(const RequestArena&) = delete;
+   RequestArena& operator=(const RequestArena&) = delete;
+
+   // Returns the number of allocations served by the arena
+   std::size_t GetNumAllocations() const;
+
+   // Returns the number of blocks the arena has taken from the shared pool
+   std::size_t GetNumUpstreamAllocations() const;
+
+private:
+   // Block of memory taken from the shared pool, its memory follows the header
+   struct Block
+   {
+      Block* previous = nullptr;          // Block used before this one, released with it
+      std::size_t size = 0;               // Bytes of memory in the block, without the header
+      std::atomic<std::size_t> used = 0;  // Bytes handed out, may exceed the size once the block is used up
+   };
+
+   void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+   void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+   bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+   // Takes a block with at least the given number of bytes from the shared pool and makes it current
+   void addBlock(std::size_t minSize);
+
+private:
+   std::atomic<Block*> m_current = nullptr;        // Block allocations are served from, nullptr before the first one
+   std::atomic<std::size_t> m_numAllocations = 0;  // Number of served allocations
+
+   mutable std::mutex m_mutex;                         // Guards the members below, and adding blocks
+   std::size_t m_nextBlockSize = sc_initialBlockSize;  // Size of the next block, doubled with each block
+   std::size_t m_numBlocks = 0;                        // Number of blocks taken from the shared pool
+
+   Metrics::Counter& m_allocationsCounter;          // Number of allocations served by arenas
+   Metrics::Counter& m_upstreamAllocationsCounter;  // Number of blocks taken by arenas from the shared pool
+};
+
+}  // namespace geo
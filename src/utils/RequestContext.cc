@@ -0,0 +1,32 @@
+#include "RequestContext.h"
+
+namespace
+{
+
+using namespace geo;
+
+const RequestContext sc_defaultContext;
+thread_local const RequestContext* s_currentContext = nullptr;
+
+}  // namespace
+
+namespace geo
+{
+
+const RequestContext& RequestContext::Current()
+{
+   return s_currentContext ? *s_currentContext : sc_defaultContext;
+}
+
+ScopedRequestContext::ScopedRequestContext(const RequestContext& context)
+   : m_previous(s_currentContext)
+{
+   s_currentContext = &context;
+}
+
+ScopedRequestContext::~ScopedRequestContext()
+{
+   s_currentContext = m_previous;
+}
+
+}  // namespace geo
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory_resource>
+#include <stop_token>
+
+namespace geo
+{
+
+// UpstreamFailures counts upstream requests of an RPC which have failed. Failed requests give empty responses,
+// which look like empty results, so RPCs check the counters before answering and caching their results.
+struct UpstreamFailures
+{
+   std::atomic<int> numFailed = 0;    // Requests which have failed with network or HTTP errors
+   std::atomic<int> numTimedOut = 0;  // Requests which have been dropped or aborted because of the RPC deadline
+};
+
+// RequestContext holds per-RPC state which is needed deep inside the engine, such as the RPC deadline.
+// The context of the RPC being processed is available to any code running on the same thread
+// through RequestContext::Current(). Coroutines move between threads, so awaitables which suspend them
+// restore the context on resumption.
+struct RequestContext
+{
+   using Clock = std::chrono::steady_clock;
+
+   Clock::time_point deadline = Clock::time_point::max();  // Time after which results are no longer needed
+
+   // Marks speculative work (e.g. prefetching), which upstreams serve only with spare capacity
+   // and abort as soon as requests of RPCs have to wait for a slot
+   bool background = false;
+
+   // Requested once results are no longer needed, e.g. when prefetching is cancelled by a new search.
+   // Upstream requests made by coroutines are aborted then, see WebClient::GetAsync().
+   std::stop_token stopToken;
+
+   // Allocates temporary objects of the RPC, such as frames of its coroutines (see Task), which must not outlive it.
+   // RPCs use their RequestArena, so that the memory is released at once when they are done.
+   std::pmr::memory_resource* memoryResource = std::pmr::new_delete_resource();
+
+   // Receives failures of upstream requests made on behalf of the RPC, see WebClient. May be nullptr.
+   UpstreamFailures* upstreamFailures = nullptr;
+
+   // Returns the context of the RPC processed by the current thread, or a default context
+   static const RequestContext& Current();
+};
+
+// Makes the given context current for the lifetime of the object.
+class ScopedRequestContext
+{
+public:
+   explicit ScopedRequestContext(const RequestContext& context);
+   ~ScopedRequestContext();
+
+   ScopedRequestContext(const ScopedRequestContext&) = delete;
+   ScopedRequestContext& operator=(const ScopedRequestContext&) = delete;
+
+private:
+   const RequestContext* m_previous;  // Context which was current before this object was created
+};
+
+}  // namespace geo
@@ -0,0 +1,62 @@
+#include "StringInterner.h"
+
+#include "MemoryUsage.h"
+
+#include <mutex>
+
+namespace geo
+{
+
+StringInterner& StringInterner::Instance()
+{
+   static StringInterner instance;
+   return instance;
+}
+
+InternedString StringInterner::Intern(std::string_view text)
+{
+   if (text.empty())
+      return {};
+
+   {
+      std::shared_lock lock(m_mutex);
+      if (const auto it = m_index.find(text); it != m_index.end())
+         return InternedString(it->second);
+   }
+
+   std::unique_lock lock(m_mutex);
+   if (const auto it = m_index.find(text); it != m_index.end())
+      return InternedString(it->second);  // Interned by another thread between the locks
+
+   const auto id = static_cast<InternedString::Id>(m_entries.size() + 1);
+   const Entry& entry = m_entries.emplace_back(Entry{std::string(text), id});
+   m_index.emplace(entry.text, &entry);
+
+   // The index node holds the key, the value, a link and the cached hash.
+   m_memoryUsage += sizeof(entry) - sizeof(entry.text) + EstimateMemoryUsage(entry.text) +
+                    sizeof(decltype(m_index)::value_type) + 2 * sizeof(void*);
+   return InternedString(&entry);
+}
+
+InternedString StringInterner::Find(InternedString::Id id) const
+{
+   if (id == 0)
+      return {};
+
+   std::shared_lock lock(m_mutex);
+   return id <= m_entries.size() ? InternedString(&m_entries[id - 1]) : InternedString();
+}
+
+std::size_t StringInterner::Size() const
+{
+   std::shared_lock lock(m_mutex);
+   return m_entries.size();
+}
+
+std::size_t StringInterner::GetMemoryUsage() const
+{
+   std::shared_lock lock(m_mutex);
+   return m_memoryUsage + m_index.bucket_count() * sizeof(void*);
+}
+
+}  // namespace geo
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace geo
+{
+
+// Handle of a string stored in StringInterner.
+// Handles of equal strings point to the same storage, so they are compared by pointer.
+// A default constructed handle represents the empty string.
+class InternedString
+{
+public:
+   // Dense identifier of an interned string, 0 for the empty string. Compact records store it instead of a handle.
+   using Id = std::uint32_t;
+
+   InternedString() = default;
+
+   // Returns the string
+   std::string_view View() const { return m_entry ? std::string_view(m_entry->text) : std::string_view(); }
+
+   // Returns the identifier of the string, see StringInterner::Find()
+   Id GetId() const { return m_entry ? m_entry->id : 0; }
+
+   bool operator==(const InternedString& other) const { return m_entry == other.m_entry; }
+
+private:
+   friend class StringInterner;
+   friend struct std::hash<InternedString>;
+
+   struct Entry
+   {
+      std::string text;  // Interned string
+      Id id;             // Identifier of the string
+   };
+
+   explicit InternedString(const Entry* entry)
+      : m_entry(entry)
+   {
+   }
+
+   const Entry* m_entry = nullptr;  // Interned string, never freed
+};
+
+// StringInterner keeps a single copy of every distinct string passed to it, for the lifetime of the process.
+// It is meant for small vocabularies repeated across many cached objects, such as country names, address types
+// and tag keys. Unique strings (e.g. names of places) must not be interned, because nothing is ever removed.
+// The class is thread-safe. Lookups of already interned strings only take a shared lock.
+class StringInterner
+{
+public:
+   // Returns the process-wide interner
+   static StringInterner& Instance();
+
+   // Returns the handle of the string, storing the string if it is seen for the first time
+   InternedString Intern(std::string_view text);
+
+   // Returns the handle of the string with the given identifier
+   // @param id Identifier returned by InternedString::GetId()
+   InternedString Find(InternedString::Id id) const;
+
+   // Returns the number of interned strings
+   std::size_t Size() const;
+
+   // Returns the estimated number of bytes taken by interned strings and the index
+   std::size_t GetMemoryUsage() const;
+
+private:
+   using Entry = InternedString::Entry;
+
+   mutable std::shared_mutex m_mutex;                           // Guards all the members below
+   std::deque<Entry> m_entries;                                 // Interned strings by id - 1, deque never moves them
+   std::unordered_map<std::string_view, const Entry*> m_index;  // Interned strings by their content
+   std::size_t m_memoryUsage = 0;                               // Estimated bytes taken by entries and the index
+};
+
+}  // namespace geo
+
+template <>
+struct std::hash<geo::InternedString>
+{
+   std::size_t operator()(const geo::InternedString& s) const noexcept
+   {
+      return std::hash<const void*>{}(s.m_entry);
+   }
+};
@@ -0,0 +1,27 @@
+#include "TagDictionary.h"
+
+#include <utility>
+
+namespace geo
+{
+
+std::uint32_t TagDictionary::Add(std::string_view text)
+{
+   const auto [it, inserted] = m_indices.try_emplace(std::string(text), static_cast<std::uint32_t>(m_strings.size()));
+   if (inserted)
+      m_strings.emplace_back(text);
+   return it->second;
+}
+
+std::size_t TagDictionary::Size() const
+{
+   return m_strings.size();
+}
+
+std::vector<std::string> TagDictionary::Release()
+{
+   m_indices.clear();
+   return std::exchange(m_strings, {});
+}
+
+}  // namespace geo
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace geo
+{
+
+// TagDictionary collects distinct tag keys and values of a single response,
+// so that features can reference them by index instead of carrying their own copies.
+// The class is not thread-safe, a dictionary is built by a single RPC.
+class TagDictionary
+{
+public:
+   // Returns the index of the string, adding it to the dictionary if needed
+   std::uint32_t Add(std::string_view text);
+
+   // Returns the number of distinct strings
+   std::size_t Size() const;
+
+   // Moves the strings out of the dictionary in the order of their indices
+   std::vector<std::string> Release();
+
+private:
+   std::vector<std::string> m_strings;                        // Strings by index
+   std::unordered_map<std::string, std::uint32_t> m_indices;  // Indices by string
+};
+
+}  // namespace geo
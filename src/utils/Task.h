@@ -0,0 +1,387 @@
+#pragma once
+
+#include "RequestContext.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace geo
+{
+
+// Task is the result of a coroutine which produces a value of type T (void is not supported).
+// Tasks are lazy: the coroutine starts when the task is awaited, and the awaiting coroutine is resumed
+// on the thread which finishes the task. Exceptions thrown by the coroutine are rethrown to the awaiting one.
+// A task may be awaited only once.
+//
+// The thread which resumes a suspended coroutine does not run the RPC the coroutine works for, so awaitables which
+// suspend coroutines (e.g. WebClient requests) must resume them with the RequestContext captured on suspension.
+// Frames of coroutines are allocated from RequestContext::memoryResource, so tasks must finish before the RPC does.
+// Tasks which may outlive their RPC are started by StartEagerly(), which allocates their frames on the heap.
+template <typename T>
+class Task
+{
+public:
+   using ValueType = T;
+
+   class promise_type
+   {
+   public:
+      // Allocates the frame from the memory resource of the current RPC. The resource is stored after the frame,
+      // as the frame may be freed by another thread.
+      static void* operator new(std::size_t size)
+      {
+         std::pmr::memory_resource* resource = RequestContext::Current().memoryResource;
+         void* frame = resource->allocate(size + sizeof(resource), alignof(std::max_align_t));
+         std::memcpy(static_cast<std::byte*>(frame) + size, &resource, sizeof(resource));
+         return frame;
+      }
+
+      static void operator delete(void* frame, std::size_t size)
+      {
+         std::pmr::memory_resource* resource = nullptr;
+         std::memcpy(&resource, static_cast<const std::byte*>(frame) + size, sizeof(resource));
+         resource->deallocate(frame, size + sizeof(resource), alignof(std::max_align_t));
+      }
+
+      Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+
+      // Resumes the awaiting coroutine without growing the stack
+      auto final_suspend() noexcept
+      {
+         struct FinalAwaiter
+         {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+               return handle.promise().m_continuation;
+            }
+
+            void await_resume() noexcept {}
+         };
+         return FinalAwaiter{};
+      }
+
+      template <typename TValue>
+      void return_value(TValue&& value)
+      {
+         m_value.emplace(std::forward<TValue>(value));
+      }
+
+      void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+
+   private:
+      friend class Task;
+
+      std::coroutine_handle<> m_continuation = std::noop_coroutine();  // Coroutine awaiting the task
+      std::optional<T> m_value;                                        // Result of the task
+      std::exception_ptr m_exception;                                  // Exception thrown by the task
+   };
+
+   Task(Task&& other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr))
+   {
+   }
+
+   Task& operator=(Task&& other) noexcept
+   {
+      if (this != &other)
+      {
+         if (m_handle)
+            m_handle.destroy();
+         m_handle = std::exchange(other.m_handle, nullptr);
+      }
+      return *this;
+   }
+
+   ~Task()
+   {
+      if (m_handle)
+         m_handle.destroy();
+   }
+
+   // Starts the task and suspends the awaiting coroutine until the task is finished
+   // @return Result of the task
+   auto operator co_await() noexcept
+   {
+      struct Awaiter
+      {
+         std::coroutine_handle<promise_type> handle;
+
+         bool await_ready() noexcept { return false; }
+
+         std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+         {
+            handle.promise().m_continuation = continuation;
+            return handle;
+         }
+
+         T await_resume() { return TakeResult(handle); }
+      };
+      return Awaiter{m_handle};
+   }
+
+   // Starts the task and suspends the awaiting coroutine until the task is finished, the result is not taken,
+   // see TakeResult(). Used to wait for tasks outside of coroutines, see SyncWait() and WhenAll().
+   auto WhenReady() noexcept
+   {
+      struct Awaiter
+      {
+         std::coroutine_handle<promise_type> handle;
+
+         bool await_ready() noexcept { return false; }
+
+         std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+         {
+            handle.promise().m_continuation = continuation;
+            return handle;
+         }
+
+         void await_resume() noexcept {}
+      };
+      return Awaiter{m_handle};
+   }
+
+   // Returns the result of a finished task, or rethrows the exception of the task
+   T TakeResult() { return TakeResult(m_handle); }
+
+private:
+   explicit Task(std::coroutine_handle<promise_type> handle)
+      : m_handle(handle)
+   {
+   }
+
+   static T TakeResult(std::coroutine_handle<promise_type> handle)
+   {
+      auto& promise = handle.promise();
+      if (promise.m_exception)
+         std::rethrow_exception(promise.m_exception);
+      return std::move(*promise.m_value);
+   }
+
+private:
+   std::coroutine_handle<promise_type> m_handle;  // Coroutine of the task, nullptr if moved out
+};
+
+namespace detail
+{
+
+// Coroutine which starts right away and destroys itself when finished. Used to await tasks from regular code.
+struct DetachedCoroutine
+{
+   struct promise_type
+   {
+      DetachedCoroutine get_return_object() noexcept { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { std::terminate(); }
+   };
+};
+
+// State of SyncWait(), the waiting thread sleeps until the task is done
+struct SyncWaitState
+{
+   std::mutex mutex;
+   std::condition_variable condition;
+   bool done = false;
+};
+
+// Waits for the task and wakes the thread blocked in SyncWait() up
+template <typename T>
+DetachedCoroutine signalWhenReady(Task<T>& task, SyncWaitState& state)
+{
+   co_await task.WhenReady();
+
+   // The waiting thread destroys the state once it sees the flag, so the state is not touched after unlocking.
+   std::lock_guard lock(state.mutex);
+   state.done = true;
+   state.condition.notify_one();
+}
+
+// State of WhenAll(), the last finished task resumes the awaiting coroutine
+struct WhenAllState
+{
+   std::atomic<std::size_t> remaining;    // Number of unfinished tasks, plus one until all the tasks are started
+   std::coroutine_handle<> continuation;  // Coroutine awaiting the tasks
+};
+
+// Waits for the task and resumes the coroutine awaiting all the tasks if this task is the last one
+template <typename T>
+DetachedCoroutine countWhenReady(Task<T>& task, WhenAllState& state)
+{
+   co_await task.WhenReady();
+   if (state.remaining.fetch_sub(1) == 1)
+      state.continuation.resume();
+}
+
+// State of StartEagerly(), shared by the started task and the task awaiting its result
+template <typename T>
+struct EagerState
+{
+   explicit EagerState(RequestContext context)
+      : context(std::move(context))
+   {
+   }
+
+   RequestContext context;                // Context the task runs with, see StartEagerly()
+   std::optional<Task<T>> task;           // Started task
+   std::atomic<bool> ready = false;       // Set by whichever of the task and the awaiting coroutine comes second
+   std::coroutine_handle<> continuation;  // Coroutine awaiting the result
+   RequestContext continuationContext;    // Context of the coroutine awaiting the result, restored on resumption
+};
+
+// Runs the task and resumes the coroutine awaiting its result if the coroutine is already suspended
+template <typename T>
+DetachedCoroutine runEagerly(std::shared_ptr<EagerState<T>> state)
+{
+   co_await state->task->WhenReady();
+   if (state->ready.exchange(true))
+   {
+      const ScopedRequestContext scopedContext(state->continuationContext);
+      state->continuation.resume();
+   }
+}
+
+// Waits for the result of a task started by runEagerly()
+template <typename T>
+Task<T> awaitEagerly(std::shared_ptr<EagerState<T>> state)
+{
+   struct Awaiter
+   {
+      EagerState<T>& state;
+
+      bool await_ready() noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<> continuation) noexcept
+      {
+         state.continuation = continuation;
+         state.continuationContext = RequestContext::Current();
+         return !state.ready.exchange(true);
+      }
+
+      void await_resume() noexcept {}
+   };
+
+   co_await Awaiter{*state};
+   co_return state->task->TakeResult();
+}
+
+// Waits for the task and passes its result to the function. The task is destroyed first, so the function may
+// release the memory the frames of the task are allocated from.
+template <typename T, typename TFunction>
+DetachedCoroutine runDetached(Task<T> task, TFunction onDone)
+{
+   co_await task.WhenReady();
+   T result = [](Task<T> finished)
+   {
+      return finished.TakeResult();
+   }(std::move(task));
+   onDone(std::move(result));
+}
+
+}  // namespace detail
+
+// Starts the task without blocking the calling thread, and calls the function with its result on the thread which
+// finishes the task. Used to finish RPCs from coroutines, e.g. onDone may finish the RPC and free its RequestArena,
+// as the task is destroyed before the function is called. An exception thrown by the task terminates the process.
+// @param onDone Function with signature void(T)
+template <typename T, typename TFunction>
+void StartDetached(Task<T> task, TFunction onDone)
+{
+   detail::runDetached(std::move(task), std::move(onDone));
+}
+
+// Starts a task right away, instead of when it is awaited, so that it runs while the caller does something else.
+// The task runs until its first suspension before the function returns.
+// The started task may outlive the caller and its RPC, so it runs with a copy of the current RequestContext, which
+// allocates frames on the heap rather than from the memory of the RPC, and does not report upstream failures.
+// @param createTask Function with signature Task<T>(), called with the copy of the context
+// @return Task which gives the result of the started task. If it is destroyed without being awaited,
+//         the started task still runs to the end.
+template <typename TFunction>
+auto StartEagerly(TFunction createTask)
+{
+   using T = typename std::invoke_result_t<TFunction&>::ValueType;
+
+   RequestContext context = RequestContext::Current();
+   context.memoryResource = std::pmr::new_delete_resource();
+   context.upstreamFailures = nullptr;
+   auto state = std::make_shared<detail::EagerState<T>>(std::move(context));
+   {
+      const ScopedRequestContext scopedContext(state->context);
+      state->task.emplace(createTask());
+      detail::runEagerly(state);
+   }
+   return detail::awaitEagerly(std::move(state));
+}
+
+// Runs the task and blocks the calling thread until the task is finished.
+// Must not be called by threads which resume coroutines (e.g. the HttpEventLoop thread), as they would wait
+// for themselves.
+// @return Result of the task
+template <typename T>
+T SyncWait(Task<T> task)
+{
+   detail::SyncWaitState state;
+   detail::signalWhenReady(task, state);
+
+   std::unique_lock lock(state.mutex);
+   state.condition.wait(lock,
+      [&state]
+      {
+         return state.done;
+      });
+   return task.TakeResult();
+}
+
+// Runs the tasks concurrently: each task runs until its first suspension before the next one is started,
+// so requests to upstreams made by the tasks are in flight at the same time.
+// @return Results of the tasks in the order of the tasks
+template <typename T>
+Task<std::vector<T>> WhenAll(std::vector<Task<T>> tasks)
+{
+   struct Awaiter
+   {
+      std::vector<Task<T>>& tasks;
+      detail::WhenAllState state;
+
+      bool await_ready() noexcept { return tasks.empty(); }
+
+      bool await_suspend(std::coroutine_handle<> continuation)
+      {
+         state.continuation = continuation;
+         state.remaining = tasks.size() + 1;
+         for (auto& task : tasks)
+            detail::countWhenReady(task, state);
+
+         // The tasks may have finished without suspension, then the awaiting coroutine just continues.
+         return state.remaining.fetch_sub(1) != 1;
+      }
+
+      void await_resume() noexcept {}
+   };
+
+   co_await Awaiter{tasks, {}};
+
+   std::vector<T> results;
+   results.reserve(tasks.size());
+   for (auto& task : tasks)
+      results.push_back(task.TakeResult());
+   co_return results;
+}
+
+}  // namespace geo
@@ -0,0 +1,332 @@
+#include "UpstreamDispatcher.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <format>
+#include <memory>
+
+namespace
+{
+
+using namespace geo;
+
+// Latency history is not used until it has this many samples.
+constexpr std::size_t sc_minLatencySamples = 8;
+
+// Work is considered hopeless if it cannot finish in time even when it is as fast as this share
+// of the fastest recent requests. A low quantile keeps the estimate conservative, so that work
+// which still has a chance is not dropped.
+constexpr double sc_latencyQuantile = 0.1;
+
+std::string formatMetricName(const char* name, const std::string& upstream)
+{
+   return std::format("geo_upstream_{}{{upstream=\"{}\"}}", name, upstream);
+}
+
+}  // namespace
+
+namespace geo
+{
+
+UpstreamDispatcher::Slot::Slot(UpstreamDispatcher& dispatcher, std::optional<std::uint64_t> queuedAtStart)
+   : m_dispatcher(&dispatcher)
+   , m_startedAt(Clock::now())
+   , m_queuedAtStart(queuedAtStart)
+{
+}
+
+UpstreamDispatcher::Slot::Slot(Slot&& other) noexcept
+   : m_dispatcher(std::exchange(other.m_dispatcher, nullptr))
+   , m_startedAt(other.m_startedAt)
+   , m_queuedAtStart(other.m_queuedAtStart)
+{
+}
+
+UpstreamDispatcher::Slot& UpstreamDispatcher::Slot::operator=(Slot&& other) noexcept
+{
+   if (this != &other)
+   {
+      if (m_dispatcher)
+         m_dispatcher->Release(Clock::now() - m_startedAt);
+      m_dispatcher = std::exchange(other.m_dispatcher, nullptr);
+      m_startedAt = other.m_startedAt;
+      m_queuedAtStart = other.m_queuedAtStart;
+   }
+   return *this;
+}
+
+UpstreamDispatcher::Slot::~Slot()
+{
+   if (m_dispatcher)
+      m_dispatcher->Release(Clock::now() - m_startedAt);
+}
+
+bool UpstreamDispatcher::Slot::IsPreempted() const
+{
+   return m_dispatcher && m_queuedAtStart &&
+          m_dispatcher->m_numQueued.load(std::memory_order_relaxed) != *m_queuedAtStart;
+}
+
+UpstreamDispatcher::UpstreamDispatcher(Settings settings)
+   : m_settings(std::move(settings))
+   , m_maxConcurrentRequests(m_settings.maxConcurrentRequests)
+   , m_latencies(sc_latencyHistorySize)
+   , m_admittedCounter(Metrics::Instance().GetCounter(formatMetricName("admitted_total", m_settings.name)))
+   , m_droppedHopelessCounter(
+        Metrics::Instance().GetCounter(formatMetricName("dropped_hopeless_total", m_settings.name)))
+   , m_droppedQueueFullCounter(
+        Metrics::Instance().GetCounter(formatMetricName("dropped_queue_full_total", m_settings.name)))
+   , m_backgroundAdmittedCounter(
+        Metrics::Instance().GetCounter(formatMetricName("background_admitted_total", m_settings.name)))
+   , m_backgroundRejectedCounter(
+        Metrics::Instance().GetCounter(formatMetricName("background_rejected_total", m_settings.name)))
+{
+   auto& metrics = Metrics::Instance();
+   m_gauges.push_back(metrics.RegisterGauge(formatMetricName("queue_length", m_settings.name),
+      [this]
+      {
+         std::lock_guard lock(m_mutex);
+         return static_cast<double>(m_queue.size());
+      }));
+   m_gauges.push_back(metrics.RegisterGauge(formatMetricName("running_requests", m_settings.name),
+      [this]
+      {
+         std::lock_guard lock(m_mutex);
+         return static_cast<double>(m_running);
+      }));
+   m_gauges.push_back(metrics.RegisterGauge(formatMetricName("latency_estimate_ms", m_settings.name),
+      [this]
+      {
+         return static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(EstimateLatency()).count());
+      }));
+}
+
+UpstreamDispatcher::Ticket UpstreamDispatcher::Submit(Clock::time_point deadline, StartFunction start)
+{
+   std::unique_lock lock(m_mutex);
+   const Ticket ticket = m_nextTicket++;
+
+   if (isHopeless(deadline, Clock::now()))
+   {
+      lock.unlock();
+      ++m_droppedHopelessCounter;
+      LOG(ERROR) << std::format("Request to {} is dropped, it cannot finish before the deadline", m_settings.name);
+      start(false);
+   }
+   else if (m_running < m_maxConcurrentRequests && m_queue.empty())
+   {
+      ++m_running;
+      lock.unlock();
+      ++m_admittedCounter;
+      start(true);
+   }
+   else if (m_queue.size() >= m_settings.maxQueueLength)
+   {
+      lock.unlock();
+      ++m_droppedQueueFullCounter;
+      LOG(ERROR) << std::format("Request to {} is dropped, the queue is full", m_settings.name);
+      start(false);
+   }
+   else
+   {
+      m_queue.emplace(QueueKey{deadline, ticket}, std::move(start));
+      m_deadlines.emplace(ticket, deadline);
+      m_numQueued.fetch_add(1, std::memory_order_relaxed);
+   }
+   return ticket;
+}
+
+bool UpstreamDispatcher::Cancel(Ticket ticket)
+{
+   std::lock_guard lock(m_mutex);
+   const auto it = m_deadlines.find(ticket);
+   if (it == m_deadlines.end())
+      return false;
+
+   m_queue.erase(QueueKey{it->second, ticket});
+   m_deadlines.erase(it);
+   return true;
+}
+
+void UpstreamDispatcher::Release(Clock::duration latency)
+{
+   std::vector<StartFunction> started;
+   std::vector<StartFunction> dropped;
+   {
+      std::lock_guard lock(m_mutex);
+      recordLatency(latency);
+      --m_running;
+      takeRunnable(started, dropped);
+   }
+
+   // Start functions are called without the lock, because they may submit new work.
+   m_droppedHopelessCounter += dropped.size();
+   m_admittedCounter += started.size();
+   for (auto& start : dropped)
+      start(false);
+   for (auto& start : started)
+      start(true);
+}
+
+std::optional<UpstreamDispatcher::Slot> UpstreamDispatcher::Acquire(Clock::time_point deadline)
+{
+   struct State
+   {
+      std::mutex mutex;
+      std::condition_variable condition;
+      std::optional<bool> admitted;
+   };
+
+   const auto state = std::make_shared<State>();
+   const Ticket ticket = Submit(deadline,
+      [state](bool admitted)
+      {
+         {
+            std::lock_guard lock(state->mutex);
+            state->admitted = admitted;
+         }
+         state->condition.notify_one();
+      });
+
+   std::unique_lock lock(state->mutex);
+   const auto isDone = [&state]
+   {
+      return state->admitted.has_value();
+   };
+
+   if (deadline == Clock::time_point::max())
+   {
+      state->condition.wait(lock, isDone);
+   }
+   else if (!state->condition.wait_until(lock, deadline, isDone))
+   {
+      // The deadline has passed while waiting in the queue.
+      lock.unlock();
+      if (Cancel(ticket))
+      {
+         ++m_droppedHopelessCounter;
+         LOG(ERROR) << std::format("Request to {} is dropped, the deadline passed in the queue", m_settings.name);
+         return std::nullopt;
+      }
+
+      // The work has been started or dropped concurrently with cancellation.
+      lock.lock();
+      state->condition.wait(lock, isDone);
+   }
+
+   if (!*state->admitted)
+      return std::nullopt;
+   return Slot(*this);
+}
+
+UpstreamDispatcher::Ticket UpstreamDispatcher::AcquireAsync(Clock::time_point deadline, SlotFunction onSlot)
+{
+   return Submit(deadline,
+      [this, onSlot = std::move(onSlot)](bool admitted)
+      {
+         onSlot(admitted ? std::optional<Slot>(Slot(*this)) : std::nullopt);
+      });
+}
+
+std::optional<UpstreamDispatcher::Slot> UpstreamDispatcher::TryAcquireSpare()
+{
+   std::unique_lock lock(m_mutex);
+   if (!hasSpareCapacity())
+   {
+      lock.unlock();
+      ++m_backgroundRejectedCounter;
+      return std::nullopt;
+   }
+
+   ++m_running;
+   const std::uint64_t numQueued = m_numQueued.load(std::memory_order_relaxed);
+   lock.unlock();
+   ++m_backgroundAdmittedCounter;
+   return Slot(*this, numQueued);
+}
+
+bool UpstreamDispatcher::HasSpareCapacity() const
+{
+   std::lock_guard lock(m_mutex);
+   return hasSpareCapacity();
+}
+
+UpstreamDispatcher::Clock::duration UpstreamDispatcher::EstimateLatency() const
+{
+   std::lock_guard lock(m_mutex);
+   return m_latencyEstimate;
+}
+
+void UpstreamDispatcher::SetMaxConcurrentRequests(std::size_t maxConcurrentRequests)
+{
+   std::vector<StartFunction> started;
+   std::vector<StartFunction> dropped;
+   {
+      std::lock_guard lock(m_mutex);
+      if (maxConcurrentRequests == m_maxConcurrentRequests)
+         return;
+
+      LOG(INFO) << std::format("Maximum number of concurrent requests to {} is changed from {} to {}", m_settings.name,
+         m_maxConcurrentRequests, maxConcurrentRequests);
+      m_maxConcurrentRequests = maxConcurrentRequests;
+      takeRunnable(started, dropped);
+   }
+
+   m_droppedHopelessCounter += dropped.size();
+   m_admittedCounter += started.size();
+   for (auto& start : dropped)
+      start(false);
+   for (auto& start : started)
+      start(true);
+}
+
+bool UpstreamDispatcher::isHopeless(Clock::time_point deadline, Clock::time_point now) const
+{
+   return deadline != Clock::time_point::max() && now + m_latencyEstimate > deadline;
+}
+
+void UpstreamDispatcher::takeRunnable(std::vector<StartFunction>& started, std::vector<StartFunction>& dropped)
+{
+   const auto now = Clock::now();
+   while (!m_queue.empty() && m_running < m_maxConcurrentRequests)
+   {
+      auto node = m_queue.extract(m_queue.begin());
+      const auto [deadline, ticket] = node.key();
+      m_deadlines.erase(ticket);
+
+      if (isHopeless(deadline, now))
+      {
+         dropped.push_back(std::move(node.mapped()));
+      }
+      else
+      {
+         ++m_running;
+         started.push_back(std::move(node.mapped()));
+      }
+   }
+}
+
+void UpstreamDispatcher::recordLatency(Clock::duration latency)
+{
+   m_latencies[m_latencyCount % m_latencies.size()] = latency;
+   ++m_latencyCount;
+
+   const std::size_t numSamples = std::min(m_latencyCount, m_latencies.size());
+   if (numSamples < sc_minLatencySamples)
+      return;
+
+   std::vector<Clock::duration> samples(m_latencies.begin(), m_latencies.begin() + numSamples);
+   const auto itQuantile = samples.begin() + static_cast<std::ptrdiff_t>(numSamples * sc_latencyQuantile);
+   std::nth_element(samples.begin(), itQuantile, samples.end());
+   m_latencyEstimate = *itQuantile;
+}
+
+// Background work must not delay requests of RPCs, so it gets neither queued work's slots nor the reserved ones
+bool UpstreamDispatcher::hasSpareCapacity() const
+{
+   return m_queue.empty() && m_running + sc_reservedSlots < m_maxConcurrentRequests;
+}
+
+}  // namespace geo
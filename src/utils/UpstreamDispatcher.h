@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace geo
+{
+
+// UpstreamDispatcher limits the number of concurrent requests to a single upstream (e.g. Overpass API).
+// Requests which exceed the limit are queued and started in the order of their deadlines (earliest deadline first).
+// Queued requests which cannot finish before their deadline, judging by the latency history of the upstream,
+// are dropped instead of wasting upstream capacity.
+// Background work (e.g. prefetching) uses only spare capacity: it never waits in the queue, never takes the slots
+// reserved for RPCs, and is expected to abort once an RPC request has to wait, see Slot::IsPreempted().
+// The class is thread-safe.
+class UpstreamDispatcher
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   struct Settings
+   {
+      std::string name;                       // Name of the upstream, used in logs and metrics
+      std::size_t maxConcurrentRequests = 4;  // Maximum number of requests running at the same time
+      std::size_t maxQueueLength = 1000;      // Maximum number of queued requests
+   };
+
+   // Called when queued work is either started (admitted = true) or dropped (admitted = false).
+   // Started work must call Release() when it is finished.
+   using StartFunction = std::function<void(bool admitted)>;
+
+   // Identifies queued work, see Cancel()
+   using Ticket = std::uint64_t;
+
+   class Slot;
+
+   // Called when a slot is taken for queued work, or with std::nullopt when the work is dropped
+   using SlotFunction = std::function<void(std::optional<Slot> slot)>;
+
+   // RAII handle of a running request, which releases the slot and records the latency on destruction.
+   class Slot
+   {
+   public:
+      Slot(Slot&& other) noexcept;
+      Slot& operator=(Slot&& other) noexcept;
+      ~Slot();
+
+      // Checks whether the slot is taken by background work and requests have been queued since then,
+      // so the work should be aborted to free the slot
+      bool IsPreempted() const;
+
+   private:
+      friend class UpstreamDispatcher;
+      explicit Slot(UpstreamDispatcher& dispatcher, std::optional<std::uint64_t> queuedAtStart = std::nullopt);
+
+      UpstreamDispatcher* m_dispatcher;              // Dispatcher the slot belongs to, nullptr if moved out
+      Clock::time_point m_startedAt;                 // When the request was started
+      std::optional<std::uint64_t> m_queuedAtStart;  // Number of ever queued requests when background work took
+                                                     // the slot, std::nullopt for requests of RPCs
+   };
+
+   explicit UpstreamDispatcher(Settings settings);
+
+   // Submits work. The start function is called either immediately or when a slot becomes free,
+   // on the thread which releases the slot.
+   // @param deadline Time after which the result of the work is no longer needed
+   // @param start Function to call when the work is started or dropped
+   // @return Ticket which can be used to cancel the work while it is queued
+   Ticket Submit(Clock::time_point deadline, StartFunction start);
+
+   // Removes queued work without calling its start function
+   // @return true if the work was still queued
+   bool Cancel(Ticket ticket);
+
+   // Releases a slot taken by started work and starts queued work if possible
+   // @param latency Time the work has been running, used to estimate latency of the upstream
+   void Release(Clock::duration latency);
+
+   // Blocks the calling thread until a slot is available
+   // @param deadline Time after which the result is no longer needed
+   // @return Slot if the request may be started, std::nullopt if it was dropped
+   std::optional<Slot> Acquire(Clock::time_point deadline);
+
+   // Takes a slot without blocking the calling thread. Unlike Acquire(), queued work is dropped after its deadline
+   // only when a slot is released, which happens soon anyway, as running requests time out by their deadlines.
+   // @param deadline Time after which the result is no longer needed
+   // @param onSlot Function called either immediately or on the thread which releases a slot
+   // @return Ticket which can be used to cancel the work while it is queued
+   Ticket AcquireAsync(Clock::time_point deadline, SlotFunction onSlot);
+
+   // Takes a slot for background work without waiting
+   // @return Slot if the upstream has spare capacity, std::nullopt otherwise
+   std::optional<Slot> TryAcquireSpare();
+
+   // Checks whether background work would get a slot now
+   bool HasSpareCapacity() const;
+
+   // Returns a latency which most requests to the upstream exceed
+   Clock::duration EstimateLatency() const;
+
+   // Changes the maximum number of concurrent requests. A higher limit starts queued work at once,
+   // with a lower one running requests are finished and new ones wait until the number of them falls below the limit.
+   void SetMaxConcurrentRequests(std::size_t maxConcurrentRequests);
+
+private:
+   // Queued work ordered by deadline, and by submission order for equal deadlines
+   using QueueKey = std::pair<Clock::time_point, Ticket>;
+
+   // Checks whether work cannot finish before the deadline
+   bool isHopeless(Clock::time_point deadline, Clock::time_point now) const;
+
+   // Removes queued work which can be started or must be dropped. Must be called under the lock.
+   // @param started Receives work to start
+   // @param dropped Receives work to drop
+   void takeRunnable(std::vector<StartFunction>& started, std::vector<StartFunction>& dropped);
+
+   // Records a latency sample. Must be called under the lock.
+   void recordLatency(Clock::duration latency);
+
+   // Checks whether background work may take a slot. Must be called under the lock.
+   bool hasSpareCapacity() const;
+
+private:
+   static constexpr std::size_t sc_latencyHistorySize = 64;
+   static constexpr std::size_t sc_reservedSlots = 1;  // Slots which background work never takes
+
+   const Settings m_settings;  // Dispatcher settings
+
+   mutable std::mutex m_mutex;                                 // Guards all the members below
+   std::map<QueueKey, StartFunction> m_queue;                  // Queued work, the earliest deadline first
+   std::unordered_map<Ticket, Clock::time_point> m_deadlines;  // Deadlines of queued work by ticket
+   std::size_t m_running = 0;                                  // Number of started but not released requests
+   std::size_t m_maxConcurrentRequests;                        // Maximum number of running requests
+   Ticket m_nextTicket = 0;                                    // Ticket of the next submitted work
+   std::vector<Clock::duration> m_latencies;                   // Ring buffer of recent latencies
+   std::size_t m_latencyCount = 0;                             // Total number of recorded latencies
+   Clock::duration m_latencyEstimate{};                        // Cached result of EstimateLatency()
+   std::atomic<std::uint64_t> m_numQueued = 0;                 // Number of ever queued requests, read by
+                                                               // Slot::IsPreempted() without the lock
+
+   Metrics::Counter& m_admittedCounter;            // Number of started requests
+   Metrics::Counter& m_droppedHopelessCounter;     // Number of requests dropped because they could not finish in time
+   Metrics::Counter& m_droppedQueueFullCounter;    // Number of requests dropped because the queue was full
+   Metrics::Counter& m_backgroundAdmittedCounter;  // Number of started background requests
+   Metrics::Counter& m_backgroundRejectedCounter;  // Number of background requests refused for lack of capacity
+   std::vector<Metrics::Gauge> m_gauges;           // Queue length, running requests and latency estimate
+};
+
+}  // namespace geo
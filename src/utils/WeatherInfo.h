@@ -2,6 +2,7 @@
 
 #include "TimeUtils.h"
 
+#include <cstddef>
 #include <vector>
 
 namespace geo
@@ -17,4 +18,13 @@ struct WeatherInfo
 
 using WeatherInfoVector = std::vector<WeatherInfo>;
 
+// Temperatures of a range of days aggregated together
+struct WeatherSummary
+{
+   std::size_t numDays = 0;         // Number of days, other members are meaningless if there are none
+   double temperatureMin{};         // Minimum temperature of the days
+   double temperatureMax{};         // Maximum temperature of the days
+   double sumTemperatureAverage{};  // Sum of average temperatures of the days
+};
+
 }  // namespace geo
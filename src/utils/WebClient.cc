@@ -1,15 +1,25 @@
 #include "WebClient.h"
 
+#include "RequestContext.h"
+
 #include <absl/log/log.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
 #include <format>
+#include <functional>
 #include <stdexcept>
+#include <stop_token>
 
 namespace
 {
 
+using namespace geo;
+
 // Callback function for CURL to write received data into string buffer
 // @param contents Pointer to the delivered data
 // @param size Always 1
@@ -22,6 +32,14 @@ size_t curlWriteFunction(void* contents, size_t size, size_t nmemb, void* userp)
    return size * nmemb;
 }
 
+// Progress callback for CURL which aborts the transfer once the background slot is preempted
+// @param clientp Pointer to the slot of the request
+// @return Non-zero value to abort the transfer
+int curlPreemptionFunction(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+   return static_cast<const geo::UpstreamDispatcher::Slot*>(clientp)->IsPreempted() ? 1 : 0;
+}
+
 // Template helper function to set CURL options with error handling
 // @param curl CURL handle to set option on
 // @param opt CURL option to set
@@ -52,13 +70,149 @@ bool safeCall(TUnsafe f)
    return true;
 }
 
+// Counts a failed request in UpstreamFailures of the RPC of the current thread, if any
+// @param deadlineExceeded true if the request has been dropped or aborted because of the RPC deadline
+void reportFailure(bool deadlineExceeded)
+{
+   if (UpstreamFailures* failures = RequestContext::Current().upstreamFailures)
+      ++(deadlineExceeded ? failures->numTimedOut : failures->numFailed);
+}
+
+// Resumes a coroutine suspended until an operation finishes on another thread. Either the operation finishes
+// after the coroutine is suspended and resumes it, or it finishes first and the coroutine is not suspended at all.
+// The coroutine is resumed with the RequestContext it was suspended with.
+class Resumption
+{
+public:
+   // Remembers the coroutine and its context, called by await_suspend() before the operation is started
+   void Prepare(std::coroutine_handle<> handle)
+   {
+      m_handle = handle;
+      m_context = RequestContext::Current();
+   }
+
+   // Called by await_suspend() after the operation is started
+   // @return false if the operation has already finished, so the coroutine must not be suspended
+   bool Suspend() { return !m_ready.exchange(true); }
+
+   // Called when the operation is finished, after its results are stored
+   void Complete()
+   {
+      if (!m_ready.exchange(true))
+         return;
+
+      // The coroutine may finish and destroy this object, so the context is copied.
+      const RequestContext context = m_context;
+      const ScopedRequestContext scopedContext(context);
+      m_handle.resume();
+   }
+
+private:
+   std::coroutine_handle<> m_handle;   // Suspended coroutine
+   RequestContext m_context;           // Context of the coroutine
+   std::atomic<bool> m_ready = false;  // Set by whichever of Suspend() and Complete() comes first
+};
+
+using StopCallback = std::stop_callback<std::function<void()>>;
+
+// Suspends a coroutine until the dispatcher gives it a slot, or cancels the wait once stop is requested
+class SlotAwaiter
+{
+public:
+   explicit SlotAwaiter(UpstreamDispatcher& dispatcher)
+      : m_dispatcher(dispatcher)
+   {
+   }
+
+   bool await_ready() const noexcept { return false; }
+
+   bool await_suspend(std::coroutine_handle<> handle)
+   {
+      m_resumption.Prepare(handle);
+      const RequestContext& context = RequestContext::Current();
+      const UpstreamDispatcher::Ticket ticket = m_dispatcher.AcquireAsync(context.deadline,
+         [this](std::optional<UpstreamDispatcher::Slot> slot)
+         {
+            m_slot = std::move(slot);
+            m_resumption.Complete();
+         });
+      m_stopCallback.emplace(context.stopToken,
+         [this, ticket]
+         {
+            if (m_dispatcher.Cancel(ticket))
+               m_resumption.Complete();
+         });
+      return m_resumption.Suspend();
+   }
+
+   std::optional<UpstreamDispatcher::Slot> await_resume()
+   {
+      m_stopCallback.reset();
+      return std::move(m_slot);
+   }
+
+private:
+   UpstreamDispatcher& m_dispatcher;                // Dispatcher to take a slot from
+   std::optional<UpstreamDispatcher::Slot> m_slot;  // Taken slot
+   std::optional<StopCallback> m_stopCallback;      // Cancels the wait
+   Resumption m_resumption;                         // Resumes the coroutine
+};
+
+// Suspends a coroutine until the event loop finishes the transfer, or aborts the transfer once stop is requested
+class TransferAwaiter
+{
+public:
+   TransferAwaiter(
+      HttpEventLoop& eventLoop, HttpEventLoop::CurlPtr curl, HttpEventLoop::ProgressFunction progress = {})
+      : m_eventLoop(eventLoop)
+      , m_curl(std::move(curl))
+      , m_progress(std::move(progress))
+   {
+   }
+
+   bool await_ready() const noexcept { return false; }
+
+   bool await_suspend(std::coroutine_handle<> handle)
+   {
+      m_resumption.Prepare(handle);
+      const HttpEventLoop::TransferId id = m_eventLoop.Start(
+         m_curl,
+         [this](CURLcode result)
+         {
+            m_result = result;
+            m_resumption.Complete();
+         },
+         std::move(m_progress));
+      m_stopCallback.emplace(RequestContext::Current().stopToken,
+         [this, id]
+         {
+            m_eventLoop.Abort(id);
+         });
+      return m_resumption.Suspend();
+   }
+
+   CURLcode await_resume()
+   {
+      m_stopCallback.reset();
+      return m_result;
+   }
+
+private:
+   HttpEventLoop& m_eventLoop;                  // Loop running the transfer
+   HttpEventLoop::CurlPtr m_curl;               // Handle of the transfer
+   HttpEventLoop::ProgressFunction m_progress;  // Called when data is received, may be empty
+   CURLcode m_result = CURLE_OK;                // Result of the transfer
+   std::optional<StopCallback> m_stopCallback;  // Aborts the transfer
+   Resumption m_resumption;                     // Resumes the coroutine
+};
+
 }  // namespace
 
 namespace geo
 {
 
 WebClient::WebClient(std::string url, std::uint64_t writeTimeoutMs)
-   : m_url(std::move(url))
+   : m_url(std::make_shared<const std::string>(std::move(url)))
    , m_writeTimeoutMs(writeTimeoutMs)
 {
 }
@@ -71,30 +225,41 @@ std::string WebClient::Get(const std::string& request)
       return "";
    }
 
+   std::optional<UpstreamDispatcher::Slot> slot;
+   if (!acquireSlot(slot))
+      return "";
+
+   const auto url = m_url.load();
    std::string response;
-   auto curl = createCurl(m_url + "?" + request, m_writeTimeoutMs, &response);
+   auto curl = createCurl(*url + "?" + request, getTimeoutMs(), &response);
    if (!curl)
    {
       LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
+      reportFailure(false);
+      return "";
+   }
+   if (!abortOnPreemption(curl, slot))
+   {
+      reportFailure(false);
       return "";
    }
 
 #ifdef NDEBUG
-   LOG(INFO) << std::format("Starting HTTP GET request to {}", m_url);
+   LOG(INFO) << std::format("Starting HTTP GET request to {}", *url);
 #else
-   LOG(INFO) << std::format("Starting HTTP GET request to {}, request:\n{}", m_url, request);
+   LOG(INFO) << std::format("Starting HTTP GET request to {}, request:\n{}", *url, request);
 #endif
 
    if (!perform(curl))
    {
-      LOG(INFO) << std::format("HTTP GET request to {} finished with error (request = {})", m_url, request);
+      LOG(INFO) << std::format("HTTP GET request to {} finished with error (request = {})", *url, request);
       return "";
    }
 
 #ifdef NDEBUG
-   LOG(INFO) << std::format("HTTP GET request to {} finished", m_url);
+   LOG(INFO) << std::format("HTTP GET request to {} finished", *url);
 #else
-   LOG(INFO) << std::format("HTTP GET request to {} finished, response:\n{}", m_url, response);
+   LOG(INFO) << std::format("HTTP GET request to {} finished, response:\n{}", *url, response);
 #endif
    return response;
 }
@@ -107,11 +272,17 @@ std::string WebClient::Post(const std::string& data)
       return "";
    }
 
+   std::optional<UpstreamDispatcher::Slot> slot;
+   if (!acquireSlot(slot))
+      return "";
+
+   const auto url = m_url.load();
    std::string response;
-   auto curl = createCurl(m_url, m_writeTimeoutMs, &response);
+   auto curl = createCurl(*url, getTimeoutMs(), &response);
    if (!curl)
    {
       LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
+      reportFailure(false);
       return "";
    }
 
@@ -122,29 +293,104 @@ std::string WebClient::Post(const std::string& data)
              setCurlOpt(curl, CURLOPT_POSTFIELDS, data.c_str());
           }))
    {
+      reportFailure(false);
+      return "";
+   }
+   if (!abortOnPreemption(curl, slot))
+   {
+      reportFailure(false);
       return "";
    }
 
 #ifdef NDEBUG
-   LOG(INFO) << std::format("Starting HTTP POST request to {}", m_url);
+   LOG(INFO) << std::format("Starting HTTP POST request to {}", *url);
 #else
-   LOG(INFO) << std::format("Starting HTTP POST request to {}, data:\n{}", m_url, data);
+   LOG(INFO) << std::format("Starting HTTP POST request to {}, data:\n{}", *url, data);
 #endif
 
    if (!perform(curl))
    {
-      LOG(INFO) << std::format("HTTP POST request to {} finished with error (data = {})", m_url, data);
+      LOG(INFO) << std::format("HTTP POST request to {} finished with error (data = {})", *url, data);
       return "";
    }
 
 #ifdef NDEBUG
-   LOG(INFO) << std::format("HTTP POST request to {} finished", m_url);
+   LOG(INFO) << std::format("HTTP POST request to {} finished", *url);
 #else
-   LOG(INFO) << std::format("HTTP POST request to {} finished, response:\n{}", m_url, response);
+   LOG(INFO) << std::format("HTTP POST request to {} finished, response:\n{}", *url, response);
 #endif
    return response;
 }
 
+Task<std::string> WebClient::GetAsync(std::string request)
+{
+   if (!m_eventLoop)
+      co_return Get(request);
+
+   if (request.empty())
+   {
+      LOG(ERROR) << "Empty request passed.";
+      co_return "";
+   }
+   co_return co_await transferAsync(false, std::move(request));
+}
+
+Task<std::string> WebClient::PostAsync(std::string data)
+{
+   if (!m_eventLoop)
+      co_return Post(data);
+
+   if (data.empty())
+   {
+      LOG(ERROR) << "Empty data passed.";
+      co_return "";
+   }
+   co_return co_await transferAsync(true, std::move(data));
+}
+
+Task<std::string> WebClient::PostStreamingAsync(std::string data, ChunkFunction onChunk)
+{
+   if (!m_eventLoop)
+   {
+      std::string response = Post(data);
+      if (!response.empty())
+         onChunk(response);
+      co_return response;
+   }
+
+   if (data.empty())
+   {
+      LOG(ERROR) << "Empty data passed.";
+      co_return "";
+   }
+   co_return co_await transferAsync(true, std::move(data), std::move(onChunk));
+}
+
+void WebClient::SetUrl(std::string url)
+{
+   m_url = std::make_shared<const std::string>(std::move(url));
+}
+
+void WebClient::SetDispatcher(std::shared_ptr<UpstreamDispatcher> dispatcher)
+{
+   m_dispatcher = std::move(dispatcher);
+}
+
+bool WebClient::HasSpareCapacity() const
+{
+   return !m_dispatcher || m_dispatcher->HasSpareCapacity();
+}
+
+void WebClient::SetEventLoop(std::shared_ptr<HttpEventLoop> eventLoop)
+{
+   m_eventLoop = std::move(eventLoop);
+}
+
+void WebClient::SetExecutor(std::shared_ptr<Executor> executor)
+{
+   m_executor = std::move(executor);
+}
+
 // Creates and configures a CURL instance with specified URL, timeout, and response buffer
 WebClient::CurlPtr WebClient::createCurl(
    const std::string& url, std::uint64_t writeTimeoutMs, std::string* responseBuffer)
@@ -179,20 +425,177 @@ WebClient::CurlPtr WebClient::createCurl(
 // Executes CURL request and handles potential errors
 bool WebClient::perform(const CurlPtr& curl)
 {
-   const auto res = curl_easy_perform(curl.get());
+   return checkResult(curl, curl_easy_perform(curl.get()));
+}
+
+// Logs HTTP and cURL errors of a finished request and counts them in UpstreamFailures of the RPC
+bool WebClient::checkResult(const CurlPtr& curl, CURLcode res)
+{
    if (res == CURLE_HTTP_RETURNED_ERROR)
    {
       long httpErrorCode = 0;
       curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &httpErrorCode);
       LOG(ERROR) << std::format("HTTP error code: {}", httpErrorCode);
+      reportFailure(false);
       return false;
    }
    else if (res != CURLE_OK)
    {
       LOG(ERROR) << std::format("cURL error: {}", curl_easy_strerror(res));
+      reportFailure(
+         res == CURLE_OPERATION_TIMEDOUT && RequestContext::Current().deadline <= RequestContext::Clock::now());
+      return false;
+   }
+   return true;
+}
+
+// The coroutine is suspended while waiting for a slot and for the response, so the thread serves other requests
+Task<std::string> WebClient::transferAsync(bool post, std::string request, ChunkFunction onChunk)
+{
+   const char* method = post ? "POST" : "GET";
+   const auto url = m_url.load();  // Taken once, so that the request is logged with the address it is sent to
+   if (RequestContext::Current().stopToken.stop_requested())
+   {
+      reportFailure(false);
+      co_return "";
+   }
+
+   // Background requests do not wait for slots, so only requests of RPCs need to be suspended.
+   std::optional<UpstreamDispatcher::Slot> slot;
+   if (m_dispatcher && !RequestContext::Current().background)
+   {
+      slot = co_await SlotAwaiter(*m_dispatcher);
+      if (!slot)
+      {
+         LOG(ERROR) << std::format("HTTP request to {} is dropped, it cannot finish before the deadline", *url);
+         reportFailure(true);
+         co_return "";
+      }
+   }
+   else if (!acquireSlot(slot))
+   {
+      co_return "";
+   }
+
+   std::string response;
+   auto curl = createCurl(post ? *url : *url + "?" + request, getTimeoutMs(), &response);
+   if (!curl)
+   {
+      LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
+      reportFailure(false);
+      co_return "";
+   }
+
+   if (post && !safeCall(
+                  [&]
+                  {
+                     setCurlOpt(curl, CURLOPT_POST, 1L);
+                     setCurlOpt(curl, CURLOPT_POSTFIELDS, request.c_str());
+                  }))
+   {
+      reportFailure(false);
+      co_return "";
+   }
+   if (!abortOnPreemption(curl, slot))
+   {
+      reportFailure(false);
+      co_return "";
+   }
+
+#ifdef NDEBUG
+   LOG(INFO) << std::format("Starting HTTP {} request to {}", method, *url);
+#else
+   LOG(INFO) << std::format(
+      "Starting HTTP {} request to {}, {}:\n{}", method, *url, post ? "data" : "request", request);
+#endif
+
+   // The response buffer is appended by cURL on the loop thread, where the progress function is called too.
+   std::size_t numPassed = 0;
+   HttpEventLoop::ProgressFunction progress;
+   if (onChunk)
+   {
+      progress = [&response, &numPassed, &onChunk, context = RequestContext::Current()]
+      {
+         const ScopedRequestContext scopedContext(context);
+         onChunk(std::string_view(response).substr(numPassed));
+         numPassed = response.size();
+      };
+   }
+
+   const CURLcode result = co_await TransferAwaiter(*m_eventLoop, curl, std::move(progress));
+   if (m_executor)
+      co_await m_executor->Schedule();
+   if (onChunk && numPassed < response.size())
+      onChunk(std::string_view(response).substr(numPassed));
+
+   if (!checkResult(curl, result))
+   {
+      LOG(INFO) << std::format("HTTP {} request to {} finished with error ({} = {})", method, *url,
+         post ? "data" : "request", request);
+      co_return "";
+   }
+
+#ifdef NDEBUG
+   LOG(INFO) << std::format("HTTP {} request to {} finished", method, *url);
+#else
+   LOG(INFO) << std::format("HTTP {} request to {} finished, response:\n{}", method, *url, response);
+#endif
+   co_return response;
+}
+
+// Waits for a free slot of the dispatcher in the order of RPC deadlines
+bool WebClient::acquireSlot(std::optional<UpstreamDispatcher::Slot>& slot) const
+{
+   if (!m_dispatcher)
+      return true;
+
+   if (RequestContext::Current().background)
+   {
+      slot = m_dispatcher->TryAcquireSpare();
+      if (!slot)
+      {
+         LOG(INFO) << std::format(
+            "Background HTTP request to {} is skipped, there is no spare capacity", *m_url.load());
+         return false;
+      }
+      return true;
+   }
+
+   slot = m_dispatcher->Acquire(RequestContext::Current().deadline);
+   if (!slot)
+   {
+      LOG(ERROR) << std::format("HTTP request to {} is dropped, it cannot finish before the deadline", *m_url.load());
+      reportFailure(true);
       return false;
    }
    return true;
 }
 
+// Background requests hold slots which requests of RPCs may need, so they check for preemption during the transfer
+bool WebClient::abortOnPreemption(const CurlPtr& curl, const std::optional<UpstreamDispatcher::Slot>& slot)
+{
+   if (!slot || !RequestContext::Current().background)
+      return true;
+
+   return safeCall(
+      [&]
+      {
+         setCurlOpt(curl, CURLOPT_XFERINFOFUNCTION, curlPreemptionFunction);
+         setCurlOpt(curl, CURLOPT_XFERINFODATA, &*slot);
+         setCurlOpt(curl, CURLOPT_NOPROGRESS, 0L);
+      });
+}
+
+// There is no point in waiting for a response after the RPC deadline
+std::uint64_t WebClient::getTimeoutMs() const
+{
+   const auto deadline = RequestContext::Current().deadline;
+   if (deadline == RequestContext::Clock::time_point::max())
+      return m_writeTimeoutMs;
+
+   const auto remainingMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - RequestContext::Clock::now()).count();
+   return remainingMs < 1 ? 1 : std::min(static_cast<std::uint64_t>(remainingMs), m_writeTimeoutMs);
+}
+
 }  // namespace geo
@@ -1,9 +1,18 @@
 #pragma once
 
+#include "Executor.h"
+#include "HttpEventLoop.h"
+#include "Task.h"
+#include "UpstreamDispatcher.h"
+
 #include <curl/curl.h>
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 
 namespace geo
 {
@@ -13,6 +22,9 @@ class WebClient
 public:
    static const int sc_defaultTimeoutMs = 180'000;  // Default timeout in milliseconds (180 seconds)
 
+   // Receives a part of a response as soon as it arrives, see PostStreamingAsync()
+   using ChunkFunction = std::function<void(std::string_view chunk)>;
+
 public:
    // Constructor taking base URL and optional write timeout in milliseconds
    // @param address The base URL for web requests
@@ -29,6 +41,48 @@ public:
    // @return The server response as string, or empty string on error
    std::string Post(const std::string& data);
 
+   // Performs HTTP GET request without blocking the calling thread if the event loop is set, see Get().
+   // The request is aborted once RequestContext::stopToken is requested.
+   // @param request The request string to append to the base URL
+   // @return The server response as string, or empty string on error
+   Task<std::string> GetAsync(std::string request);
+
+   // Performs HTTP POST request without blocking the calling thread if the event loop is set, see Post().
+   // The request is aborted once RequestContext::stopToken is requested.
+   // @param data The data to send in the POST request body
+   // @return The server response as string, or empty string on error
+   Task<std::string> PostAsync(std::string data);
+
+   // Performs HTTP POST request like PostAsync(), and passes parts of the response to the function as they arrive,
+   // so that the caller can act on them before the whole response is received.
+   // The function is called on the event loop thread with the RequestContext of the caller, it must not block.
+   // Without the event loop the whole response is passed at once. Parts received before an error are passed too.
+   // @param data The data to send in the POST request body
+   // @param onChunk Function to pass parts of the response to
+   // @return The server response as string, or empty string on error
+   Task<std::string> PostStreamingAsync(std::string data, ChunkFunction onChunk);
+
+   // Changes the base URL. Requests which have already started are finished with the previous one.
+   void SetUrl(std::string url);
+
+   // Limits concurrency of requests with the given dispatcher.
+   // Requests wait for a free slot in the order of RequestContext deadlines, and fail if they cannot finish in time.
+   // @param dispatcher Dispatcher shared by all clients of the same upstream, or nullptr to remove the limit
+   void SetDispatcher(std::shared_ptr<UpstreamDispatcher> dispatcher);
+
+   // Checks whether background requests (see RequestContext::background) would be sent now
+   bool HasSpareCapacity() const;
+
+   // Runs asynchronous requests on the given event loop.
+   // @param eventLoop Loop shared by clients of all upstreams, or nullptr to make GetAsync() and PostAsync() block
+   //                  the calling thread like Get() and Post()
+   void SetEventLoop(std::shared_ptr<HttpEventLoop> eventLoop);
+
+   // Resumes coroutines awaiting responses of asynchronous requests on the given executor, so that responses
+   // are parsed by its workers rather than by the event loop thread, which serves the transfers of all the clients.
+   // @param executor Executor shared by clients of all upstreams, or nullptr to resume coroutines on the loop thread
+   void SetExecutor(std::shared_ptr<Executor> executor);
+
 private:
    using CurlPtr = std::shared_ptr<CURL>;  // Type alias for shared pointer to CURL handle
 
@@ -45,9 +99,41 @@ private:
    // @return true if request succeeded, false otherwise
    static bool perform(const CurlPtr& curl);
 
+   // Checks the result of a finished CURL request, logs errors and counts them in RequestContext::upstreamFailures
+   // @param curl CURL handle of the request
+   // @param result Result code of the request
+   // @return true if request succeeded, false otherwise
+   static bool checkResult(const CurlPtr& curl, CURLcode result);
+
+   // Runs the request on the event loop
+   // @param post true for POST requests, false for GET requests
+   // @param request The data of POST requests, the request string of GET requests
+   // @param onChunk Function to pass parts of the response to as they arrive, may be empty
+   // @return The server response as string, or empty string on error
+   Task<std::string> transferAsync(bool post, std::string request, ChunkFunction onChunk = {});
+
+   // Waits for a free slot of the dispatcher, if any. Background requests get a slot only if it is free right away.
+   // @param slot Receives the slot which must be kept until the request is finished
+   // @return false if the request must not be sent
+   bool acquireSlot(std::optional<UpstreamDispatcher::Slot>& slot) const;
+
+   // Makes the request abort once its background slot is preempted by requests of RPCs
+   // @param curl Configured CURL handle
+   // @param slot Slot taken by acquireSlot()
+   // @return false on error
+   static bool abortOnPreemption(const CurlPtr& curl, const std::optional<UpstreamDispatcher::Slot>& slot);
+
+   // Returns the timeout for a request, taking into account the deadline of the current RPC
+   std::uint64_t getTimeoutMs() const;
+
 private:
-   std::string m_url;               // Base URL for web requests
-   std::uint64_t m_writeTimeoutMs;  // Timeout value for write operations in milliseconds
+   std::atomic<std::shared_ptr<const std::string>> m_url;  // Base URL for web requests, see SetUrl()
+   std::uint64_t m_writeTimeoutMs;                         // Timeout value for write operations in milliseconds
+   std::shared_ptr<UpstreamDispatcher> m_dispatcher;       // Limits concurrency of requests, may be nullptr
+   std::shared_ptr<Executor> m_executor;                   // Resumes coroutines awaiting responses, may be nullptr
+   std::shared_ptr<HttpEventLoop> m_eventLoop;             // Runs asynchronous requests, may be nullptr, destroyed
+                                                           // before the executor which resumes coroutines of aborted
+                                                           // transfers
 };
 
 }  // namespace geo
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace geo
+{
+
+// WorkStealingDeque is the lock-free Chase-Lev deque: the owner thread pushes and pops items at the bottom,
+// and other threads steal items from the top. Neither end takes a lock, so an owner working through its own items
+// does not contend with anybody unless the deque is almost empty.
+// The implementation follows "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al., 2013).
+// Push() and Pop() may be called only by the owner thread, Steal() by any thread.
+// Items must be trivially copyable, usually pointers.
+template <typename T>
+class WorkStealingDeque
+{
+   static_assert(std::is_trivially_copyable_v<T>, "Items of WorkStealingDeque must be trivially copyable");
+
+public:
+   // @param capacity Initial capacity, rounded up to a power of two. The deque grows when it is full.
+   explicit WorkStealingDeque(std::size_t capacity = 256)
+   {
+      std::size_t roundedCapacity = 1;
+      while (roundedCapacity < capacity)
+         roundedCapacity *= 2;
+
+      m_buffers.push_back(std::make_unique<Buffer>(roundedCapacity));
+      m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+   }
+
+   WorkStealingDeque(const WorkStealingDeque&) = delete;
+   WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+   // Adds an item at the bottom. Called by the owner thread.
+   void Push(T item)
+   {
+      const std::int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+      const std::int64_t top = m_top.load(std::memory_order_acquire);
+      Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+      if (bottom - top > buffer->mask)
+         buffer = grow(buffer, top, bottom);
+
+      buffer->Put(bottom, item);
+      std::atomic_thread_fence(std::memory_order_release);
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+   }
+
+   // Takes the item pushed last. Called by the owner thread.
+   // @return std::nullopt if the deque is empty
+   std::optional<T> Pop()
+   {
+      const std::int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+      Buffer* const buffer = m_buffer.load(std::memory_order_relaxed);
+      m_bottom.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t top = m_top.load(std::memory_order_relaxed);
+
+      if (top > bottom)
+      {
+         m_bottom.store(bottom + 1, std::memory_order_relaxed);
+         return std::nullopt;
+      }
+
+      std::optional<T> item = buffer->Get(bottom);
+      if (top == bottom)
+      {
+         // The last item is raced for with thieves.
+         if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            item.reset();
+         m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      }
+      return item;
+   }
+
+   // Takes the oldest item. Called by any thread.
+   // @return std::nullopt if the deque is empty, or if another thread has taken the item first
+   std::optional<T> Steal()
+   {
+      std::int64_t top = m_top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const std::int64_t bottom = m_bottom.load(std::memory_order_acquire);
+      if (top >= bottom)
+         return std::nullopt;
+
+      const T item = m_buffer.load(std::memory_order_acquire)->Get(top);
+      if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+         return std::nullopt;
+      return item;
+   }
+
+   // Checks whether the deque seems empty, the answer may be outdated once it is returned
+   bool IsEmpty() const
+   {
+      return m_top.load(std::memory_order_relaxed) >= m_bottom.load(std::memory_order_relaxed);
+   }
+
+private:
+   // Ring buffer of items, indexed by positions which only grow
+   struct Buffer
+   {
+      explicit Buffer(std::size_t capacity)
+         : mask(static_cast<std::int64_t>(capacity) - 1)
+         , items(std::make_unique<std::atomic<T>[]>(capacity))
+      {
+      }
+
+      T Get(std::int64_t position) const { return items[position & mask].load(std::memory_order_relaxed); }
+
+      void Put(std::int64_t position, T item) { items[position & mask].store(item, std::memory_order_relaxed); }
+
+      const std::int64_t mask;                  // Capacity minus one
+      std::unique_ptr<std::atomic<T>[]> items;  // Items
+   };
+
+   // Replaces the buffer with one twice as large. Called by the owner thread.
+   Buffer* grow(Buffer* buffer, std::int64_t top, std::int64_t bottom)
+   {
+      auto grown = std::make_unique<Buffer>(static_cast<std::size_t>(buffer->mask + 1) * 2);
+      for (std::int64_t position = top; position < bottom; ++position)
+         grown->Put(position, buffer->Get(position));
+
+      // Thieves may still read the old buffer, so buffers are freed only with the deque.
+      m_buffers.push_back(std::move(grown));
+      m_buffer.store(m_buffers.back().get(), std::memory_order_release);
+      return m_buffers.back().get();
+   }
+
+private:
+   alignas(64) std::atomic<std::int64_t> m_top = 0;     // Position of the oldest item, advanced by Steal() and Pop()
+   alignas(64) std::atomic<std::int64_t> m_bottom = 0;  // Position after the newest item, changed by the owner
+   std::atomic<Buffer*> m_buffer;                       // Current buffer
+   std::vector<std::unique_ptr<Buffer>> m_buffers;      // Current and previous buffers, changed by the owner
+};
+
+}  // namespace geo
@@ -2,6 +2,9 @@
 
 #include <grpcpp/server_context.h>
 
+#include <chrono>
+#include <format>
+
 namespace geo
 {
 
@@ -12,4 +15,41 @@ std::string ExtractClientId(grpc::CallbackServerContext& context)
    return it == md.end() ? "" : it->second.data();  // Return empty string if not found, otherwise client ID value
 }
 
+RequestContext::Clock::time_point ExtractDeadline(grpc::CallbackServerContext& context)
+{
+   const auto deadline = context.deadline();
+   if (deadline == std::chrono::system_clock::time_point::max())
+      return RequestContext::Clock::time_point::max();
+
+   // Deadline is converted to steady clock, so that it is not affected by changes of system time
+   const auto remaining = deadline - std::chrono::system_clock::now();
+   return RequestContext::Clock::now() + std::chrono::duration_cast<RequestContext::Clock::duration>(remaining);
+}
+
+grpc::Status ToStatus(const UpstreamFailures& failures)
+{
+   if (const int numTimedOut = failures.numTimedOut.load(std::memory_order_relaxed); numTimedOut > 0)
+   {
+      return grpc::Status{grpc::StatusCode::DEADLINE_EXCEEDED,
+         std::format("{} upstream requests have not finished before the deadline", numTimedOut)};
+   }
+   if (const int numFailed = failures.numFailed.load(std::memory_order_relaxed); numFailed > 0)
+      return grpc::Status{grpc::StatusCode::UNAVAILABLE, std::format("{} upstream requests have failed", numFailed)};
+   return grpc::Status::OK;
+}
+
+grpc::Status ToStatus(Bulkhead::DropReason reason)
+{
+   switch (reason)
+   {
+   case Bulkhead::DropReason::Cancelled:
+      return grpc::Status{grpc::StatusCode::CANCELLED, "RPC has been cancelled while it was queued"};
+   case Bulkhead::DropReason::Expired:
+      return grpc::Status{grpc::StatusCode::DEADLINE_EXCEEDED, "RPC has not been started before the deadline"};
+   case Bulkhead::DropReason::ShutDown:
+      break;
+   }
+   return grpc::Status{grpc::StatusCode::UNAVAILABLE, "Service is shutting down"};
+}
+
 }  // namespace geo
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "Bulkhead.h"
+#include "RequestContext.h"
+
+#include <grpcpp/support/status.h>
+
 #include <string>
 
 namespace grpc
@@ -13,4 +18,15 @@ namespace geo
 // Extracts client ID from gRPC request metadata
 std::string ExtractClientId(grpc::CallbackServerContext& context);
 
+// Extracts RPC deadline, RequestContext::Clock::time_point::max() if the client has not set it
+RequestContext::Clock::time_point ExtractDeadline(grpc::CallbackServerContext& context);
+
+// Converts failures of upstream requests of an RPC to its status
+// @return DEADLINE_EXCEEDED if any request has timed out, UNAVAILABLE if any has failed, OK otherwise
+grpc::Status ToStatus(const UpstreamFailures& failures);
+
+// Converts the reason why a bulkhead has dropped the queued job of an RPC to its status
+// @return CANCELLED, DEADLINE_EXCEEDED, or UNAVAILABLE if the service is shutting down
+grpc::Status ToStatus(Bulkhead::DropReason reason);
+
 }  // namespace geo